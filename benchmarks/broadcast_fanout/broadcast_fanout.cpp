@@ -0,0 +1,656 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * Broadcast fan-out benchmark
+ *
+ * Starts a server and, in a forked child process, a configurable number of
+ * loopback clients. Once every client is connected the server publishes
+ * messages at a fixed rate to all of them and reports:
+ *
+ * - publish to last delivery latency (per message, across all clients)
+ * - server CPU time per delivered message
+ * - server resident memory per connection
+ *
+ * The client process is separate so that the server figures do not include
+ * the cost of receiving. Timestamps are taken from the monotonic clock, which
+ * is shared by both processes.
+ *
+ * Options:
+ *
+ * | Option             | Default | Meaning                                     |
+ * | ------------------ | ------- | ------------------------------------------- |
+ * | --clients N        | 1000    | Number of loopback clients                  |
+ * | --size B           | 256     | Message size in bytes (at least 12)         |
+ * | --rate R           | 10      | Messages published per second (0 = no wait)|
+ * | --messages M       | 50      | Number of messages to publish               |
+ * | --mode naive       | naive   | Send the same unprepared message to every  |
+ * |                    |         | connection, as examples/broadcast_server    |
+ * | --mode prepared    |         | Frame the message once and share it         |
+ * | --threads T        | 1       | Server io_service threads                   |
+ * | --client-threads T | 1       | Client io_service threads                   |
+ * | --deflate          | off     | Negotiate permessage-deflate                |
+ * | --port P           | 9002    | Listening port                              |
+ *
+ * Large client counts need a raised file descriptor limit (the benchmark
+ * raises the soft limit to the hard limit) and are spread across loopback
+ * addresses 127.0.0.1, 127.0.0.2, ... to avoid running out of ephemeral
+ * ports. This benchmark requires a POSIX system.
+ */
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+
+#include <websocketpp/common/thread.hpp>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+template <typename base>
+struct deflate_config : public base {
+    struct permessage_deflate_config {
+        typedef typename base::request_type request_type;
+    };
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+};
+
+using websocketpp::connection_hdl;
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+using websocketpp::lib::thread;
+using websocketpp::lib::mutex;
+using websocketpp::lib::lock_guard;
+
+struct options {
+    options()
+      : clients(1000)
+      , size(256)
+      , rate(10)
+      , messages(50)
+      , prepared(false)
+      , threads(1)
+      , client_threads(1)
+      , deflate(false)
+      , port(9002) {}
+
+    size_t clients;
+    size_t size;
+    size_t rate;
+    size_t messages;
+    bool prepared;
+    size_t threads;
+    size_t client_threads;
+    bool deflate;
+    uint16_t port;
+};
+
+// Clients per loopback address, comfortably below the ephemeral port range
+static size_t const clients_per_address = 50000;
+
+// Bytes at the start of each payload: publish time (8) and sequence (4)
+static size_t const stamp_size = 12;
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        websocketpp::lib::chrono::duration_cast<
+            websocketpp::lib::chrono::nanoseconds>(
+                websocketpp::lib::chrono::steady_clock::now()
+                    .time_since_epoch()
+        ).count()
+    );
+}
+
+double cpu_seconds() {
+    rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_utime.tv_sec + u.ru_utime.tv_usec / 1e6
+         + u.ru_stime.tv_sec + u.ru_stime.tv_usec / 1e6;
+}
+
+size_t rss_bytes() {
+    size_t pages = 0;
+    size_t resident = 0;
+    FILE * f = std::fopen("/proc/self/statm", "r");
+    if (f) {
+        if (std::fscanf(f, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(f);
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void raise_fd_limit() {
+    rlimit l;
+    if (getrlimit(RLIMIT_NOFILE, &l) == 0 && l.rlim_cur < l.rlim_max) {
+        l.rlim_cur = l.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &l);
+    }
+}
+
+bool read_line(int fd, std::string & line) {
+    line.clear();
+    char c;
+    while (read(fd, &c, 1) == 1) {
+        if (c == '\n') {
+            return true;
+        }
+        line += c;
+    }
+    return false;
+}
+
+void write_line(int fd, std::string const & line) {
+    std::string l = line + "\n";
+    if (write(fd, l.data(), l.size()) != static_cast<ssize_t>(l.size())) {
+        std::perror("write");
+    }
+}
+
+template <typename config>
+class fanout_server {
+public:
+    typedef websocketpp::server<config> server_type;
+    typedef typename server_type::message_ptr message_ptr;
+
+    explicit fanout_server(options const & o) : m_options(o) {
+        m_server.clear_access_channels(websocketpp::log::alevel::all);
+        m_server.clear_error_channels(websocketpp::log::elevel::all);
+
+        m_server.init_asio();
+        m_server.set_reuse_addr(true);
+        m_server.set_listen_backlog(65535);
+
+        m_server.set_open_handler(bind(&fanout_server::on_open,this,_1));
+        m_server.set_close_handler(bind(&fanout_server::on_close,this,_1));
+    }
+
+    void listen() {
+        m_server.listen(websocketpp::lib::asio::ip::tcp::v4(),
+            m_options.port);
+        m_server.start_accept();
+
+        for (size_t i = 0; i < m_options.threads; ++i) {
+            m_threads.push_back(websocketpp::lib::make_shared<thread>(
+                bind(&fanout_server::run,this)));
+        }
+    }
+
+    void publish(uint32_t seq) {
+        std::string payload(m_options.size, ' ');
+        for (size_t i = stamp_size; i < payload.size(); ++i) {
+            payload[i] = "{\"price\":12.5,\"qty\":100}"[i % 24];
+        }
+
+        std::vector<connection_hdl> targets;
+        {
+            lock_guard<mutex> guard(m_lock);
+            targets.assign(m_connections.begin(), m_connections.end());
+        }
+        if (targets.empty()) {
+            return;
+        }
+
+        typename server_type::connection_ptr first =
+            m_server.get_con_from_hdl(targets[0]);
+        message_ptr msg = first->get_message(
+            websocketpp::frame::opcode::binary, payload.size());
+
+        uint64_t stamp = now_ns();
+        std::memcpy(&payload[0], &stamp, sizeof(stamp));
+        std::memcpy(&payload[8], &seq, sizeof(seq));
+        msg->set_payload(payload);
+
+        if (m_options.prepared) {
+            // Frame once. Server frames are unmasked so the same bytes can
+            // be written to every connection.
+            websocketpp::frame::basic_header h(
+                websocketpp::frame::opcode::binary, payload.size(), true,
+                false);
+            websocketpp::frame::extended_header e(payload.size());
+            msg->set_header(websocketpp::frame::prepare_header(h,e));
+            msg->set_prepared(true);
+        } else {
+            // Compressed per connection when permessage-deflate was
+            // negotiated. Prepared frames are always sent uncompressed.
+            msg->set_compressed(m_options.deflate);
+        }
+
+        websocketpp::lib::error_code ec;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            m_server.send(targets[i], msg, ec);
+        }
+    }
+
+    size_t size() {
+        lock_guard<mutex> guard(m_lock);
+        return m_connections.size();
+    }
+
+    void stop() {
+        m_server.stop();
+        for (size_t i = 0; i < m_threads.size(); ++i) {
+            m_threads[i]->join();
+        }
+    }
+private:
+    void run() {
+        m_server.run();
+    }
+
+    void on_open(connection_hdl hdl) {
+        lock_guard<mutex> guard(m_lock);
+        m_connections.insert(hdl);
+    }
+
+    void on_close(connection_hdl hdl) {
+        lock_guard<mutex> guard(m_lock);
+        m_connections.erase(hdl);
+    }
+
+    typedef std::set<connection_hdl,
+        websocketpp::lib::owner_less<connection_hdl> > con_list;
+
+    options m_options;
+    server_type m_server;
+    con_list m_connections;
+    mutex m_lock;
+    std::vector<websocketpp::lib::shared_ptr<thread> > m_threads;
+};
+
+template <typename config>
+class fanout_clients {
+public:
+    typedef websocketpp::client<config> client_type;
+    typedef typename client_type::message_ptr message_ptr;
+
+    explicit fanout_clients(options const & o)
+      : m_options(o)
+      , m_open(0)
+      , m_failed(0)
+      , m_delivered(0)
+      , m_counts(o.messages)
+      , m_publish(o.messages)
+      , m_last(o.messages)
+    {
+        for (size_t i = 0; i < o.messages; ++i) {
+            m_counts[i] = 0;
+            m_publish[i] = 0;
+            m_last[i] = 0;
+        }
+
+        m_client.clear_access_channels(websocketpp::log::alevel::all);
+        m_client.clear_error_channels(websocketpp::log::elevel::all);
+
+        m_client.init_asio();
+        m_client.start_perpetual();
+
+        m_client.set_open_handler(bind(&fanout_clients::on_open,this,_1));
+        m_client.set_fail_handler(bind(&fanout_clients::on_fail,this,_1));
+        m_client.set_message_handler(
+            bind(&fanout_clients::on_message,this,_1,_2));
+
+        for (size_t i = 0; i < o.client_threads; ++i) {
+            m_threads.push_back(websocketpp::lib::make_shared<thread>(
+                bind(&fanout_clients::run,this)));
+        }
+    }
+
+    /// Connect all clients, keeping a bounded number of handshakes in flight
+    void connect() {
+        size_t const window = 512;
+
+        for (size_t i = 0; i < m_options.clients; ++i) {
+            while (i - m_open - m_failed >= window) {
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(1));
+            }
+
+            std::stringstream uri;
+            uri << "ws://127.0.0." << (1 + i / clients_per_address) << ":"
+                << m_options.port << "/";
+
+            websocketpp::lib::error_code ec;
+            typename client_type::connection_ptr con =
+                m_client.get_connection(uri.str(), ec);
+            if (ec) {
+                ++m_failed;
+                continue;
+            }
+            m_client.connect(con);
+        }
+
+        while (m_open + m_failed < m_options.clients) {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(1));
+        }
+    }
+
+    /// Wait until all messages arrived or nothing arrived for two seconds
+    void drain() {
+        uint64_t expected = static_cast<uint64_t>(m_open) * m_options.messages;
+        uint64_t seen = m_delivered;
+        uint64_t idle_since = now_ns();
+
+        while (m_delivered < expected) {
+            std::this_thread::sleep_for(
+                std::chrono::milliseconds(10));
+            if (m_delivered != seen) {
+                seen = m_delivered;
+                idle_since = now_ns();
+            } else if (now_ns() - idle_since > 2000000000ull) {
+                break;
+            }
+        }
+    }
+
+    void report() {
+        std::vector<double> latency;
+        size_t incomplete = 0;
+
+        for (size_t i = 0; i < m_options.messages; ++i) {
+            if (m_counts[i] < m_open || m_publish[i] == 0) {
+                ++incomplete;
+                continue;
+            }
+            latency.push_back((m_last[i] - m_publish[i]) / 1e6);
+        }
+
+        std::sort(latency.begin(), latency.end());
+
+        std::cout << "clients connected:     " << m_open << " ("
+                  << m_failed << " failed)" << std::endl;
+        std::cout << "messages delivered:    " << m_delivered << std::endl;
+        if (incomplete) {
+            std::cout << "incomplete messages:   " << incomplete << std::endl;
+        }
+        if (!latency.empty()) {
+            std::cout << "publish to last delivery (ms): p50 "
+                      << latency[latency.size() / 2] << ", p99 "
+                      << latency[latency.size() * 99 / 100] << ", max "
+                      << latency.back() << std::endl;
+        }
+        std::cout.flush();
+    }
+
+    size_t open() const {
+        return m_open;
+    }
+
+    uint64_t delivered() const {
+        return m_delivered;
+    }
+
+    void stop() {
+        m_client.stop_perpetual();
+        m_client.stop();
+        for (size_t i = 0; i < m_threads.size(); ++i) {
+            m_threads[i]->join();
+        }
+    }
+private:
+    void run() {
+        m_client.run();
+    }
+
+    void on_open(connection_hdl) {
+        ++m_open;
+    }
+
+    void on_fail(connection_hdl) {
+        ++m_failed;
+    }
+
+    void on_message(connection_hdl, message_ptr msg) {
+        uint64_t now = now_ns();
+        std::string const & p = msg->get_payload();
+        if (p.size() < stamp_size) {
+            return;
+        }
+
+        uint64_t stamp;
+        uint32_t seq;
+        std::memcpy(&stamp, p.data(), sizeof(stamp));
+        std::memcpy(&seq, p.data() + 8, sizeof(seq));
+        if (seq >= m_options.messages) {
+            return;
+        }
+
+        m_publish[seq] = stamp;
+        ++m_counts[seq];
+        ++m_delivered;
+
+        uint64_t last = m_last[seq];
+        while (now > last && !m_last[seq].compare_exchange_weak(last, now)) {}
+    }
+
+    options m_options;
+    client_type m_client;
+    std::atomic<size_t> m_open;
+    std::atomic<size_t> m_failed;
+    std::atomic<uint64_t> m_delivered;
+    std::vector<std::atomic<size_t> > m_counts;
+    std::vector<std::atomic<uint64_t> > m_publish;
+    std::vector<std::atomic<uint64_t> > m_last;
+    std::vector<websocketpp::lib::shared_ptr<thread> > m_threads;
+};
+
+template <typename config>
+int run_clients(options const & o, int go_fd, int result_fd) {
+    std::string line;
+    if (!read_line(go_fd, line)) {
+        return 1;
+    }
+
+    fanout_clients<config> clients(o);
+    clients.connect();
+
+    std::stringstream ready;
+    ready << "ready " << clients.open();
+    write_line(result_fd, ready.str());
+
+    if (!read_line(go_fd, line)) {
+        clients.stop();
+        return 1;
+    }
+
+    clients.drain();
+    clients.report();
+
+    std::stringstream done;
+    done << "done " << clients.delivered();
+    write_line(result_fd, done.str());
+
+    clients.stop();
+    return 0;
+}
+
+template <typename config>
+int run_server(options const & o, int go_fd, int result_fd) {
+    fanout_server<config> server(o);
+    size_t baseline = rss_bytes();
+
+    server.listen();
+    write_line(go_fd, "listening");
+
+    std::string line;
+    if (!read_line(result_fd, line)) {
+        server.stop();
+        return 1;
+    }
+
+    // Wait for the server side of every handshake to complete
+    size_t expected = std::strtoul(line.c_str() + 6, NULL, 10);
+    while (server.size() < expected) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(1));
+    }
+
+    size_t connected = rss_bytes();
+    double cpu_start = cpu_seconds();
+    write_line(go_fd, "go");
+
+    uint64_t start = now_ns();
+    uint64_t interval = o.rate ? 1000000000ull / o.rate : 0;
+    for (size_t i = 0; i < o.messages; ++i) {
+        uint64_t due = start + i * interval;
+        uint64_t now = now_ns();
+        if (due > now) {
+            std::this_thread::sleep_for(
+                std::chrono::nanoseconds(due - now));
+        }
+        server.publish(static_cast<uint32_t>(i));
+    }
+
+    if (!read_line(result_fd, line)) {
+        server.stop();
+        return 1;
+    }
+    double cpu = cpu_seconds() - cpu_start;
+    uint64_t delivered = std::strtoull(line.c_str() + 5, NULL, 10);
+    size_t peak = rss_bytes();
+
+    std::cout << "server cpu per delivered message (us): "
+              << (delivered ? cpu * 1e6 / delivered : 0) << std::endl;
+    std::cout << "server rss per connection (KiB): "
+              << (expected ? (connected - baseline) / 1024.0 / expected : 0)
+              << " idle, "
+              << (expected ? (peak - baseline) / 1024.0 / expected : 0)
+              << " after publishing" << std::endl;
+
+    server.stop();
+    return 0;
+}
+
+template <typename server_config, typename client_config>
+int run(options const & o) {
+    int go[2];
+    int result[2];
+    if (pipe(go) != 0 || pipe(result) != 0) {
+        std::perror("pipe");
+        return 1;
+    }
+
+    // Fork before any threads or io_services exist
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(go[1]);
+        close(result[0]);
+        std::exit(run_clients<client_config>(o, go[0], result[1]));
+    }
+
+    close(go[0]);
+    close(result[1]);
+
+    int ret = run_server<server_config>(o, go[1], result[0]);
+
+    close(go[1]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ret ? ret : (WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+int main(int argc, char * argv[]) {
+    options o;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char const * value = (i + 1 < argc) ? argv[i + 1] : "";
+
+        if (arg == "--clients") {
+            o.clients = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--size") {
+            o.size = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--rate") {
+            o.rate = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--messages") {
+            o.messages = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--mode") {
+            o.prepared = (std::string(value) == "prepared"); ++i;
+        } else if (arg == "--threads") {
+            o.threads = std::max<size_t>(1, std::strtoul(value, NULL, 10)); ++i;
+        } else if (arg == "--client-threads") {
+            o.client_threads =
+                std::max<size_t>(1, std::strtoul(value, NULL, 10)); ++i;
+        } else if (arg == "--deflate") {
+            o.deflate = true;
+        } else if (arg == "--port") {
+            o.port = static_cast<uint16_t>(std::strtoul(value, NULL, 10)); ++i;
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    o.size = std::max(o.size, stamp_size);
+    raise_fd_limit();
+
+    std::cout << o.clients << " clients, " << o.messages << " messages of "
+              << o.size << " bytes at " << o.rate << "/s, "
+              << (o.prepared ? "prepared" : "naive") << " send, "
+              << o.threads << " server thread(s), permessage-deflate "
+              << (o.deflate ? "on" : "off") << std::endl;
+
+    try {
+        if (o.deflate) {
+            return run< deflate_config<websocketpp::config::asio>,
+                        deflate_config<websocketpp::config::asio_client> >(o);
+        } else {
+            return run< websocketpp::config::asio,
+                        websocketpp::config::asio_client >(o);
+        }
+    } catch (websocketpp::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
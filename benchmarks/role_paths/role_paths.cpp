@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * Role paths benchmark
+ *
+ * Compares configs that leave the endpoint role to runtime (`role::any`, the
+ * default) with configs compiled for a single role (`role::server` and
+ * `role::client`). A client and a server connected by in-memory iostream
+ * transports echo messages. The cycles spent inside each endpoint are
+ * reported per message, best of several trials.
+ *
+ * Usage: role_paths [messages] [message size] [trials]
+ */
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/config/core_client.hpp>
+#include <websocketpp/metrics/cycles.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+/// A config compiled for a single endpoint role
+template <typename base, websocketpp::role::value compiled_role>
+struct role_config : public base {
+    static const websocketpp::role::value endpoint_role = compiled_role;
+};
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::placeholders::_3;
+using websocketpp::lib::bind;
+using websocketpp::metrics::cycles;
+
+websocketpp::lib::error_code on_write(std::string * out,
+    websocketpp::connection_hdl, char const * data, size_t len)
+{
+    out->append(data,len);
+    return websocketpp::lib::error_code();
+}
+
+template <typename server, typename message_ptr>
+void on_echo(server * s, websocketpp::connection_hdl hdl, message_ptr msg) {
+    s->send(hdl, msg->get_payload(), msg->get_opcode());
+}
+
+template <typename message_ptr>
+void on_reply(size_t * count, websocketpp::connection_hdl, message_ptr) {
+    ++*count;
+}
+
+/// Cycles per message spent in each endpoint
+struct result {
+    result() : server(0), client(0) {}
+
+    uint64_t server;
+    uint64_t client;
+};
+
+template <typename server_config, typename client_config>
+bool run(size_t messages, size_t size, result & out) {
+    typedef websocketpp::server<server_config> server;
+    typedef websocketpp::client<client_config> client;
+    typedef typename server_config::message_type::ptr server_message_ptr;
+    typedef typename client_config::message_type::ptr client_message_ptr;
+
+    server s;
+    client c;
+    std::string to_client;
+    std::string to_server;
+    std::string buf;
+    size_t replies = 0;
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+
+    s.set_message_handler(bind(&on_echo<server,server_message_ptr>,&s,_1,_2));
+    c.set_message_handler(bind(&on_reply<client_message_ptr>,&replies,_1,_2));
+
+    typename server::connection_ptr scon = s.get_connection();
+    scon->set_write_handler(bind(&on_write,&to_client,_1,_2,_3));
+    scon->start();
+
+    websocketpp::lib::error_code ec;
+    typename client::connection_ptr ccon =
+        c.get_connection("ws://localhost/", ec);
+    if (ec) {
+        return false;
+    }
+    ccon->set_write_handler(bind(&on_write,&to_server,_1,_2,_3));
+    c.connect(ccon);
+
+    while (!to_client.empty() || !to_server.empty()) {
+        buf.swap(to_server);
+        to_server.clear();
+        scon->read_all(buf.data(), buf.size());
+        buf.swap(to_client);
+        to_client.clear();
+        ccon->read_all(buf.data(), buf.size());
+    }
+
+    if (ccon->get_state() != websocketpp::session::state::open) {
+        return false;
+    }
+
+    std::string payload(size, 'x');
+    uint64_t server_cycles = 0;
+    uint64_t client_cycles = 0;
+
+    for (size_t i = 0; i < messages; ++i) {
+        // client: frame and mask the message
+        uint64_t start = cycles();
+        ccon->send(payload, websocketpp::frame::opcode::binary);
+        client_cycles += cycles() - start;
+
+        // server: read, unmask, dispatch and frame the echo
+        buf.swap(to_server);
+        to_server.clear();
+        start = cycles();
+        scon->read_all(buf.data(), buf.size());
+        server_cycles += cycles() - start;
+
+        // client: read the echo
+        buf.swap(to_client);
+        to_client.clear();
+        start = cycles();
+        ccon->read_all(buf.data(), buf.size());
+        client_cycles += cycles() - start;
+    }
+
+    if (replies != messages) {
+        return false;
+    }
+
+    out.server = server_cycles / messages;
+    out.client = client_cycles / messages;
+    return true;
+}
+
+/// Keep the lowest cost seen for each endpoint
+void keep_best(result & best, result const & r, bool first) {
+    if (first || r.server < best.server) {
+        best.server = r.server;
+    }
+    if (first || r.client < best.client) {
+        best.client = r.client;
+    }
+}
+
+void report(char const * label, uint64_t any, uint64_t specialized) {
+    std::cout << std::left << std::setw(8) << label << std::right
+              << std::setw(12) << any << std::setw(14) << specialized
+              << std::setw(9) << std::fixed << std::setprecision(1)
+              << (any ? 100.0 * (double(any) - double(specialized)) / any : 0)
+              << "%" << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    typedef websocketpp::config::core server_any;
+    typedef websocketpp::config::core_client client_any;
+    typedef role_config<server_any, websocketpp::role::server> server_only;
+    typedef role_config<client_any, websocketpp::role::client> client_only;
+
+    size_t messages = 200000;
+    size_t size = 16;
+    size_t trials = 5;
+
+    if (argc > 1) {
+        messages = std::max<size_t>(1, std::strtoul(argv[1], NULL, 10));
+    }
+    if (argc > 2) {
+        size = std::strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        trials = std::max<size_t>(1, std::strtoul(argv[3], NULL, 10));
+    }
+
+    result any;
+    result specialized;
+
+    // Interleave so that frequency scaling affects both alike
+    for (size_t i = 0; i < trials; ++i) {
+        result a;
+        result b;
+        if (!run<server_any,client_any>(messages, size, a) ||
+            !run<server_only,client_only>(messages, size, b))
+        {
+            std::cerr << "echo failed" << std::endl;
+            return 1;
+        }
+        keep_best(any, a, i == 0);
+        keep_best(specialized, b, i == 0);
+    }
+
+    std::cout << messages << " echoed messages of " << size << " bytes, best of "
+              << trials << " trials, cycles per message" << std::endl
+              << std::endl
+              << std::left << std::setw(8) << "" << std::right
+              << std::setw(12) << "role::any" << std::setw(14)
+              << "single role" << std::setw(10) << "saved" << std::endl;
+    report("server", any.server, specialized.server);
+    report("client", any.client, specialized.client);
+    return 0;
+}
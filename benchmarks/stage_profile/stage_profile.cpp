@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * Stage profile benchmark
+ *
+ * Drives a client and a server connected by in-memory iostream transports.
+ * The client sends messages that the server echoes back. The time spent in
+ * each stage of the read and write pipelines of both endpoints is reported.
+ *
+ * Usage: stage_profile [messages] [message size] [deflate]
+ *
+ * Pass `deflate` as the third argument to negotiate permessage-deflate.
+ */
+
+// Stage profiling is compiled out unless requested before any WebSocket++
+// header is included.
+#define _WEBSOCKETPP_PROFILE_STAGES_
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/config/core_client.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/metrics/stage_profile.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+template <typename base>
+struct deflate_config : public base {
+    struct permessage_deflate_config {
+        typedef typename base::request_type request_type;
+    };
+
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+};
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::placeholders::_3;
+using websocketpp::lib::bind;
+using websocketpp::metrics::stage_profile;
+using websocketpp::metrics::stage_snapshot;
+namespace stage = websocketpp::metrics::stage;
+
+websocketpp::lib::error_code on_write(std::string * out,
+    websocketpp::connection_hdl, char const * data, size_t len)
+{
+    out->append(data,len);
+    return websocketpp::lib::error_code();
+}
+
+template <typename server, typename message_ptr>
+void on_echo(server * s, websocketpp::connection_hdl hdl, message_ptr msg) {
+    s->send(hdl, msg->get_payload(), msg->get_opcode());
+}
+
+template <typename message_ptr>
+void on_reply(size_t * count, websocketpp::connection_hdl, message_ptr) {
+    ++*count;
+}
+
+/// Move bytes between the two connections until neither has output pending
+template <typename server_con, typename client_con>
+void pump(server_con scon, std::string & to_client, client_con ccon,
+    std::string & to_server)
+{
+    std::string buf;
+    while (!to_client.empty() || !to_server.empty()) {
+        buf.swap(to_server);
+        to_server.clear();
+        scon->read_all(buf.data(), buf.size());
+        buf.clear();
+
+        buf.swap(to_client);
+        to_client.clear();
+        ccon->read_all(buf.data(), buf.size());
+        buf.clear();
+    }
+}
+
+void report(stage_snapshot const & snap, size_t messages) {
+    uint64_t total = snap.total_cycles();
+
+    std::cout << std::left << std::setw(18) << "stage"
+              << std::right << std::setw(12) << "calls"
+              << std::setw(16) << "cycles"
+              << std::setw(14) << "cycles/msg"
+              << std::setw(9) << "share" << std::endl;
+
+    for (size_t i = 0; i < stage::count; ++i) {
+        stage::value s = static_cast<stage::value>(i);
+        websocketpp::metrics::stage_counter const & c = snap[s];
+
+        std::cout << std::left << std::setw(18) << stage::name(s)
+                  << std::right << std::setw(12) << c.calls
+                  << std::setw(16) << c.cycles
+                  << std::setw(14) << (messages ? c.cycles / messages : 0)
+                  << std::setw(8) << std::fixed << std::setprecision(1)
+                  << (total ? 100.0 * c.cycles / total : 0.0) << "%"
+                  << std::endl;
+    }
+
+    std::cout << std::left << std::setw(18) << "total"
+              << std::right << std::setw(12) << ""
+              << std::setw(16) << total
+              << std::setw(14) << (messages ? total / messages : 0)
+              << std::endl;
+}
+
+template <typename server_config, typename client_config>
+int run(size_t messages, size_t size) {
+    typedef websocketpp::server<server_config> server;
+    typedef websocketpp::client<client_config> client;
+    typedef typename server_config::message_type::ptr server_message_ptr;
+    typedef typename client_config::message_type::ptr client_message_ptr;
+
+    server s;
+    client c;
+    std::string to_client;
+    std::string to_server;
+    size_t replies = 0;
+
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+
+    s.set_message_handler(bind(&on_echo<server,server_message_ptr>,&s,_1,_2));
+    c.set_message_handler(bind(&on_reply<client_message_ptr>,&replies,_1,_2));
+
+    typename server::connection_ptr scon = s.get_connection();
+    scon->set_write_handler(bind(&on_write,&to_client,_1,_2,_3));
+    scon->start();
+
+    websocketpp::lib::error_code ec;
+    typename client::connection_ptr ccon =
+        c.get_connection("ws://localhost/", ec);
+    if (ec) {
+        std::cerr << "get_connection failed: " << ec.message() << std::endl;
+        return 1;
+    }
+    ccon->set_write_handler(bind(&on_write,&to_server,_1,_2,_3));
+    c.connect(ccon);
+
+    pump(scon, to_client, ccon, to_server);
+
+    if (ccon->get_state() != websocketpp::session::state::open) {
+        std::cerr << "handshake failed" << std::endl;
+        return 1;
+    }
+
+    std::string payload(size, 'x');
+    for (size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<char>('a' + i % 26);
+    }
+
+    stage_profile::reset();
+
+    for (size_t i = 0; i < messages; ++i) {
+        ccon->send(payload, websocketpp::frame::opcode::text);
+        pump(scon, to_client, ccon, to_server);
+    }
+
+    stage_snapshot snap = stage_profile::snapshot();
+
+    if (replies != messages) {
+        std::cerr << "expected " << messages << " replies, got " << replies
+                  << std::endl;
+        return 1;
+    }
+
+    std::cout << messages << " echoed messages of " << size << " bytes, "
+              << "permessage-deflate "
+              << (ccon->get_response_header("Sec-WebSocket-Extensions").empty()
+                  ? "off" : "on")
+              << std::endl << std::endl;
+    report(snap, messages);
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+    size_t messages = 100000;
+    size_t size = 128;
+    bool deflate = false;
+
+    if (argc > 1) {
+        messages = std::strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        size = std::strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        deflate = (std::strcmp(argv[3], "deflate") == 0);
+    }
+
+    if (deflate) {
+        return run< deflate_config<websocketpp::config::core>,
+                    deflate_config<websocketpp::config::core_client> >
+               (messages, size);
+    } else {
+        return run<websocketpp::config::core, websocketpp::config::core_client>
+               (messages, size);
+    }
+}
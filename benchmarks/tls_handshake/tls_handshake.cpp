@@ -0,0 +1,936 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+/**
+ * TLS benchmark
+ *
+ * Compares `config::asio_tls` with `config::asio` on loopback. A parent
+ * process runs a plain and a TLS echo server on one io_service thread, so that
+ * server CPU time is time on a single core. A forked child process runs the
+ * clients and prints the results. It measures:
+ *
+ * - full and resumed (session ticket / session id) TLS handshakes, plus plain
+ *   TCP WebSocket handshakes for reference, per second of server CPU
+ * - echo throughput for a range of message sizes
+ * - round trip latency of small messages
+ * - server resident memory per idle connection
+ * - connect to open latency of sequential reconnects with a full handshake,
+ *   with session resumption, and with the opening handshake request sent as
+ *   TLS 1.3 early data. A third server, accepting early data, listens on
+ *   port P + 2 for the latter.
+ *
+ * The server certificate is a self-signed certificate generated in memory at
+ * startup, so no files are needed.
+ *
+ * Options:
+ *
+ * | Option              | Default | Meaning                                    |
+ * | ------------------- | ------- | ------------------------------------------ |
+ * | --handshakes N      | 500     | Handshakes per handshake test              |
+ * | --concurrency C     | 8       | Handshakes in flight                       |
+ * | --round-trips N     | 2000    | Round trips for the latency test           |
+ * | --bytes B           | 33554432| Bytes echoed per throughput size           |
+ * | --idle N            | 500     | Idle connections for the memory test       |
+ * | --reconnects N      | 500     | Connections for the reconnect latency test |
+ * | --key rsa\|ec        | rsa     | RSA 2048 or ECDSA P-256 server key         |
+ * | --keep-buffers      | off     | Disable SSL_MODE_RELEASE_BUFFERS on the    |
+ * |                     |         | server, to compare idle memory             |
+ * | --port P            | 9443    | TLS port, the plain server uses P + 1      |
+ *
+ * This benchmark requires a POSIX system and OpenSSL 1.1.1 or later.
+ */
+
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+
+#include <websocketpp/common/thread.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using websocketpp::connection_hdl;
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+namespace asio = websocketpp::lib::asio;
+
+typedef websocketpp::lib::shared_ptr<asio::ssl::context> context_ptr;
+typedef asio::ssl::stream<asio::ip::tcp::socket> ssl_socket;
+
+struct options {
+    options()
+      : handshakes(500)
+      , concurrency(8)
+      , round_trips(2000)
+      , bytes(32 * 1024 * 1024)
+      , idle(500)
+      , reconnects(500)
+      , ec_key(false)
+      , keep_buffers(false)
+      , port(9443) {}
+
+    size_t handshakes;
+    size_t concurrency;
+    size_t round_trips;
+    size_t bytes;
+    size_t idle;
+    size_t reconnects;
+    bool ec_key;
+    bool keep_buffers;
+    uint16_t port;
+};
+
+uint64_t now_ns() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count()
+    );
+}
+
+double cpu_seconds() {
+    rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_utime.tv_sec + u.ru_utime.tv_usec / 1e6
+         + u.ru_stime.tv_sec + u.ru_stime.tv_usec / 1e6;
+}
+
+size_t rss_bytes() {
+    size_t pages = 0;
+    size_t resident = 0;
+    FILE * f = std::fopen("/proc/self/statm", "r");
+    if (f) {
+        if (std::fscanf(f, "%zu %zu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        std::fclose(f);
+    }
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+void raise_fd_limit() {
+    rlimit l;
+    if (getrlimit(RLIMIT_NOFILE, &l) == 0 && l.rlim_cur < l.rlim_max) {
+        l.rlim_cur = l.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &l);
+    }
+}
+
+bool read_line(int fd, std::string & line) {
+    line.clear();
+    char c;
+    while (read(fd, &c, 1) == 1) {
+        if (c == '\n') {
+            return true;
+        }
+        line += c;
+    }
+    return false;
+}
+
+void write_line(int fd, std::string const & line) {
+    std::string l = line + "\n";
+    if (write(fd, l.data(), l.size()) != static_cast<ssize_t>(l.size())) {
+        std::perror("write");
+    }
+}
+
+/// Generate a self-signed certificate for localhost
+bool make_certificate(bool ec_key, EVP_PKEY ** key, X509 ** cert) {
+    EVP_PKEY_CTX * kctx = EVP_PKEY_CTX_new_id(
+        ec_key ? EVP_PKEY_EC : EVP_PKEY_RSA, NULL);
+    *key = NULL;
+    bool ok = kctx && EVP_PKEY_keygen_init(kctx) > 0;
+    if (ok && ec_key) {
+        ok = EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx,
+            NID_X9_62_prime256v1) > 0;
+    } else if (ok) {
+        ok = EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048) > 0;
+    }
+    ok = ok && EVP_PKEY_keygen(kctx, key) > 0;
+    EVP_PKEY_CTX_free(kctx);
+    if (!ok) {
+        return false;
+    }
+
+    *cert = X509_new();
+    X509_set_version(*cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(*cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(*cert), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(*cert), 86400);
+    X509_set_pubkey(*cert, *key);
+
+    X509_NAME * name = X509_get_subject_name(*cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+        reinterpret_cast<unsigned char const *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(*cert, name);
+
+    return X509_sign(*cert, *key, EVP_sha256()) > 0;
+}
+
+context_ptr on_server_tls_init(context_ptr ctx, connection_hdl) {
+    return ctx;
+}
+
+context_ptr on_client_tls_init(context_ptr ctx, connection_hdl) {
+    return ctx;
+}
+
+bool on_early_data(connection_hdl, std::string const &) {
+    return true;
+}
+
+template <typename server_type>
+void on_echo(server_type * s, connection_hdl hdl,
+    typename server_type::message_ptr msg)
+{
+    websocketpp::lib::error_code ec;
+    s->send(hdl, msg->get_payload(), msg->get_opcode(), ec);
+}
+
+/// Run the plain and TLS servers until the client process is done
+int run_server(options const & o, int go_fd, int result_fd) {
+    typedef websocketpp::server<websocketpp::config::asio_tls> tls_server;
+    typedef websocketpp::server<websocketpp::config::asio> plain_server;
+
+    EVP_PKEY * key;
+    X509 * cert;
+    if (!make_certificate(o.ec_key, &key, &cert)) {
+        std::cerr << "failed to generate a certificate" << std::endl;
+        return 1;
+    }
+
+    // A single context is shared by all connections so that the session
+    // cache and ticket keys allow resumption.
+    context_ptr ctx = websocketpp::lib::make_shared<asio::ssl::context>(
+        asio::ssl::context::sslv23);
+    ctx->set_options(asio::ssl::context::default_workarounds |
+                     asio::ssl::context::no_sslv2 |
+                     asio::ssl::context::no_sslv3);
+    SSL_CTX_use_certificate(ctx->native_handle(), cert);
+    SSL_CTX_use_PrivateKey(ctx->native_handle(), key);
+
+    asio::io_service ios;
+    tls_server ts;
+    plain_server ps;
+
+    ts.clear_access_channels(websocketpp::log::alevel::all);
+    ts.clear_error_channels(websocketpp::log::elevel::all);
+    ps.clear_access_channels(websocketpp::log::alevel::all);
+    ps.clear_error_channels(websocketpp::log::elevel::all);
+
+    ts.init_asio(&ios);
+    ps.init_asio(&ios);
+    ts.set_reuse_addr(true);
+    ps.set_reuse_addr(true);
+    ts.set_listen_backlog(4096);
+    ps.set_listen_backlog(4096);
+
+    ts.set_tls_init_handler(bind(&on_server_tls_init,ctx,_1));
+    ts.set_release_buffers(!o.keep_buffers);
+    ts.set_message_handler(bind(&on_echo<tls_server>,&ts,_1,_2));
+    ps.set_message_handler(bind(&on_echo<plain_server>,&ps,_1,_2));
+
+    // Opening an echo connection has no side effects, so every request may
+    // be processed from early data.
+    tls_server es;
+    es.clear_access_channels(websocketpp::log::alevel::all);
+    es.clear_error_channels(websocketpp::log::elevel::all);
+    es.init_asio(&ios);
+    es.set_reuse_addr(true);
+    es.set_tls_init_handler(bind(&on_server_tls_init,ctx,_1));
+    es.set_early_data_handler(&on_early_data);
+    es.set_message_handler(bind(&on_echo<tls_server>,&es,_1,_2));
+
+    ts.listen(asio::ip::tcp::v4(), o.port);
+    ps.listen(asio::ip::tcp::v4(), o.port + 1);
+    es.listen(asio::ip::tcp::v4(), o.port + 2);
+    ts.start_accept();
+    ps.start_accept();
+    es.start_accept();
+
+    std::thread io([&ios] { ios.run(); });
+    write_line(go_fd, "listening");
+
+    // Answer measurement requests until the client closes the pipe
+    std::string line;
+    while (read_line(result_fd, line)) {
+        std::stringstream s;
+        s << std::setprecision(9) << cpu_seconds() << " " << rss_bytes();
+        write_line(go_fd, s.str());
+    }
+
+    ios.stop();
+    io.join();
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return 0;
+}
+
+/// Server side measurement taken between two marks
+struct server_sample {
+    double cpu;
+    size_t rss;
+};
+
+class server_probe {
+public:
+    server_probe(int go_fd, int result_fd)
+      : m_go(go_fd), m_result(result_fd) {}
+
+    server_sample mark() {
+        write_line(m_result, "mark");
+        std::string line;
+        server_sample s = {0, 0};
+        if (read_line(m_go, line)) {
+            std::stringstream in(line);
+            in >> s.cpu >> s.rss;
+        }
+        return s;
+    }
+private:
+    int m_go;
+    int m_result;
+};
+
+// Session helpers, no-ops for plain sockets
+void set_session(ssl_socket & s, SSL_SESSION * session) {
+    if (session) {
+        SSL_set_session(s.native_handle(), session);
+    }
+}
+
+void set_session(asio::ip::tcp::socket &, SSL_SESSION *) {}
+
+bool session_reused(ssl_socket & s) {
+    return SSL_session_reused(s.native_handle()) == 1;
+}
+
+bool session_reused(asio::ip::tcp::socket &) {
+    return false;
+}
+
+SSL_SESSION * get_session(ssl_socket & s) {
+    return SSL_get1_session(s.native_handle());
+}
+
+SSL_SESSION * get_session(asio::ip::tcp::socket &) {
+    return NULL;
+}
+
+bool early_data_accepted(ssl_socket & s) {
+    return SSL_get_early_data_status(s.native_handle()) ==
+        SSL_EARLY_DATA_ACCEPTED;
+}
+
+bool early_data_accepted(asio::ip::tcp::socket &) {
+    return false;
+}
+
+template <typename config>
+class bench_client {
+public:
+    typedef websocketpp::client<config> client_type;
+    typedef typename client_type::connection_ptr connection_ptr;
+    typedef typename client_type::message_ptr message_ptr;
+    typedef typename client_type::transport_con_type::socket_con_type::
+        socket_type socket_type;
+
+    explicit bench_client(std::string const & uri)
+      : m_uri(uri)
+      , m_mode(mode_handshake)
+      , m_session(NULL)
+      , m_resume(false)
+      , m_started(0)
+      , m_target(0)
+      , m_done(0)
+      , m_opened(0)
+      , m_resumed(0)
+      , m_failed(0)
+      , m_received(0)
+      , m_sent(0)
+      , m_early(0)
+      , m_connect_start(0)
+    {
+        m_client.clear_access_channels(websocketpp::log::alevel::all);
+        m_client.clear_error_channels(websocketpp::log::elevel::all);
+        m_client.init_asio();
+        m_client.start_perpetual();
+
+        m_client.set_socket_init_handler(
+            bind(&bench_client::on_socket_init,this,_1,_2));
+        m_client.set_open_handler(bind(&bench_client::on_open,this,_1));
+        m_client.set_fail_handler(bind(&bench_client::on_fail,this,_1));
+        m_client.set_close_handler(bind(&bench_client::on_close,this,_1));
+        m_client.set_message_handler(
+            bind(&bench_client::on_message,this,_1,_2));
+
+        m_thread = std::thread(bind(&bench_client::run,this));
+    }
+
+    ~bench_client() {
+        m_client.stop_perpetual();
+        m_client.stop();
+        m_thread.join();
+        if (m_session) {
+            SSL_SESSION_free(m_session);
+        }
+    }
+
+    client_type & get_client() {
+        return m_client;
+    }
+
+    /// Run n handshakes, closing each connection once it is open
+    /**
+     * @return The number of resumed sessions
+     */
+    size_t handshakes(size_t n, size_t concurrency, bool resume) {
+        m_mode = mode_handshake;
+        m_resume = resume;
+        m_target = n;
+        m_started = 0;
+        m_done = 0;
+        m_resumed = 0;
+
+        for (size_t i = 0; i < std::min(n, concurrency); ++i) {
+            ++m_started;
+            start_one();
+        }
+        wait_for(m_done, n);
+        return m_resumed;
+    }
+
+    /// Open and close n connections one after another
+    /**
+     * @return The sorted connect to open latencies in microseconds
+     */
+    std::vector<double> reconnects(size_t n) {
+        m_mode = mode_reconnect;
+        m_resume = false;
+        m_early = 0;
+        m_latencies.clear();
+
+        for (size_t i = 0; i < n; ++i) {
+            m_done = 0;
+            m_connect_start = now_ns();
+            start_one();
+            wait_for(m_done, 1);
+        }
+
+        std::sort(m_latencies.begin(), m_latencies.end());
+        return m_latencies;
+    }
+
+    /// Number of connections of the last reconnect test that used early data
+    size_t early_accepted() const {
+        return m_early;
+    }
+
+    /// Open n connections and keep them open
+    void open_idle(size_t n) {
+        m_mode = mode_idle;
+        m_resume = false;
+        m_opened = 0;
+        m_failed = 0;
+        for (size_t i = 0; i < n; ++i) {
+            start_one();
+            // Keep the accept backlog from overflowing
+            while (i - m_opened - m_failed > 256) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        wait_for_sum(n);
+    }
+
+    void close_idle() {
+        m_done = 0;
+        size_t n = m_idle.size();
+        for (size_t i = 0; i < n; ++i) {
+            websocketpp::lib::error_code ec;
+            m_client.close(m_idle[i], websocketpp::close::status::going_away,
+                "", ec);
+        }
+        wait_for(m_done, n);
+        m_idle.clear();
+    }
+
+    /// Open a single connection used for echo tests
+    bool open_echo() {
+        m_mode = mode_echo;
+        m_opened = 0;
+        m_failed = 0;
+        start_one();
+        wait_for_sum(1);
+        return m_opened == 1;
+    }
+
+    /// Measure round trips of a small message
+    std::vector<double> round_trips(size_t n) {
+        std::vector<double> result;
+        std::string payload(64, 'x');
+
+        for (size_t i = 0; i < n; ++i) {
+            m_received = 0;
+            uint64_t start = now_ns();
+            websocketpp::lib::error_code ec;
+            m_client.send(m_echo, payload, websocketpp::frame::opcode::binary,
+                ec);
+            if (ec) {
+                break;
+            }
+            while (m_received == 0) {
+                std::this_thread::yield();
+            }
+            result.push_back((now_ns() - start) / 1e3);
+        }
+
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    /// Echo `count` messages of `size` bytes keeping `window` in flight
+    /**
+     * @return The elapsed time in seconds
+     */
+    double throughput(size_t size, size_t count, size_t window) {
+        m_payload.assign(size, 'x');
+        m_received = 0;
+        m_sent = 0;
+        m_target = count;
+
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < std::min(window, count); ++i) {
+            send_next();
+        }
+        wait_for(m_received, count);
+        return (now_ns() - start) / 1e9;
+    }
+
+    void close_echo() {
+        m_done = 0;
+        websocketpp::lib::error_code ec;
+        m_client.close(m_echo, websocketpp::close::status::going_away, "", ec);
+        wait_for(m_done, 1);
+    }
+private:
+    enum mode {
+        mode_handshake,
+        mode_idle,
+        mode_echo,
+        mode_reconnect
+    };
+
+    void run() {
+        m_client.run();
+    }
+
+    void start_one() {
+        websocketpp::lib::error_code ec;
+        connection_ptr con = m_client.get_connection(m_uri, ec);
+        if (ec) {
+            on_fail(connection_hdl());
+            return;
+        }
+        m_client.connect(con);
+    }
+
+    void send_next() {
+        if (m_sent >= m_target) {
+            return;
+        }
+        ++m_sent;
+        websocketpp::lib::error_code ec;
+        m_client.send(m_echo, m_payload, websocketpp::frame::opcode::binary,
+            ec);
+    }
+
+    void wait_for(std::atomic<size_t> & counter, size_t n) {
+        while (counter < n) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    void wait_for_sum(size_t n) {
+        while (m_opened + m_failed < n) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    void on_socket_init(connection_hdl, socket_type & s) {
+        if (m_resume) {
+            set_session(s, m_session);
+        }
+    }
+
+    void on_open(connection_hdl hdl) {
+        connection_ptr con = m_client.get_con_from_hdl(hdl);
+        socket_type & s = con->get_socket();
+
+        if (session_reused(s)) {
+            ++m_resumed;
+        }
+
+        // Keep the most recent session for later resumption
+        SSL_SESSION * session = get_session(s);
+        if (session) {
+            if (m_session) {
+                SSL_SESSION_free(m_session);
+            }
+            m_session = session;
+        }
+
+        if (m_mode == mode_reconnect) {
+            m_latencies.push_back((now_ns() - m_connect_start) / 1e3);
+            if (early_data_accepted(s)) {
+                ++m_early;
+            }
+        }
+
+        if (m_mode == mode_handshake || m_mode == mode_reconnect) {
+            websocketpp::lib::error_code ec;
+            con->close(websocketpp::close::status::going_away, "", ec);
+        } else if (m_mode == mode_idle) {
+            m_idle.push_back(hdl);
+            ++m_opened;
+        } else {
+            m_echo = hdl;
+            ++m_opened;
+        }
+    }
+
+    void on_fail(connection_hdl) {
+        ++m_failed;
+        connection_done();
+    }
+
+    void on_close(connection_hdl) {
+        connection_done();
+    }
+
+    void connection_done() {
+        ++m_done;
+        if (m_mode == mode_handshake && m_started < m_target) {
+            ++m_started;
+            start_one();
+        }
+    }
+
+    void on_message(connection_hdl, message_ptr) {
+        ++m_received;
+        if (m_mode == mode_echo) {
+            send_next();
+        }
+    }
+
+    std::string m_uri;
+    client_type m_client;
+    std::thread m_thread;
+
+    mode m_mode;
+    SSL_SESSION * m_session;
+    bool m_resume;
+
+    std::vector<connection_hdl> m_idle;
+    connection_hdl m_echo;
+    std::string m_payload;
+    std::vector<double> m_latencies;
+
+    std::atomic<size_t> m_started;
+    std::atomic<size_t> m_target;
+    std::atomic<size_t> m_done;
+    std::atomic<size_t> m_opened;
+    std::atomic<size_t> m_resumed;
+    std::atomic<size_t> m_failed;
+    std::atomic<size_t> m_received;
+    std::atomic<size_t> m_sent;
+    std::atomic<size_t> m_early;
+    std::atomic<uint64_t> m_connect_start;
+};
+
+typedef bench_client<websocketpp::config::asio_tls_client> tls_client;
+typedef bench_client<websocketpp::config::asio_client> plain_client;
+
+template <typename client>
+void report_handshakes(char const * label, client & c, server_probe & probe,
+    options const & o, bool resume)
+{
+    server_sample before = probe.mark();
+    uint64_t start = now_ns();
+    size_t resumed = c.handshakes(o.handshakes, o.concurrency, resume);
+    double wall = (now_ns() - start) / 1e9;
+    server_sample after = probe.mark();
+
+    double cpu = after.cpu - before.cpu;
+    std::cout << std::left << std::setw(20) << label << std::right
+              << std::setw(10) << std::fixed << std::setprecision(0)
+              << (cpu > 0 ? o.handshakes / cpu : 0) << " per server cpu s"
+              << std::setw(10) << o.handshakes / wall << " per wall s";
+    if (resume) {
+        std::cout << "  (" << resumed << "/" << o.handshakes << " resumed)";
+    }
+    std::cout << std::endl;
+}
+
+template <typename client>
+double report_latency(char const * label, client & c, options const & o) {
+    std::vector<double> rtt = c.round_trips(o.round_trips);
+    if (rtt.empty()) {
+        return 0;
+    }
+    double p50 = rtt[rtt.size() / 2];
+    std::cout << std::left << std::setw(20) << label << std::right
+              << std::fixed << std::setprecision(1)
+              << "p50 " << std::setw(8) << p50 << " us  p99 "
+              << std::setw(8) << rtt[rtt.size() * 99 / 100] << " us"
+              << std::endl;
+    return p50;
+}
+
+template <typename client>
+void report_reconnects(char const * label, client & c, options const & o) {
+    std::vector<double> lat = c.reconnects(o.reconnects);
+    if (lat.empty()) {
+        return;
+    }
+    std::cout << std::left << std::setw(20) << label << std::right
+              << std::fixed << std::setprecision(1)
+              << "p50 " << std::setw(8) << lat[lat.size() / 2] << " us  p99 "
+              << std::setw(8) << lat[lat.size() * 99 / 100] << " us";
+    if (c.early_accepted()) {
+        std::cout << "  (" << c.early_accepted() << "/" << lat.size()
+                  << " early data)";
+    }
+    std::cout << std::endl;
+}
+
+template <typename client>
+void report_throughput(char const * label, client & c, server_probe & probe,
+    options const & o, size_t size)
+{
+    size_t count = std::max<size_t>(16, o.bytes / size);
+
+    server_sample before = probe.mark();
+    double elapsed = c.throughput(size, count, 64);
+    server_sample after = probe.mark();
+
+    double mb = static_cast<double>(size) * count / (1024 * 1024);
+    double cpu = after.cpu - before.cpu;
+    std::cout << std::left << std::setw(8) << label << std::right
+              << std::setw(9) << size << " B" << std::fixed
+              << std::setprecision(1) << std::setw(10) << mb / elapsed
+              << " MiB/s" << std::setw(10) << (cpu > 0 ? mb / cpu : 0)
+              << " MiB per server cpu s" << std::endl;
+}
+
+int run_clients(options const & o, int go_fd, int result_fd) {
+    std::string line;
+    if (!read_line(go_fd, line)) {
+        return 1;
+    }
+
+    std::stringstream tls_uri;
+    tls_uri << "wss://localhost:" << o.port << "/";
+    std::stringstream plain_uri;
+    plain_uri << "ws://localhost:" << (o.port + 1) << "/";
+
+    context_ptr ctx = websocketpp::lib::make_shared<asio::ssl::context>(
+        asio::ssl::context::sslv23);
+    ctx->set_verify_mode(asio::ssl::verify_none);
+
+    server_probe probe(go_fd, result_fd);
+    plain_client pc(plain_uri.str());
+    tls_client tc(tls_uri.str());
+    tc.get_client().set_tls_init_handler(bind(&on_client_tls_init,ctx,_1));
+
+    std::cout << "== handshakes (" << o.handshakes << ", " << o.concurrency
+              << " in flight, " << (o.ec_key ? "ECDSA P-256" : "RSA 2048")
+              << ")" << std::endl;
+    report_handshakes("plain", pc, probe, o, false);
+    report_handshakes("tls full", tc, probe, o, false);
+    report_handshakes("tls resumed", tc, probe, o, true);
+
+    std::cout << std::endl << "== idle memory (" << o.idle
+              << " connections, server rss, TLS buffers "
+              << (o.keep_buffers ? "kept" : "released") << ")" << std::endl;
+    server_sample m0 = probe.mark();
+    pc.open_idle(o.idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server_sample m1 = probe.mark();
+    tc.open_idle(o.idle);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server_sample m2 = probe.mark();
+    double plain_kib = (double(m1.rss) - double(m0.rss)) / 1024 / o.idle;
+    double tls_kib = (double(m2.rss) - double(m1.rss)) / 1024 / o.idle;
+    std::cout << std::fixed << std::setprecision(1)
+              << "plain               " << plain_kib << " KiB/connection"
+              << std::endl
+              << "tls                 " << tls_kib << " KiB/connection ("
+              << tls_kib - plain_kib << " KiB TLS overhead)" << std::endl;
+    tc.close_idle();
+    pc.close_idle();
+
+    std::cout << std::endl << "== reconnect latency, connect to open ("
+              << o.reconnects << " sequential)" << std::endl;
+    {
+        std::stringstream early_uri;
+        early_uri << "wss://localhost:" << (o.port + 2) << "/";
+
+        tls_client rc(tls_uri.str());
+        rc.get_client().set_tls_init_handler(bind(&on_client_tls_init,ctx,_1));
+        rc.get_client().set_session_resumption(true);
+        tls_client ec(early_uri.str());
+        ec.get_client().set_tls_init_handler(bind(&on_client_tls_init,ctx,_1));
+        ec.get_client().set_early_data(true);
+
+        report_reconnects("plain", pc, o);
+        report_reconnects("tls full", tc, o);
+        report_reconnects("tls resumed", rc, o);
+        report_reconnects("tls early data", ec, o);
+    }
+
+    if (!pc.open_echo() || !tc.open_echo()) {
+        std::cerr << "failed to open echo connections" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::endl << "== round trip latency (64 B)" << std::endl;
+    double plain_p50 = report_latency("plain", pc, o);
+    double tls_p50 = report_latency("tls", tc, o);
+    std::cout << "tls overhead        " << std::fixed << std::setprecision(1)
+              << tls_p50 - plain_p50 << " us at p50" << std::endl;
+
+    std::cout << std::endl << "== echo throughput" << std::endl;
+    size_t sizes[] = {64, 1024, 16384, 262144};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        report_throughput("plain", pc, probe, o, sizes[i]);
+        report_throughput("tls", tc, probe, o, sizes[i]);
+    }
+
+    pc.close_echo();
+    tc.close_echo();
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+    options o;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        char const * value = (i + 1 < argc) ? argv[i + 1] : "";
+
+        if (arg == "--handshakes") {
+            o.handshakes = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--concurrency") {
+            o.concurrency = std::max<size_t>(1, std::strtoul(value, NULL, 10));
+            ++i;
+        } else if (arg == "--round-trips") {
+            o.round_trips = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--bytes") {
+            o.bytes = std::strtoul(value, NULL, 10); ++i;
+        } else if (arg == "--idle") {
+            o.idle = std::max<size_t>(1, std::strtoul(value, NULL, 10)); ++i;
+        } else if (arg == "--reconnects") {
+            o.reconnects = std::max<size_t>(1, std::strtoul(value, NULL, 10));
+            ++i;
+        } else if (arg == "--key") {
+            o.ec_key = (std::string(value) == "ec"); ++i;
+        } else if (arg == "--keep-buffers") {
+            o.keep_buffers = true;
+        } else if (arg == "--port") {
+            o.port = static_cast<uint16_t>(std::strtoul(value, NULL, 10)); ++i;
+        } else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    raise_fd_limit();
+
+    int go[2];
+    int result[2];
+    if (pipe(go) != 0 || pipe(result) != 0) {
+        std::perror("pipe");
+        return 1;
+    }
+
+    // Fork before any threads or io_services exist
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return 1;
+    }
+
+    if (pid == 0) {
+        close(go[1]);
+        close(result[0]);
+        int ret = 1;
+        try {
+            ret = run_clients(o, go[0], result[1]);
+        } catch (websocketpp::exception const & e) {
+            std::cerr << e.what() << std::endl;
+        }
+        std::cout.flush();
+        std::exit(ret);
+    }
+
+    close(go[0]);
+    close(result[1]);
+
+    int ret = 1;
+    try {
+        ret = run_server(o, go[1], result[0]);
+    } catch (websocketpp::exception const & e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    close(go[1]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ret ? ret : (WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
@@ -71,6 +71,32 @@ macro (build_test TARGET_NAME)
     endif ()
 endmacro ()
 
+# Build fuzz target and register a test that runs its corpus. Clang builds
+# link libFuzzer with the address and undefined behavior sanitizers, other
+# compilers link the standalone driver in fuzz/driver.cpp.
+macro (build_fuzzer TARGET_NAME)
+    if (CMAKE_COMPILER_IS_CLANGXX)
+        build_executable (${TARGET_NAME} ${ARGN})
+
+        set_property (TARGET ${TARGET_NAME} APPEND_STRING PROPERTY
+            COMPILE_FLAGS " -fsanitize=fuzzer,address,undefined")
+        set_property (TARGET ${TARGET_NAME} APPEND_STRING PROPERTY
+            LINK_FLAGS " -fsanitize=fuzzer,address,undefined")
+        set (FUZZER_CORPUS_ARGS -runs=0 ${CMAKE_CURRENT_SOURCE_DIR}/corpus)
+    else ()
+        build_executable (${TARGET_NAME} ${ARGN} ${WEBSOCKETPP_ROOT}/fuzz/driver.cpp)
+
+        set (FUZZER_CORPUS_ARGS ${CMAKE_CURRENT_SOURCE_DIR}/corpus)
+    endif ()
+
+    if (${CMAKE_VERSION} VERSION_LESS 3)
+        message(WARNING "CMake too old to register ${TARGET_NAME} as a test")
+    else ()
+        add_test(NAME ${TARGET_NAME}
+                 COMMAND $<TARGET_FILE:${TARGET_NAME}> ${FUZZER_CORPUS_ARGS})
+    endif ()
+endmacro ()
+
 # Finalize target for all types
 macro (final_target)
     if ("${TARGET_LIB_TYPE}" STREQUAL "EXECUTABLE")
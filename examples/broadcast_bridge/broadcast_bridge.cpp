@@ -0,0 +1,107 @@
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/broadcast/bridge.hpp>
+
+#include <websocketpp/client.hpp>
+#include <websocketpp/server.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// A publish/subscribe server that shares topics with other instances.
+//
+// Usage: broadcast_bridge port [peer_uri...]
+//
+// Start every node with the URIs of all the others, for example:
+//   broadcast_bridge 9002 ws://localhost:9003
+//   broadcast_bridge 9003 ws://localhost:9002
+//
+// Clients send "sub <topic>", "unsub <topic>" or "pub <topic> <message>".
+// Messages published on any node reach the subscribers of every node.
+
+typedef websocketpp::server<websocketpp::config::asio> server;
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+typedef websocketpp::broadcast::bridge<server,client> bridge;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+typedef server::message_ptr message_ptr;
+
+bool on_validate(bridge * b, websocketpp::connection_hdl hdl) {
+    b->validate(hdl);
+    return true;
+}
+
+void on_message(server * s, bridge * b, websocketpp::connection_hdl hdl,
+    message_ptr msg)
+{
+    if (b->on_message(hdl, msg)) {
+        return;
+    }
+
+    std::string const & cmd = msg->get_payload();
+    std::string::size_type space = cmd.find(' ');
+    std::string verb = cmd.substr(0, space);
+    std::string rest = (space == std::string::npos ? "" : cmd.substr(space+1));
+
+    websocketpp::lib::error_code ec;
+    if (verb == "sub") {
+        b->subscribe(rest, hdl);
+    } else if (verb == "unsub") {
+        b->unsubscribe(rest, hdl);
+    } else if (verb == "pub") {
+        space = rest.find(' ');
+        std::string topic = rest.substr(0, space);
+        std::string payload = (space == std::string::npos ? "" :
+            rest.substr(space+1));
+        b->publish(topic, payload, msg->get_opcode(), ec);
+        if (ec) {
+            s->send(hdl, "error: " + ec.message(),
+                websocketpp::frame::opcode::text, ec);
+        }
+    } else {
+        s->send(hdl, "error: unknown command",
+            websocketpp::frame::opcode::text, ec);
+    }
+}
+
+int main(int argc, char * argv[]) {
+    if (argc < 2) {
+        std::cout << "Usage: broadcast_bridge port [peer_uri...]" << std::endl;
+        return 1;
+    }
+
+    server s;
+    client c;
+
+    try {
+        s.clear_access_channels(websocketpp::log::alevel::all);
+        c.clear_access_channels(websocketpp::log::alevel::all);
+
+        // the peer links share the server's io_service and thread
+        s.init_asio();
+        c.init_asio(&s.get_io_service());
+
+        bridge b(s, c);
+        s.set_validate_handler(bind(&on_validate,&b,::_1));
+        s.set_message_handler(bind(&on_message,&s,&b,::_1,::_2));
+        s.set_close_handler(bind(&bridge::on_close,&b,::_1));
+
+        s.set_reuse_addr(true);
+        s.listen(static_cast<uint16_t>(std::atoi(argv[1])));
+        s.start_accept();
+
+        for (int i = 2; i < argc; ++i) {
+            b.add_peer(argv[i]);
+        }
+
+        s.run();
+    } catch (websocketpp::exception const & e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include <websocketpp/config/asio_no_tls_prefork.hpp>
+#include <websocketpp/prefork/supervisor.hpp>
+
+#include <websocketpp/server.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+// An echo server that runs one single threaded worker process per core.
+//
+// Usage: prefork_server [port] [workers]
+
+typedef websocketpp::server<websocketpp::config::asio_prefork> server;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+typedef server::message_ptr message_ptr;
+
+void on_message(server* s, websocketpp::connection_hdl hdl, message_ptr msg) {
+    websocketpp::lib::error_code ec;
+    s->send(hdl, msg->get_payload(), msg->get_opcode(), ec);
+}
+
+// Runs in each worker process
+int run_worker(uint16_t port, websocketpp::prefork::worker & w) {
+    server echo_server;
+
+    try {
+        echo_server.clear_access_channels(websocketpp::log::alevel::all);
+        echo_server.init_asio();
+        echo_server.set_message_handler(bind(&on_message,&echo_server,::_1,::_2));
+
+        // report traffic to the supervisor
+        echo_server.set_counters(&w.get_counters());
+
+        // every worker listens on the same port
+        echo_server.set_reuse_port(true);
+        echo_server.listen(port);
+        echo_server.start_accept();
+
+        echo_server.run();
+    } catch (websocketpp::exception const & e) {
+        std::cerr << "worker " << w.get_index() << ": " << e.what()
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+void report(websocketpp::prefork::supervisor * s) {
+    websocketpp::metrics::endpoint_counters totals = s->get_totals();
+    std::cout << "active: " << totals.connections_active()
+              << " opened: " << totals.connections_opened
+              << " messages in: " << totals.messages_in
+              << " messages out: " << totals.messages_out
+              << " restarts: " << s->get_restarts() << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    uint16_t port = 9002;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (argc > 1) {
+        port = static_cast<uint16_t>(std::atoi(argv[1]));
+    }
+    if (argc > 2) {
+        workers = std::atol(argv[2]);
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+
+    websocketpp::prefork::supervisor s(static_cast<size_t>(workers));
+    s.set_worker_handler(bind(&run_worker,port,::_1));
+    s.set_report_handler(bind(&report,&s),5000);
+    s.handle_signals();
+
+    websocketpp::lib::error_code ec;
+    s.run(ec);
+    if (ec) {
+        std::cerr << "supervisor: " << ec.message() << std::endl;
+        return 1;
+    }
+
+    report(&s);
+    return 0;
+}
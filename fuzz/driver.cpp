@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// Standalone driver for the fuzz targets
+//
+// Used instead of libFuzzer when the compiler does not provide it. Runs the
+// target once on each file named on the command line, or on each file in a
+// named directory, and prints the work done per byte. Running it on a
+// target's worst case corpus makes a regression benchmark for the parser.
+
+#include "work.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size);
+
+namespace {
+
+void run_file(std::string const & path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        std::fprintf(stderr, "could not read %s\n", path.c_str());
+        std::exit(1);
+    }
+    std::vector<char> input((std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+
+    // print the name first so that a failing input is named by the abort
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    std::printf("%-32s ", name.c_str());
+    std::fflush(stdout);
+
+    fuzz::last_result() = fuzz::result();
+    LLVMFuzzerTestOneInput(input.empty() ? NULL :
+        reinterpret_cast<uint8_t const *>(&input[0]), input.size());
+
+    fuzz::result const & r = fuzz::last_result();
+    std::printf("%8lu %10llu %14llu %10.1f %10.1f%%\n",
+        static_cast<unsigned long>(input.size()),
+        static_cast<unsigned long long>(r.bytes),
+        static_cast<unsigned long long>(r.work),
+        r.bytes ? static_cast<double>(r.work) / r.bytes : 0,
+        r.bound ? 100.0 * r.work / r.bound : 0);
+}
+
+void run_path(std::string const & path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        std::vector<std::string> files;
+        DIR * dir = opendir(path.c_str());
+        for (dirent * e = dir ? readdir(dir) : NULL; e; e = readdir(dir)) {
+            if (e->d_name[0] != '.') {
+                files.push_back(path + "/" + e->d_name);
+            }
+        }
+        if (dir) {
+            closedir(dir);
+        }
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size(); ++i) {
+            run_file(files[i]);
+        }
+    } else {
+        run_file(path);
+    }
+}
+
+} // namespace
+
+int main(int argc, char * argv[]) {
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s file_or_directory...\n", argv[0]);
+        return 1;
+    }
+
+    fuzz::work_counter counter;
+    std::printf("%-32s %8s %10s %14s %10s %11s\n", "input", "size", "bytes",
+        counter.unit(), "per byte", "of bound");
+    for (int i = 1; i < argc; ++i) {
+        run_path(argv[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// Fuzz target for http::parser::request::consume
+//
+// The first byte of the input sets how many bytes are passed to each call to
+// consume, 0 meaning all at once. The rest is the request. The request must
+// parse the same way in chunks as it does all at once, and the chunked parse
+// must do work linear in the size of the request.
+
+#include "../work.hpp"
+
+#include <websocketpp/http/request.hpp>
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+fuzz::limit const bound = {200000, 2000};
+
+struct outcome {
+    outcome() : ready(false), failed(false), status(0), consumed(0) {}
+
+    bool ready;
+    bool failed;
+    int status;
+    size_t consumed;
+    std::string raw;
+};
+
+void parse(char const * data, size_t size, size_t chunk, outcome & o) {
+    websocketpp::http::parser::request r;
+
+    try {
+        while (o.consumed < size && !r.ready()) {
+            size_t n = std::min(chunk, size - o.consumed);
+            size_t c = r.consume(data + o.consumed, n);
+            fuzz::require(c == n || (c < n && r.ready()), "http_request",
+                "consume stopped before the end of its input");
+            o.consumed += c;
+        }
+    } catch (websocketpp::http::exception const & e) {
+        o.failed = true;
+        o.status = e.m_error_code;
+    }
+
+    o.ready = r.ready();
+    if (o.ready) {
+        o.raw = r.raw();
+    }
+}
+
+struct chunked_parse {
+    size_t operator()() {
+        result = outcome();
+        parse(data, size, chunk, result);
+        return size;
+    }
+
+    char const * data;
+    size_t size;
+    size_t chunk;
+    outcome result;
+};
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    chunked_parse chunked;
+    chunked.data = reinterpret_cast<char const *>(data + 1);
+    chunked.size = size - 1;
+    chunked.chunk = data[0] ? data[0] : chunked.size;
+    fuzz::measure("http_request", bound, chunked);
+
+    outcome whole;
+    parse(chunked.data, chunked.size, chunked.size, whole);
+
+    outcome const & c = chunked.result;
+    fuzz::require(c.ready == whole.ready && c.failed == whole.failed &&
+        c.status == whole.status, "http_request",
+        "chunked and whole parses reached different states");
+    fuzz::require(c.consumed == whole.consumed || c.failed, "http_request",
+        "chunked and whole parses consumed different lengths");
+    fuzz::require(c.raw == whole.raw, "http_request",
+        "chunked and whole parses produced different requests");
+
+    if (whole.ready) {
+        // The request must survive being written out and parsed again
+        outcome again;
+        parse(whole.raw.data(), whole.raw.size(), whole.raw.size(), again);
+        fuzz::require(again.ready && again.raw == whole.raw, "http_request",
+            "the written out request parses differently");
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// Fuzz target for processor::hybi13::consume on the server side
+//
+// The first byte of the input sets how many bytes are passed to each call to
+// consume, 0 meaning all at once. Bit 0 of the second byte negotiates
+// permessage-deflate and bit 1 adds client_no_context_takeover to the offer.
+// The rest is the frames sent by the client. The frames must decode to the
+// same messages and error in chunks as all at once, and the chunked decode
+// must do work linear in the size of its input and output.
+
+#include "../work.hpp"
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/processors/hybi13.hpp>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct fuzz_config : public websocketpp::config::core {
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+
+    static const size_t max_message_size = 1024 * 1024;
+};
+
+typedef websocketpp::processor::hybi13<fuzz_config> processor_type;
+typedef fuzz_config::con_msg_manager_type con_msg_manager_type;
+typedef fuzz_config::message_type::ptr message_ptr;
+
+fuzz::limit const bound = {400000, 1000};
+
+struct outcome {
+    std::vector<std::pair<int,std::string> > messages;
+    websocketpp::lib::error_code ec;
+    size_t output;
+};
+
+void decode(std::string input, size_t chunk, uint8_t options, outcome & o) {
+    o.messages.clear();
+    o.ec = websocketpp::lib::error_code();
+    o.output = 0;
+
+    fuzz_config::rng_type rng;
+    processor_type p(false, true,
+        con_msg_manager_type::ptr(new con_msg_manager_type()), rng);
+
+    if (options & 0x01) {
+        fuzz_config::request_type req;
+        req.replace_header("Sec-WebSocket-Extensions", options & 0x02 ?
+            "permessage-deflate; client_no_context_takeover" :
+            "permessage-deflate");
+        fuzz::require(!p.negotiate_extensions(req).first, "hybi13_consume",
+            "permessage-deflate negotiation failed");
+    }
+
+    // consume unmasks in place
+    uint8_t * buf = reinterpret_cast<uint8_t *>(&input[0]);
+    size_t offset = 0;
+    while (offset < input.size()) {
+        size_t n = std::min(chunk, input.size() - offset);
+        size_t c = p.consume(buf + offset, n, o.ec);
+        if (o.ec == websocketpp::processor::error::message_too_big) {
+            // a compressed message is inflated up to the limit before it is
+            // rejected
+            o.output += fuzz_config::max_message_size;
+        }
+        if (o.ec) {
+            break;
+        }
+        fuzz::require(c <= n, "hybi13_consume", "consumed past the input");
+        fuzz::require(c > 0 || p.ready(), "hybi13_consume",
+            "consume made no progress");
+        offset += c;
+
+        if (p.ready()) {
+            message_ptr msg = p.get_message();
+            fuzz::require(!!msg, "hybi13_consume", "ready without a message");
+            o.messages.push_back(std::make_pair(
+                static_cast<int>(msg->get_opcode()), msg->get_payload()));
+            o.output += msg->get_payload().size();
+        }
+    }
+}
+
+struct chunked_decode {
+    size_t operator()() {
+        decode(input, chunk, options, result);
+        return input.size() + result.output;
+    }
+
+    std::string input;
+    size_t chunk;
+    uint8_t options;
+    outcome result;
+};
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size) {
+    if (size < 2) {
+        return 0;
+    }
+
+    chunked_decode chunked;
+    chunked.input.assign(reinterpret_cast<char const *>(data + 2), size - 2);
+    chunked.chunk = data[0] ? data[0] : chunked.input.size();
+    chunked.options = data[1];
+    fuzz::measure("hybi13_consume", bound, chunked);
+
+    outcome whole;
+    decode(chunked.input, chunked.input.size(), chunked.options, whole);
+
+    fuzz::require(chunked.result.ec == whole.ec, "hybi13_consume",
+        "chunked and whole decodes ended differently");
+    fuzz::require(chunked.result.messages == whole.messages, "hybi13_consume",
+        "chunked and whole decodes produced different messages");
+    return 0;
+}
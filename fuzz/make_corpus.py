@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#
+# Writes the worst case corpus of each fuzz target to <target>/corpus.
+#
+# Each input is built to push one path of the parser to its largest cost per
+# byte: input fed a byte at a time, long lines with no delimiter, many tiny
+# frames, and compressed data with a high expansion ratio. The files are
+# checked in, rerun this after changing an input.
+
+import os
+import random
+import struct
+import zlib
+
+root = os.path.dirname(os.path.abspath(__file__))
+
+
+def write(target, name, data):
+    path = os.path.join(root, target, 'corpus')
+    os.makedirs(path, exist_ok=True)
+    with open(os.path.join(path, name), 'wb') as f:
+        f.write(data)
+
+
+def frame(opcode, payload, fin=True, rsv1=False, mask=b'\x01\x02\x03\x04'):
+    head = (0x80 if fin else 0) | (0x40 if rsv1 else 0) | opcode
+    n = len(payload)
+    if n < 126:
+        length = struct.pack('!B', 0x80 | n)
+    elif n < 65536:
+        length = struct.pack('!BH', 0x80 | 126, n)
+    else:
+        length = struct.pack('!BQ', 0x80 | 127, n)
+    masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+    return struct.pack('!B', head) + length + mask + masked
+
+
+def deflate(data, wbits=-15):
+    c = zlib.compressobj(9, zlib.DEFLATED, wbits)
+    out = c.compress(data) + c.flush(zlib.Z_SYNC_FLUSH)
+    return out[:-4]
+
+
+rnd = random.Random(1)
+
+# http_request: first byte is the chunk size, 0 for all at once
+request = b'GET /chat HTTP/1.1\r\nHost: example.com\r\nUpgrade: websocket\r\n' \
+    b'Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n' \
+    b'Sec-WebSocket-Version: 13\r\n\r\n'
+write('http_request', 'handshake', b'\x00' + request)
+write('http_request', 'handshake_byte_at_a_time', b'\x01' + request)
+write('http_request', 'long_header_byte_at_a_time',
+    b'\x01GET / HTTP/1.1\r\nHost: ' + b'a' * 15000)
+write('http_request', 'header_too_big_byte_at_a_time',
+    b'\x01GET / HTTP/1.1\r\nHost: ' + b'a' * 17000 + b'\r\n\r\n')
+write('http_request', 'long_uri_byte_at_a_time',
+    b'\x01GET /' + b'a' * 15000 + b' HTTP/1.1\r\n\r\n')
+write('http_request', 'many_headers_byte_at_a_time',
+    b'\x01GET / HTTP/1.1\r\n' + b'a: b\r\n' * 2500 + b'\r\n')
+write('http_request', 'many_repeated_headers',
+    b'\x00GET / HTTP/1.1\r\n' + b'Connection: x\r\n' * 1000 + b'\r\n')
+write('http_request', 'carriage_returns_byte_at_a_time',
+    b'\x01GET / HTTP/1.1\r\nHost: ' + b'\r' * 15000 + b'\r\n\r\n')
+write('http_request', 'body_with_content_length',
+    b'\x07POST / HTTP/1.1\r\nContent-Length: 10000\r\n\r\n' + b'x' * 10000)
+
+# uri: the whole input is the uri
+write('uri', 'simple', b'ws://example.com:9002/chat?x=1')
+write('uri', 'ipv6', b'wss://[::1]:9002/')
+write('uri', 'long_path', b'ws://example.com/' + b'a' * 20000)
+write('uri', 'many_colons', b'ws://' + b':' * 20000)
+write('uri', 'long_ipv6', b'ws://[' + b'0:' * 10000 + b']/')
+write('uri', 'unterminated_ipv6', b'ws://[' + b'a' * 20000)
+write('uri', 'long_port', b'ws://a:' + b'9' * 20000 + b'/')
+
+# hybi13_consume: chunk size, options, then frames from the client
+deflated = 0x01
+write('hybi13_consume', 'text_byte_at_a_time',
+    b'\x01\x00' + frame(0x1, b'hello' * 2000))
+write('hybi13_consume', 'binary_64k', b'\x00\x00' +
+    frame(0x2, bytes(rnd.getrandbits(8) for _ in range(70000))))
+write('hybi13_consume', 'tiny_fragments_byte_at_a_time', b'\x01\x00' +
+    frame(0x1, b'a', fin=False) +
+    b''.join(frame(0x0, b'a', fin=False) for _ in range(1500)) +
+    frame(0x0, b'a'))
+write('hybi13_consume', 'many_pings', b'\x00\x00' +
+    b''.join(frame(0x9, b'p' * 125) for _ in range(200)))
+write('hybi13_consume', 'many_empty_messages', b'\x00\x00' +
+    b''.join(frame(0x2, b'') for _ in range(2000)))
+write('hybi13_consume', 'deflate_text', struct.pack('!BB', 0, deflated) +
+    frame(0x1, deflate(b'hello world ' * 1000), rsv1=True))
+write('hybi13_consume', 'deflate_bomb', struct.pack('!BB', 0, deflated) +
+    frame(0x2, deflate(b'\x00' * 1000000), rsv1=True))
+write('hybi13_consume', 'deflate_bomb_too_big',
+    struct.pack('!BB', 0, deflated) +
+    frame(0x2, deflate(b'\x00' * 2000000), rsv1=True))
+write('hybi13_consume', 'deflate_fragments_byte_at_a_time',
+    struct.pack('!BB', 1, deflated | 0x02) +
+    frame(0x1, deflate(b'abc' * 3000)[:100], fin=False, rsv1=True) +
+    frame(0x0, deflate(b'abc' * 3000)[100:]))
+
+# permessage_deflate: bit 0 selects a round trip, bits 1-3 the window bits
+write('permessage_deflate', 'inflate_zeros', b'\x0e' + deflate(b'\x00' * 4000000))
+write('permessage_deflate', 'inflate_small_window', b'\x00' +
+    deflate(b'abcdefgh' * 10000, -9))
+write('permessage_deflate', 'inflate_random', b'\x0e' +
+    deflate(bytes(rnd.getrandbits(8) for _ in range(20000))))
+write('permessage_deflate', 'inflate_stored_blocks', b'\x0e' +
+    deflate(bytes(rnd.getrandbits(8) for _ in range(100000)), -15)[:50000])
+write('permessage_deflate', 'round_trip_text', b'\x01' + b'hello world ' * 2000)
+write('permessage_deflate', 'round_trip_random',
+    b'\x01' + bytes(rnd.getrandbits(8) for _ in range(50000)))
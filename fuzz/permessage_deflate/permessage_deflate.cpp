@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// Fuzz target for permessage-deflate compression and decompression
+//
+// Bit 0 of the first byte picks the mode. When clear the rest of the input
+// is inflated as a message from a client that negotiated
+// client_max_window_bits 8 + (bits 1-3) and must take work linear in the size
+// of the input and output. When set the rest of the input is deflated and
+// inflated again and must come back unchanged.
+
+#include "../work.hpp"
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/http/parser.hpp>
+
+#include <sstream>
+#include <string>
+
+namespace {
+
+typedef websocketpp::extensions::permessage_deflate::enabled
+    <websocketpp::config::core::permessage_deflate_config> deflate_type;
+
+fuzz::limit const bound = {400000, 200};
+
+void setup(deflate_type & d, std::string const & window_bits) {
+    websocketpp::http::attribute_list offer;
+    if (!window_bits.empty()) {
+        offer["client_max_window_bits"] = window_bits;
+    }
+    fuzz::require(!d.negotiate(offer).first, "permessage_deflate",
+        "negotiation failed");
+    fuzz::require(!d.init(true), "permessage_deflate", "init failed");
+}
+
+struct inflate_message {
+    size_t operator()() {
+        deflate_type d;
+        setup(d, window_bits);
+
+        uint8_t const trailer[4] = {0x00, 0x00, 0xff, 0xff};
+        output.clear();
+        if (!d.decompress(data, size, output)) {
+            d.decompress(trailer, 4, output);
+        }
+        return size + output.size();
+    }
+
+    uint8_t const * data;
+    size_t size;
+    std::string window_bits;
+    std::string output;
+};
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    if (data[0] & 0x01) {
+        std::string in(reinterpret_cast<char const *>(data + 1), size - 1);
+        std::string compressed;
+        std::string out;
+
+        deflate_type sender;
+        deflate_type receiver;
+        setup(sender, "");
+        setup(receiver, "");
+
+        fuzz::require(!sender.compress(in, compressed), "permessage_deflate",
+            "compress failed");
+        // compress output ends with the sync flush trailer, so the receiver
+        // can inflate it without appending one
+        fuzz::require(!receiver.decompress(
+            reinterpret_cast<uint8_t const *>(compressed.data()),
+            compressed.size(), out), "permessage_deflate",
+            "could not inflate deflated data");
+        fuzz::require(out == in, "permessage_deflate",
+            "round trip changed the message");
+        return 0;
+    }
+
+    std::stringstream bits;
+    bits << 8 + ((data[0] >> 1) & 0x07);
+
+    inflate_message inflate;
+    inflate.data = data + 1;
+    inflate.size = size - 1;
+    inflate.window_bits = bits.str();
+    fuzz::measure("permessage_deflate", bound, inflate);
+    return 0;
+}
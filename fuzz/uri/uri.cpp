@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// Fuzz target for the uri parser
+//
+// The input is the URI string. Valid URIs must come out of str() in a form
+// that parses to the same parts, and parsing must do work linear in the size
+// of the input.
+
+#include "../work.hpp"
+
+#include <websocketpp/uri.hpp>
+
+#include <string>
+
+namespace {
+
+fuzz::limit const bound = {100000, 500};
+
+struct parse {
+    size_t operator()() {
+        u = websocketpp::uri_ptr(new websocketpp::uri(input));
+        return input.size();
+    }
+
+    std::string input;
+    websocketpp::uri_ptr u;
+};
+
+} // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(uint8_t const * data, size_t size) {
+    parse p;
+    p.input.assign(reinterpret_cast<char const *>(data), size);
+    fuzz::measure("uri", bound, p);
+
+    websocketpp::uri const & u = *p.u;
+    if (!u.get_valid()) {
+        return 0;
+    }
+
+    websocketpp::uri again(u.str());
+    fuzz::require(again.get_valid(), "uri", "str() is not a valid URI");
+    fuzz::require(again.get_secure() == u.get_secure() &&
+        again.get_scheme() == u.get_scheme() &&
+        again.get_host() == u.get_host() &&
+        again.get_port() == u.get_port() &&
+        again.get_resource() == u.get_resource(), "uri",
+        "str() parses to different parts");
+    return 0;
+}
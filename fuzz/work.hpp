@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_FUZZ_WORK_HPP
+#define WEBSOCKETPP_FUZZ_WORK_HPP
+
+#include <websocketpp/metrics/cycles.hpp>
+
+#include <websocketpp/common/stdint.hpp>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Work accounting shared by the fuzz targets
+//
+// Each target measures the work done on an input and aborts when it exceeds
+// a linear bound of the form fixed + per_byte * bytes. libFuzzer reports the
+// abort as a crash and saves the input, so inputs that trigger super linear
+// behaviour are found the same way as memory errors.
+//
+// Work is counted in user space instructions retired when the kernel allows
+// perf_event_open, which is repeatable from run to run. Otherwise it falls
+// back to metrics::cycles() and takes the least of three runs to filter out
+// preemption. Bounds are in instructions. Environment variables:
+//
+// - WSPP_FUZZ_SLACK=n multiplies every bound by n
+// - WSPP_FUZZ_REPORT_ONLY=1 reports work without ever aborting
+
+namespace fuzz {
+
+/// Counts the work done by the calling thread
+class work_counter {
+public:
+    work_counter() : m_fd(-1), m_start(0) {
+#if defined(__linux__)
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1,
+            -1, 0));
+#endif
+    }
+
+    ~work_counter() {
+#if defined(__linux__)
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+#endif
+    }
+
+    /// Whether work is counted in instructions rather than cycles
+    bool exact() const {
+        return m_fd != -1;
+    }
+
+    char const * unit() const {
+        return exact() ? "instructions" : "cycles";
+    }
+
+    void start() {
+#if defined(__linux__)
+        if (m_fd != -1) {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+            return;
+        }
+#endif
+        m_start = websocketpp::metrics::cycles();
+    }
+
+    uint64_t stop() {
+#if defined(__linux__)
+        if (m_fd != -1) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t count = 0;
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+                return 0;
+            }
+            return count;
+        }
+#endif
+        return websocketpp::metrics::cycles() - m_start;
+    }
+private:
+    int m_fd;
+    uint64_t m_start;
+};
+
+/// A linear bound on the work for an input
+struct limit {
+    /// Work allowed whatever the size, for setup and teardown
+    uint64_t fixed;
+    /// Work allowed per byte processed
+    uint64_t per_byte;
+};
+
+/// The measurement of the last input, for the standalone driver
+struct result {
+    uint64_t work;
+    uint64_t bytes;
+    uint64_t bound;
+    char const * unit;
+};
+
+inline result & last_result() {
+    static result r = result();
+    return r;
+}
+
+inline uint64_t env_value(char const * name, uint64_t fallback) {
+    char const * value = std::getenv(name);
+    return value ? std::strtoull(value, NULL, 10) : fallback;
+}
+
+/// Run a target on an input and check its work against a linear bound
+/**
+ * `run` is called with no arguments and returns the number of bytes it
+ * processed. That is usually the input size, plus the output size for
+ * targets that expand their input such as inflate. Each call must start from
+ * fresh state since the fallback counter calls it more than once.
+ */
+template <typename function>
+void measure(char const * target, limit const & l, function & run) {
+    static work_counter counter;
+    static uint64_t const slack = env_value("WSPP_FUZZ_SLACK", 1);
+    static bool const report_only = env_value("WSPP_FUZZ_REPORT_ONLY", 0) != 0;
+
+    uint64_t work = 0;
+    uint64_t bytes = 0;
+    for (int i = 0; i < (counter.exact() ? 1 : 3); ++i) {
+        counter.start();
+        bytes = run();
+        uint64_t w = counter.stop();
+        if (i == 0 || w < work) {
+            work = w;
+        }
+    }
+
+    uint64_t bound = (l.fixed + l.per_byte * bytes) * slack;
+#if defined(__SANITIZE_ADDRESS__)
+    // Sanitizer checks multiply the work of every memory access
+    bound *= 10;
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+    bound *= 10;
+#endif
+#endif
+
+    result & r = last_result();
+    r.work = work;
+    r.bytes = bytes;
+    r.bound = bound;
+    r.unit = counter.unit();
+
+    if (work > bound && !report_only) {
+        std::fprintf(stderr, "%s: %llu %s for %llu bytes exceeds the linear "
+            "bound of %llu\n", target, static_cast<unsigned long long>(work),
+            counter.unit(), static_cast<unsigned long long>(bytes),
+            static_cast<unsigned long long>(bound));
+        std::abort();
+    }
+}
+
+/// Abort with a message when a correctness check fails
+inline void require(bool condition, char const * target, char const * what) {
+    if (!condition) {
+        std::fprintf(stderr, "%s: %s\n", target, what);
+        std::abort();
+    }
+}
+
+} // namespace fuzz
+
+#endif // WEBSOCKETPP_FUZZ_WORK_HPP
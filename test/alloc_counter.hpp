@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TEST_ALLOC_COUNTER_HPP
+#define WEBSOCKETPP_TEST_ALLOC_COUNTER_HPP
+
+/**
+ * Allocation counting test utility
+ *
+ * Replaces the global `operator new` and `operator delete` with versions that
+ * count calls made by the current thread. Tests take a snapshot before and
+ * after a section of code to find the number of heap allocations it made.
+ *
+ * The replacement operators are defined (not just declared) by this header,
+ * so it must be included by exactly one translation unit per test program.
+ */
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <cstdlib>
+#include <new>
+
+#ifdef _WEBSOCKETPP_CPP11_INTERNAL_
+    #define _WEBSOCKETPP_TEST_THREAD_LOCAL_ thread_local
+    #define _WEBSOCKETPP_TEST_THROWS_BAD_ALLOC_
+    #define _WEBSOCKETPP_TEST_NOTHROW_ noexcept
+#else
+    // Without thread_local the counters are shared by all threads. The tests
+    // that use them are single threaded.
+    #define _WEBSOCKETPP_TEST_THREAD_LOCAL_
+    #define _WEBSOCKETPP_TEST_THROWS_BAD_ALLOC_ throw(std::bad_alloc)
+    #define _WEBSOCKETPP_TEST_NOTHROW_ throw()
+#endif
+
+namespace alloc_counter {
+
+/// Allocation counts for one thread
+struct counts {
+    /// Number of calls to any form of operator new
+    uint64_t allocations;
+    /// Number of calls to any form of operator delete with a non-null pointer
+    uint64_t deallocations;
+    /// Total number of bytes requested from operator new
+    uint64_t bytes;
+};
+
+namespace detail {
+
+inline counts & local() {
+    static _WEBSOCKETPP_TEST_THREAD_LOCAL_ counts c = {0, 0, 0};
+    return c;
+}
+
+inline void * allocate(std::size_t size) {
+    counts & c = local();
+    ++c.allocations;
+    c.bytes += size;
+
+    void * p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+inline void deallocate(void * p) {
+    if (p) {
+        ++local().deallocations;
+        std::free(p);
+    }
+}
+
+} // namespace detail
+
+/// Return the counts for the calling thread
+inline counts snapshot() {
+    return detail::local();
+}
+
+/// Number of allocations made by the calling thread since `since` was taken
+inline uint64_t allocations_since(counts const & since) {
+    return detail::local().allocations - since.allocations;
+}
+
+/// Number of deallocations made by the calling thread since `since` was taken
+inline uint64_t deallocations_since(counts const & since) {
+    return detail::local().deallocations - since.deallocations;
+}
+
+} // namespace alloc_counter
+
+void * operator new(std::size_t size) _WEBSOCKETPP_TEST_THROWS_BAD_ALLOC_ {
+    return alloc_counter::detail::allocate(size);
+}
+
+void * operator new[](std::size_t size) _WEBSOCKETPP_TEST_THROWS_BAD_ALLOC_ {
+    return alloc_counter::detail::allocate(size);
+}
+
+void * operator new(std::size_t size, std::nothrow_t const &)
+    _WEBSOCKETPP_TEST_NOTHROW_
+{
+    try {
+        return alloc_counter::detail::allocate(size);
+    } catch (std::bad_alloc const &) {
+        return NULL;
+    }
+}
+
+void * operator new[](std::size_t size, std::nothrow_t const &)
+    _WEBSOCKETPP_TEST_NOTHROW_
+{
+    try {
+        return alloc_counter::detail::allocate(size);
+    } catch (std::bad_alloc const &) {
+        return NULL;
+    }
+}
+
+void operator delete(void * p) _WEBSOCKETPP_TEST_NOTHROW_ {
+    alloc_counter::detail::deallocate(p);
+}
+
+void operator delete[](void * p) _WEBSOCKETPP_TEST_NOTHROW_ {
+    alloc_counter::detail::deallocate(p);
+}
+
+void operator delete(void * p, std::nothrow_t const &)
+    _WEBSOCKETPP_TEST_NOTHROW_
+{
+    alloc_counter::detail::deallocate(p);
+}
+
+void operator delete[](void * p, std::nothrow_t const &)
+    _WEBSOCKETPP_TEST_NOTHROW_
+{
+    alloc_counter::detail::deallocate(p);
+}
+
+#endif // WEBSOCKETPP_TEST_ALLOC_COUNTER_HPP
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_TEST_ALLOCATION_TEST_HPP
+#define WEBSOCKETPP_TEST_ALLOCATION_TEST_HPP
+
+#include <websocketpp/frame.hpp>
+
+#include <cstddef>
+#include <string>
+
+/// Parameters and helpers shared by the allocation tests
+namespace allocation_test {
+
+/// Messages handled before counting starts, so buffers reach their capacity
+std::size_t const warm_up = 64;
+/// Messages handled while counting
+std::size_t const messages = 256;
+/// Number of connections or messages in the fan out tests
+std::size_t const fan_out = 8;
+
+/// Build a masked client frame with a payload of up to 125 bytes
+inline std::string client_frame(websocketpp::frame::opcode::value op,
+    bool fin, std::string const & payload)
+{
+    std::string frame;
+    frame.push_back(static_cast<char>((fin ? 0x80 : 0x00) | op));
+    frame.push_back(static_cast<char>(0x80 | payload.size()));
+    // an all zero masking key leaves the payload as is
+    frame.append(4, '\0');
+    frame.append(payload);
+    return frame;
+}
+
+} // namespace allocation_test
+
+#endif // WEBSOCKETPP_TEST_ALLOCATION_TEST_HPP
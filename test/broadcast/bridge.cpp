@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_MODULE broadcast_bridge
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/broadcast/batch.hpp>
+#include <websocketpp/broadcast/bridge.hpp>
+
+#include <string>
+
+namespace broadcast = websocketpp::broadcast;
+using websocketpp::frame::opcode::text;
+using websocketpp::frame::opcode::binary;
+
+BOOST_AUTO_TEST_CASE( batch_round_trip ) {
+    std::string big(70000, 'x');
+
+    broadcast::batch_writer w;
+    BOOST_CHECK( w.empty() );
+    w.append("prices", text, "one");
+    w.append("", binary, "");
+    w.append("prices", binary, big);
+    w.append(std::string(200, 't'), text, "four");
+
+    BOOST_CHECK_EQUAL( w.count(), 4 );
+    BOOST_CHECK_EQUAL( w.size(),
+        broadcast::batch_writer::record_size("prices", "one") +
+        broadcast::batch_writer::record_size("", "") +
+        broadcast::batch_writer::record_size("prices", big) +
+        broadcast::batch_writer::record_size(std::string(200, 't'), "four") );
+
+    std::string batch;
+    w.take(batch);
+    BOOST_CHECK( w.empty() );
+    BOOST_CHECK_EQUAL( w.size(), 0 );
+    BOOST_CHECK_EQUAL( batch.size(),
+        broadcast::batch_writer::record_size("prices", "one") +
+        broadcast::batch_writer::record_size("", "") +
+        broadcast::batch_writer::record_size("prices", big) +
+        broadcast::batch_writer::record_size(std::string(200, 't'), "four") );
+
+    broadcast::batch_reader r(batch);
+    std::string topic;
+    std::string payload;
+    websocketpp::frame::opcode::value op;
+    websocketpp::lib::error_code ec;
+
+    BOOST_REQUIRE( r.next(topic, op, payload, ec) );
+    BOOST_CHECK_EQUAL( topic, "prices" );
+    BOOST_CHECK_EQUAL( op, text );
+    BOOST_CHECK_EQUAL( payload, "one" );
+
+    BOOST_REQUIRE( r.next(topic, op, payload, ec) );
+    BOOST_CHECK_EQUAL( topic, "" );
+    BOOST_CHECK_EQUAL( op, binary );
+    BOOST_CHECK_EQUAL( payload, "" );
+
+    BOOST_REQUIRE( r.next(topic, op, payload, ec) );
+    BOOST_CHECK_EQUAL( topic, "prices" );
+    BOOST_CHECK( payload == big );
+
+    BOOST_REQUIRE( r.next(topic, op, payload, ec) );
+    BOOST_CHECK_EQUAL( topic, std::string(200, 't') );
+    BOOST_CHECK_EQUAL( payload, "four" );
+
+    BOOST_CHECK( !r.next(topic, op, payload, ec) );
+    BOOST_CHECK( !ec );
+}
+
+BOOST_AUTO_TEST_CASE( batch_truncated ) {
+    broadcast::batch_writer w;
+    w.append("a", text, "first");
+    w.append("b", binary, std::string(300, 'y'));
+
+    std::string batch;
+    w.take(batch);
+    size_t first = broadcast::batch_writer::record_size("a", "first");
+
+    // Every prefix ends cleanly on a record boundary or fails
+    for (size_t len = 0; len < batch.size(); ++len) {
+        std::string prefix = batch.substr(0, len);
+        broadcast::batch_reader r(prefix);
+        std::string topic;
+        std::string payload;
+        websocketpp::frame::opcode::value op;
+        websocketpp::lib::error_code ec;
+
+        size_t records = 0;
+        while (r.next(topic, op, payload, ec)) {
+            ++records;
+        }
+        BOOST_CHECK_EQUAL( records, (len >= first ? 1 : 0) );
+        if (len == 0 || len == first) {
+            BOOST_CHECK( !ec );
+        } else {
+            BOOST_CHECK_EQUAL( ec, broadcast::error::make_error_code(
+                broadcast::error::invalid_batch) );
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( batch_invalid_opcode ) {
+    std::string batch;
+    batch.push_back(1);
+    batch.push_back('a');
+    batch.push_back(0x9); // ping
+    batch.push_back(0);
+
+    broadcast::batch_reader r(batch);
+    std::string topic;
+    std::string payload;
+    websocketpp::frame::opcode::value op;
+    websocketpp::lib::error_code ec;
+
+    BOOST_CHECK( !r.next(topic, op, payload, ec) );
+    BOOST_CHECK_EQUAL( ec, broadcast::error::make_error_code(
+        broadcast::error::invalid_batch) );
+}
+
+BOOST_AUTO_TEST_CASE( batch_overlong_length ) {
+    std::string batch(11, static_cast<char>(0xFF));
+
+    broadcast::batch_reader r(batch);
+    std::string topic;
+    std::string payload;
+    websocketpp::frame::opcode::value op;
+    websocketpp::lib::error_code ec;
+
+    BOOST_CHECK( !r.next(topic, op, payload, ec) );
+    BOOST_CHECK_EQUAL( ec, broadcast::error::make_error_code(
+        broadcast::error::invalid_batch) );
+}
+
+BOOST_AUTO_TEST_CASE( registry_subscriptions ) {
+    websocketpp::lib::shared_ptr<int> a = websocketpp::lib::make_shared<int>(1);
+    websocketpp::lib::shared_ptr<int> b = websocketpp::lib::make_shared<int>(2);
+    websocketpp::connection_hdl ha = a;
+    websocketpp::connection_hdl hb = b;
+
+    broadcast::topic_registry r;
+    BOOST_CHECK( r.subscribers("x") == NULL );
+
+    r.subscribe("x", ha);
+    r.subscribe("x", hb);
+    r.subscribe("x", ha);
+    r.subscribe("y", ha);
+
+    BOOST_REQUIRE( r.subscribers("x") != NULL );
+    BOOST_CHECK_EQUAL( r.subscribers("x")->size(), 2 );
+    BOOST_CHECK_EQUAL( r.subscribers("y")->size(), 1 );
+    BOOST_CHECK_EQUAL( r.topics(), 2 );
+
+    r.unsubscribe("x", hb);
+    BOOST_CHECK_EQUAL( r.subscribers("x")->size(), 1 );
+
+    r.unsubscribe_all(ha);
+    BOOST_CHECK( r.subscribers("x") == NULL );
+    BOOST_CHECK( r.subscribers("y") == NULL );
+    BOOST_CHECK_EQUAL( r.topics(), 0 );
+
+    // Unknown connections and topics are ignored
+    r.unsubscribe("z", hb);
+    r.unsubscribe_all(hb);
+    BOOST_CHECK_EQUAL( r.topics(), 0 );
+}
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_MODULE broadcast_bridge_asio
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/broadcast/bridge.hpp>
+
+#include <websocketpp/client.hpp>
+#include <websocketpp/server.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef websocketpp::server<websocketpp::config::asio> server;
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+typedef websocketpp::broadcast::bridge<server,client> bridge;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+namespace asio = websocketpp::lib::asio;
+
+typedef websocketpp::lib::lock_guard<websocketpp::lib::mutex> scoped_lock;
+
+void run(asio::io_service * ios) {
+    ios->run();
+}
+
+void pause(long ms) {
+    asio::io_service ios;
+    asio::steady_timer timer(ios, websocketpp::lib::chrono::milliseconds(ms));
+    timer.wait();
+}
+
+// Small socket buffers so that a peer that stops reading pushes back quickly
+template <typename endpoint>
+void small_buffers(endpoint * e, websocketpp::connection_hdl hdl) {
+    asio::ip::tcp::socket & s = e->get_con_from_hdl(hdl)->get_socket();
+    s.set_option(asio::socket_base::send_buffer_size(4096));
+    s.set_option(asio::socket_base::receive_buffer_size(4096));
+}
+
+std::string make_uri(server & s) {
+    asio::error_code ec;
+    std::stringstream uri;
+    uri << "ws://127.0.0.1:" << s.get_local_endpoint(ec).port();
+    return uri.str();
+}
+
+void listen(server & s) {
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_reuse_addr(true);
+    s.listen(asio::ip::tcp::endpoint(
+        asio::ip::address::from_string("127.0.0.1"), 0));
+    s.start_accept();
+}
+
+/// A server instance with its bridge. Clients send "sub <topic>" and are
+/// answered "subscribed".
+struct node {
+    explicit node(asio::io_service & ios) : b(s, c) {
+        s.init_asio(&ios);
+        s.set_validate_handler(bind(&node::on_validate,this,_1));
+        s.set_message_handler(bind(&node::on_message,this,_1,_2));
+        s.set_close_handler(bind(&bridge::on_close,&b,_1));
+        listen(s);
+
+        c.clear_access_channels(websocketpp::log::alevel::all);
+        c.clear_error_channels(websocketpp::log::elevel::all);
+        c.init_asio(&ios);
+        c.set_tcp_post_init_handler(bind(&small_buffers<client>,&c,_1));
+    }
+
+    bool on_validate(websocketpp::connection_hdl hdl) {
+        b.validate(hdl);
+        return true;
+    }
+
+    void on_message(websocketpp::connection_hdl hdl, server::message_ptr msg) {
+        if (b.on_message(hdl, msg)) {
+            return;
+        }
+        b.subscribe(msg->get_payload().substr(4), hdl);
+        s.send(hdl, "subscribed", websocketpp::frame::opcode::text);
+    }
+
+    bool connected() const {
+        std::vector<bridge::peer_status> peers = b.get_peers();
+        for (size_t i = 0; i < peers.size(); ++i) {
+            if (!peers[i].connected) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    server s;
+    client c;
+    bridge b;
+};
+
+/// Three bridged nodes with one subscriber each, on one io_service thread
+struct fixture {
+    fixture() : work(new asio::io_service::work(ios)) {
+        for (size_t i = 0; i < 3; ++i) {
+            nodes.push_back(websocketpp::lib::make_shared<node>(
+                websocketpp::lib::ref(ios)));
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            for (size_t j = 0; j < nodes.size(); ++j) {
+                if (i != j) {
+                    nodes[i]->b.add_peer(make_uri(nodes[j]->s));
+                }
+            }
+        }
+
+        subs.clear_access_channels(websocketpp::log::alevel::all);
+        subs.clear_error_channels(websocketpp::log::elevel::all);
+        subs.init_asio(&ios);
+        received.resize(nodes.size());
+        ready = 0;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            websocketpp::lib::error_code ec;
+            client::connection_ptr con = subs.get_connection(
+                make_uri(nodes[i]->s), ec);
+            BOOST_REQUIRE(!ec);
+            con->set_open_handler(bind(&fixture::on_sub_open,this,_1));
+            con->set_message_handler(bind(&fixture::on_sub_message,this,i,_1,
+                _2));
+            subs.connect(con);
+        }
+
+        thread = websocketpp::lib::thread(bind(&run,&ios));
+    }
+
+    ~fixture() {
+        work.reset();
+        ios.stop();
+        thread.join();
+    }
+
+    void on_sub_open(websocketpp::connection_hdl hdl) {
+        subs.send(hdl, "sub t", websocketpp::frame::opcode::text);
+    }
+
+    void on_sub_message(size_t index, websocketpp::connection_hdl,
+        client::message_ptr msg)
+    {
+        scoped_lock lock(mutex);
+        if (msg->get_payload() == "subscribed") {
+            ready++;
+        } else {
+            received[index].push_back(msg->get_payload());
+        }
+    }
+
+    bool linked() {
+        scoped_lock lock(mutex);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!nodes[i]->connected()) {
+                return false;
+            }
+        }
+        return ready == nodes.size();
+    }
+
+    size_t count(size_t index) {
+        scoped_lock lock(mutex);
+        return received[index].size();
+    }
+
+    std::vector<std::string> messages(size_t index) {
+        scoped_lock lock(mutex);
+        return received[index];
+    }
+
+    asio::io_service ios;
+    websocketpp::lib::shared_ptr<asio::io_service::work> work;
+    std::vector<websocketpp::lib::shared_ptr<node> > nodes;
+    client subs;
+    websocketpp::lib::thread thread;
+
+    websocketpp::lib::mutex mutex;
+    size_t ready;
+    std::vector<std::vector<std::string> > received;
+};
+
+template <typename predicate>
+bool wait_until(predicate p) {
+    for (int i = 0; i < 1000; ++i) {
+        if (p()) {
+            return true;
+        }
+        pause(10);
+    }
+    return false;
+}
+
+struct all_linked {
+    explicit all_linked(fixture & f) : f(f) {}
+    bool operator()() const { return f.linked(); }
+    fixture & f;
+};
+
+struct received_at_least {
+    received_at_least(fixture & f, size_t index, size_t n)
+      : f(f), index(index), n(n) {}
+    bool operator()() const { return f.count(index) >= n; }
+    fixture & f;
+    size_t index;
+    size_t n;
+};
+
+std::string label(size_t origin, size_t seq) {
+    std::stringstream s;
+    s << origin << ":" << seq;
+    return s.str();
+}
+
+void publish_many(bridge * b, size_t origin, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        b->publish("t", label(origin, i));
+    }
+}
+
+BOOST_AUTO_TEST_CASE( per_topic_order_across_nodes ) {
+    fixture f;
+    BOOST_REQUIRE( wait_until(all_linked(f)) );
+
+    // two nodes publish at the same time, from threads other than the one
+    // delivering batches from peers
+    size_t const n = 500;
+    websocketpp::lib::thread other(bind(&publish_many,&f.nodes[1]->b,1,n));
+    publish_many(&f.nodes[0]->b, 0, n);
+    other.join();
+
+    for (size_t i = 0; i < f.nodes.size(); ++i) {
+        BOOST_REQUIRE( wait_until(received_at_least(f, i, 2 * n)) );
+
+        // the messages of each publishing node arrive in order
+        std::vector<std::string> got = f.messages(i);
+        BOOST_CHECK_EQUAL( got.size(), 2 * n );
+        size_t next[2] = {0, 0};
+        for (size_t j = 0; j < got.size(); ++j) {
+            size_t origin = got[j][0] - '0';
+            BOOST_REQUIRE( origin < 2 );
+            BOOST_CHECK_EQUAL( got[j], label(origin, next[origin]) );
+            next[origin]++;
+        }
+    }
+}
+
+bool select_bridge(server * s, websocketpp::connection_hdl hdl) {
+    s->get_con_from_hdl(hdl)->select_subprotocol(bridge::subprotocol());
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE( backpressure_from_stalled_peer ) {
+    fixture f;
+
+    // a peer that completes the handshake and then never reads again
+    asio::io_service stalled_ios;
+    server stalled;
+    stalled.init_asio(&stalled_ios);
+    stalled.set_validate_handler(bind(&select_bridge,&stalled,_1));
+    stalled.set_tcp_post_init_handler(bind(&small_buffers<server>,&stalled,
+        _1));
+    listen(stalled);
+    websocketpp::lib::thread stalled_thread(bind(&run,&stalled_ios));
+
+    bridge & b = f.nodes[0]->b;
+    b.set_high_water(64 * 1024);
+    b.set_max_queued(256 * 1024);
+    b.add_peer(make_uri(stalled));
+    BOOST_REQUIRE( wait_until(all_linked(f)) );
+    stalled_ios.stop();
+    stalled_thread.join();
+
+    // publish until the queue for the stalled peer stays full
+    std::string payload(16 * 1024, 'x');
+    size_t published = 0;
+    bool blocked = false;
+    for (size_t i = 0; i < 10000 && !blocked; ++i) {
+        websocketpp::lib::error_code ec;
+        b.publish("t", label(0, published) + payload,
+            websocketpp::frame::opcode::text, ec);
+        if (ec) {
+            BOOST_REQUIRE_EQUAL( ec, websocketpp::broadcast::error::
+                make_error_code(websocketpp::broadcast::error::backpressure) );
+            pause(100);
+            b.publish("t", label(0, published) + payload,
+                websocketpp::frame::opcode::text, ec);
+            blocked = !!ec;
+        }
+        if (!ec) {
+            published++;
+        }
+    }
+    BOOST_REQUIRE( blocked );
+
+    std::vector<bridge::peer_status> peers = b.get_peers();
+    BOOST_REQUIRE_EQUAL( peers.size(), 3 );
+    BOOST_CHECK( peers[2].connected );
+    BOOST_CHECK( peers[2].queued <= 256 * 1024 );
+
+    // refused messages are delivered nowhere, accepted ones everywhere else
+    for (size_t i = 0; i < f.nodes.size(); ++i) {
+        BOOST_REQUIRE( wait_until(received_at_least(f, i, published)) );
+    }
+    pause(100);
+    for (size_t i = 0; i < f.nodes.size(); ++i) {
+        std::vector<std::string> got = f.messages(i);
+        BOOST_REQUIRE_EQUAL( got.size(), published );
+        for (size_t j = 0; j < got.size(); ++j) {
+            BOOST_CHECK( got[j] == label(0, j) + payload );
+        }
+    }
+}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE broadcast_deflate_stream
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/broadcast/deflate_stream.hpp>
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/processors/hybi13.hpp>
+#include <websocketpp/server.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct deflate_config : public websocketpp::config::core {
+    typedef websocketpp::extensions::permessage_deflate::enabled
+        <permessage_deflate_config> permessage_deflate_type;
+
+    static const websocketpp::log::level elog_level =
+        websocketpp::log::elevel::none;
+    static const websocketpp::log::level alog_level =
+        websocketpp::log::alevel::none;
+};
+
+typedef websocketpp::server<deflate_config> server;
+typedef websocketpp::broadcast::deflate_stream
+    <deflate_config::concurrency_type> stream_type;
+typedef websocketpp::broadcast::message_ptr broadcast_ptr;
+
+using websocketpp::frame::opcode::text;
+
+std::string payload(int i) {
+    std::stringstream s;
+    s << "the quick brown fox jumps over the lazy dog " << i;
+    return s.str();
+}
+
+server::connection_ptr open_connection(server & s, std::ostream & out) {
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\nSec-WebSocket-Extensions: permessage-deflate\r\n\r\n";
+
+    server::connection_ptr con = s.get_connection();
+    con->register_ostream(&out);
+    con->start();
+    con->read_all(input.data(), input.size());
+    return con;
+}
+
+struct received {
+    std::string payload;
+    bool compressed;
+};
+
+// Decode the frames a server connection wrote as its client would
+std::vector<received> decode(server::connection_ptr con, std::string wire) {
+    deflate_config::con_msg_manager_type::ptr manager(
+        new deflate_config::con_msg_manager_type());
+    deflate_config::rng_type rng;
+    websocketpp::processor::hybi13<deflate_config> p(false,false,manager,rng);
+
+    deflate_config::response_type res;
+    res.replace_header("Sec-WebSocket-Extensions",
+        con->get_response_header("Sec-WebSocket-Extensions"));
+    BOOST_REQUIRE( !p.negotiate_extensions(res).first );
+
+    std::vector<received> out;
+
+    size_t start = wire.find("\r\n\r\n");
+    BOOST_REQUIRE( start != std::string::npos );
+    start += 4;
+
+    websocketpp::lib::error_code ec;
+    while (start < wire.size()) {
+        start += p.consume(reinterpret_cast<uint8_t *>(&wire[start]),
+            wire.size()-start, ec);
+        BOOST_REQUIRE( !ec );
+
+        while (p.ready()) {
+            deflate_config::message_type::ptr msg = p.get_message();
+            received r;
+            r.payload = msg->get_payload();
+            r.compressed = msg->get_compressed();
+            out.push_back(r);
+        }
+    }
+
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE( reset_points ) {
+    stream_type s(15,3);
+    websocketpp::lib::error_code ec;
+
+    for (int i = 0; i < 7; i++) {
+        broadcast_ptr msg = s.prepare(payload(i),text,ec);
+        BOOST_REQUIRE( !ec );
+        BOOST_CHECK_EQUAL( msg->sequence, i );
+        BOOST_CHECK_EQUAL( msg->reset, i % 3 == 0 );
+        BOOST_CHECK_EQUAL( msg->window_bits, 15 );
+        BOOST_CHECK_EQUAL( msg->payload, payload(i) );
+    }
+
+    s.request_reset();
+    BOOST_CHECK( s.prepare("",text,ec)->reset );
+    BOOST_CHECK( !s.prepare("",text,ec)->reset );
+}
+
+BOOST_AUTO_TEST_CASE( history_shrinks_messages ) {
+    stream_type s(15,64);
+    websocketpp::lib::error_code ec;
+
+    broadcast_ptr first = s.prepare(payload(1),text,ec);
+    broadcast_ptr second = s.prepare(payload(2),text,ec);
+
+    // the second message refers back to the first
+    BOOST_CHECK( second->compressed.size() < first->compressed.size() );
+    BOOST_CHECK( first->stream == second->stream );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_messages ) {
+    stream_type s;
+    websocketpp::lib::error_code ec;
+
+    BOOST_CHECK( !s.prepare("a",websocketpp::frame::opcode::ping,ec) );
+    BOOST_CHECK_EQUAL( ec, websocketpp::processor::error::invalid_opcode );
+
+    BOOST_CHECK( !s.prepare("\xff",text,ec) );
+    BOOST_CHECK_EQUAL( ec, websocketpp::processor::error::invalid_payload );
+
+    // window sizes are clamped to what zlib supports
+    BOOST_CHECK_EQUAL( stream_type(8).get_window_bits(), 9 );
+}
+
+BOOST_AUTO_TEST_CASE( subscribers_join_at_reset_points ) {
+    server s;
+    stream_type topic(15,3);
+    websocketpp::lib::error_code ec;
+
+    std::stringstream out_a, out_b;
+    server::connection_ptr a = open_connection(s,out_a);
+    BOOST_REQUIRE_EQUAL( a->get_state(), websocketpp::session::state::open );
+
+    std::vector<broadcast_ptr> msgs;
+    for (int i = 0; i < 8; i++) {
+        msgs.push_back(topic.prepare(payload(i),text,ec));
+        BOOST_REQUIRE( !ec );
+    }
+
+    // a receives 0 to 3 compressed
+    for (int i = 0; i < 4; i++) {
+        BOOST_CHECK( !a->send_broadcast(msgs[i]) );
+    }
+
+    // b joins after the reset point at 0 and receives 1 and 2 uncompressed,
+    // then the rest compressed from the reset point at 3
+    server::connection_ptr b = open_connection(s,out_b);
+    for (int i = 1; i < 6; i++) {
+        BOOST_CHECK( !b->send_broadcast(msgs[i]) );
+    }
+
+    // a compresses a message of its own, which puts it out of step until
+    // the reset point at 6
+    BOOST_CHECK( !a->send(payload(100)) );
+    for (int i = 4; i < 8; i++) {
+        BOOST_CHECK( !a->send_broadcast(msgs[i]) );
+    }
+    BOOST_CHECK( !a->send(payload(101)) );
+
+    std::vector<received> ra = decode(a,out_a.str());
+    BOOST_REQUIRE_EQUAL( ra.size(), 10 );
+
+    bool const a_compressed[10] = {true, true, true, true, true, false, false,
+        true, true, true};
+    std::string const a_payloads[10] = {payload(0), payload(1), payload(2),
+        payload(3), payload(100), payload(4), payload(5), payload(6),
+        payload(7), payload(101)};
+    for (int i = 0; i < 10; i++) {
+        BOOST_CHECK_EQUAL( ra[i].payload, a_payloads[i] );
+        BOOST_CHECK_EQUAL( ra[i].compressed, a_compressed[i] );
+    }
+
+    std::vector<received> rb = decode(b,out_b.str());
+    BOOST_REQUIRE_EQUAL( rb.size(), 5 );
+    for (int i = 0; i < 5; i++) {
+        BOOST_CHECK_EQUAL( rb[i].payload, payload(i+1) );
+        BOOST_CHECK_EQUAL( rb[i].compressed, i >= 2 );
+    }
+
+    // both subscribers got the same bytes for the shared messages
+    std::string const & shared = msgs[6]->compressed;
+    BOOST_CHECK( out_a.str().find(shared) != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( uncompressed_connections ) {
+    server s;
+    stream_type topic;
+    websocketpp::lib::error_code ec;
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+    std::stringstream out;
+
+    server::connection_ptr con = s.get_connection();
+    con->register_ostream(&out);
+    con->start();
+    con->read_all(input.data(), input.size());
+
+    BOOST_CHECK( !con->send_broadcast(topic.prepare("abc",text,ec)) );
+
+    std::string wire = out.str();
+    BOOST_CHECK_EQUAL( wire.substr(wire.size()-5), std::string("\x81\x03" "abc",5) );
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <boost/test/unit_test.hpp>
+
+#include "../alloc_counter.hpp"
+#include "../allocation_test.hpp"
+#include "../recycling_msg_manager.hpp"
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/server.hpp>
+
+#include <string>
+#include <vector>
+
+// Allocation tests for the connection read and write paths
+//
+// Each test opens server connections over the iostream transport, warms them
+// up so that buffers reach their steady state capacity, and then counts the
+// heap allocations made while handling a batch of messages. The bounds are
+// per message and hold for both the default message manager, which allocates
+// every message, and a manager that recycles them.
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::placeholders::_3;
+using websocketpp::lib::bind;
+
+namespace {
+
+using allocation_test::warm_up;
+using allocation_test::messages;
+using allocation_test::fan_out;
+using allocation_test::client_frame;
+
+std::string const handshake =
+    "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\n"
+    "Upgrade: websocket\r\nSec-WebSocket-Version: 13\r\n"
+    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+    "Origin: http://www.example.com\r\n\r\n";
+
+websocketpp::lib::error_code on_write(std::string * out,
+    websocketpp::connection_hdl, char const * data, size_t len)
+{
+    out->append(data,len);
+    return websocketpp::lib::error_code();
+}
+
+template <typename config>
+struct fixture {
+    typedef websocketpp::server<config> server_type;
+    typedef typename server_type::connection_ptr connection_ptr;
+    typedef typename config::message_type::ptr message_ptr;
+
+    typedef void (fixture::*handler)(websocketpp::connection_hdl, message_ptr);
+
+    fixture(size_t connections, handler h) : received(0) {
+        s.clear_access_channels(websocketpp::log::alevel::all);
+        s.clear_error_channels(websocketpp::log::elevel::all);
+        // connections copy the handlers when they are created
+        s.set_message_handler(bind(h,this,_1,_2));
+
+        // Sized up front so that appends during the measured section only
+        // reuse capacity.
+        output.reserve(64 * 1024);
+
+        for (size_t i = 0; i < connections; ++i) {
+            connection_ptr con = s.get_connection();
+            con->set_write_handler(bind(&on_write,&output,_1,_2,_3));
+            con->start();
+            con->read_all(handshake.data(),handshake.size());
+            cons.push_back(con);
+        }
+        output.clear();
+    }
+
+    void echo(websocketpp::connection_hdl hdl, message_ptr msg) {
+        ++received;
+        s.send(hdl,msg->get_payload(),msg->get_opcode());
+    }
+
+    void count(websocketpp::connection_hdl, message_ptr) {
+        ++received;
+    }
+
+    void broadcast(websocketpp::connection_hdl, message_ptr msg) {
+        ++received;
+        for (size_t i = 0; i < cons.size(); ++i) {
+            cons[i]->send(msg);
+        }
+    }
+
+    void read(connection_ptr con, std::string const & data) {
+        con->read_all(data.data(),data.size());
+        output.clear();
+    }
+
+    server_type s;
+    std::vector<connection_ptr> cons;
+    std::string output;
+    size_t received;
+};
+
+/// Allocations per message while reading `frames` on the first connection
+template <typename config>
+double per_message(fixture<config> & f, std::string const & frames) {
+    for (size_t i = 0; i < warm_up; ++i) {
+        f.read(f.cons[0],frames);
+    }
+
+    alloc_counter::counts before = alloc_counter::snapshot();
+    for (size_t i = 0; i < messages; ++i) {
+        f.read(f.cons[0],frames);
+    }
+    return static_cast<double>(alloc_counter::allocations_since(before)) /
+        messages;
+}
+
+template <typename config>
+double receive_allocations() {
+    fixture<config> f(1,&fixture<config>::count);
+
+    std::string frames = client_frame(websocketpp::frame::opcode::text,true,
+        std::string(100,'r'));
+    double result = per_message(f,frames);
+
+    BOOST_CHECK_EQUAL(f.received, warm_up + messages);
+    return result;
+}
+
+template <typename config>
+double echo_allocations() {
+    fixture<config> f(1,&fixture<config>::echo);
+
+    std::string frames = client_frame(websocketpp::frame::opcode::text,true,
+        std::string(100,'e'));
+    double result = per_message(f,frames);
+
+    BOOST_CHECK_EQUAL(f.received, warm_up + messages);
+    return result;
+}
+
+template <typename config>
+double fragmented_allocations() {
+    fixture<config> f(1,&fixture<config>::echo);
+
+    std::string frames;
+    frames += client_frame(websocketpp::frame::opcode::binary,false,
+        std::string(60,'a'));
+    frames += client_frame(websocketpp::frame::opcode::continuation,false,
+        std::string(60,'b'));
+    frames += client_frame(websocketpp::frame::opcode::continuation,true,
+        std::string(60,'c'));
+    double result = per_message(f,frames);
+
+    BOOST_CHECK_EQUAL(f.received, warm_up + messages);
+    return result;
+}
+
+template <typename config>
+double send_allocations() {
+    fixture<config> f(1,&fixture<config>::count);
+    std::string payload(100,'s');
+
+    for (size_t i = 0; i < warm_up; ++i) {
+        f.cons[0]->send(payload,websocketpp::frame::opcode::text);
+        f.output.clear();
+    }
+
+    alloc_counter::counts before = alloc_counter::snapshot();
+    for (size_t i = 0; i < messages; ++i) {
+        f.cons[0]->send(payload,websocketpp::frame::opcode::text);
+        f.output.clear();
+    }
+    return static_cast<double>(alloc_counter::allocations_since(before)) /
+        messages;
+}
+
+/// Allocations per delivered message when one read is sent to every connection
+template <typename config>
+double broadcast_allocations() {
+    fixture<config> f(fan_out,&fixture<config>::broadcast);
+
+    std::string frames = client_frame(websocketpp::frame::opcode::text,true,
+        std::string(100,'b'));
+    double result = per_message(f,frames) / fan_out;
+
+    BOOST_CHECK_EQUAL(f.received, warm_up + messages);
+    return result;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( allocation_counter_counts_this_thread ) {
+    alloc_counter::counts before = alloc_counter::snapshot();
+    std::vector<int> * v = new std::vector<int>(10);
+    BOOST_CHECK_EQUAL(alloc_counter::allocations_since(before), 2);
+    delete v;
+    BOOST_CHECK_EQUAL(alloc_counter::deallocations_since(before), 2);
+}
+
+// The bounds below are the measured steady state counts rounded up. With the
+// recycling manager what remains are the handler objects that the transport
+// interface copies. Lower them when a change removes allocations.
+
+BOOST_AUTO_TEST_CASE( allocations_per_message_received ) {
+    BOOST_CHECK_LE( receive_allocations<websocketpp::config::core>(), 3 );
+    BOOST_CHECK_LE( receive_allocations<recycling_config>(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_message_echoed ) {
+    BOOST_CHECK_LE( echo_allocations<websocketpp::config::core>(), 10 );
+    BOOST_CHECK_LE( echo_allocations<recycling_config>(), 4 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_fragmented_message_echoed ) {
+    BOOST_CHECK_LE( fragmented_allocations<websocketpp::config::core>(), 12 );
+    BOOST_CHECK_LE( fragmented_allocations<recycling_config>(), 4 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_message_sent ) {
+    BOOST_CHECK_LE( send_allocations<websocketpp::config::core>(), 7 );
+    BOOST_CHECK_LE( send_allocations<recycling_config>(), 3 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_message_broadcast ) {
+    BOOST_CHECK_LE( broadcast_allocations<websocketpp::config::core>(), 5 );
+    BOOST_CHECK_LE( broadcast_allocations<recycling_config>(), 3 );
+}
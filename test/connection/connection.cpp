@@ -33,6 +33,8 @@
 // Include special debugging transport
 //#include <websocketpp/config/minimal_client.hpp>
 #include <websocketpp/transport/debug/endpoint.hpp>
+#include <websocketpp/extensions/message_batching/enabled.hpp>
+#include <websocketpp/common/thread.hpp>
 
 // NOTE: these tests currently test against hardcoded output values. I am not
 // sure how problematic this will be. If issues arise like order of headers the
@@ -228,6 +230,47 @@ BOOST_AUTO_TEST_CASE( basic_websocket_request ) {
     BOOST_CHECK(run_server_test(s,input) == output);
 }
 
+BOOST_AUTO_TEST_CASE( endpoint_counters ) {
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nOrigin: http://www.example.com\r\n\r\n";
+    // masked text frame "Hi", then a masked close frame
+    input += std::string("\x81\x82\x00\x00\x00\x00Hi",8);
+    input += std::string("\x88\x82\x00\x00\x00\x00\x03\xe8",8);
+
+    websocketpp::metrics::endpoint_counters counters;
+
+    server s;
+    s.set_counters(&counters);
+    s.set_message_handler(bind(&echo_func,&s,::_1,::_2));
+    run_server_test(s,input);
+
+    BOOST_CHECK_EQUAL( counters.connections_opened, 1 );
+    BOOST_CHECK_EQUAL( counters.connections_failed, 0 );
+    BOOST_CHECK_EQUAL( counters.messages_in, 1 );
+    BOOST_CHECK_EQUAL( counters.messages_out, 1 );
+    BOOST_CHECK_EQUAL( counters.bytes_in, 16 );
+    BOOST_CHECK( counters.bytes_out >= 4 );
+    BOOST_CHECK_EQUAL( counters.connections_started, 1 );
+    BOOST_CHECK_EQUAL( counters.connections_connecting(), 0 );
+    BOOST_CHECK_EQUAL( counters.http_requests, 0 );
+    BOOST_CHECK_EQUAL( counters.queued_bytes, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( endpoint_counters_http ) {
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+
+    websocketpp::metrics::endpoint_counters counters;
+
+    server s;
+    s.set_counters(&counters);
+    s.set_http_handler(bind(&http_func,&s,::_1));
+    run_server_test(s,input);
+
+    BOOST_CHECK_EQUAL( counters.connections_started, 1 );
+    BOOST_CHECK_EQUAL( counters.http_requests, 1 );
+    BOOST_CHECK_EQUAL( counters.connections_failed, 0 );
+    BOOST_CHECK_EQUAL( counters.connections_connecting(), 0 );
+}
+
 BOOST_AUTO_TEST_CASE( http_request ) {
     std::string input = "GET /foo/bar HTTP/1.1\r\nHost: www.example.com\r\nOrigin: http://www.example.com\r\n\r\n";
     std::string output = "HTTP/1.1 200 OK\r\nContent-Length: 8\r\nServer: ";
@@ -360,6 +403,70 @@ BOOST_AUTO_TEST_CASE( websocket_fail_parse_error ) {
     BOOST_CHECK(called);
 }
 
+// A logger policy written before loggers could rate limit keyed messages
+class legacy_log {
+public:
+    explicit legacy_log(websocketpp::log::channel_type_hint::value) {}
+    legacy_log(websocketpp::log::level,
+        websocketpp::log::channel_type_hint::value) {}
+    legacy_log() {}
+
+    void set_channels(websocketpp::log::level) {}
+    void clear_channels(websocketpp::log::level) {}
+
+    void write(websocketpp::log::level, std::string const & msg) {
+        written().push_back(msg);
+    }
+    void write(websocketpp::log::level l, char const * msg) {
+        write(l, std::string(msg));
+    }
+
+    bool static_test(websocketpp::log::level) const { return true; }
+    bool dynamic_test(websocketpp::log::level) { return true; }
+
+    static std::vector<std::string> & written() {
+        static std::vector<std::string> lines;
+        return lines;
+    }
+};
+
+struct legacy_log_config : public debug_config_client {
+    typedef legacy_log_config type;
+    typedef legacy_log alog_type;
+    typedef legacy_log elog_type;
+
+    struct transport_config : public debug_config_client::transport_config {
+        typedef type::elog_type elog_type;
+        typedef type::alog_type alog_type;
+    };
+
+    typedef websocketpp::transport::debug::endpoint<transport_config>
+        transport_type;
+};
+
+BOOST_AUTO_TEST_CASE( logger_without_keyed_test ) {
+    BOOST_CHECK( !websocketpp::log::has_keyed_test<legacy_log>::value );
+
+    websocketpp::server<legacy_log_config> s;
+    legacy_log::written().clear();
+
+    // keyed messages fall back to the channel tests
+    std::string input = "asdf\r\n\r\n";
+    websocketpp::server<legacy_log_config>::connection_ptr con =
+        s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+
+    std::vector<std::string> const & lines = legacy_log::written();
+    bool failed = false;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        failed = failed ||
+            lines[i].find("WebSocket Connection") != std::string::npos;
+    }
+    BOOST_CHECK( failed );
+}
+
 BOOST_AUTO_TEST_CASE( websocket_fail_invalid_version ) {
     std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: foo\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nOrigin: http://www.example.com\r\n\r\n";
 
@@ -531,3 +638,883 @@ BOOST_AUTO_TEST_CASE( server_handshake_timeout_race2 ) {
 }
 
 
+
+void count_expired(std::vector<std::string> * payloads,
+    websocketpp::connection_hdl, debug_server::message_ptr msg)
+{
+    payloads->push_back(msg->get_payload());
+}
+
+debug_server::connection_ptr open_debug_server_connection(debug_server & s) {
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+
+    debug_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+
+    return con;
+}
+
+debug_server::message_ptr make_debug_message(debug_server::connection_ptr con,
+    websocketpp::frame::opcode::value op, std::string const & payload,
+    bool fin, bool expired)
+{
+    debug_server::message_ptr msg = con->get_message(op, payload.size());
+    msg->set_payload(payload);
+    msg->set_fin(fin);
+    if (expired) {
+        msg->set_deadline(debug_config_client::message_type::clock_type::now() -
+            websocketpp::lib::chrono::seconds(1));
+    } else {
+        msg->set_ttl(60000);
+    }
+    return msg;
+}
+
+BOOST_AUTO_TEST_CASE( expired_messages_are_dropped ) {
+    debug_server s;
+    std::vector<std::string> expired;
+    s.set_message_expired_handler(bind(&count_expired,&expired,::_1,::_2));
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    using websocketpp::frame::opcode::binary;
+
+    // The first message is handed to the transport immediately. The rest wait
+    // in the queue until that write completes.
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"a",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"b",true,true)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"c",true,false)));
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 2);
+
+    con->fullfil_write();
+
+    BOOST_CHECK_EQUAL(con->get_expired_message_count(), 1);
+    BOOST_REQUIRE_EQUAL(expired.size(), 1);
+    BOOST_CHECK_EQUAL(expired[0], "b");
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0);
+}
+
+void record_expired(std::vector<debug_server::message_ptr> * msgs,
+    websocketpp::connection_hdl, debug_server::message_ptr msg)
+{
+    msgs->push_back(msg);
+}
+
+BOOST_AUTO_TEST_CASE( expired_hybi00_messages_report_sent_message ) {
+    debug_server s;
+    std::vector<debug_server::message_ptr> expired;
+    s.set_message_expired_handler(bind(&record_expired,&expired,::_1,::_2));
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nOrigin: http://example.com\r\nSec-WebSocket-Key1: 3e6b263  4 17 80\r\nSec-WebSocket-Key2: 17  9 G`ZD9   2 2b 7X 3 /r90\r\n\r\nWjN}|M(6";
+
+    debug_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    using websocketpp::frame::opcode::text;
+
+    // hybi00 prepares messages when they are sent. The prepared copy that
+    // expires is reported as the message that was sent.
+    debug_server::message_ptr b = make_debug_message(con,text,"b",true,true);
+    BOOST_CHECK(!con->send(make_debug_message(con,text,"a",true,false)));
+    BOOST_CHECK(!con->send(b));
+    con->fullfil_write();
+
+    BOOST_CHECK_EQUAL(con->get_expired_message_count(), 1);
+    BOOST_REQUIRE_EQUAL(expired.size(), 1);
+    BOOST_CHECK(expired[0] == b);
+}
+
+BOOST_AUTO_TEST_CASE( expired_messages_respect_fragments ) {
+    debug_server s;
+    std::vector<std::string> expired;
+    s.set_message_expired_handler(bind(&count_expired,&expired,::_1,::_2));
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    using websocketpp::frame::opcode::binary;
+    using websocketpp::frame::opcode::continuation;
+
+    // An expired first fragment takes the rest of its message with it, even
+    // if those fragments have not expired.
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"a",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"b1",false,true)));
+    BOOST_CHECK(!con->send(make_debug_message(con,continuation,"b2",false,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,continuation,"b3",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"c1",false,false)));
+    con->fullfil_write();
+
+    BOOST_CHECK_EQUAL(con->get_expired_message_count(), 3);
+    BOOST_REQUIRE_EQUAL(expired.size(), 3);
+    BOOST_CHECK_EQUAL(expired[2], "b3");
+
+    // c1 is now on the wire, the remaining fragments of its message must be
+    // written even though they have expired.
+    BOOST_CHECK(!con->send(make_debug_message(con,continuation,"c2",true,true)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"d",true,true)));
+    con->fullfil_write();
+
+    BOOST_CHECK_EQUAL(con->get_expired_message_count(), 4);
+    BOOST_REQUIRE_EQUAL(expired.size(), 4);
+    BOOST_CHECK_EQUAL(expired[3], "d");
+}
+
+BOOST_AUTO_TEST_CASE( expired_first_fragment_without_ttl_tail ) {
+    debug_server s;
+    std::vector<std::string> expired;
+    s.set_message_expired_handler(bind(&count_expired,&expired,::_1,::_2));
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    using websocketpp::frame::opcode::binary;
+    using websocketpp::frame::opcode::continuation;
+
+    // Only the first fragment has a deadline. The fragments that follow must
+    // be dropped with it rather than written as orphan continuation frames.
+    debug_server::message_ptr b2 = make_debug_message(con,continuation,"b2",
+        false,false);
+    b2->clear_deadline();
+    debug_server::message_ptr b3 = make_debug_message(con,continuation,"b3",
+        true,false);
+    b3->clear_deadline();
+    debug_server::message_ptr c = make_debug_message(con,binary,"c",true,false);
+    c->clear_deadline();
+
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"a",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"b1",false,true)));
+    BOOST_CHECK(!con->send(b2));
+    BOOST_CHECK(!con->send(b3));
+    BOOST_CHECK(!con->send(c));
+    con->fullfil_write();
+
+    BOOST_CHECK_EQUAL(con->get_expired_message_count(), 3);
+    BOOST_REQUIRE_EQUAL(expired.size(), 3);
+    BOOST_CHECK_EQUAL(expired[0], "b1");
+    BOOST_CHECK_EQUAL(expired[1], "b2");
+    BOOST_CHECK_EQUAL(expired[2], "b3");
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0);
+}
+
+struct accounting_config : public debug_config_client {
+    static const bool enable_resource_accounting = true;
+    static const size_t heavy_hitter_capacity = 4;
+};
+
+typedef websocketpp::server<accounting_config> accounting_server;
+
+void ignore_message(websocketpp::connection_hdl, accounting_server::message_ptr) {}
+
+BOOST_AUTO_TEST_CASE( resource_accounting ) {
+    accounting_server s;
+    s.set_message_handler(bind(&ignore_message,::_1,::_2));
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+
+    accounting_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // Masked text frame "Hi"
+    char frame[8] = {char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'i'};
+    con->read_all(frame, 8);
+
+    websocketpp::metrics::connection_stats stats = con->get_resource_stats();
+    BOOST_CHECK_EQUAL(stats.bytes_in, 8);
+    BOOST_CHECK_EQUAL(stats.messages_in, 1);
+    BOOST_CHECK(stats.parse_cycles > 0);
+
+    BOOST_CHECK(!con->send(std::string("abc"), websocketpp::frame::opcode::text));
+    stats = con->get_resource_stats();
+    BOOST_CHECK(stats.prepare_cycles > 0);
+    BOOST_CHECK_EQUAL(stats.queue_bytes, 0);
+    BOOST_CHECK_EQUAL(stats.messages_out, 0);
+
+    con->fullfil_write();
+    stats = con->get_resource_stats();
+    BOOST_CHECK_EQUAL(stats.bytes_out, 5);
+    BOOST_CHECK_EQUAL(stats.messages_out, 1);
+
+    BOOST_CHECK(s.get_heavy_connections(4).size() <= 1);
+}
+
+struct eager_accounting_config : public accounting_config {
+    static const uint64_t heavy_hitter_report_cycles = 1;
+};
+
+typedef websocketpp::server<eager_accounting_config> eager_accounting_server;
+
+BOOST_AUTO_TEST_CASE( heavy_hitter_report_threshold ) {
+    eager_accounting_server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+
+    eager_accounting_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK(s.get_heavy_connections(4).empty());
+
+    // A connection that used only a few cycles is listed once it reaches the
+    // configured report threshold
+    char frame[8] = {char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'i'};
+    con->read_all(frame, 8);
+    BOOST_REQUIRE_EQUAL(s.get_heavy_connections(4).size(), 1);
+    BOOST_CHECK(s.get_heavy_connections(4)[0].count > 0);
+
+    // and removed when it ends
+    con->terminate(websocketpp::lib::error_code());
+    BOOST_CHECK(s.get_heavy_connections(4).empty());
+}
+
+struct quantum_config : public debug_config_client {
+    static const size_t write_quantum = 10;
+    static const size_t read_quantum_messages = 1;
+};
+
+typedef websocketpp::server<quantum_config> quantum_server;
+
+void collect_message(std::vector<std::string> * out, websocketpp::connection_hdl,
+    quantum_server::message_ptr msg)
+{
+    out->push_back(msg->get_payload());
+}
+
+BOOST_AUTO_TEST_CASE( write_and_read_quanta ) {
+    quantum_server s;
+    std::vector<std::string> received;
+    s.set_message_handler(bind(&collect_message,&received,::_1,::_2));
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+
+    quantum_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // Each message is a 2 byte header plus a 2 byte payload. The first goes
+    // out alone, the other five wait for it.
+    for (int i = 0; i < 6; i++) {
+        BOOST_CHECK(!con->send(std::string("ab"),
+            websocketpp::frame::opcode::binary));
+    }
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 10);
+
+    // A 10 byte quantum fits two messages and leaves 2 bytes of credit
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 6);
+
+    // which lets the next write take the remaining three
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0);
+
+    // Three masked text frames in a single read are all delivered even though
+    // the connection yields after each one.
+    char frames[24] = {
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'i',
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'o',
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'a'
+    };
+    BOOST_CHECK_EQUAL(con->read_all(frames, 24), 24);
+
+    BOOST_REQUIRE_EQUAL(received.size(), 3);
+    BOOST_CHECK_EQUAL(received[0], "Hi");
+    BOOST_CHECK_EQUAL(received[1], "Ho");
+    BOOST_CHECK_EQUAL(received[2], "Ha");
+}
+
+void pause_or_resume(quantum_server * s, std::vector<std::string> * out,
+    websocketpp::connection_hdl hdl, quantum_server::message_ptr msg)
+{
+    out->push_back(msg->get_payload());
+    if (msg->get_payload() == "Hp") {
+        s->get_con_from_hdl(hdl)->pause_reading();
+    } else if (msg->get_payload() == "Hr") {
+        s->get_con_from_hdl(hdl)->resume_reading();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( resume_while_read_quantum_yields ) {
+    quantum_server s;
+    std::vector<std::string> received;
+    s.set_message_handler(bind(&pause_or_resume,&s,&received,::_1,::_2));
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+
+    quantum_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // Reading is paused and resumed while the rest of the buffer waits for
+    // its next turn. The next read starts only once the buffer is consumed.
+    char frames[24] = {
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'p',
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'r',
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'i'
+    };
+    BOOST_CHECK_EQUAL(con->read_all(frames, 24), 24);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK_EQUAL(received.size(), 3);
+
+    BOOST_CHECK_EQUAL(con->read_all(frames+16, 8), 8);
+    BOOST_REQUIRE_EQUAL(received.size(), 4);
+    BOOST_CHECK_EQUAL(received[3], "Hi");
+}
+
+websocketpp::lib::error_code ping_on_first_write(server * s, std::string * out,
+    bool * armed, websocketpp::connection_hdl hdl, char const * buf, size_t len)
+{
+    out->append(buf,len);
+    if (*armed) {
+        *armed = false;
+        s->get_con_from_hdl(hdl)->ping("x");
+    }
+    return websocketpp::lib::error_code();
+}
+
+BOOST_AUTO_TEST_CASE( max_outbound_frame_size ) {
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_max_outbound_frame_size(4);
+
+    std::string out;
+    bool armed = false;
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\n\r\n";
+
+    server::connection_ptr con = s.get_connection();
+    BOOST_CHECK_EQUAL(con->get_max_outbound_frame_size(), 4);
+    con->set_write_handler(bind(&ping_on_first_write,&s,&out,&armed,::_1,
+        websocketpp::lib::placeholders::_2,websocketpp::lib::placeholders::_3));
+    con->start();
+    con->read_all(input.data(), input.size());
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // Payloads at the limit go out in one frame
+    out.clear();
+    BOOST_CHECK(!con->send(std::string("abcd"), websocketpp::frame::opcode::binary));
+    BOOST_CHECK_EQUAL(out, std::string("\x82\x04" "abcd",6));
+
+    // Larger ones are split. A ping sent while the first fragment is being
+    // written goes out before the second.
+    out.clear();
+    armed = true;
+    BOOST_CHECK(!con->send(std::string("0123456789"), websocketpp::frame::opcode::binary));
+    BOOST_CHECK_EQUAL(out, std::string("\x02\x04" "0123" "\x89\x01" "x"
+        "\x00\x04" "4567" "\x80\x02" "89",19));
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0);
+
+    // Invalid text is still rejected by send
+    BOOST_CHECK_EQUAL(con->send(std::string("\xc3\x28\xc3\x28\xc3\x28"),
+        websocketpp::frame::opcode::text),
+        websocketpp::processor::error::invalid_payload);
+}
+
+void count_close(int * count, websocketpp::connection_hdl) {
+    (*count)++;
+}
+
+// Transport connections written before async_abort was added
+struct shutdown_only_con {
+protected:
+    void async_shutdown(websocketpp::transport::shutdown_handler) {}
+};
+
+struct protected_abort_con {
+protected:
+    void async_abort(websocketpp::transport::shutdown_handler) {}
+};
+
+BOOST_AUTO_TEST_CASE( transport_async_abort_is_optional ) {
+    using websocketpp::transport::has_async_abort;
+
+    BOOST_CHECK( has_async_abort<debug_config_client::transport_type::transport_con_type>::value );
+    BOOST_CHECK( has_async_abort<protected_abort_con>::value );
+    BOOST_CHECK( !has_async_abort<shutdown_only_con>::value );
+}
+
+BOOST_AUTO_TEST_CASE( fast_close_drops_backlog ) {
+    debug_server s;
+    int closed = 0;
+    s.set_close_handler(bind(&count_close,&closed,::_1));
+    s.set_fast_close(true);
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK(con->get_fast_close());
+
+    using websocketpp::frame::opcode::binary;
+
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"a",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"bbbb",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"cccc",true,false)));
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 8);
+
+    // The queued messages are dropped, the close frame follows the write
+    // already in progress and ends the connection without waiting for a reply
+    con->close(websocketpp::close::status::going_away,"");
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 2); // close frame payload
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closing);
+
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(closed, 0);
+
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(closed, 1);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closed);
+    BOOST_CHECK_EQUAL(con->get_local_close_code(),
+        websocketpp::close::status::going_away);
+}
+
+BOOST_AUTO_TEST_CASE( fast_close_reports_sent_messages ) {
+    debug_server s;
+    std::vector<debug_server::message_ptr> expired;
+    s.set_message_expired_handler(bind(&record_expired,&expired,::_1,::_2));
+    s.set_fast_close(true);
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    using websocketpp::frame::opcode::binary;
+
+    // messages without a deadline are prepared when sent even though a
+    // handler is set, the handler still gets the message that was sent
+    debug_server::message_ptr b = make_debug_message(con,binary,"bbbb",true,false);
+    b->clear_deadline();
+    debug_server::message_ptr c = make_debug_message(con,binary,"cccc",true,false);
+    c->clear_deadline();
+
+    BOOST_CHECK(!con->send(b));
+    BOOST_CHECK(!con->send(c));
+    BOOST_CHECK(!con->send("dddd",4,binary));
+
+    con->close(websocketpp::close::status::going_away,"");
+    BOOST_REQUIRE_EQUAL(expired.size(), 2);
+    BOOST_CHECK(expired[0] == c);
+    BOOST_CHECK_EQUAL(expired[1]->get_payload(), "dddd");
+    BOOST_CHECK(!expired[1]->get_prepared());
+}
+
+BOOST_AUTO_TEST_CASE( fast_close_during_close_handshake ) {
+    debug_server s;
+    int closed = 0;
+    s.set_close_handler(bind(&count_close,&closed,::_1));
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK(!con->get_fast_close());
+
+    con->close(websocketpp::close::status::normal,"");
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closing);
+
+    // Stops waiting for the peer's close frame
+    websocketpp::lib::error_code ec;
+    s.fast_close(con->get_handle(),websocketpp::close::status::going_away,"",ec);
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(closed, 1);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closed);
+}
+
+BOOST_AUTO_TEST_CASE( failed_fast_close_leaves_it_off ) {
+    debug_server s;
+    debug_server::connection_ptr con = s.get_connection();
+    con->start();
+
+    // the handshake has not completed yet
+    websocketpp::lib::error_code ec;
+    con->fast_close(websocketpp::close::status::going_away,"",ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::error::make_error_code(
+        websocketpp::error::invalid_state));
+    BOOST_CHECK(!con->get_fast_close());
+}
+
+BOOST_AUTO_TEST_CASE( rejected_fast_close_keeps_backlog ) {
+    debug_server s;
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    using websocketpp::frame::opcode::binary;
+
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"a",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"bbbb",true,false)));
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 4);
+
+    // a reason without a status code cannot be put in a close frame
+    websocketpp::lib::error_code ec;
+    con->fast_close(websocketpp::close::status::no_status,"shedding",ec);
+    BOOST_CHECK_EQUAL(ec, websocketpp::processor::error::reason_requires_code);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 4);
+    BOOST_CHECK(!con->get_fast_close());
+
+    // the backlog is still written and a later close waits for the handshake
+    con->close(websocketpp::close::status::normal,"");
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 6);
+    con->fullfil_write();
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closing);
+}
+
+BOOST_AUTO_TEST_CASE( idle_table_keepalive_and_idle_close ) {
+    debug_server s;
+    websocketpp::idle::table t;
+    t.set_ping_interval(1000);
+    t.set_pong_timeout(500);
+    t.set_idle_timeout(5000);
+    s.set_idle_table(&t);
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    std::vector<websocketpp::idle::hit> hits;
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_REQUIRE_EQUAL(t.size(), 1);
+    BOOST_CHECK_EQUAL(t.get_state(0), websocketpp::idle::state::open);
+
+    // nothing read for a second, send a keepalive ping
+    t.sweep(1000, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), 1);
+    BOOST_CHECK_EQUAL(hits[0].what, websocketpp::idle::action::ping);
+    con->handle_idle_action(hits[0].what);
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0); // empty ping payload
+    con->fullfil_write();
+
+    // the pong answers it
+    std::string pong("\x8a\x80\x00\x00\x00\x00", 6);
+    con->read_all(pong.data(), pong.size());
+    BOOST_CHECK_EQUAL(t.get_state(0), websocketpp::idle::state::open);
+
+    // the next ping goes unanswered
+    hits.clear();
+    t.sweep(2000, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), 1);
+    con->handle_idle_action(hits[0].what);
+    con->fullfil_write();
+
+    hits.clear();
+    t.sweep(2500, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), 1);
+    BOOST_CHECK_EQUAL(hits[0].what, websocketpp::idle::action::keepalive_timeout);
+    con->handle_idle_action(hits[0].what);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closed);
+    BOOST_CHECK_EQUAL(con->get_ec(), websocketpp::error::keepalive_timeout);
+    BOOST_CHECK_EQUAL(t.size(), 0);
+
+    // without keepalive a silent connection is closed after the idle timeout
+    t.set_ping_interval(0);
+    con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(t.size(), 1);
+
+    hits.clear();
+    t.sweep(2500 + 5000, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), 1);
+    BOOST_CHECK_EQUAL(hits[0].what, websocketpp::idle::action::idle_close);
+    con->handle_idle_action(hits[0].what);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closing);
+    BOOST_CHECK_EQUAL(con->get_local_close_code(),
+        websocketpp::close::status::going_away);
+
+    // and terminated if the peer does not answer the close
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(t.get_state(0), websocketpp::idle::state::closing);
+    hits.clear();
+    t.sweep(t.tick() + 10000, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), 1);
+    BOOST_CHECK_EQUAL(hits[0].what, websocketpp::idle::action::close_timeout);
+    con->handle_idle_action(hits[0].what);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closed);
+    BOOST_CHECK_EQUAL(con->get_ec(), websocketpp::error::close_handshake_timeout);
+    BOOST_CHECK_EQUAL(t.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE( idle_table_handshake_timeout ) {
+    debug_server s;
+    websocketpp::idle::table t;
+    s.set_idle_table(&t);
+    s.set_open_handshake_timeout(1000);
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+
+    // the debug transport has no timers, the table times the handshake
+    debug_server::connection_ptr con = s.get_connection();
+    con->start();
+    BOOST_REQUIRE_EQUAL(t.size(), 1);
+    BOOST_CHECK_EQUAL(t.get_state(0), websocketpp::idle::state::handshake);
+
+    std::vector<websocketpp::idle::hit> hits;
+    uint32_t now = t.tick();
+    t.sweep(now, hits);
+    BOOST_CHECK(hits.empty());
+
+    t.sweep(now + 1000, hits);
+    BOOST_REQUIRE_EQUAL(hits.size(), 1);
+    BOOST_CHECK_EQUAL(hits[0].what, websocketpp::idle::action::handshake_timeout);
+    con->handle_idle_action(hits[0].what);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closed);
+    BOOST_CHECK_EQUAL(con->get_ec(), websocketpp::error::open_handshake_timeout);
+    BOOST_CHECK_EQUAL(t.size(), 0);
+}
+
+bool assign_tenant(debug_server * s, std::string name,
+    websocketpp::connection_hdl hdl)
+{
+    // the handshake is rejected anyway if the tenant has no room
+    websocketpp::lib::error_code ec;
+    s->get_con_from_hdl(hdl)->set_tenant(name,ec);
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE( tenant_quotas ) {
+    debug_server s;
+
+    websocketpp::tenant::quota q;
+    q.max_connections = 1;
+    q.max_queued_bytes = 6;
+    s.set_tenant_quota("a",q);
+    s.set_validate_handler(bind(&assign_tenant,&s,std::string("a"),::_1));
+
+    debug_server::connection_ptr con = open_debug_server_connection(s);
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK_EQUAL(con->get_tenant(), "a");
+
+    debug_server::connection_ptr full = open_debug_server_connection(s);
+    BOOST_CHECK_EQUAL(full->get_state(), websocketpp::session::state::closed);
+    BOOST_CHECK_EQUAL(full->get_response_code(),
+        websocketpp::http::status_code::service_unavailable);
+
+    using websocketpp::frame::opcode::binary;
+
+    // The first message is handed to the transport immediately, the second
+    // waits in the queue and the third would exceed the queued bytes quota
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"aaaa",true,false)));
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"bbbb",true,false)));
+    BOOST_CHECK_EQUAL(con->send(make_debug_message(con,binary,"cccc",true,false)),
+        websocketpp::error::make_error_code(
+            websocketpp::error::tenant_quota_exceeded));
+
+    websocketpp::tenant::stats st = s.get_tenant_stats("a");
+    BOOST_CHECK_EQUAL(st.connections, 1);
+    BOOST_CHECK_EQUAL(st.queued_bytes, 4);
+    BOOST_CHECK_EQUAL(st.rejected_connections, 1);
+    BOOST_CHECK_EQUAL(st.rejected_messages, 1);
+
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(s.get_tenant_stats("a").queued_bytes, 0);
+    BOOST_CHECK(!con->send(make_debug_message(con,binary,"cccc",true,false)));
+    BOOST_CHECK_EQUAL(s.get_tenant_stats("a").queued_bytes, 4);
+
+    // terminating the connection gives its slot back
+    con->fast_close(websocketpp::close::status::going_away,"");
+    con->fullfil_write();
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::closed);
+
+    st = s.get_tenant_stats("a");
+    BOOST_CHECK_EQUAL(st.connections, 0);
+    BOOST_CHECK_EQUAL(st.queued_bytes, 0);
+    // aaaa, bbbb and the close frame, cccc was still queued and dropped
+    BOOST_CHECK_EQUAL(st.bytes_out, 2+4 + 2+4 + 2+2);
+
+    con = open_debug_server_connection(s);
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::open);
+}
+
+/// Holds threads back until all of them are ready to start
+struct start_gate {
+    start_gate() : open(false) {}
+
+    void wait() {
+        websocketpp::lib::unique_lock<websocketpp::lib::mutex> lock(m);
+        while (!open) {
+            cv.wait(lock);
+        }
+    }
+
+    void release() {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(m);
+        open = true;
+        cv.notify_all();
+    }
+
+    websocketpp::lib::mutex m;
+    websocketpp::lib::condition_variable cv;
+    bool open;
+};
+
+void send_until_full(start_gate * gate, debug_server::connection_ptr con,
+    std::string const * payload, size_t * accepted, size_t * failed)
+{
+    gate->wait();
+    for (int i = 0; i < 100; ++i) {
+        websocketpp::lib::error_code ec = con->send(*payload,
+            websocketpp::frame::opcode::binary);
+        if (!ec) {
+            (*accepted)++;
+        } else if (ec != websocketpp::error::tenant_quota_exceeded) {
+            (*failed)++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( tenant_queue_quota_concurrent_senders ) {
+    typedef websocketpp::lib::shared_ptr<websocketpp::lib::thread> thread_ptr;
+
+    std::string const payload(16384,'a');
+    size_t const limit = 16;
+
+    // The connections race for the last room in the quota, repeat to give
+    // them a fair chance of overlapping
+    for (int round = 0; round < 20; ++round) {
+        debug_server s;
+
+        websocketpp::tenant::quota q;
+        q.max_queued_bytes = limit * payload.size();
+        s.set_tenant_quota("a",q);
+        s.set_validate_handler(bind(&assign_tenant,&s,std::string("a"),::_1));
+
+        std::vector<debug_server::connection_ptr> cons;
+        for (int i = 0; i < 4; ++i) {
+            debug_server::connection_ptr con = open_debug_server_connection(s);
+            BOOST_REQUIRE_EQUAL(con->get_state(),
+                websocketpp::session::state::open);
+
+            // keeps the transport busy so that later messages stay queued
+            BOOST_CHECK(!con->send(std::string("x"),
+                websocketpp::frame::opcode::binary));
+            cons.push_back(con);
+        }
+
+        // each connection has its own write lock, the tenant is shared
+        start_gate gate;
+        std::vector<size_t> accepted(cons.size(),0);
+        std::vector<size_t> failed(cons.size(),0);
+        std::vector<thread_ptr> senders;
+        for (size_t i = 0; i < cons.size(); ++i) {
+            senders.push_back(websocketpp::lib::make_shared<
+                websocketpp::lib::thread>(bind(&send_until_full,&gate,cons[i],
+                &payload,&accepted[i],&failed[i])));
+        }
+        gate.release();
+
+        size_t total = 0;
+        for (size_t i = 0; i < senders.size(); ++i) {
+            senders[i]->join();
+            BOOST_CHECK_EQUAL(failed[i], 0);
+            BOOST_CHECK_EQUAL(cons[i]->get_buffered_amount(),
+                accepted[i] * payload.size());
+            total += accepted[i];
+        }
+
+        websocketpp::tenant::stats st = s.get_tenant_stats("a");
+        BOOST_CHECK_EQUAL(total, limit);
+        BOOST_CHECK_EQUAL(st.queued_bytes, q.max_queued_bytes);
+        BOOST_CHECK_EQUAL(st.rejected_messages, 400 - total);
+    }
+}
+
+struct batching_config : public debug_config_client {
+    static const bool enable_resource_accounting = true;
+
+    typedef websocketpp::extensions::message_batching::enabled
+        <message_batching_config> message_batching_type;
+};
+
+typedef websocketpp::server<batching_config> batching_server;
+
+void collect_batched(std::vector<std::string> * out, websocketpp::connection_hdl,
+    batching_server::message_ptr msg)
+{
+    out->push_back(msg->get_payload());
+}
+
+BOOST_AUTO_TEST_CASE( message_batching ) {
+    batching_server s;
+    std::vector<std::string> received;
+    s.set_message_handler(bind(&collect_batched,&received,::_1,::_2));
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\nSec-WebSocket-Extensions: x-websocketpp-batch\r\n\r\n";
+
+    batching_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+    BOOST_CHECK_EQUAL(con->get_response_header("Sec-WebSocket-Extensions"),
+        "x-websocketpp-batch");
+
+    // Masked binary batch frame holding "a", "b" and "c"
+    char frame[12] = {char(0xa2), char(0x86), 0x00, 0x00, 0x00, 0x00,
+        0x01, 'a', 0x01, 'b', 0x01, 'c'};
+    con->read_all(frame, 12);
+
+    BOOST_REQUIRE_EQUAL(received.size(), 3);
+    BOOST_CHECK_EQUAL(received[0], "a");
+    BOOST_CHECK_EQUAL(received[2], "c");
+
+    // The first message goes out alone, the three queued behind it share a
+    // frame with a 2 byte header and a 1 byte length prefix per message
+    using websocketpp::frame::opcode::binary;
+    BOOST_CHECK(!con->send(std::string("w"), binary));
+    BOOST_CHECK(!con->send(std::string("x"), binary));
+    BOOST_CHECK(!con->send(std::string("y"), binary));
+    BOOST_CHECK(!con->send(std::string("z"), binary));
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 3);
+
+    con->fullfil_write();
+    BOOST_CHECK_EQUAL(con->get_buffered_amount(), 0);
+    con->fullfil_write();
+
+    websocketpp::metrics::connection_stats stats = con->get_resource_stats();
+    BOOST_CHECK_EQUAL(stats.bytes_out, 3 + 2+6);
+    BOOST_CHECK_EQUAL(stats.messages_out, 2);
+}
+
+struct quantum_batching_config : public batching_config {
+    static const size_t read_quantum_messages = 1;
+};
+
+typedef websocketpp::server<quantum_batching_config> quantum_batching_server;
+
+BOOST_AUTO_TEST_CASE( message_batching_read_quantum ) {
+    quantum_batching_server s;
+    std::vector<std::string> received;
+    s.set_message_handler(bind(&collect_batched,&received,::_1,::_2));
+
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: AAAAAAAAAAAAAAAAAAAAAA==\r\nSec-WebSocket-Extensions: x-websocketpp-batch\r\n\r\n";
+
+    quantum_batching_server::connection_ptr con = s.get_connection();
+    con->start();
+    con->read_all(input.data(), input.size());
+    con->fullfil_write();
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // The connection yields after each message of the batch. The rest of the
+    // batch is delivered before the text frame that follows it is consumed.
+    char frames[20] = {char(0xa2), char(0x86), 0x00, 0x00, 0x00, 0x00,
+        0x01, 'a', 0x01, 'b', 0x01, 'c',
+        char(0x81), char(0x82), 0x00, 0x00, 0x00, 0x00, 'H', 'i'};
+    BOOST_CHECK_EQUAL(con->read_all(frames, 20), 20);
+
+    BOOST_REQUIRE_EQUAL(received.size(), 4);
+    BOOST_CHECK_EQUAL(received[0], "a");
+    BOOST_CHECK_EQUAL(received[1], "b");
+    BOOST_CHECK_EQUAL(received[2], "c");
+    BOOST_CHECK_EQUAL(received[3], "Hi");
+    BOOST_CHECK_EQUAL(con->get_state(), websocketpp::session::state::open);
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE message_batching
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/error.hpp>
+
+#include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/message_batching/disabled.hpp>
+#include <websocketpp/extensions/message_batching/enabled.hpp>
+
+#include <string>
+
+struct config {
+    static const size_t max_message_size = 512;
+    static const size_t max_batch_size = 16384;
+};
+
+typedef websocketpp::extensions::message_batching::enabled<config> enabled_type;
+typedef websocketpp::extensions::message_batching::disabled<config> disabled_type;
+
+namespace mbe = websocketpp::extensions::message_batching::error;
+
+BOOST_AUTO_TEST_CASE( disabled_is_disabled ) {
+    disabled_type ext;
+    BOOST_CHECK( !ext.is_implemented() );
+    BOOST_CHECK( !ext.is_enabled() );
+    BOOST_CHECK_EQUAL( ext.generate_offer(), "" );
+}
+
+BOOST_AUTO_TEST_CASE( negotiate ) {
+    enabled_type ext;
+    websocketpp::http::attribute_list attr;
+
+    BOOST_CHECK( ext.is_implemented() );
+    BOOST_CHECK( !ext.is_enabled() );
+    BOOST_CHECK_EQUAL( ext.generate_offer(), "x-websocketpp-batch" );
+
+    attr["max"] = "10";
+    BOOST_CHECK_EQUAL( ext.negotiate(attr).first, mbe::invalid_attributes );
+
+    attr.clear();
+    websocketpp::err_str_pair esp = ext.negotiate(attr);
+    BOOST_CHECK( !esp.first );
+    BOOST_CHECK_EQUAL( esp.second, "x-websocketpp-batch" );
+
+    BOOST_CHECK( !ext.init(true) );
+    BOOST_CHECK( ext.is_enabled() );
+}
+
+BOOST_AUTO_TEST_CASE( pack_unpack ) {
+    enabled_type ext;
+    std::string batch;
+    std::string big(300,'b');
+
+    BOOST_CHECK( !ext.pack(reinterpret_cast<uint8_t const *>("abc"),3,batch) );
+    BOOST_CHECK( !ext.pack(NULL,0,batch) );
+    BOOST_CHECK( !ext.pack(reinterpret_cast<uint8_t const *>(big.data()),
+        big.size(),batch) );
+
+    // 300 needs a two byte length prefix
+    BOOST_CHECK_EQUAL( batch.size(), 1+3 + 1 + 2+300 );
+
+    size_t offset = 0;
+    size_t len = 0;
+
+    BOOST_CHECK( !ext.unpack(batch,offset,len) );
+    BOOST_CHECK_EQUAL( batch.substr(offset-len,len), "abc" );
+    BOOST_CHECK( !ext.unpack(batch,offset,len) );
+    BOOST_CHECK_EQUAL( len, 0 );
+    BOOST_CHECK( !ext.unpack(batch,offset,len) );
+    BOOST_CHECK_EQUAL( batch.substr(offset-len,len), big );
+    BOOST_CHECK_EQUAL( offset, batch.size() );
+}
+
+BOOST_AUTO_TEST_CASE( unpack_malformed ) {
+    enabled_type ext;
+    size_t offset = 0;
+    size_t len = 0;
+
+    // length runs past the end
+    BOOST_CHECK_EQUAL( ext.unpack(std::string("\x04" "abc"),offset,len),
+        mbe::malformed_batch );
+    BOOST_CHECK_EQUAL( offset, 0 );
+
+    // truncated length prefix
+    BOOST_CHECK_EQUAL( ext.unpack(std::string("\x80"),offset,len),
+        mbe::malformed_batch );
+
+    // overlong length prefix
+    BOOST_CHECK_EQUAL( ext.unpack(std::string(11,'\xff'),offset,len),
+        mbe::malformed_batch );
+}
@@ -30,6 +30,8 @@
 
 #include <websocketpp/error.hpp>
 
+#include <websocketpp/concurrency/basic.hpp>
+
 #include <websocketpp/extensions/extension.hpp>
 #include <websocketpp/extensions/permessage_deflate/disabled.hpp>
 #include <websocketpp/extensions/permessage_deflate/enabled.hpp>
@@ -596,6 +598,201 @@ BOOST_AUTO_TEST_CASE( negotiate_four_client_initiated ) {
     BOOST_CHECK_EQUAL( v.esp.second, "permessage-deflate; server_no_context_takeover; client_no_context_takeover; server_max_window_bits=10; client_max_window_bits=10");
 }
 
+// Negotiation policy
+namespace pmd = websocketpp::extensions::permessage_deflate;
+
+BOOST_AUTO_TEST_CASE( apply_settings_limits_windows ) {
+    ext_vars v;
+    pmd::settings s;
+
+    s.server_max_window_bits = 10;
+    s.client_max_window_bits = 11;
+    v.ec = v.exts.apply_settings(s);
+    BOOST_CHECK( !v.ec );
+
+    v.attr["server_max_window_bits"] = "9";
+    v.attr["client_max_window_bits"] = "";
+
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK( !v.esp.first );
+    BOOST_CHECK_EQUAL( v.esp.second, "permessage-deflate; server_max_window_bits=9; client_max_window_bits=11");
+
+    v.ec = v.exts.init(true);
+    BOOST_CHECK( !v.ec );
+    BOOST_CHECK_EQUAL( v.exts.estimate_memory(), pmd::estimate_memory(9,11) );
+}
+
+BOOST_AUTO_TEST_CASE( apply_settings_client_bits_not_offered ) {
+    ext_vars v;
+    pmd::settings s;
+
+    // A client that does not offer client_max_window_bits may not be
+    // limited, the server must decompress with the full window
+    s.client_max_window_bits = 9;
+    v.ec = v.exts.apply_settings(s);
+    BOOST_CHECK( !v.ec );
+
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK( !v.esp.first );
+    BOOST_CHECK_EQUAL( v.esp.second, "permessage-deflate");
+
+    v.ec = v.exts.init(true);
+    BOOST_CHECK( !v.ec );
+    BOOST_CHECK_EQUAL( v.exts.estimate_memory(), pmd::estimate_memory(15,15) );
+}
+
+BOOST_AUTO_TEST_CASE( apply_settings_decline ) {
+    ext_vars v;
+    pmd::settings s;
+
+    s.decline = true;
+    v.ec = v.exts.apply_settings(s);
+    BOOST_CHECK( !v.ec );
+
+    v.esp = v.exts.negotiate(v.attr);
+    BOOST_CHECK_EQUAL( v.esp.first, pmde::make_error_code(pmde::declined) );
+    BOOST_CHECK( !v.exts.is_enabled() );
+}
+
+BOOST_AUTO_TEST_CASE( apply_settings_invalid ) {
+    ext_vars v;
+    pmd::settings s;
+
+    s.memory_level = 0;
+    v.ec = v.exts.apply_settings(s);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_memory_level) );
+
+    s.memory_level = 4;
+    s.server_max_window_bits = 16;
+    v.ec = v.exts.apply_settings(s);
+    BOOST_CHECK_EQUAL( v.ec, pmde::make_error_code(pmde::invalid_max_window_bits) );
+
+    disabled_type extd;
+    v.ec = extd.apply_settings(pmd::settings());
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::extensions::error::make_error_code(
+        websocketpp::extensions::error::disabled) );
+    BOOST_CHECK_EQUAL( extd.estimate_memory(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( fit_budget_unlimited ) {
+    pmd::usage u;
+    u.memory = 1000000;
+    u.connections = 100;
+
+    pmd::settings s = pmd::fit_budget(pmd::settings(), u, true);
+    BOOST_CHECK( !s.decline );
+    BOOST_CHECK_EQUAL( s.server_max_window_bits, 15 );
+    BOOST_CHECK_EQUAL( s.client_max_window_bits, 15 );
+    BOOST_CHECK_EQUAL( s.memory_level, 4 );
+}
+
+BOOST_AUTO_TEST_CASE( fit_budget_shrinks_with_connections ) {
+    size_t full = pmd::estimate_memory(15,15);
+    pmd::usage u;
+    u.budget = full * 4;
+
+    // the first connection gets full windows
+    pmd::settings s = pmd::fit_budget(pmd::settings(), u, true);
+    BOOST_CHECK( !s.decline );
+    BOOST_CHECK_EQUAL( pmd::estimate_memory(s,true), full );
+
+    // with more connections the fair share shrinks, compressor window first
+    u.connections = 7;
+    u.memory = full * 2;
+    s = pmd::fit_budget(pmd::settings(), u, true);
+    BOOST_CHECK( !s.decline );
+    BOOST_CHECK( pmd::estimate_memory(s,true) <= u.budget / 8 );
+    BOOST_CHECK( s.server_max_window_bits < 15 );
+
+    // the client side shrinks its own compressor window
+    s = pmd::fit_budget(pmd::settings(), u, false);
+    BOOST_CHECK( pmd::estimate_memory(s,false) <= u.budget / 8 );
+    BOOST_CHECK( s.client_max_window_bits < 15 );
+
+    // at the smallest settings the budget is still not enough
+    u.connections = 1000;
+    s = pmd::fit_budget(pmd::settings(), u, true);
+    BOOST_CHECK( s.decline );
+    BOOST_CHECK_EQUAL( pmd::estimate_memory(s,true), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( fit_budget_exhausted ) {
+    size_t smallest = pmd::estimate_memory(9,9,1);
+    pmd::usage u;
+    u.budget = smallest * 10;
+    u.connections = 2;
+
+    // less room left than the fair share
+    u.memory = u.budget - smallest;
+    pmd::settings s = pmd::fit_budget(pmd::settings(), u, true);
+    BOOST_CHECK( !s.decline );
+    BOOST_CHECK_EQUAL( pmd::estimate_memory(s,true), smallest );
+
+    u.memory = u.budget;
+    s = pmd::fit_budget(pmd::settings(), u, true);
+    BOOST_CHECK( s.decline );
+}
+
+BOOST_AUTO_TEST_CASE( fit_budget_remote_not_offered ) {
+    pmd::usage u;
+    u.budget = pmd::estimate_memory(12,15) * 2;
+    u.connections = 1;
+
+    // a client that did not offer client_max_window_bits keeps its window
+    pmd::settings s = pmd::fit_budget(pmd::settings(), u, true, false);
+    BOOST_CHECK( !s.decline );
+    BOOST_CHECK_EQUAL( s.client_max_window_bits, 15 );
+    BOOST_CHECK( s.server_max_window_bits < 15 );
+    BOOST_CHECK( pmd::estimate_memory(s,true) <= u.budget / 2 );
+
+    // and is declined if its window alone does not fit
+    u.budget = pmd::estimate_memory(9,14,1) * 2;
+    s = pmd::fit_budget(pmd::settings(), u, true, false);
+    BOOST_CHECK( s.decline );
+
+    // while one that offered it is limited instead
+    s = pmd::fit_budget(pmd::settings(), u, true, true);
+    BOOST_CHECK( !s.decline );
+    BOOST_CHECK( s.client_max_window_bits < 15 );
+}
+
+BOOST_AUTO_TEST_CASE( tracker_reserve_and_adjust ) {
+    size_t full = pmd::estimate_memory(15,15);
+    pmd::tracker<websocketpp::concurrency::basic> t;
+    t.set_budget(full * 2);
+
+    // each reservation sees the ones before it
+    pmd::usage u;
+    pmd::settings s;
+    size_t first = t.reserve(s, true, true, u);
+    BOOST_CHECK_EQUAL( first, full );
+    BOOST_CHECK_EQUAL( u.memory, 0 );
+    BOOST_CHECK_EQUAL( t.get_usage().memory, full );
+    BOOST_CHECK_EQUAL( t.get_usage().connections, 1 );
+
+    s = pmd::settings();
+    size_t second = t.reserve(s, true, true, u);
+    BOOST_CHECK_EQUAL( u.memory, full );
+    BOOST_CHECK_EQUAL( u.connections, 1 );
+    BOOST_CHECK_EQUAL( second, full );
+
+    s = pmd::settings();
+    BOOST_CHECK_EQUAL( t.reserve(s, true, true, u), 0 );
+    BOOST_CHECK( s.decline );
+    BOOST_CHECK_EQUAL( t.get_usage().connections, 2 );
+
+    // negotiation settled on smaller windows, then on no compression
+    t.adjust(first, pmd::estimate_memory(10,10));
+    BOOST_CHECK_EQUAL( t.get_usage().memory,
+        full + pmd::estimate_memory(10,10) );
+    t.adjust(second, 0);
+    BOOST_CHECK_EQUAL( t.get_usage().connections, 1 );
+
+    t.release(pmd::estimate_memory(10,10));
+    BOOST_CHECK_EQUAL( t.get_usage().memory, 0 );
+    BOOST_CHECK_EQUAL( t.get_usage().connections, 0 );
+}
+
 // Compression
 BOOST_AUTO_TEST_CASE( compress_data ) {
     ext_vars v;
@@ -750,3 +947,25 @@ BOOST_AUTO_TEST_CASE( decompress_data ) {
     BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
     BOOST_CHECK_EQUAL( out, reference );
 }
+
+// Decompression stops shortly after the output limit
+BOOST_AUTO_TEST_CASE( decompress_limit ) {
+    ext_vars v;
+    std::string compressed;
+    std::string out;
+
+    v.ec = v.exts.init(true);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    v.ec = v.extc.init(false);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    v.ec = v.extc.compress(std::string(10000000,'a'),compressed);
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+
+    v.ec = v.exts.decompress(reinterpret_cast<uint8_t const *>(
+        compressed.data()),compressed.size(),out,100000);
+
+    BOOST_CHECK_EQUAL( v.ec, websocketpp::lib::error_code() );
+    BOOST_CHECK( out.size() > 100000 );
+    BOOST_CHECK( out.size() < 1000000 );
+}
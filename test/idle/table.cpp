@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE idle_table
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/idle/table.hpp>
+
+#include <websocketpp/common/memory.hpp>
+
+#include <vector>
+
+namespace idle = websocketpp::idle;
+
+namespace {
+
+websocketpp::connection_hdl make_hdl(websocketpp::lib::shared_ptr<int> & owner)
+{
+    owner = websocketpp::lib::make_shared<int>(0);
+    return owner;
+}
+
+std::vector<idle::hit> sweep(idle::table & t, uint32_t now) {
+    std::vector<idle::hit> hits;
+    t.sweep(now, hits);
+    return hits;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE( slots_are_reused ) {
+    websocketpp::lib::shared_ptr<int> a, b, c;
+    idle::table t;
+
+    uint32_t sa = t.add(make_hdl(a));
+    uint32_t sb = t.add(make_hdl(b));
+    BOOST_CHECK_EQUAL( t.size(), 2 );
+    BOOST_CHECK( sa != sb );
+    BOOST_CHECK_EQUAL( t.get_state(sa), idle::state::inactive );
+
+    t.remove(sa);
+    BOOST_CHECK_EQUAL( t.size(), 1 );
+    BOOST_CHECK_EQUAL( t.get_state(sa), idle::state::free );
+    BOOST_CHECK( t.get_hdl(sa).expired() );
+
+    BOOST_CHECK_EQUAL( t.add(make_hdl(c)), sa );
+    BOOST_CHECK( t.get_hdl(sa).lock() == c );
+}
+
+BOOST_AUTO_TEST_CASE( inactive_slots_are_ignored ) {
+    websocketpp::lib::shared_ptr<int> a;
+    idle::table t;
+    t.set_ping_interval(10);
+    t.set_idle_timeout(20);
+
+    t.add(make_hdl(a));
+    BOOST_CHECK( sweep(t, 1000000).empty() );
+}
+
+BOOST_AUTO_TEST_CASE( keepalive ) {
+    websocketpp::lib::shared_ptr<int> a;
+    idle::table t;
+    t.set_ping_interval(1000);
+    t.set_pong_timeout(500);
+
+    uint32_t s = t.add(make_hdl(a));
+    t.set_open(s);
+    uint32_t start = t.tick();
+
+    BOOST_CHECK( sweep(t, start + 500).empty() );
+
+    std::vector<idle::hit> hits = sweep(t, start + 1000);
+    BOOST_REQUIRE_EQUAL( hits.size(), 1 );
+    BOOST_CHECK_EQUAL( hits[0].slot, s );
+    BOOST_CHECK_EQUAL( hits[0].what, idle::action::ping );
+    BOOST_CHECK_EQUAL( t.get_state(s), idle::state::ping_sent );
+
+    // the hit keeps the connection even if the slot is reused afterwards
+    BOOST_CHECK( hits[0].hdl.lock() == a );
+
+    // pinged once only, any read answers
+    BOOST_CHECK( sweep(t, start + 1200).empty() );
+    t.touch_read(s);
+    BOOST_CHECK_EQUAL( t.get_state(s), idle::state::open );
+    BOOST_CHECK( sweep(t, start + 1700).empty() );
+
+    // the read carried the tick of the sweep before it
+    hits = sweep(t, start + 2200);
+    BOOST_REQUIRE_EQUAL( hits.size(), 1 );
+    BOOST_CHECK_EQUAL( hits[0].what, idle::action::ping );
+
+    hits = sweep(t, start + 2700);
+    BOOST_REQUIRE_EQUAL( hits.size(), 1 );
+    BOOST_CHECK_EQUAL( hits[0].what, idle::action::keepalive_timeout );
+    BOOST_CHECK_EQUAL( t.get_state(s), idle::state::inactive );
+    BOOST_CHECK( sweep(t, start + 100000).empty() );
+}
+
+BOOST_AUTO_TEST_CASE( idle_close_counts_writes ) {
+    websocketpp::lib::shared_ptr<int> a;
+    idle::table t;
+    t.set_idle_timeout(1000);
+
+    uint32_t s = t.add(make_hdl(a));
+    t.set_open(s);
+    uint32_t start = t.tick();
+
+    BOOST_CHECK( sweep(t, start + 800).empty() );
+    t.touch_write(s);
+    BOOST_CHECK( sweep(t, start + 1500).empty() );
+
+    std::vector<idle::hit> hits = sweep(t, start + 1800);
+    BOOST_REQUIRE_EQUAL( hits.size(), 1 );
+    BOOST_CHECK_EQUAL( hits[0].what, idle::action::idle_close );
+    BOOST_CHECK_EQUAL( t.get_state(s), idle::state::inactive );
+}
+
+BOOST_AUTO_TEST_CASE( deadlines ) {
+    websocketpp::lib::shared_ptr<int> a, b;
+    idle::table t;
+    t.set_ping_interval(10);
+    t.set_idle_timeout(10);
+
+    uint32_t sa = t.add(make_hdl(a));
+    uint32_t sb = t.add(make_hdl(b));
+    t.set_deadline(sa, idle::state::handshake, 5000);
+    t.set_deadline(sb, idle::state::closing, 1000);
+    uint32_t start = t.tick();
+
+    // handshakes are not pinged or closed for inactivity
+    BOOST_CHECK( sweep(t, start + 900).empty() );
+
+    std::vector<idle::hit> hits = sweep(t, start + 2000);
+    BOOST_REQUIRE_EQUAL( hits.size(), 1 );
+    BOOST_CHECK_EQUAL( hits[0].slot, sb );
+    BOOST_CHECK_EQUAL( hits[0].what, idle::action::close_timeout );
+
+    hits = sweep(t, start + 6000);
+    BOOST_REQUIRE_EQUAL( hits.size(), 1 );
+    BOOST_CHECK_EQUAL( hits[0].slot, sa );
+    BOOST_CHECK_EQUAL( hits[0].what, idle::action::handshake_timeout );
+}
+
+BOOST_AUTO_TEST_CASE( ticks_wrap ) {
+    websocketpp::lib::shared_ptr<int> a;
+    idle::table t;
+    t.set_idle_timeout(1000);
+
+    // open the connection just before the tick counter wraps
+    uint32_t s = t.add(make_hdl(a));
+    sweep(t, 0xffffff00);
+    t.set_open(s);
+
+    BOOST_CHECK( sweep(t, 0x00000200).empty() );
+    BOOST_CHECK_EQUAL( sweep(t, 0x00000400).size(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( sparse_hits_in_a_large_table ) {
+    std::vector<websocketpp::lib::shared_ptr<int> > owners(10000);
+    idle::table t;
+    t.set_idle_timeout(1000);
+
+    for (size_t i = 0; i < owners.size(); ++i) {
+        t.set_open(t.add(make_hdl(owners[i])));
+    }
+    uint32_t start = t.tick();
+    sweep(t, start);
+
+    // everything but a few slots at block edges stays busy
+    for (uint32_t i = 0; i < owners.size(); ++i) {
+        if (i != 0 && i != 255 && i != 256 && i != 9999) {
+            t.touch_read(i);
+        }
+    }
+    sweep(t, start + 600);
+    for (uint32_t i = 0; i < owners.size(); ++i) {
+        if (i != 0 && i != 255 && i != 256 && i != 9999) {
+            t.touch_read(i);
+        }
+    }
+
+    std::vector<idle::hit> hits = sweep(t, start + 1200);
+    BOOST_REQUIRE_EQUAL( hits.size(), 4 );
+    BOOST_CHECK_EQUAL( hits[0].slot, 0 );
+    BOOST_CHECK_EQUAL( hits[1].slot, 255 );
+    BOOST_CHECK_EQUAL( hits[2].slot, 256 );
+    BOOST_CHECK_EQUAL( hits[3].slot, 9999 );
+}
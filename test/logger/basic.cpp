@@ -31,6 +31,9 @@
 #include <string>
 
 #include <websocketpp/logger/basic.hpp>
+#include <websocketpp/logger/keyed.hpp>
+#include <websocketpp/logger/stub.hpp>
+#include <websocketpp/logger/syslog.hpp>
 #include <websocketpp/concurrency/none.hpp>
 #include <websocketpp/concurrency/basic.hpp>
 
@@ -143,3 +146,170 @@ BOOST_AUTO_TEST_CASE( move_assign ) {
 
     logger2 = std::move(logger1);
 }*/
+
+BOOST_AUTO_TEST_CASE( rate_limit_burst ) {
+    typedef websocketpp::log::basic<websocketpp::concurrency::basic,websocketpp::log::elevel> error_log;
+
+    std::stringstream out;
+    error_log logger(0xffffffff,&out);
+    logger.set_channels(websocketpp::log::elevel::rerror);
+
+    // disabled channels are never allowed, without a limit all others are
+    BOOST_CHECK( !logger.test(websocketpp::log::elevel::info,"scan") );
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"scan") );
+
+    logger.set_rate_limit(2);
+
+    int allowed = 0;
+    for (int i = 0; i < 10; i++) {
+        allowed += logger.test(websocketpp::log::elevel::rerror,"scan",7);
+    }
+    BOOST_CHECK_EQUAL( allowed, 2 );
+
+    // keys and codes are limited separately
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"scan",8) );
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"flood",7) );
+    BOOST_CHECK( out.str().empty() );
+
+    logger.flush_suppressed();
+    BOOST_CHECK( out.str().find("Suppressed 8 similar messages: scan (code 7)")
+        != std::string::npos );
+
+    // a new interval starts after the flush
+    out.str("");
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"scan",7) );
+    logger.flush_suppressed();
+    BOOST_CHECK( out.str().empty() );
+}
+
+BOOST_AUTO_TEST_CASE( rate_limit_categories ) {
+    typedef websocketpp::log::basic<websocketpp::concurrency::none,websocketpp::log::elevel> error_log;
+
+    std::stringstream out;
+    error_log logger(0xffffffff,&out);
+    logger.set_channels(websocketpp::log::elevel::rerror);
+    logger.set_rate_limit(1);
+
+    // equal codes of different categories are limited separately
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"read",2,"asio.misc") );
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"read",2,"websocketpp") );
+    BOOST_CHECK( logger.test(websocketpp::log::elevel::rerror,"read",2) );
+    BOOST_CHECK( !logger.test(websocketpp::log::elevel::rerror,"read",2,"asio.misc") );
+    BOOST_CHECK( !logger.test(websocketpp::log::elevel::rerror,"read",2,"asio.misc") );
+    BOOST_CHECK( !logger.test(websocketpp::log::elevel::rerror,"read",2,"websocketpp") );
+
+    logger.flush_suppressed();
+    BOOST_CHECK( out.str().find("Suppressed 2 similar messages: read (asio.misc code 2)")
+        != std::string::npos );
+    BOOST_CHECK( out.str().find("Suppressed 1 similar messages: read (websocketpp code 2)")
+        != std::string::npos );
+    BOOST_CHECK( out.str().find("(code 2)") == std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( rate_limit_sample ) {
+    typedef websocketpp::log::basic<websocketpp::concurrency::none,websocketpp::log::elevel> error_log;
+
+    std::stringstream out;
+    error_log logger(0xffffffff,&out);
+    logger.set_channels(websocketpp::log::elevel::rerror);
+    logger.set_rate_limit(1,1000,4);
+
+    int allowed = 0;
+    for (int i = 0; i < 9; i++) {
+        allowed += logger.test(websocketpp::log::elevel::rerror,"scan");
+    }
+    BOOST_CHECK_EQUAL( allowed, 3 );
+
+    logger.flush_suppressed();
+    BOOST_CHECK( out.str().find("Suppressed 6 similar messages: scan, 2 sampled")
+        != std::string::npos );
+}
+
+// Exposes the lock that writes hold
+class writing_log : public websocketpp::log::basic<websocketpp::concurrency::basic,websocketpp::log::elevel> {
+public:
+    typedef websocketpp::log::basic<websocketpp::concurrency::basic,websocketpp::log::elevel> base;
+
+    explicit writing_log(std::ostream * out) : base(0xffffffff,out) {}
+
+    mutex_type & write_lock() {
+        return m_lock;
+    }
+};
+
+BOOST_AUTO_TEST_CASE( rate_limit_does_not_wait_for_writes ) {
+    std::stringstream out;
+    writing_log logger(&out);
+    logger.set_channels(websocketpp::log::elevel::rerror);
+    logger.set_rate_limit(1);
+
+    // checks only take the rate limit lock, so they run while a write holds
+    // the write lock
+    int allowed = 0;
+    {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(logger.write_lock());
+        for (int i = 0; i < 5; i++) {
+            allowed += logger.test(websocketpp::log::elevel::rerror,"scan");
+        }
+    }
+    BOOST_CHECK_EQUAL( allowed, 1 );
+    BOOST_CHECK( out.str().empty() );
+
+    logger.flush_suppressed();
+    BOOST_CHECK( out.str().find("Suppressed 4 similar messages: scan")
+        != std::string::npos );
+}
+
+BOOST_AUTO_TEST_CASE( rate_limiter_intervals ) {
+    typedef websocketpp::log::rate_limiter limiter_type;
+
+    limiter_type l;
+    std::vector<limiter_type::summary> ended;
+    limiter_type::time_point t = limiter_type::clock_type::now();
+
+    l.set_limit(1,100);
+    l.set_max_keys(2);
+
+    BOOST_CHECK( l.allow(1,"a",0,t,ended) );
+    BOOST_CHECK( !l.allow(1,"a",0,t,ended) );
+    BOOST_CHECK( l.allow(1,"b",0,t,ended) );
+
+    // keys over the maximum share one entry
+    BOOST_CHECK( l.allow(1,"c",0,t,ended) );
+    BOOST_CHECK( !l.allow(1,"d",0,t,ended) );
+
+    t += websocketpp::lib::chrono::milliseconds(50);
+    BOOST_CHECK( !l.allow(1,"a",0,t,ended) );
+    BOOST_CHECK( ended.empty() );
+
+    // the first message after the interval reports the one before
+    t += websocketpp::lib::chrono::milliseconds(50);
+    BOOST_CHECK( l.allow(1,"a",0,t,ended) );
+    BOOST_REQUIRE_EQUAL( ended.size(), 2 );
+
+    size_t a = ended[0].key == "a" ? 0 : 1;
+    BOOST_CHECK_EQUAL( ended[a].suppressed, 2 );
+    BOOST_CHECK_EQUAL( ended[1-a].key, "" );
+    BOOST_CHECK_EQUAL( ended[1-a].suppressed, 1 );
+    BOOST_CHECK_EQUAL( websocketpp::log::format_summary(ended[1-a]),
+        "Suppressed 1 similar messages: other" );
+}
+
+BOOST_AUTO_TEST_CASE( keyed_test_trait ) {
+    typedef websocketpp::log::basic<websocketpp::concurrency::none,websocketpp::log::elevel> error_log;
+    typedef websocketpp::log::syslog<websocketpp::concurrency::none,websocketpp::log::elevel> syslog_log;
+
+    BOOST_CHECK( websocketpp::log::has_keyed_test<error_log>::value );
+    BOOST_CHECK( websocketpp::log::has_keyed_test<syslog_log>::value );
+    BOOST_CHECK( websocketpp::log::has_keyed_test<websocketpp::log::stub>::value );
+
+    std::stringstream out;
+    error_log logger(0xffffffff,&out);
+    logger.set_channels(websocketpp::log::elevel::rerror);
+    logger.set_rate_limit(1);
+
+    // the free function uses the logger's rate limit
+    BOOST_CHECK( websocketpp::log::test(logger,websocketpp::log::elevel::rerror,"scan",7,"cat") );
+    BOOST_CHECK( !websocketpp::log::test(logger,websocketpp::log::elevel::rerror,"scan",7,"cat") );
+    BOOST_CHECK( !websocketpp::log::test(logger,websocketpp::log::elevel::info,"scan") );
+}
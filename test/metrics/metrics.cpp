@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE metrics
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/metrics/connection_stats.hpp>
+#include <websocketpp/metrics/cycles.hpp>
+#include <websocketpp/metrics/endpoint_counters.hpp>
+#include <websocketpp/metrics/space_saving.hpp>
+
+#include <websocketpp/concurrency/basic.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <string>
+#include <vector>
+
+typedef websocketpp::metrics::space_saving<std::string> sketch_type;
+
+BOOST_AUTO_TEST_CASE( cycles_monotonic ) {
+    uint64_t a = websocketpp::metrics::cycles();
+    uint64_t b = websocketpp::metrics::cycles();
+    BOOST_CHECK(b >= a);
+}
+
+BOOST_AUTO_TEST_CASE( space_saving_exact_under_capacity ) {
+    sketch_type s(3);
+
+    s.update("a", 5);
+    s.update("b", 10);
+    s.update("a", 7);
+
+    std::vector<sketch_type::entry> top = s.top(10);
+    BOOST_REQUIRE_EQUAL(top.size(), 2);
+    BOOST_CHECK_EQUAL(top[0].key, "a");
+    BOOST_CHECK_EQUAL(top[0].count, 12);
+    BOOST_CHECK_EQUAL(top[0].error, 0);
+    BOOST_CHECK_EQUAL(top[1].key, "b");
+
+    BOOST_CHECK_EQUAL(s.top(1).size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE( space_saving_replaces_minimum ) {
+    sketch_type s(2);
+
+    s.update("heavy", 100);
+    s.update("light", 1);
+    s.update("new", 2);
+
+    std::vector<sketch_type::entry> top = s.top(2);
+    BOOST_REQUIRE_EQUAL(top.size(), 2);
+    BOOST_CHECK_EQUAL(top[0].key, "heavy");
+    BOOST_CHECK_EQUAL(top[1].key, "new");
+    BOOST_CHECK_EQUAL(top[1].count, 3);
+    BOOST_CHECK_EQUAL(top[1].error, 1);
+}
+
+BOOST_AUTO_TEST_CASE( space_saving_finds_heavy_key_in_stream ) {
+    sketch_type s(4);
+
+    for (int i = 0; i < 1000; i++) {
+        s.update("heavy", 10);
+        s.update(std::string(1, char('a' + i % 26)), 1);
+    }
+
+    std::vector<sketch_type::entry> top = s.top(1);
+    BOOST_REQUIRE_EQUAL(top.size(), 1);
+    BOOST_CHECK_EQUAL(top[0].key, "heavy");
+    BOOST_CHECK(top[0].count - top[0].error <= 10000);
+    BOOST_CHECK(top[0].count >= 10000);
+}
+
+BOOST_AUTO_TEST_CASE( space_saving_erase ) {
+    sketch_type s(3);
+
+    s.update("a", 1);
+    s.update("b", 2);
+    s.update("c", 3);
+    s.erase("a");
+    s.erase("missing");
+
+    BOOST_CHECK_EQUAL(s.size(), 2);
+    s.update("c", 1);
+
+    std::vector<sketch_type::entry> top = s.top(3);
+    BOOST_REQUIRE_EQUAL(top.size(), 2);
+    BOOST_CHECK_EQUAL(top[0].key, "c");
+    BOOST_CHECK_EQUAL(top[0].count, 4);
+}
+
+BOOST_AUTO_TEST_CASE( heavy_hitters_by_connection ) {
+    typedef websocketpp::metrics::heavy_hitters<websocketpp::concurrency::basic>
+        heavy_hitters;
+
+    websocketpp::lib::shared_ptr<int> c1 = websocketpp::lib::make_shared<int>(1);
+    websocketpp::lib::shared_ptr<int> c2 = websocketpp::lib::make_shared<int>(2);
+
+    heavy_hitters h(8);
+    h.report(c1, 10);
+    h.report(c2, 20);
+    h.report(c1, 15);
+
+    std::vector<heavy_hitters::entry> top = h.top(2);
+    BOOST_REQUIRE_EQUAL(top.size(), 2);
+    BOOST_CHECK(top[0].key.lock() == c1);
+    BOOST_CHECK_EQUAL(top[0].count, 25);
+
+    h.remove(c1);
+    BOOST_CHECK_EQUAL(h.top(2).size(), 1);
+}
+
+void count_traffic(websocketpp::metrics::endpoint_counters * c) {
+    for (int i = 0; i < 100000; ++i) {
+        websocketpp::metrics::counter_add(c->messages_in, 1);
+        websocketpp::metrics::counter_add(c->bytes_in, 3);
+        websocketpp::metrics::counter_add(c->queued_bytes, 5);
+        websocketpp::metrics::counter_sub(c->queued_bytes, 5);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( endpoint_counters_from_several_threads ) {
+    websocketpp::metrics::endpoint_counters c;
+
+    websocketpp::lib::thread a(count_traffic, &c);
+    websocketpp::lib::thread b(count_traffic, &c);
+    websocketpp::lib::thread d(count_traffic, &c);
+    count_traffic(&c);
+    a.join();
+    b.join();
+    d.join();
+
+    websocketpp::metrics::endpoint_counters s = c.snapshot();
+    BOOST_CHECK_EQUAL(s.messages_in, 400000);
+    BOOST_CHECK_EQUAL(s.bytes_in, 1200000);
+    BOOST_CHECK_EQUAL(s.queued_bytes, 0);
+}
@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#define BOOST_TEST_MODULE shared_stats
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/metrics/shared_stats.hpp>
+
+#include <websocketpp/common/thread.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace metrics = websocketpp::metrics;
+
+std::string segment_name(char const * test) {
+    std::stringstream s;
+    s << "/wspp_test_" << test << "_" << getpid();
+    return s.str();
+}
+
+// Write a raw segment to test how readers handle bad ones
+void write_raw(std::string const & name, metrics::stats_segment const & seg,
+    size_t size)
+{
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    BOOST_REQUIRE( fd != -1 );
+    BOOST_REQUIRE( ftruncate(fd, size) == 0 );
+    BOOST_REQUIRE( write(fd, &seg, std::min(size, sizeof(seg))) != -1 );
+    close(fd);
+}
+
+metrics::stats_segment valid_segment() {
+    metrics::stats_segment seg = metrics::stats_segment();
+    std::memcpy(seg.header.magic, "WSPPSTAT", 8);
+    seg.header.version = metrics::stats_segment::version;
+    seg.header.size = sizeof(metrics::stats_segment);
+    seg.header.pid = getpid();
+    return seg;
+}
+
+BOOST_AUTO_TEST_CASE( publish_and_read ) {
+    std::string name = segment_name("publish");
+
+    metrics::shared_stats writer;
+    websocketpp::lib::error_code ec;
+    writer.create(name, ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK( writer.is_open() );
+
+    metrics::shared_stats_reader reader;
+    reader.open(name, ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK_EQUAL( reader.get_pid(), static_cast<uint64_t>(getpid()) );
+
+    // a new segment reads as an empty snapshot
+    metrics::stats_snapshot s;
+    reader.read(s, ec);
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( s.publishes, 0 );
+
+    metrics::stats_snapshot out;
+    out.publishes = 3;
+    out.counters.connections_started = 10;
+    out.counters.connections_opened = 7;
+    out.counters.queued_bytes = 1234;
+    out.threads = 2;
+    out.lag[1].max_us = 99;
+    writer.publish(out);
+
+    reader.read(s, ec);
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( s.publishes, 3 );
+    BOOST_CHECK_EQUAL( s.counters.connections_started, 10 );
+    BOOST_CHECK_EQUAL( s.counters.connections_active(), 7 );
+    BOOST_CHECK_EQUAL( s.counters.queued_bytes, 1234 );
+    BOOST_CHECK_EQUAL( s.threads, 2 );
+    BOOST_CHECK_EQUAL( s.lag[1].max_us, 99 );
+}
+
+BOOST_AUTO_TEST_CASE( segment_removed_with_writer ) {
+    std::string name = segment_name("removed");
+    websocketpp::lib::error_code ec;
+    {
+        metrics::shared_stats writer;
+        writer.create(name, ec);
+        BOOST_REQUIRE( !ec );
+    }
+
+    metrics::shared_stats_reader reader;
+    reader.open(name, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::segment_not_found) );
+
+    metrics::stats_snapshot s;
+    reader.read(s, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::not_open) );
+}
+
+BOOST_AUTO_TEST_CASE( running_writer_keeps_segment ) {
+    std::string name = segment_name("in_use");
+    websocketpp::lib::error_code ec;
+
+    metrics::shared_stats writer;
+    writer.create(name, ec);
+    BOOST_REQUIRE( !ec );
+    {
+        metrics::shared_stats second;
+        second.create(name, ec);
+        BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+            metrics::error::segment_in_use) );
+        BOOST_CHECK( !second.is_open() );
+    }
+
+    // the refused writer did not remove the segment on its way out
+    metrics::shared_stats_reader reader;
+    reader.open(name, ec);
+    BOOST_CHECK( !ec );
+}
+
+BOOST_AUTO_TEST_CASE( stale_segment_replaced ) {
+    std::string name = segment_name("stale");
+
+    // a segment left behind by a process that has exited
+    pid_t child = fork();
+    BOOST_REQUIRE( child != -1 );
+    if (child == 0) {
+        _exit(0);
+    }
+    BOOST_REQUIRE_EQUAL( waitpid(child, NULL, 0), child );
+
+    metrics::stats_segment seg = valid_segment();
+    seg.header.pid = child;
+    write_raw(name, seg, sizeof(seg));
+
+    metrics::shared_stats writer;
+    websocketpp::lib::error_code ec;
+    writer.create(name, ec);
+    BOOST_REQUIRE( !ec );
+
+    metrics::shared_stats_reader reader;
+    reader.open(name, ec);
+    BOOST_REQUIRE( !ec );
+    BOOST_CHECK_EQUAL( reader.get_pid(), static_cast<uint64_t>(getpid()) );
+}
+
+BOOST_AUTO_TEST_CASE( replaced_segment_not_removed ) {
+    std::string name = segment_name("replaced");
+    websocketpp::lib::error_code ec;
+
+    metrics::shared_stats second;
+    {
+        metrics::shared_stats first;
+        first.create(name, ec);
+        BOOST_REQUIRE( !ec );
+
+        // someone removed the name and another writer took it
+        shm_unlink(name.c_str());
+        second.create(name, ec);
+        BOOST_REQUIRE( !ec );
+    }
+
+    metrics::shared_stats_reader reader;
+    reader.open(name, ec);
+    BOOST_CHECK( !ec );
+}
+
+BOOST_AUTO_TEST_CASE( invalid_segments ) {
+    std::string name = segment_name("invalid");
+    metrics::shared_stats_reader reader;
+    websocketpp::lib::error_code ec;
+
+    metrics::stats_segment seg = valid_segment();
+    std::memcpy(seg.header.magic, "NOTSTATS", 8);
+    write_raw(name, seg, sizeof(seg));
+    reader.open(name, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::invalid_segment) );
+
+    seg = valid_segment();
+    seg.header.version = metrics::stats_segment::version + 1;
+    write_raw(name, seg, sizeof(seg));
+    reader.open(name, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::version_mismatch) );
+
+    seg = valid_segment();
+    write_raw(name, seg, sizeof(seg.header));
+    reader.open(name, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::version_mismatch) );
+
+    write_raw(name, seg, 4);
+    reader.open(name, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::invalid_segment) );
+
+    shm_unlink(name.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( writer_holding_segment ) {
+    std::string name = segment_name("held");
+
+    // a writer that died half way through an update
+    metrics::stats_segment seg = valid_segment();
+    seg.header.sequence = 1;
+    write_raw(name, seg, sizeof(seg));
+
+    metrics::shared_stats_reader reader;
+    websocketpp::lib::error_code ec;
+    reader.open(name, ec);
+    BOOST_REQUIRE( !ec );
+
+    metrics::stats_snapshot s;
+    reader.read(s, ec);
+    BOOST_CHECK_EQUAL( ec, metrics::error::make_error_code(
+        metrics::error::write_in_progress) );
+
+    shm_unlink(name.c_str());
+}
+
+void write_loop(metrics::shared_stats * writer, bool * done) {
+    metrics::stats_snapshot s;
+    for (uint64_t i = 1; i <= 20000; ++i) {
+        s.publishes = i;
+        s.counters.bytes_in = i;
+        s.counters.queued_bytes = i;
+        s.lag[metrics::stats_snapshot::max_threads-1].total_us = i;
+        writer->publish(s);
+    }
+    __atomic_store_n(done, true, __ATOMIC_RELEASE);
+}
+
+BOOST_AUTO_TEST_CASE( reads_are_consistent ) {
+    std::string name = segment_name("consistent");
+
+    metrics::shared_stats writer;
+    websocketpp::lib::error_code ec;
+    writer.create(name, ec);
+    BOOST_REQUIRE( !ec );
+
+    metrics::shared_stats_reader reader;
+    reader.open(name, ec);
+    BOOST_REQUIRE( !ec );
+
+    bool done = false;
+    websocketpp::lib::thread t(&write_loop, &writer, &done);
+
+    size_t torn = 0;
+    uint64_t last = 0;
+    while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        metrics::stats_snapshot s;
+        reader.read(s, ec);
+        if (ec) {
+            continue;
+        }
+        uint64_t i = s.publishes;
+        if (s.counters.bytes_in != i || s.counters.queued_bytes != i ||
+            s.lag[metrics::stats_snapshot::max_threads-1].total_us != i ||
+            i < last)
+        {
+            ++torn;
+        }
+        last = i;
+    }
+    t.join();
+
+    BOOST_CHECK_EQUAL( torn, 0 );
+
+    metrics::stats_snapshot s;
+    reader.read(s, ec);
+    BOOST_CHECK( !ec );
+    BOOST_CHECK_EQUAL( s.publishes, 20000 );
+}
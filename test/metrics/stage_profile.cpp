@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE stage_profile
+#include <boost/test/unit_test.hpp>
+
+#define _WEBSOCKETPP_PROFILE_STAGES_
+#include <websocketpp/metrics/stage_profile.hpp>
+
+#include <websocketpp/common/thread.hpp>
+
+namespace metrics = websocketpp::metrics;
+
+void spin(uint64_t n) {
+    uint64_t start = metrics::cycles();
+    while (metrics::cycles() - start < n) {}
+}
+
+void record_unmask() {
+    _WEBSOCKETPP_PROFILE_STAGE_(unmask);
+    spin(1000);
+}
+
+BOOST_AUTO_TEST_CASE( stage_names ) {
+    BOOST_CHECK_EQUAL(metrics::stage::name(metrics::stage::frame_parse),
+        "frame_parse");
+    BOOST_CHECK_EQUAL(metrics::stage::name(metrics::stage::write_completion),
+        "write_completion");
+    BOOST_CHECK_EQUAL(metrics::stage::name(metrics::stage::count), "unknown");
+}
+
+BOOST_AUTO_TEST_CASE( nested_stages_are_exclusive ) {
+    metrics::stage_profile::reset();
+
+    uint64_t start = metrics::cycles();
+    {
+        _WEBSOCKETPP_PROFILE_STAGE_(read_completion);
+        spin(1000);
+        {
+            _WEBSOCKETPP_PROFILE_STAGE_(frame_parse);
+            spin(1000);
+            record_unmask();
+            record_unmask();
+        }
+    }
+    uint64_t elapsed = metrics::cycles() - start;
+
+    metrics::stage_snapshot s = metrics::stage_profile::snapshot();
+
+    BOOST_CHECK_EQUAL(s[metrics::stage::read_completion].calls, 1);
+    BOOST_CHECK_EQUAL(s[metrics::stage::frame_parse].calls, 1);
+    BOOST_CHECK_EQUAL(s[metrics::stage::unmask].calls, 2);
+    BOOST_CHECK_EQUAL(s[metrics::stage::handler].calls, 0);
+
+    BOOST_CHECK(s[metrics::stage::read_completion].cycles >= 1000);
+    BOOST_CHECK(s[metrics::stage::frame_parse].cycles >= 1000);
+    BOOST_CHECK(s[metrics::stage::unmask].cycles >= 2000);
+
+    // Nested time is not double counted
+    BOOST_CHECK(s.total_cycles() <= elapsed);
+}
+
+BOOST_AUTO_TEST_CASE( reset_clears_counters ) {
+    record_unmask();
+    BOOST_CHECK(metrics::stage_profile::snapshot()[metrics::stage::unmask].calls > 0);
+
+    metrics::stage_profile::reset();
+
+    metrics::stage_snapshot s = metrics::stage_profile::snapshot();
+    BOOST_CHECK_EQUAL(s[metrics::stage::unmask].calls, 0);
+    BOOST_CHECK_EQUAL(s.total_cycles(), 0);
+}
+
+void record_unmask_times(size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        record_unmask();
+    }
+}
+
+BOOST_AUTO_TEST_CASE( snapshot_sums_threads ) {
+    metrics::stage_profile::reset();
+
+    websocketpp::lib::thread a(record_unmask_times, 3);
+    websocketpp::lib::thread b(record_unmask_times, 4);
+    a.join();
+    b.join();
+    record_unmask();
+
+    metrics::stage_snapshot s = metrics::stage_profile::snapshot();
+    BOOST_CHECK_EQUAL(s[metrics::stage::unmask].calls, 8);
+}
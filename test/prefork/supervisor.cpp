@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE prefork
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/prefork/supervisor.hpp>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using websocketpp::prefork::supervisor;
+using websocketpp::prefork::worker;
+using websocketpp::prefork::worker_record;
+
+// Worker handlers run in the forked processes, so they must not use the test
+// framework. Results are checked through the shared worker records.
+
+int count_and_exit(worker & w) {
+    websocketpp::metrics::endpoint_counters & c = w.get_counters();
+    c.connections_opened += 2;
+    c.connections_closed += 2;
+    c.messages_in += 10 + w.get_index();
+    c.bytes_out += 100;
+    return 0;
+}
+
+int fail_first_start(worker & w) {
+    if (w.get_starts() == 1) {
+        return 3;
+    }
+    return 0;
+}
+
+int crash_with_open_connections(worker & w) {
+    websocketpp::metrics::endpoint_counters & c = w.get_counters();
+    if (w.get_starts() == 1) {
+        c.connections_opened += 3;
+        c.connections_closed += 1;
+        raise(SIGKILL);
+    }
+    return 0;
+}
+
+int wait_for_signal(worker &) {
+    while (true) {
+        pause();
+    }
+    return 0;
+}
+
+int sleep_and_exit(worker &) {
+    usleep(50000);
+    return 0;
+}
+
+void stop_after_report(supervisor * s, int * reports) {
+    ++*reports;
+    s->stop();
+}
+
+BOOST_AUTO_TEST_CASE( invalid_settings ) {
+    websocketpp::lib::error_code ec;
+
+    supervisor none(0);
+    none.set_worker_handler(&count_and_exit);
+    none.run(ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::prefork::error::make_error_code(
+        websocketpp::prefork::error::invalid_worker_count) );
+
+    supervisor no_handler(2);
+    no_handler.run(ec);
+    BOOST_CHECK_EQUAL( ec, websocketpp::prefork::error::make_error_code(
+        websocketpp::prefork::error::no_worker_handler) );
+}
+
+BOOST_AUTO_TEST_CASE( totals_are_summed_across_workers ) {
+    supervisor s(3);
+    s.set_worker_handler(&count_and_exit);
+
+    websocketpp::lib::error_code ec;
+    s.run(ec);
+    BOOST_CHECK( !ec );
+
+    websocketpp::metrics::endpoint_counters totals = s.get_totals();
+    BOOST_CHECK_EQUAL( totals.connections_opened, 6 );
+    BOOST_CHECK_EQUAL( totals.connections_active(), 0 );
+    BOOST_CHECK_EQUAL( totals.messages_in, 10 + 11 + 12 );
+    BOOST_CHECK_EQUAL( totals.bytes_out, 300 );
+
+    for (size_t i = 0; i < 3; ++i) {
+        worker_record r = s.get_worker(i);
+        BOOST_CHECK_EQUAL( r.starts, 1 );
+        BOOST_CHECK_EQUAL( r.crashes, 0 );
+        BOOST_CHECK_EQUAL( r.pid, 0 );
+    }
+    BOOST_CHECK_EQUAL( s.get_restarts(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( failed_workers_are_restarted ) {
+    supervisor s(2);
+    s.set_worker_handler(&fail_first_start);
+    s.set_restart_delay(10);
+
+    s.run();
+
+    BOOST_CHECK_EQUAL( s.get_restarts(), 2 );
+    for (size_t i = 0; i < 2; ++i) {
+        worker_record r = s.get_worker(i);
+        BOOST_CHECK_EQUAL( r.starts, 2 );
+        BOOST_CHECK_EQUAL( r.crashes, 1 );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( crashed_worker_connections_are_closed ) {
+    supervisor s(1);
+    s.set_worker_handler(&crash_with_open_connections);
+    s.set_restart_delay(10);
+
+    s.run();
+
+    websocketpp::metrics::endpoint_counters totals = s.get_totals();
+    BOOST_CHECK_EQUAL( totals.connections_opened, 3 );
+    BOOST_CHECK_EQUAL( totals.connections_closed, 3 );
+    BOOST_CHECK_EQUAL( s.get_worker(0).crashes, 1 );
+    BOOST_CHECK_EQUAL( s.get_restarts(), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( stop_terminates_workers ) {
+    supervisor s(2);
+    int reports = 0;
+    s.set_worker_handler(&wait_for_signal);
+    s.set_report_handler(websocketpp::lib::bind(&stop_after_report,&s,
+        &reports), 20);
+
+    s.run();
+
+    BOOST_CHECK( reports >= 1 );
+    for (size_t i = 0; i < 2; ++i) {
+        worker_record r = s.get_worker(i);
+        BOOST_CHECK_EQUAL( r.pid, 0 );
+        BOOST_CHECK_EQUAL( r.starts, 1 );
+        BOOST_CHECK_EQUAL( r.crashes, 0 );
+    }
+}
+
+BOOST_AUTO_TEST_CASE( other_children_are_not_reaped ) {
+    // a child of the application that exits while the supervisor runs
+    pid_t child = fork();
+    BOOST_REQUIRE( child != -1 );
+    if (child == 0) {
+        _exit(7);
+    }
+
+    supervisor s(1);
+    s.set_worker_handler(&sleep_and_exit);
+    s.run();
+    BOOST_CHECK_EQUAL( s.get_worker(0).crashes, 0 );
+
+    // its exit status is still there for the application to collect
+    int status = 0;
+    BOOST_REQUIRE_EQUAL( waitpid(child, &status, 0), child );
+    BOOST_CHECK( WIFEXITED(status) );
+    BOOST_CHECK_EQUAL( WEXITSTATUS(status), 7 );
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE processor_allocations
+#include <boost/test/unit_test.hpp>
+
+#include "../alloc_counter.hpp"
+#include "../allocation_test.hpp"
+#include "../recycling_msg_manager.hpp"
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/processors/hybi13.hpp>
+
+#include <string>
+#include <vector>
+
+// Allocation tests for the hybi13 frame reader and writer
+//
+// The processor is driven directly with config::core and with the recycling
+// message manager. Each test warms up first and then checks the number of
+// heap allocations per message against an upper bound.
+
+namespace {
+
+using allocation_test::warm_up;
+using allocation_test::messages;
+using allocation_test::fan_out;
+using allocation_test::client_frame;
+
+template <typename config>
+struct processor_setup {
+    typedef typename config::con_msg_manager_type con_msg_manager_type;
+    typedef typename config::message_type::ptr message_ptr;
+
+    processor_setup()
+      : msg_manager(new con_msg_manager_type())
+      , p(false,true,msg_manager,rng) {}
+
+    /// Consume all of `frames` and return the number of messages completed
+    size_t consume(std::string const & frames) {
+        size_t count = 0;
+        char const * buf = frames.data();
+        size_t len = frames.size();
+
+        while (len > 0) {
+            size_t consumed = p.consume(
+                reinterpret_cast<uint8_t *>(const_cast<char *>(buf)),len,ec);
+            BOOST_REQUIRE( !ec );
+            buf += consumed;
+            len -= consumed;
+            if (p.ready()) {
+                message_ptr msg = p.get_message();
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    websocketpp::lib::error_code ec;
+    typename con_msg_manager_type::ptr msg_manager;
+    typename config::rng_type rng;
+    websocketpp::processor::hybi13<config> p;
+};
+
+template <typename config>
+double consume_allocations(std::string const & frames) {
+    processor_setup<config> env;
+
+    for (size_t i = 0; i < warm_up; ++i) {
+        BOOST_REQUIRE_EQUAL( env.consume(frames), 1 );
+    }
+
+    alloc_counter::counts before = alloc_counter::snapshot();
+    for (size_t i = 0; i < messages; ++i) {
+        env.consume(frames);
+    }
+    return static_cast<double>(alloc_counter::allocations_since(before)) /
+        messages;
+}
+
+template <typename config>
+double single_frame_allocations() {
+    return consume_allocations<config>(client_frame(
+        websocketpp::frame::opcode::text,true,std::string(100,'r')));
+}
+
+template <typename config>
+double fragmented_allocations() {
+    std::string frames;
+    frames += client_frame(websocketpp::frame::opcode::binary,false,
+        std::string(60,'a'));
+    frames += client_frame(websocketpp::frame::opcode::continuation,false,
+        std::string(60,'b'));
+    frames += client_frame(websocketpp::frame::opcode::continuation,true,
+        std::string(60,'c'));
+    return consume_allocations<config>(frames);
+}
+
+/// Prepare `in` as `width` outgoing frames, as a send or broadcast does
+template <typename config>
+void prepare(processor_setup<config> & env,
+    typename config::message_type::ptr in, size_t width)
+{
+    for (size_t j = 0; j < width; ++j) {
+        typename config::message_type::ptr out =
+            env.msg_manager->get_message();
+        BOOST_REQUIRE( !env.p.prepare_data_frame(in,out) );
+    }
+}
+
+/// Allocations per prepared frame when each message is prepared `width` times
+template <typename config>
+double prepare_allocations(size_t width) {
+    typedef typename config::message_type::ptr message_ptr;
+    processor_setup<config> env;
+    std::string payload(100,'s');
+
+    for (size_t i = 0; i < warm_up; ++i) {
+        message_ptr in = env.msg_manager->get_message(
+            websocketpp::frame::opcode::text,payload.size());
+        in->append_payload(payload);
+        prepare(env,in,width);
+    }
+
+    alloc_counter::counts before = alloc_counter::snapshot();
+    for (size_t i = 0; i < messages; ++i) {
+        message_ptr in = env.msg_manager->get_message(
+            websocketpp::frame::opcode::text,payload.size());
+        in->append_payload(payload);
+        prepare(env,in,width);
+    }
+    return static_cast<double>(alloc_counter::allocations_since(before)) /
+        (messages * width);
+}
+
+} // namespace
+
+// config::core allocates every message and its payload. The recycling
+// manager reuses both, so its steady state must not allocate at all.
+
+BOOST_AUTO_TEST_CASE( allocations_per_frame_consumed ) {
+    BOOST_CHECK_LE( single_frame_allocations<websocketpp::config::core>(), 2 );
+    BOOST_CHECK_EQUAL( single_frame_allocations<recycling_config>(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_fragmented_message_consumed ) {
+    BOOST_CHECK_LE( fragmented_allocations<websocketpp::config::core>(), 4 );
+    BOOST_CHECK_EQUAL( fragmented_allocations<recycling_config>(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_frame_prepared ) {
+    BOOST_CHECK_LE( prepare_allocations<websocketpp::config::core>(1), 4 );
+    BOOST_CHECK_EQUAL( prepare_allocations<recycling_config>(1), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( allocations_per_frame_broadcast ) {
+    BOOST_CHECK_LE(
+        prepare_allocations<websocketpp::config::core>(fan_out), 3 );
+    BOOST_CHECK_EQUAL( prepare_allocations<recycling_config>(fan_out), 0 );
+}
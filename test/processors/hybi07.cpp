@@ -37,6 +37,7 @@
 #include <websocketpp/message_buffer/message.hpp>
 #include <websocketpp/message_buffer/alloc.hpp>
 #include <websocketpp/extensions/permessage_deflate/disabled.hpp>
+#include <websocketpp/extensions/message_batching/disabled.hpp>
 #include <websocketpp/random/none.hpp>
 
 struct stub_config {
@@ -51,6 +52,8 @@ struct stub_config {
     typedef websocketpp::random::none::int_generator<uint32_t> rng_type;
 
     static const size_t max_message_size = 16000000;
+    static const websocketpp::role::value endpoint_role =
+        websocketpp::role::any;
 
     /// Extension related config
     static const bool enable_extensions = false;
@@ -64,6 +67,14 @@ struct stub_config {
 
     typedef websocketpp::extensions::permessage_deflate::disabled
         <permessage_deflate_config> permessage_deflate_type;
+
+    struct message_batching_config {
+        static const size_t max_message_size = 512;
+        static const size_t max_batch_size = 16384;
+    };
+
+    typedef websocketpp::extensions::message_batching::disabled
+        <message_batching_config> message_batching_type;
 };
 
 BOOST_AUTO_TEST_CASE( exact_match ) {
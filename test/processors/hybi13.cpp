@@ -40,7 +40,9 @@
 #include <websocketpp/random/none.hpp>
 
 #include <websocketpp/extensions/permessage_deflate/disabled.hpp>
+#include <websocketpp/extensions/message_batching/disabled.hpp>
 #include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/extensions/message_batching/enabled.hpp>
 
 struct stub_config {
     typedef websocketpp::http::parser::request request_type;
@@ -60,7 +62,17 @@ struct stub_config {
     typedef websocketpp::extensions::permessage_deflate::disabled
         <permessage_deflate_config> permessage_deflate_type;
 
+    struct message_batching_config {
+        static const size_t max_message_size = 512;
+        static const size_t max_batch_size = 16384;
+    };
+
+    typedef websocketpp::extensions::message_batching::disabled
+        <message_batching_config> message_batching_type;
+
     static const size_t max_message_size = 16000000;
+    static const websocketpp::role::value endpoint_role =
+        websocketpp::role::any;
     static const bool enable_extensions = false;
 };
 
@@ -82,7 +94,49 @@ struct stub_config_ext {
     typedef websocketpp::extensions::permessage_deflate::enabled
         <permessage_deflate_config> permessage_deflate_type;
 
+    struct message_batching_config {
+        static const size_t max_message_size = 512;
+        static const size_t max_batch_size = 16384;
+    };
+
+    typedef websocketpp::extensions::message_batching::disabled
+        <message_batching_config> message_batching_type;
+
+    static const size_t max_message_size = 16000000;
+    static const websocketpp::role::value endpoint_role =
+        websocketpp::role::any;
+    static const bool enable_extensions = true;
+};
+
+struct stub_config_batch {
+    typedef websocketpp::http::parser::request request_type;
+    typedef websocketpp::http::parser::response response_type;
+
+    typedef websocketpp::message_buffer::message
+        <websocketpp::message_buffer::alloc::con_msg_manager> message_type;
+    typedef websocketpp::message_buffer::alloc::con_msg_manager<message_type>
+        con_msg_manager_type;
+
+    typedef websocketpp::random::none::int_generator<uint32_t> rng_type;
+
+    struct permessage_deflate_config {
+        typedef stub_config_batch::request_type request_type;
+    };
+
+    typedef websocketpp::extensions::permessage_deflate::disabled
+        <permessage_deflate_config> permessage_deflate_type;
+
+    struct message_batching_config {
+        static const size_t max_message_size = 512;
+        static const size_t max_batch_size = 16384;
+    };
+
+    typedef websocketpp::extensions::message_batching::enabled
+        <message_batching_config> message_batching_type;
+
     static const size_t max_message_size = 16000000;
+    static const websocketpp::role::value endpoint_role =
+        websocketpp::role::any;
     static const bool enable_extensions = true;
 };
 
@@ -117,6 +171,19 @@ struct processor_setup_ext {
     websocketpp::processor::hybi13<stub_config_ext> p;
 };
 
+struct processor_setup_batch {
+    processor_setup_batch(bool server)
+      : msg_manager(new con_msg_manager_type())
+      , p(false,server,msg_manager,rng) {}
+
+    websocketpp::lib::error_code ec;
+    con_msg_manager_type::ptr msg_manager;
+    stub_config::rng_type rng;
+    stub_config::request_type req;
+    stub_config::response_type res;
+    websocketpp::processor::hybi13<stub_config_batch> p;
+};
+
 BOOST_AUTO_TEST_CASE( exact_match ) {
     processor_setup env(true);
 
@@ -298,6 +365,59 @@ BOOST_AUTO_TEST_CASE( frame_jumbo_binary_unmasked ) {
     BOOST_CHECK_EQUAL( foo->get_payload().size(), 126 );
 }
 
+BOOST_AUTO_TEST_CASE( frames_split_at_every_offset ) {
+    // masked text "Hello", masked ping "ab" and masked 126 byte binary with
+    // a 16 bit length, all with the masking key 0x37fa213d
+    uint8_t key[4] = {0x37, 0xfa, 0x21, 0x3d};
+    std::string frames;
+    frames += "\x81\x85";
+    frames.append(reinterpret_cast<char *>(key),4);
+    frames += "Hello";
+    frames += "\x89\x82";
+    frames.append(reinterpret_cast<char *>(key),4);
+    frames += "ab";
+    frames += std::string("\x82\xfe\x00\x7e",4);
+    frames.append(reinterpret_cast<char *>(key),4);
+    frames += std::string(126,'*');
+
+    std::string wire(frames);
+    size_t payloads[3] = {6, 17, 27};
+    size_t lengths[3] = {5, 2, 126};
+    for (size_t f = 0; f < 3; f++) {
+        for (size_t i = 0; i < lengths[f]; i++) {
+            wire[payloads[f]+i] = static_cast<char>(wire[payloads[f]+i] ^ key[i % 4]);
+        }
+    }
+
+    for (size_t split = 0; split <= wire.size(); split++) {
+        processor_setup env(true);
+        std::string buf(wire);
+        uint8_t * data = reinterpret_cast<uint8_t *>(&buf[0]);
+        std::vector<message_ptr> msgs;
+
+        size_t p = 0;
+        while (p < split && !env.ec) {
+            p += env.p.consume(data+p,split-p,env.ec);
+            if (env.p.ready()) {
+                msgs.push_back(env.p.get_message());
+            }
+        }
+        while (p < buf.size() && !env.ec) {
+            p += env.p.consume(data+p,buf.size()-p,env.ec);
+            if (env.p.ready()) {
+                msgs.push_back(env.p.get_message());
+            }
+        }
+
+        BOOST_CHECK( !env.ec );
+        BOOST_REQUIRE_EQUAL( msgs.size(), 3 );
+        BOOST_CHECK_EQUAL( msgs[0]->get_payload(), "Hello" );
+        BOOST_CHECK_EQUAL( msgs[1]->get_opcode(), websocketpp::frame::opcode::PING );
+        BOOST_CHECK_EQUAL( msgs[1]->get_payload(), "ab" );
+        BOOST_CHECK_EQUAL( msgs[2]->get_payload(), std::string(126,'*') );
+    }
+}
+
 BOOST_AUTO_TEST_CASE( control_frame_too_large ) {
     processor_setup env(false);
 
@@ -491,6 +611,79 @@ BOOST_AUTO_TEST_CASE( prepare_data_frame ) {
 
 }
 
+BOOST_AUTO_TEST_CASE( prepare_data_fragment ) {
+    processor_setup env(true);
+    processor_setup env_c(false);
+
+    message_ptr in = env.msg_manager->get_message();
+    message_ptr out = env.msg_manager->get_message();
+
+    in->set_opcode(websocketpp::frame::opcode::BINARY);
+    in->set_payload("abcdef");
+
+    // ranges past the end of the payload are rejected
+    BOOST_CHECK_EQUAL( env.p.prepare_data_fragment(in,4,3,out), websocketpp::processor::error::invalid_arguments );
+    BOOST_CHECK_EQUAL( env.p.prepare_data_fragment(in,7,0,out), websocketpp::processor::error::invalid_arguments );
+
+    // first fragment keeps the opcode and clears fin
+    BOOST_CHECK( !env.p.prepare_data_fragment(in,0,4,out) );
+    BOOST_CHECK_EQUAL( out->get_header(), std::string("\x02\x04",2) );
+    BOOST_CHECK_EQUAL( out->get_payload(), "abcd" );
+    BOOST_CHECK_EQUAL( out->get_fin(), false );
+
+    std::string wire = out->get_header() + out->get_payload();
+
+    // last fragment is a continuation frame with fin set
+    out = env.msg_manager->get_message();
+    BOOST_CHECK( !env.p.prepare_data_fragment(in,4,2,out) );
+    BOOST_CHECK_EQUAL( out->get_header(), std::string("\x80\x02",2) );
+    BOOST_CHECK_EQUAL( out->get_opcode(), websocketpp::frame::opcode::CONTINUATION );
+    BOOST_CHECK_EQUAL( out->get_fin(), true );
+
+    wire += out->get_header() + out->get_payload();
+
+    BOOST_CHECK_EQUAL( env_c.p.consume(reinterpret_cast<uint8_t *>(&wire[0]),wire.size(),env_c.ec), wire.size() );
+    BOOST_CHECK( !env_c.ec );
+    BOOST_REQUIRE( env_c.p.ready() );
+    BOOST_CHECK_EQUAL( env_c.p.get_message()->get_payload(), "abcdef" );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_data_fragment_compressed ) {
+    processor_setup_ext env(true);
+    processor_setup_ext env_c(false);
+
+    env.req.replace_header("Sec-WebSocket-Extensions","permessage-deflate");
+    std::pair<websocketpp::lib::error_code,std::string> neg_results;
+    neg_results = env.p.negotiate_extensions(env.req);
+    BOOST_REQUIRE( !neg_results.first );
+
+    env.res.replace_header("Sec-WebSocket-Extensions",neg_results.second);
+    BOOST_REQUIRE( !env_c.p.negotiate_extensions(env.res).first );
+
+    message_ptr in = env.msg_manager->get_message();
+    in->set_opcode(websocketpp::frame::opcode::TEXT);
+    in->set_payload("hello hello hello hello");
+    in->set_compressed(true);
+
+    // Only the first fragment carries the compression bit. The fragments
+    // together decompress to the original message.
+    std::string wire;
+    for (size_t offset = 0; offset < 23; offset += 8) {
+        message_ptr out = env.msg_manager->get_message();
+        size_t len = (offset + 8 > 23 ? 23 - offset : 8);
+
+        BOOST_CHECK( !env.p.prepare_data_fragment(in,offset,len,out) );
+        BOOST_CHECK_EQUAL( websocketpp::frame::get_rsv1(websocketpp::frame::basic_header(out->get_header()[0],0)), offset == 0 );
+
+        wire += out->get_header() + out->get_payload();
+    }
+
+    BOOST_CHECK_EQUAL( env_c.p.consume(reinterpret_cast<uint8_t *>(&wire[0]),wire.size(),env_c.ec), wire.size() );
+    BOOST_CHECK( !env_c.ec );
+    BOOST_REQUIRE( env_c.p.ready() );
+    BOOST_CHECK_EQUAL( env_c.p.get_message()->get_payload(), "hello hello hello hello" );
+}
+
 BOOST_AUTO_TEST_CASE( single_frame_message_too_large ) {
     processor_setup env(true);
     
@@ -520,6 +713,35 @@ BOOST_AUTO_TEST_CASE( multiple_frame_message_too_large ) {
     BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::message_too_big );
 }
 
+BOOST_AUTO_TEST_CASE( compressed_message_too_large ) {
+    processor_setup_ext env(true);
+    processor_setup_ext env_c(false);
+
+    env.req.replace_header("Sec-WebSocket-Extensions","permessage-deflate");
+    std::pair<websocketpp::lib::error_code,std::string> neg_results;
+    neg_results = env.p.negotiate_extensions(env.req);
+    BOOST_REQUIRE( !neg_results.first );
+
+    env.res.replace_header("Sec-WebSocket-Extensions",neg_results.second);
+    BOOST_REQUIRE( !env_c.p.negotiate_extensions(env.res).first );
+
+    env.p.set_max_message_size(1000);
+
+    // a message that compresses to well under the limit but inflates past it
+    message_ptr in = env_c.msg_manager->get_message();
+    message_ptr out = env_c.msg_manager->get_message();
+    in->set_opcode(websocketpp::frame::opcode::BINARY);
+    in->set_payload(std::string(100000,'a'));
+    in->set_compressed(true);
+    BOOST_REQUIRE( !env_c.p.prepare_data_frame(in,out) );
+    BOOST_REQUIRE( out->get_payload().size() < 1000 );
+
+    std::string wire = out->get_header() + out->get_payload();
+    env.p.consume(reinterpret_cast<uint8_t *>(&wire[0]),wire.size(),env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::message_too_big );
+    BOOST_CHECK( !env.p.ready() );
+}
+
 
 
 BOOST_AUTO_TEST_CASE( client_handshake_request ) {
@@ -635,6 +857,7 @@ BOOST_AUTO_TEST_CASE( extension_negotiation_unknown ) {
 
     BOOST_CHECK( !neg_results.first );
     BOOST_CHECK_EQUAL( neg_results.second, "" );
+    BOOST_CHECK( !env.p.permessage_compress_enabled() );
 }
 
 BOOST_AUTO_TEST_CASE( extract_subprotocols_empty ) {
@@ -689,5 +912,144 @@ BOOST_AUTO_TEST_CASE( extension_negotiation_permessage_deflate ) {
 
     BOOST_CHECK( !neg_results.first );
     BOOST_CHECK_EQUAL( neg_results.second, "permessage-deflate" );
+    BOOST_CHECK( env.p.permessage_compress_enabled() );
 }
 
+BOOST_AUTO_TEST_CASE( extension_negotiation_permessage_deflate_settings ) {
+    processor_setup_ext env(true);
+    processor_setup_ext env_declined(true);
+    websocketpp::extensions::permessage_deflate::settings s;
+
+    env.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; client_max_window_bits");
+    env_declined.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate; client_max_window_bits");
+
+    BOOST_CHECK_EQUAL( env.p.permessage_compress_memory(), 0 );
+
+    s.server_max_window_bits = 10;
+    s.client_max_window_bits = 9;
+    s.memory_level = 1;
+    BOOST_CHECK( !env.p.set_permessage_compress_settings(s) );
+
+    std::pair<websocketpp::lib::error_code,std::string> neg_results;
+    neg_results = env.p.negotiate_extensions(env.req);
+
+    BOOST_CHECK( !neg_results.first );
+    BOOST_CHECK_EQUAL( neg_results.second,
+        "permessage-deflate; server_max_window_bits=10; client_max_window_bits=9" );
+    BOOST_CHECK( env.p.permessage_compress_enabled() );
+    BOOST_CHECK_EQUAL( env.p.permessage_compress_memory(),
+        websocketpp::extensions::permessage_deflate::estimate_memory(10,9,1) );
+
+    s.decline = true;
+    BOOST_CHECK( !env_declined.p.set_permessage_compress_settings(s) );
+    neg_results = env_declined.p.negotiate_extensions(env_declined.req);
+
+    BOOST_CHECK( !neg_results.first );
+    BOOST_CHECK_EQUAL( neg_results.second, "" );
+    BOOST_CHECK( !env_declined.p.permessage_compress_enabled() );
+}
+
+
+BOOST_AUTO_TEST_CASE( extension_negotiation_message_batching ) {
+    processor_setup_batch env(true);
+    processor_setup_batch env_c(false);
+
+    std::pair<websocketpp::lib::error_code,std::string> neg_results;
+
+    // offers with parameters are declined
+    env.req.replace_header("Sec-WebSocket-Extensions",
+        "x-websocketpp-batch; size=10");
+    neg_results = env.p.negotiate_extensions(env.req);
+
+    BOOST_CHECK( !neg_results.first );
+    BOOST_CHECK_EQUAL( neg_results.second, "" );
+    BOOST_CHECK( !env.p.message_batching_enabled() );
+
+    env.req.replace_header("Sec-WebSocket-Extensions",
+        "permessage-deflate, x-websocketpp-batch");
+    neg_results = env.p.negotiate_extensions(env.req);
+
+    BOOST_CHECK( !neg_results.first );
+    BOOST_CHECK_EQUAL( neg_results.second, "x-websocketpp-batch" );
+    BOOST_CHECK( env.p.message_batching_enabled() );
+
+    // clients offer it with their handshake request
+    websocketpp::uri_ptr u(new websocketpp::uri("ws://localhost/"));
+    BOOST_CHECK( !env_c.p.client_handshake_request(env_c.req,u,
+        std::vector<std::string>()) );
+    BOOST_CHECK_EQUAL( env_c.req.get_header("Sec-WebSocket-Extensions"),
+        "x-websocketpp-batch" );
+}
+
+BOOST_AUTO_TEST_CASE( prepare_batch ) {
+    processor_setup_batch env(true);
+    processor_setup_batch env_c(false);
+
+    env.req.replace_header("Sec-WebSocket-Extensions","x-websocketpp-batch");
+    env_c.res.replace_header("Sec-WebSocket-Extensions","x-websocketpp-batch");
+
+    std::vector<message_ptr> batch;
+    message_ptr out = env.msg_manager->get_message();
+
+    // requires a negotiated extension
+    batch.push_back(env.msg_manager->get_message(
+        websocketpp::frame::opcode::TEXT,0));
+    batch.back()->set_payload("foo");
+    BOOST_CHECK_EQUAL( env.p.prepare_batch(batch,out), websocketpp::processor::error::extensions_disabled );
+
+    BOOST_CHECK( !env.p.negotiate_extensions(env.req).first );
+    BOOST_CHECK( !env_c.p.negotiate_extensions(env_c.res).first );
+
+    batch.push_back(env.msg_manager->get_message(
+        websocketpp::frame::opcode::TEXT,0));
+    batch.back()->set_payload(std::string(200,'x'));
+    batch.push_back(env.msg_manager->get_message(
+        websocketpp::frame::opcode::TEXT,0));
+
+    // 3 + 200 + 0 bytes of payload, length prefixes of 1, 2 and 1 bytes
+    BOOST_CHECK( !env.p.prepare_batch(batch,out) );
+    BOOST_CHECK_EQUAL( out->get_header(), std::string("\xa1\x7e\x00\xcf",4) );
+    BOOST_CHECK_EQUAL( out->get_payload().substr(0,6), std::string("\x03" "foo" "\xc8\x01",6) );
+
+    std::string wire = out->get_header() + out->get_payload();
+    BOOST_CHECK_EQUAL( env_c.p.consume(reinterpret_cast<uint8_t *>(&wire[0]),wire.size(),env_c.ec), wire.size() );
+    BOOST_CHECK( !env_c.ec );
+
+    // each message of the batch is handed out separately
+    BOOST_REQUIRE( env_c.p.ready() );
+    BOOST_CHECK_EQUAL( env_c.p.get_message()->get_payload(), "foo" );
+    BOOST_REQUIRE( env_c.p.ready() );
+    BOOST_CHECK_EQUAL( env_c.p.get_message()->get_payload(), std::string(200,'x') );
+    BOOST_REQUIRE( env_c.p.ready() );
+    message_ptr last = env_c.p.get_message();
+    BOOST_CHECK_EQUAL( last->get_payload(), "" );
+    BOOST_CHECK_EQUAL( last->get_opcode(), websocketpp::frame::opcode::TEXT );
+    BOOST_CHECK( !env_c.p.ready() );
+
+    // mixed opcodes can not share a batch
+    batch.push_back(env.msg_manager->get_message(
+        websocketpp::frame::opcode::BINARY,0));
+    BOOST_CHECK_EQUAL( env.p.prepare_batch(batch,out), websocketpp::processor::error::invalid_opcode );
+}
+
+BOOST_AUTO_TEST_CASE( batch_requires_negotiation ) {
+    processor_setup env(false);
+    processor_setup_batch env_b(false);
+
+    uint8_t frame[5] = {0xa2, 0x03, 0x02, 0x61, 0x62};
+
+    // rsv2 is a protocol error without the extension
+    env.p.consume(frame,5,env.ec);
+    BOOST_CHECK_EQUAL( env.ec, websocketpp::processor::error::invalid_rsv_bit );
+
+    // a record running past the end of the batch is malformed
+    env_b.req.replace_header("Sec-WebSocket-Extensions","x-websocketpp-batch");
+    BOOST_CHECK( !env_b.p.negotiate_extensions(env_b.req).first );
+
+    frame[2] = 0x05;
+    env_b.p.consume(frame,5,env_b.ec);
+    BOOST_CHECK_EQUAL( env_b.ec, websocketpp::extensions::message_batching::error::malformed_batch );
+    BOOST_CHECK( !env_b.p.ready() );
+}
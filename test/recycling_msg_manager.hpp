@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TEST_RECYCLING_MSG_MANAGER_HPP
+#define WEBSOCKETPP_TEST_RECYCLING_MSG_MANAGER_HPP
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/message_buffer/alloc.hpp>
+#include <websocketpp/message_buffer/message.hpp>
+
+#include <string>
+#include <vector>
+
+/// A connection message manager that reuses messages
+/**
+ * Keeps up to `pool_size` messages and hands out one that nobody else holds a
+ * reference to before allocating a new one. Reused messages keep the capacity
+ * of their header and payload strings. Used by the allocation tests as the
+ * second message manager configuration next to message_buffer::alloc.
+ */
+template <typename message>
+class recycling_con_msg_manager
+  : public websocketpp::lib::enable_shared_from_this<
+        recycling_con_msg_manager<message> >
+{
+public:
+    typedef recycling_con_msg_manager<message> type;
+    typedef websocketpp::lib::shared_ptr<recycling_con_msg_manager> ptr;
+    typedef websocketpp::lib::weak_ptr<recycling_con_msg_manager> weak_ptr;
+
+    typedef typename message::ptr message_ptr;
+
+    static size_t const pool_size = 16;
+
+    recycling_con_msg_manager() {
+        m_pool.reserve(pool_size);
+    }
+
+    message_ptr get_message() {
+        message_ptr msg = find_idle();
+        if (msg) {
+            return msg;
+        }
+        msg = websocketpp::lib::make_shared<message>(type::shared_from_this());
+        keep(msg);
+        return msg;
+    }
+
+    message_ptr get_message(websocketpp::frame::opcode::value op, size_t size)
+    {
+        message_ptr msg = find_idle();
+        if (msg) {
+            msg->set_opcode(op);
+            msg->get_raw_payload().reserve(size);
+            return msg;
+        }
+        msg = websocketpp::lib::make_shared<message>(type::shared_from_this(),
+            op, size);
+        keep(msg);
+        return msg;
+    }
+
+    bool recycle(message *) {
+        return false;
+    }
+private:
+    message_ptr find_idle() {
+        for (size_t i = 0; i < m_pool.size(); ++i) {
+            if (m_pool[i].use_count() == 1) {
+                message_ptr msg = m_pool[i];
+                msg->set_header(std::string());
+                msg->get_raw_payload().clear();
+                msg->set_prepared(false);
+                msg->set_fin(true);
+                msg->set_terminal(false);
+                msg->set_compressed(false);
+                msg->clear_deadline();
+                return msg;
+            }
+        }
+        return message_ptr();
+    }
+
+    void keep(message_ptr const & msg) {
+        if (m_pool.size() < pool_size) {
+            m_pool.push_back(msg);
+        }
+    }
+
+    std::vector<message_ptr> m_pool;
+};
+
+/// config::core with the recycling message manager
+struct recycling_config : public websocketpp::config::core {
+    typedef websocketpp::message_buffer::message<recycling_con_msg_manager>
+        message_type;
+    typedef recycling_con_msg_manager<message_type> con_msg_manager_type;
+    typedef websocketpp::message_buffer::alloc::endpoint_msg_manager
+        <con_msg_manager_type> endpoint_msg_manager_type;
+};
+
+#endif // WEBSOCKETPP_TEST_RECYCLING_MSG_MANAGER_HPP
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE resume
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/resume/session_store.hpp>
+
+#include <websocketpp/config/core.hpp>
+#include <websocketpp/server.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+typedef websocketpp::server<websocketpp::config::core> server;
+typedef websocketpp::config::core::message_type::ptr message_ptr;
+typedef websocketpp::config::core::con_msg_manager_type con_msg_manager_type;
+typedef websocketpp::resume::replay_buffer<message_ptr> replay_buffer;
+typedef websocketpp::resume::session_store<websocketpp::config::core> session_store;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::bind;
+
+message_ptr make_message(std::string const & payload) {
+    static con_msg_manager_type::ptr manager =
+        websocketpp::lib::make_shared<con_msg_manager_type>();
+
+    message_ptr msg = manager->get_message(websocketpp::frame::opcode::text,
+        payload.size());
+    msg->set_payload(payload);
+    return msg;
+}
+
+BOOST_AUTO_TEST_CASE( replay_buffer_sequence ) {
+    replay_buffer b(3);
+
+    BOOST_CHECK_EQUAL(b.push(make_message("a")), 1);
+    BOOST_CHECK_EQUAL(b.push(make_message("bb")), 2);
+    BOOST_CHECK_EQUAL(b.first_seq(), 1);
+    BOOST_CHECK_EQUAL(b.last_seq(), 2);
+    BOOST_CHECK_EQUAL(b.bytes(), 3);
+
+    std::vector<message_ptr> out;
+    BOOST_CHECK(b.replay(1, out));
+    BOOST_REQUIRE_EQUAL(out.size(), 1);
+    BOOST_CHECK_EQUAL(out[0]->get_payload(), "bb");
+
+    out.clear();
+    BOOST_CHECK(b.replay(2, out));
+    BOOST_CHECK(out.empty());
+
+    BOOST_CHECK(!b.replay(3, out));
+}
+
+BOOST_AUTO_TEST_CASE( replay_buffer_wrap ) {
+    replay_buffer b(2);
+
+    b.push(make_message("a"));
+    b.push(make_message("b"));
+    b.push(make_message("c"));
+
+    BOOST_CHECK_EQUAL(b.size(), 2);
+    BOOST_CHECK_EQUAL(b.first_seq(), 2);
+    BOOST_CHECK_EQUAL(b.bytes(), 2);
+
+    std::vector<message_ptr> out;
+    BOOST_CHECK(!b.replay(0, out));
+    BOOST_CHECK(out.empty());
+
+    BOOST_CHECK(b.replay(1, out));
+    BOOST_REQUIRE_EQUAL(out.size(), 2);
+    BOOST_CHECK_EQUAL(out[0]->get_payload(), "b");
+    BOOST_CHECK_EQUAL(out[1]->get_payload(), "c");
+
+    b.clear();
+    BOOST_CHECK_EQUAL(b.bytes(), 0);
+    BOOST_CHECK_EQUAL(b.push(make_message("d")), 4);
+}
+
+BOOST_AUTO_TEST_CASE( replay_buffer_erase ) {
+    replay_buffer b(3);
+
+    message_ptr dropped = make_message("bb");
+    b.push(make_message("a"));
+    b.push(dropped);
+    b.push(make_message("c"));
+
+    BOOST_CHECK(b.erase(dropped));
+    BOOST_CHECK(!b.erase(dropped));
+    BOOST_CHECK_EQUAL(b.last_seq(), 2);
+    BOOST_CHECK_EQUAL(b.bytes(), 2);
+
+    std::vector<message_ptr> out;
+    BOOST_CHECK(b.replay(1, out));
+    BOOST_REQUIRE_EQUAL(out.size(), 1);
+    BOOST_CHECK_EQUAL(out[0]->get_payload(), "c");
+
+    BOOST_CHECK_EQUAL(b.push(make_message("d")), 3);
+}
+
+BOOST_AUTO_TEST_CASE( parse_session_header ) {
+    std::string token;
+    uint64_t last_seq;
+
+    BOOST_CHECK(websocketpp::resume::parse_header("abc; last=42", token, last_seq));
+    BOOST_CHECK_EQUAL(token, "abc");
+    BOOST_CHECK_EQUAL(last_seq, 42);
+
+    BOOST_CHECK(websocketpp::resume::parse_header(" abc ", token, last_seq));
+    BOOST_CHECK_EQUAL(token, "abc");
+    BOOST_CHECK_EQUAL(last_seq, 0);
+
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=x", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header(";last=1", token, last_seq));
+
+    // parameters are matched by their whole name
+    BOOST_CHECK(websocketpp::resume::parse_header("abc;v=2 ; last = 7", token, last_seq));
+    BOOST_CHECK_EQUAL(last_seq, 7);
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; xlast=5", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; foo=\"last=9\"", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=1; last=2", token, last_seq));
+
+    // the sequence number is a whole, unsigned, decimal number
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=-1", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=+1", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=5x", token, last_seq));
+    BOOST_CHECK(!websocketpp::resume::parse_header("abc; last=99999999999999999999", token, last_seq));
+}
+
+BOOST_AUTO_TEST_CASE( session_store_resume ) {
+    session_store store(8, 1024, 60000);
+
+    std::string token = store.create();
+    BOOST_CHECK_EQUAL(token.size(), 32);
+    BOOST_CHECK(store.create() != token);
+
+    message_ptr shared = make_message("shared");
+    BOOST_CHECK_EQUAL(store.record(token, make_message("a")), 1);
+    BOOST_CHECK_EQUAL(store.record(token, shared), 2);
+    BOOST_CHECK_EQUAL(store.record(token, make_message("c")), 3);
+    BOOST_CHECK_EQUAL(store.record("unknown", shared), 0);
+
+    store.detach(token);
+
+    std::vector<message_ptr> missed;
+    BOOST_CHECK(!store.resume(token, 1, missed));
+    BOOST_REQUIRE_EQUAL(missed.size(), 2);
+    BOOST_CHECK(missed[0] == shared);
+
+    missed.clear();
+    BOOST_CHECK_EQUAL(store.resume("unknown", 1, missed),
+        websocketpp::resume::error::make_error_code(
+            websocketpp::resume::error::unknown_session));
+    BOOST_CHECK_EQUAL(store.resume(token, 7, missed),
+        websocketpp::resume::error::make_error_code(
+            websocketpp::resume::error::session_in_use));
+
+    // A session attached to a connection cannot be taken over
+    BOOST_CHECK_EQUAL(store.resume(token, 1, missed),
+        websocketpp::resume::error::make_error_code(
+            websocketpp::resume::error::session_in_use));
+
+    store.detach(token);
+    BOOST_CHECK_EQUAL(store.resume(token, 7, missed),
+        websocketpp::resume::error::make_error_code(
+            websocketpp::resume::error::replay_unavailable));
+    BOOST_CHECK(missed.empty());
+}
+
+BOOST_AUTO_TEST_CASE( session_store_eviction ) {
+    session_store store(8, 4, 60000);
+
+    std::string detached = store.create();
+    std::string attached = store.create();
+
+    store.record(detached, make_message("aa"));
+    store.detach(detached);
+
+    // Going over budget evicts detached sessions but never attached ones
+    store.record(attached, make_message("bbbb"));
+    BOOST_CHECK_EQUAL(store.size(), 1);
+    BOOST_CHECK_EQUAL(store.last_seq(detached), 0);
+    BOOST_CHECK_EQUAL(store.bytes(), 4);
+
+    store.record(attached, make_message("c"));
+    BOOST_CHECK_EQUAL(store.size(), 1);
+    BOOST_CHECK_EQUAL(store.bytes(), 5);
+
+    // Detached sessions are evicted once their TTL has passed
+    session_store short_lived(8, 1024, 0);
+    std::string token = short_lived.create();
+    BOOST_CHECK_EQUAL(short_lived.expire(), 0);
+    short_lived.detach(token);
+    BOOST_CHECK_EQUAL(short_lived.expire(), 1);
+    BOOST_CHECK_EQUAL(short_lived.size(), 0);
+}
+
+struct handshake_result {
+    std::string token;
+    websocketpp::lib::error_code ec;
+    websocketpp::lib::error_code open_ec;
+    // recorded between the validate and open handlers
+    std::vector<std::string> during_handshake;
+};
+
+bool accept_session(server * s, session_store * store,
+    handshake_result * result, websocketpp::connection_hdl hdl)
+{
+    server::connection_ptr con = s->get_con_from_hdl(hdl);
+    result->token = store->accept(con, result->ec);
+    for (size_t i = 0; i < result->during_handshake.size(); ++i) {
+        store->send(result->token, con,
+            make_message(result->during_handshake[i]));
+    }
+    return true;
+}
+
+void open_session(server * s, session_store * store,
+    handshake_result * result, websocketpp::connection_hdl hdl)
+{
+    result->open_ec = store->open(result->token, s->get_con_from_hdl(hdl));
+}
+
+std::string run_handshake(session_store & store, handshake_result & result,
+    std::string const & session_header)
+{
+    std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n";
+    if (!session_header.empty()) {
+        input += "WebSocket-Session: " + session_header + "\r\n";
+    }
+    input += "\r\n";
+
+    server s;
+    std::stringstream output;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.register_ostream(&output);
+    s.set_validate_handler(bind(&accept_session,&s,&store,&result,::_1));
+    s.set_open_handler(bind(&open_session,&s,&store,&result,::_1));
+
+    server::connection_ptr con = s.get_connection();
+    con->start();
+
+    std::stringstream channel;
+    channel << input;
+    channel >> *con;
+
+    return output.str();
+}
+
+BOOST_AUTO_TEST_CASE( handshake_new_and_resumed_session ) {
+    session_store store(8, 1024, 60000);
+
+    handshake_result first;
+    std::string response = run_handshake(store, first, "");
+    BOOST_CHECK(!first.ec);
+    BOOST_CHECK(!first.open_ec);
+    BOOST_CHECK(response.find("WebSocket-Session: " + first.token + "\r\n")
+        != std::string::npos);
+    BOOST_CHECK(response.find("\x81") == std::string::npos);
+
+    store.record(first.token, make_message("a"));
+    store.record(first.token, make_message("b"));
+    store.detach(first.token);
+
+    // b is missed and c is recorded while the handshake is in progress. Both
+    // are sent once the connection is open.
+    handshake_result second;
+    second.during_handshake.push_back("c");
+    response = run_handshake(store, second, first.token + "; last=1");
+    BOOST_CHECK(!second.ec);
+    BOOST_CHECK(!second.open_ec);
+    BOOST_CHECK_EQUAL(second.token, first.token);
+    BOOST_CHECK_EQUAL(store.last_seq(first.token), 3);
+    BOOST_CHECK(response.find("\x81\x01" "b\x81\x01" "c") != std::string::npos);
+    BOOST_CHECK(response.find("\x81\x01" "a") == std::string::npos);
+
+    // the session is still attached to the second connection
+    handshake_result stolen;
+    response = run_handshake(store, stolen, first.token + "; last=3");
+    BOOST_CHECK_EQUAL(stolen.ec, websocketpp::resume::error::make_error_code(
+        websocketpp::resume::error::session_in_use));
+    BOOST_CHECK(stolen.token != first.token);
+
+    handshake_result third;
+    response = run_handshake(store, third, "unknown; last=1");
+    BOOST_CHECK_EQUAL(third.ec, websocketpp::resume::error::make_error_code(
+        websocketpp::resume::error::unknown_session));
+    BOOST_CHECK(third.token != first.token);
+    BOOST_CHECK(response.find("WebSocket-Session: " + third.token + "\r\n")
+        != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( refused_messages_are_not_numbered ) {
+    session_store store(2, 1024, 60000);
+
+    handshake_result result;
+    run_handshake(store, result, "");
+    BOOST_REQUIRE(!result.open_ec);
+
+    std::stringstream output;
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.register_ostream(&output);
+    server::connection_ptr con = s.get_connection();
+
+    // not open yet, recorded for the replay
+    BOOST_CHECK(store.send(result.token, con, make_message("a")));
+    BOOST_CHECK_EQUAL(store.last_seq(result.token), 1);
+
+    std::stringstream channel;
+    channel << "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    con->start();
+    channel >> *con;
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // refused by the open connection, not numbered
+    BOOST_CHECK(store.send(result.token, con, make_message("\xff")));
+    BOOST_CHECK_EQUAL(store.last_seq(result.token), 1);
+    BOOST_CHECK(!store.send(result.token, con, make_message("b")));
+    BOOST_CHECK_EQUAL(store.last_seq(result.token), 2);
+
+    BOOST_CHECK(store.send("unknown", con, make_message("c")));
+}
+
+BOOST_AUTO_TEST_CASE( open_restarts_numbering_when_replay_is_lost ) {
+    session_store store(2, 1024, 60000);
+
+    handshake_result first;
+    run_handshake(store, first, "");
+    store.record(first.token, make_message("a"));
+    store.detach(first.token);
+
+    // messages recorded during the handshake push a out of the ring
+    handshake_result second;
+    second.during_handshake.push_back("b");
+    second.during_handshake.push_back("c");
+    run_handshake(store, second, first.token + "; last=0");
+
+    BOOST_CHECK(!second.ec);
+    BOOST_CHECK_EQUAL(second.open_ec,
+        websocketpp::resume::error::make_error_code(
+            websocketpp::resume::error::replay_unavailable));
+
+    // the next message is number 1 as counted by the client
+    BOOST_CHECK_EQUAL(store.bytes(), 0);
+    BOOST_CHECK_EQUAL(store.record(first.token, make_message("snapshot")), 1);
+    BOOST_CHECK_EQUAL(store.bytes(), 8);
+}
+
+void drop_message(session_store * store, std::string const * token,
+    websocketpp::connection_hdl, message_ptr msg)
+{
+    store->dropped(*token, msg);
+}
+
+BOOST_AUTO_TEST_CASE( expired_messages_are_not_replayed ) {
+    session_store store(8, 1024, 60000);
+
+    handshake_result first;
+    run_handshake(store, first, "");
+
+    std::stringstream output;
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.register_ostream(&output);
+    s.set_message_expired_handler(bind(&drop_message,&store,&first.token,
+        ::_1,websocketpp::lib::placeholders::_2));
+    server::connection_ptr con = s.get_connection();
+
+    std::stringstream channel;
+    channel << "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    con->start();
+    channel >> *con;
+    BOOST_REQUIRE_EQUAL(con->get_state(), websocketpp::session::state::open);
+
+    // b expires in the write queue and never reaches the client, which
+    // counts a and c as messages 1 and 2
+    message_ptr expired = make_message("b");
+    expired->set_ttl(-1);
+
+    BOOST_CHECK(!store.send(first.token, con, make_message("a")));
+    BOOST_CHECK(!store.send(first.token, con, expired));
+    BOOST_CHECK(!store.send(first.token, con, make_message("c")));
+    BOOST_CHECK_EQUAL(con->get_expired_message_count(), 1);
+    BOOST_CHECK_EQUAL(store.last_seq(first.token), 2);
+    BOOST_CHECK(output.str().find("\x81\x01" "a\x81\x01" "c") !=
+        std::string::npos);
+
+    store.detach(first.token);
+
+    // the client received a only and is sent c
+    handshake_result second;
+    std::string response = run_handshake(store, second, first.token + "; last=1");
+    BOOST_CHECK(!second.ec);
+    BOOST_CHECK(!second.open_ec);
+    BOOST_CHECK(response.find("\x81\x01" "c") != std::string::npos);
+    BOOST_CHECK(response.find("\x81\x01" "b") == std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE( dropping_an_evicted_message_ends_resumption ) {
+    session_store store(1, 1024, 60000);
+
+    std::string token = store.create();
+    message_ptr evicted = make_message("a");
+    store.record(token, evicted);
+    store.record(token, make_message("b"));
+
+    store.dropped(token, evicted);
+    store.detach(token);
+
+    std::vector<message_ptr> missed;
+    BOOST_CHECK_EQUAL(store.resume(token, 1, missed),
+        websocketpp::resume::error::make_error_code(
+            websocketpp::resume::error::replay_unavailable));
+}
@@ -236,6 +236,61 @@ BOOST_AUTO_TEST_CASE( accept_subprotocol_two ) {
     BOOST_CHECK_EQUAL(open, "bar");
 }
 
+struct server_only_config : public websocketpp::config::core {
+    static const websocketpp::role::value endpoint_role =
+        websocketpp::role::server;
+};
+
+typedef websocketpp::server<server_only_config> server_only;
+
+void echo_server_only(server_only* s, websocketpp::connection_hdl hdl,
+    server_only_config::message_type::ptr msg)
+{
+    s->send(hdl, msg->get_payload(), msg->get_opcode());
+}
+
+std::string run_server_only_test(std::string input) {
+    server_only s;
+    std::stringstream output;
+
+    s.register_ostream(&output);
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.set_user_agent("test");
+    s.set_message_handler(bind(&echo_server_only,&s,::_1,::_2));
+
+    server_only::connection_ptr con = s.get_connection();
+    BOOST_CHECK(con->is_server());
+    con->start();
+
+    std::stringstream channel;
+    channel << input;
+    channel >> *con;
+
+    return output.str();
+}
+
+BOOST_AUTO_TEST_CASE( server_only_role_echo ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nOrigin: http://www.example.com\r\n\r\n";
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\nServer: test\r\nUpgrade: websocket\r\n\r\n";
+
+    // masked "Hi" with masking key 01 02 03 04
+    std::string masked = "\x81\x82\x01\x02\x03\x04" "Ik";
+
+    BOOST_CHECK_EQUAL(run_server_only_test(handshake + masked),
+        response + "\x81\x02" "Hi");
+}
+
+BOOST_AUTO_TEST_CASE( server_only_role_requires_masking ) {
+    std::string handshake = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nOrigin: http://www.example.com\r\n\r\n";
+
+    std::string output = run_server_only_test(handshake + "\x81\x02" "Hi");
+
+    // The unmasked frame is a protocol error, answered with a close frame
+    BOOST_CHECK(output.find("\x88") != std::string::npos);
+    BOOST_CHECK(output.find("\x81\x02" "Hi") == std::string::npos);
+}
+
 /*BOOST_AUTO_TEST_CASE( user_reject_origin ) {
     std::string input = "GET / HTTP/1.1\r\nHost: www.example.com\r\nConnection: Upgrade\r\nUpgrade: websocket\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nOrigin: http://www.example2.com\r\n\r\n";
     std::string output = "HTTP/1.1 403 Forbidden\r\nServer: test\r\n\r\n";
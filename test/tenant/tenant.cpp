@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+//#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE tenant
+#include <boost/test/unit_test.hpp>
+
+#include <websocketpp/tenant/registry.hpp>
+#include <websocketpp/tenant/token_bucket.hpp>
+
+#include <websocketpp/concurrency/basic.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using websocketpp::tenant::token_bucket;
+
+typedef websocketpp::tenant::registry<websocketpp::concurrency::basic>
+    registry_type;
+typedef registry_type::account_ptr account_ptr;
+
+namespace chrono = websocketpp::lib::chrono;
+
+BOOST_AUTO_TEST_CASE( token_bucket_unlimited ) {
+    token_bucket b;
+    token_bucket::time_point t = token_bucket::clock_type::now();
+
+    b.consume(1000000, t);
+    BOOST_CHECK_EQUAL(b.delay(t), 0);
+    BOOST_CHECK_EQUAL(b.available(t), uint64_t(-1));
+}
+
+BOOST_AUTO_TEST_CASE( token_bucket_burst_and_refill ) {
+    token_bucket b;
+    b.set_rate(1000);
+
+    token_bucket::time_point t = token_bucket::clock_type::now();
+
+    // one second worth is available at once
+    BOOST_CHECK_EQUAL(b.available(t), 1000);
+    b.consume(900, t);
+    BOOST_CHECK_EQUAL(b.delay(t), 0);
+    BOOST_CHECK_EQUAL(b.available(t), 100);
+
+    // once it runs low the wait lasts until 50ms worth is available again
+    b.consume(100, t);
+    BOOST_CHECK_EQUAL(b.delay(t), 50);
+
+    // debt is paid off at the configured rate
+    b.consume(500, t);
+    BOOST_CHECK_EQUAL(b.available(t), 0);
+    BOOST_CHECK_EQUAL(b.delay(t), 550);
+    BOOST_CHECK_EQUAL(b.delay(t + chrono::milliseconds(200)), 350);
+    BOOST_CHECK_EQUAL(b.delay(t + chrono::milliseconds(550)), 0);
+}
+
+BOOST_AUTO_TEST_CASE( token_bucket_keeps_fractions ) {
+    token_bucket b;
+    b.set_rate(1000);
+
+    token_bucket::time_point t = token_bucket::clock_type::now();
+    b.consume(2400, t);
+
+    // many short intervals add up to the same as one long one
+    for (int i = 1; i <= 1000; ++i) {
+        b.delay(t + chrono::microseconds(i * 1500));
+    }
+    BOOST_CHECK_EQUAL(b.delay(t + chrono::microseconds(1500000)), 0);
+}
+
+BOOST_AUTO_TEST_CASE( token_bucket_large_debt ) {
+    token_bucket b;
+    b.set_rate(1000);
+
+    token_bucket::time_point t = token_bucket::clock_type::now();
+    b.consume(4000, t);
+
+    BOOST_CHECK_EQUAL(b.delay(t), 3050);
+    BOOST_CHECK_EQUAL(b.delay(t + chrono::seconds(2)), 1050);
+    BOOST_CHECK_EQUAL(b.delay(t + chrono::milliseconds(3050)), 0);
+
+    // a long idle period never stores more than one second
+    b.consume(1500, t + chrono::seconds(60));
+    BOOST_CHECK_EQUAL(b.delay(t + chrono::seconds(60)), 550);
+}
+
+BOOST_AUTO_TEST_CASE( registry_defaults ) {
+    registry_type r;
+
+    BOOST_CHECK(r.get_names().empty());
+    BOOST_CHECK_EQUAL(r.get_quota("a").max_connections, 0);
+    BOOST_CHECK_EQUAL(r.get_quota("a").weight, 1);
+    BOOST_CHECK_EQUAL(r.get_stats("a").connections, 0);
+
+    // tenants without a quota share the default account
+    account_ptr a = r.get("a");
+    BOOST_CHECK(a == r.get("a"));
+    BOOST_CHECK(a == r.get("b"));
+    BOOST_CHECK(!a->admit(0));
+    BOOST_CHECK_EQUAL(r.get_stats("b").connections, 1);
+
+    r.set_quota("c", websocketpp::tenant::quota());
+    BOOST_CHECK(r.get("c") != a);
+
+    std::vector<std::string> names = r.get_names();
+    BOOST_REQUIRE_EQUAL(names.size(), 1);
+    BOOST_CHECK_EQUAL(names[0], "c");
+}
+
+BOOST_AUTO_TEST_CASE( unknown_tenants_do_not_accumulate ) {
+    registry_type r;
+
+    websocketpp::tenant::quota q;
+    q.max_connections = 2;
+    r.set_default_quota(q);
+
+    for (int i = 0; i < 100; ++i) {
+        std::stringstream name;
+        name << "client-" << i;
+        r.get(name.str());
+    }
+    BOOST_CHECK(r.get_names().empty());
+
+    // unconfigured tenants are limited together
+    BOOST_CHECK(!r.get("x")->admit(0));
+    BOOST_CHECK(!r.get("y")->admit(0));
+    BOOST_CHECK_EQUAL(r.get("z")->admit(0),
+        websocketpp::error::make_error_code(
+            websocketpp::error::tenant_quota_exceeded));
+    BOOST_CHECK_EQUAL(r.get_quota("z").max_connections, 2);
+}
+
+BOOST_AUTO_TEST_CASE( account_connection_quota ) {
+    registry_type r;
+    websocketpp::tenant::quota q;
+    q.max_connections = 2;
+    r.set_quota("a", q);
+
+    account_ptr a = r.get("a");
+    BOOST_CHECK(!a->admit(0));
+    BOOST_CHECK(!a->admit(0));
+    BOOST_CHECK_EQUAL(a->admit(0),
+        websocketpp::error::make_error_code(
+            websocketpp::error::tenant_quota_exceeded));
+
+    a->release(0);
+    BOOST_CHECK(!a->admit(0));
+
+    websocketpp::tenant::stats s = a->get_stats();
+    BOOST_CHECK_EQUAL(s.connections, 2);
+    BOOST_CHECK_EQUAL(s.rejected_connections, 1);
+
+    // other tenants are not affected
+    BOOST_CHECK(!r.get("b")->admit(0));
+}
+
+BOOST_AUTO_TEST_CASE( account_deflate_memory_quota ) {
+    size_t per_connection = websocketpp::tenant::deflate_memory();
+    BOOST_CHECK(per_connection > 0);
+
+    websocketpp::tenant::quota q;
+    q.max_deflate_memory = per_connection * 3 / 2;
+
+    registry_type r;
+    r.set_quota("a", q);
+    account_ptr a = r.get("a");
+
+    BOOST_CHECK(!a->admit(per_connection));
+    BOOST_CHECK(a->admit(per_connection));
+    // connections without compression still fit
+    BOOST_CHECK(!a->admit(0));
+
+    BOOST_CHECK_EQUAL(a->get_stats().deflate_memory, per_connection);
+    a->release(per_connection);
+    BOOST_CHECK_EQUAL(a->get_stats().deflate_memory, 0);
+}
+
+BOOST_AUTO_TEST_CASE( account_queue_quota ) {
+    websocketpp::tenant::quota q;
+    q.max_queued_bytes = 10;
+
+    registry_type r;
+    r.set_quota("a", q);
+    account_ptr a = r.get("a");
+
+    BOOST_CHECK(a->try_queue(6));
+    BOOST_CHECK(a->try_queue(2));
+    BOOST_CHECK(!a->try_queue(3));
+    BOOST_CHECK_EQUAL(a->get_stats().queued_bytes, 8);
+
+    // a charge corrected to what was actually queued
+    a->update_queued(2, 1);
+    BOOST_CHECK(a->try_queue(3));
+
+    a->update_queued(6, 0);
+    BOOST_CHECK(a->try_queue(6));
+    BOOST_CHECK(!a->try_queue(1));
+
+    websocketpp::tenant::stats s = a->get_stats();
+    BOOST_CHECK_EQUAL(s.queued_bytes, 10);
+    BOOST_CHECK_EQUAL(s.rejected_messages, 2);
+}
+
+BOOST_AUTO_TEST_CASE( account_rates ) {
+    websocketpp::tenant::quota q;
+    q.inbound_rate = 100;
+    q.weight = 0;
+
+    registry_type r;
+    r.set_quota("a", q);
+    account_ptr a = r.get("a");
+
+    BOOST_CHECK_EQUAL(a->get_weight(), 1);
+
+    token_bucket::time_point t = token_bucket::clock_type::now();
+    a->consume_inbound(150, t);
+    a->consume_outbound(150, t);
+
+    BOOST_CHECK_EQUAL(a->inbound_delay(t), 550);
+    BOOST_CHECK_EQUAL(a->inbound_allowance(t), 0);
+    BOOST_CHECK_EQUAL(a->outbound_delay(t), 0);
+    BOOST_CHECK_EQUAL(a->outbound_allowance(t), uint64_t(-1));
+
+    websocketpp::tenant::stats s = a->get_stats();
+    BOOST_CHECK_EQUAL(s.bytes_in, 150);
+    BOOST_CHECK_EQUAL(s.bytes_out, 150);
+    BOOST_CHECK_EQUAL(s.delayed_reads, 1);
+    BOOST_CHECK_EQUAL(s.delayed_writes, 0);
+}
@@ -29,12 +29,26 @@
 #include <boost/test/unit_test.hpp>
 
 #include <iostream>
+#include <map>
+#include <string>
 
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/thread.hpp>
 #include <websocketpp/common/type_traits.hpp>
 
 #include <websocketpp/transport/asio/security/none.hpp>
 #include <websocketpp/transport/asio/security/tls.hpp>
 
+#include <websocketpp/config/asio.hpp>
+#include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/server.hpp>
+#include <websocketpp/client.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
 template <typename base>
 struct dummy_con : public base {
 	websocketpp::lib::error_code test() {
@@ -67,3 +81,488 @@ BOOST_AUTO_TEST_CASE( translated_ec_tls ) {
     	BOOST_CHECK_EQUAL( tscon.test(), websocketpp::transport::error::make_error_code(websocketpp::transport::error::pass_through) );
     }
 }
+
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+
+// TLS 1.3 early data. A client and a server run over loopback on one io_service
+// in a background thread while the test waits for the events they record.
+
+struct early_config : public websocketpp::config::asio_tls {
+    typedef early_config type;
+    typedef websocketpp::config::asio_tls base;
+
+    struct transport_config : public base::transport_config {
+        /// Short TLS handshake timeout so that stalled handshakes fail quickly
+        static const long timeout_socket_post_init = 300;
+    };
+
+    typedef websocketpp::transport::asio::endpoint<transport_config>
+        transport_type;
+};
+
+typedef websocketpp::server<early_config> early_server;
+typedef websocketpp::client<websocketpp::config::asio_tls_client> early_client;
+typedef websocketpp::lib::shared_ptr<websocketpp::lib::asio::ssl::context>
+    context_ptr;
+
+using websocketpp::lib::placeholders::_1;
+using websocketpp::lib::placeholders::_2;
+using websocketpp::lib::bind;
+
+/// Generate a self-signed certificate for localhost
+bool make_certificate(EVP_PKEY ** key, X509 ** cert) {
+    EVP_PKEY_CTX * kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    *key = NULL;
+    bool ok = kctx && EVP_PKEY_keygen_init(kctx) > 0 &&
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) > 0 &&
+        EVP_PKEY_keygen(kctx, key) > 0;
+    EVP_PKEY_CTX_free(kctx);
+    if (!ok) {
+        return false;
+    }
+
+    *cert = X509_new();
+    X509_set_version(*cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(*cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(*cert), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(*cert), 86400);
+    X509_set_pubkey(*cert, *key);
+
+    X509_NAME * name = X509_get_subject_name(*cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+        reinterpret_cast<unsigned char const *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(*cert, name);
+
+    return X509_sign(*cert, *key, EVP_sha256()) > 0;
+}
+
+context_ptr get_context(context_ptr ctx, websocketpp::connection_hdl) {
+    return ctx;
+}
+
+struct early_fixture {
+    early_fixture()
+      : work(new websocketpp::lib::asio::io_service::work(ios))
+      , accept_early(true)
+      , server_status(-1)
+      , client_status(-1)
+      , client_reused(false)
+    {
+        EVP_PKEY * key;
+        X509 * cert;
+        BOOST_REQUIRE(make_certificate(&key, &cert));
+
+        // One server context for all connections so that its ticket keys
+        // allow resumption
+        server_ctx = websocketpp::lib::make_shared<
+            websocketpp::lib::asio::ssl::context>(
+            websocketpp::lib::asio::ssl::context::tls_server);
+        SSL_CTX_use_certificate(server_ctx->native_handle(), cert);
+        SSL_CTX_use_PrivateKey(server_ctx->native_handle(), key);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+
+        client_ctx = websocketpp::lib::make_shared<
+            websocketpp::lib::asio::ssl::context>(
+            websocketpp::lib::asio::ssl::context::tls_client);
+
+        server.clear_access_channels(websocketpp::log::alevel::all);
+        server.clear_error_channels(websocketpp::log::elevel::all);
+        server.init_asio(&ios);
+        server.set_reuse_addr(true);
+        server.set_tls_init_handler(bind(&get_context,server_ctx,_1));
+        server.set_early_data_handler(bind(&early_fixture::on_early,this,_1,_2));
+        server.set_open_handler(bind(&early_fixture::on_server_open,this,_1));
+        server.set_fail_handler(bind(&early_fixture::on_server_fail,this,_1));
+        server.set_close_handler(bind(&early_fixture::record,this,
+            std::string("server_close")));
+        server.set_message_handler(bind(&early_fixture::on_echo,this,_1,_2));
+
+        client.clear_access_channels(websocketpp::log::alevel::all);
+        client.clear_error_channels(websocketpp::log::elevel::all);
+        client.init_asio(&ios);
+        client.set_tls_init_handler(bind(&get_context,client_ctx,_1));
+        client.set_early_data(true);
+        client.set_open_handler(bind(&early_fixture::on_client_open,this,_1));
+        client.set_fail_handler(bind(&early_fixture::record,this,
+            std::string("client_fail")));
+        client.set_close_handler(bind(&early_fixture::record,this,
+            std::string("client_close")));
+        client.set_message_handler(bind(&early_fixture::on_reply,this,_1,_2));
+
+        server.listen(websocketpp::lib::asio::ip::tcp::endpoint(
+            websocketpp::lib::asio::ip::address::from_string("127.0.0.1"), 0));
+        websocketpp::lib::asio::error_code ec;
+        port = server.get_local_endpoint(ec).port();
+        server.start_accept();
+
+        thread = websocketpp::lib::thread(bind(&early_fixture::run,this));
+    }
+
+    ~early_fixture() {
+        ios.post(bind(&early_fixture::stop,this));
+        work.reset();
+        ios.stop();
+        thread.join();
+    }
+
+    void run() {
+        ios.run();
+    }
+
+    void stop() {
+        websocketpp::lib::error_code ec;
+        server.stop_listening(ec);
+    }
+
+    void record(std::string event) {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(mutex);
+        events[event]++;
+        cond.notify_all();
+    }
+
+    struct recorded {
+        recorded(std::map<std::string,int> & e, std::string const & n, int c)
+          : events(e), name(n), count(c) {}
+
+        bool operator()() const {
+            return events[name] >= count;
+        }
+
+        std::map<std::string,int> & events;
+        std::string const & name;
+        int count;
+    };
+
+    /// Wait up to five seconds for an event to be recorded count times
+    bool wait(std::string const & event, int count = 1) {
+        websocketpp::lib::unique_lock<websocketpp::lib::mutex> lock(mutex);
+        return cond.wait_for(lock, websocketpp::lib::chrono::seconds(5),
+            recorded(events, event, count));
+    }
+
+    int count(std::string const & event) {
+        websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(mutex);
+        return events[event];
+    }
+
+    /// Open a client connection that echoes one message and closes
+    void connect() {
+        ios.post(bind(&early_fixture::do_connect,this));
+    }
+
+    void do_connect() {
+        std::stringstream uri;
+        uri << "wss://localhost:" << port << "/early";
+
+        websocketpp::lib::error_code ec;
+        early_client::connection_ptr con = client.get_connection(uri.str(), ec);
+        if (ec) {
+            record("client_fail");
+            return;
+        }
+        client.connect(con);
+    }
+
+    bool on_early(websocketpp::connection_hdl, std::string const & target) {
+        record("early:" + target);
+        return accept_early;
+    }
+
+    void on_server_open(websocketpp::connection_hdl hdl) {
+        early_server::connection_ptr con = server.get_con_from_hdl(hdl);
+        {
+            websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(mutex);
+            server_status = SSL_get_early_data_status(
+                con->get_socket().native_handle());
+        }
+        record("server_open");
+    }
+
+    void on_server_fail(websocketpp::connection_hdl hdl) {
+        early_server::connection_ptr con = server.get_con_from_hdl(hdl);
+        {
+            websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(mutex);
+            server_fail_ec = con->get_ec();
+        }
+        record("server_fail");
+    }
+
+    void on_echo(websocketpp::connection_hdl hdl, early_server::message_ptr msg) {
+        websocketpp::lib::error_code ec;
+        server.send(hdl, msg->get_payload(), msg->get_opcode(), ec);
+    }
+
+    void on_client_open(websocketpp::connection_hdl hdl) {
+        early_client::connection_ptr con = client.get_con_from_hdl(hdl);
+        SSL * ssl = con->get_socket().native_handle();
+        {
+            websocketpp::lib::lock_guard<websocketpp::lib::mutex> lock(mutex);
+            client_status = SSL_get_early_data_status(ssl);
+            client_reused = SSL_session_reused(ssl) == 1;
+        }
+        record("client_open");
+
+        websocketpp::lib::error_code ec;
+        client.send(hdl, "hello", websocketpp::frame::opcode::text, ec);
+    }
+
+    void on_reply(websocketpp::connection_hdl hdl, early_client::message_ptr msg) {
+        if (msg->get_payload() == "hello") {
+            record("client_echo");
+        }
+        websocketpp::lib::error_code ec;
+        client.close(hdl, websocketpp::close::status::normal, "", ec);
+    }
+
+    /// Connect a blocking socket to the server
+    int raw_connect(websocketpp::lib::asio::io_service & raw_ios,
+        websocketpp::lib::asio::ip::tcp::socket & sock)
+    {
+        websocketpp::lib::asio::error_code ec;
+        sock.connect(websocketpp::lib::asio::ip::tcp::endpoint(
+            websocketpp::lib::asio::ip::address::from_string("127.0.0.1"),
+            port), ec);
+        return ec ? -1 : static_cast<int>(sock.native_handle());
+    }
+
+    /// Open a connection with a plain OpenSSL client to get a session ticket
+    /**
+     * The returned session allows early data. Free it with SSL_SESSION_free.
+     */
+    SSL_SESSION * raw_session(websocketpp::lib::asio::io_service & raw_ios) {
+        websocketpp::lib::asio::ip::tcp::socket sock(raw_ios);
+        int fd = raw_connect(raw_ios, sock);
+        BOOST_REQUIRE(fd >= 0);
+
+        SSL * ssl = SSL_new(client_ctx->native_handle());
+        SSL_set_tlsext_host_name(ssl, "localhost");
+        SSL_set_fd(ssl, fd);
+        BOOST_REQUIRE_EQUAL(SSL_connect(ssl), 1);
+
+        std::string req = request();
+        BOOST_REQUIRE_EQUAL(SSL_write(ssl, req.data(), int(req.size())),
+            int(req.size()));
+
+        // The tickets follow the handshake response. Reading the echo of a
+        // message sent after it reads them too.
+        std::string response;
+        char buf[512];
+        while (response.find("\r\n\r\n") == std::string::npos) {
+            int n = SSL_read(ssl, buf, sizeof(buf));
+            BOOST_REQUIRE(n > 0);
+            response.append(buf, n);
+        }
+        BOOST_CHECK(response.find("101") != std::string::npos);
+
+        std::string frame("\x81\x82\x00\x00\x00\x00hi", 8);
+        BOOST_REQUIRE_EQUAL(SSL_write(ssl, frame.data(), int(frame.size())),
+            int(frame.size()));
+        response.erase(0, response.find("\r\n\r\n") + 4);
+        while (response.size() < 4) {
+            int n = SSL_read(ssl, buf, sizeof(buf));
+            BOOST_REQUIRE(n > 0);
+            response.append(buf, n);
+        }
+        BOOST_CHECK_EQUAL(response, "\x81\x02hi");
+
+        SSL_SESSION * session = SSL_get1_session(ssl);
+        BOOST_CHECK(session && SSL_SESSION_is_resumable(session) &&
+            SSL_SESSION_get_max_early_data(session) > 0);
+
+        // a connection that ends without close_notify invalidates its session
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+
+        return session;
+    }
+
+    std::string request() const {
+        return "GET /raw HTTP/1.1\r\nHost: localhost\r\nConnection: Upgrade\r\n"
+            "Upgrade: websocket\r\nSec-WebSocket-Version: 13\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n";
+    }
+
+    websocketpp::lib::asio::io_service ios;
+    websocketpp::lib::shared_ptr<websocketpp::lib::asio::io_service::work> work;
+    websocketpp::lib::thread thread;
+
+    context_ptr server_ctx;
+    context_ptr client_ctx;
+    early_server server;
+    early_client client;
+    uint16_t port;
+
+    websocketpp::lib::mutex mutex;
+    websocketpp::lib::condition_variable cond;
+    std::map<std::string,int> events;
+
+    bool accept_early;
+    int server_status;
+    int client_status;
+    bool client_reused;
+    websocketpp::lib::error_code server_fail_ec;
+};
+
+BOOST_AUTO_TEST_CASE( early_data_full_resumed_and_rejected ) {
+    early_fixture f;
+
+    // No session yet, a full handshake with early data enabled on both ends
+    f.connect();
+    BOOST_REQUIRE(f.wait("client_close"));
+    BOOST_CHECK_EQUAL(f.count("client_echo"), 1);
+    BOOST_CHECK_EQUAL(f.count("early:/early"), 0);
+    BOOST_CHECK(!f.client_reused);
+    BOOST_CHECK_EQUAL(f.client_status, SSL_EARLY_DATA_NOT_SENT);
+    BOOST_CHECK_EQUAL(f.server_status, SSL_EARLY_DATA_NOT_SENT);
+
+    // Resumed, the request is sent as 0-RTT and processed early
+    f.connect();
+    BOOST_REQUIRE(f.wait("client_close", 2));
+    BOOST_CHECK_EQUAL(f.count("client_echo"), 2);
+    BOOST_CHECK_EQUAL(f.count("early:/early"), 1);
+    BOOST_CHECK(f.client_reused);
+    BOOST_CHECK_EQUAL(f.client_status, SSL_EARLY_DATA_ACCEPTED);
+    BOOST_CHECK_EQUAL(f.server_status, SSL_EARLY_DATA_ACCEPTED);
+
+    // Accepted by TLS, but the handler defers the request to the handshake
+    f.accept_early = false;
+    f.connect();
+    BOOST_REQUIRE(f.wait("client_close", 3));
+    BOOST_CHECK_EQUAL(f.count("client_echo"), 3);
+    BOOST_CHECK_EQUAL(f.count("early:/early"), 2);
+    BOOST_CHECK(f.client_reused);
+    BOOST_CHECK_EQUAL(f.client_status, SSL_EARLY_DATA_ACCEPTED);
+
+    // The server no longer knows the session, for example after a restart.
+    // It rejects the early data and the client falls back to a full handshake
+    // and sends the request again.
+    f.accept_early = true;
+    unsigned char keys[80];
+    BOOST_REQUIRE_EQUAL(RAND_bytes(keys, sizeof(keys)), 1);
+    SSL_CTX_set_tlsext_ticket_keys(f.server_ctx->native_handle(), keys,
+        sizeof(keys));
+    SSL_CTX_flush_sessions(f.server_ctx->native_handle(), 0x7fffffffL);
+    f.connect();
+    BOOST_REQUIRE(f.wait("client_close", 4));
+    BOOST_CHECK_EQUAL(f.count("client_echo"), 4);
+    BOOST_CHECK_EQUAL(f.count("early:/early"), 2);
+    BOOST_CHECK(!f.client_reused);
+    BOOST_CHECK_EQUAL(f.client_status, SSL_EARLY_DATA_REJECTED);
+    BOOST_CHECK_EQUAL(f.server_status, SSL_EARLY_DATA_REJECTED);
+
+    // A server without an early data handler rejects the early data and the
+    // client retries the request after the handshake. The server creates each connection when it accepts the
+    // previous one, so the handler is cleared one connection in advance.
+    f.server.set_early_data_handler(
+        websocketpp::transport::asio::tls_socket::early_data_handler());
+    f.connect();
+    BOOST_REQUIRE(f.wait("client_close", 5));
+    BOOST_CHECK_EQUAL(f.count("early:/early"), 3);
+    f.connect();
+    BOOST_REQUIRE(f.wait("client_close", 6));
+    BOOST_CHECK_EQUAL(f.count("client_echo"), 6);
+    BOOST_CHECK_EQUAL(f.count("early:/early"), 3);
+    BOOST_CHECK_EQUAL(f.client_status, SSL_EARLY_DATA_REJECTED);
+    BOOST_CHECK_EQUAL(f.server_status, SSL_EARLY_DATA_REJECTED);
+
+    BOOST_CHECK_EQUAL(f.count("client_fail"), 0);
+    BOOST_CHECK_EQUAL(f.count("server_fail"), 0);
+}
+
+BOOST_AUTO_TEST_CASE( early_data_handshake_timeouts ) {
+    early_fixture f;
+    f.server.set_early_data_timeout(200);
+
+    websocketpp::lib::asio::io_service raw_ios;
+
+    // A client that never sends its ClientHello times out while the server
+    // handshake runs over the memory BIOs
+    {
+        websocketpp::lib::asio::ip::tcp::socket sock(raw_ios);
+        BOOST_REQUIRE(f.raw_connect(raw_ios, sock) >= 0);
+        BOOST_REQUIRE(f.wait("server_fail"));
+        BOOST_CHECK_EQUAL(f.server_fail_ec,
+            websocketpp::transport::asio::socket::make_error_code(
+            websocketpp::transport::asio::socket::error::tls_handshake_timeout));
+        BOOST_CHECK_EQUAL(f.count("server_open"), 0);
+    }
+
+    // Get a session ticket that allows early data
+    SSL_SESSION * session = f.raw_session(raw_ios);
+    BOOST_REQUIRE(session);
+    BOOST_REQUIRE(f.wait("server_close"));
+
+    // A request processed from early data whose handshake is never finished
+    // is closed after the early data timeout
+    {
+        websocketpp::lib::asio::ip::tcp::socket sock(raw_ios);
+        int fd = f.raw_connect(raw_ios, sock);
+        BOOST_REQUIRE(fd >= 0);
+
+        SSL * ssl = SSL_new(f.client_ctx->native_handle());
+        SSL_set_tlsext_host_name(ssl, "localhost");
+        SSL_set_session(ssl, session);
+        SSL_set_fd(ssl, fd);
+        SSL_set_connect_state(ssl);
+
+        std::string req = f.request();
+        size_t written = 0;
+        BOOST_REQUIRE_EQUAL(SSL_write_early_data(ssl, req.data(), req.size(),
+            &written), 1);
+
+        // the client stops here, without sending its Finished message
+        BOOST_REQUIRE(f.wait("early:/raw"));
+        BOOST_REQUIRE(f.wait("server_open", 2));
+        BOOST_CHECK_EQUAL(f.server_status, SSL_EARLY_DATA_ACCEPTED);
+        BOOST_REQUIRE(f.wait("server_close", 2));
+
+        SSL_free(ssl);
+    }
+
+    SSL_SESSION_free(session);
+    BOOST_CHECK_EQUAL(f.count("server_fail"), 1);
+}
+
+BOOST_AUTO_TEST_CASE( early_data_client_disconnects ) {
+    early_fixture f;
+    f.server.set_early_data_timeout(60000);
+
+    websocketpp::lib::asio::io_service raw_ios;
+    SSL_SESSION * session = f.raw_session(raw_ios);
+    BOOST_REQUIRE(session);
+    BOOST_REQUIRE(f.wait("server_close"));
+
+    // A client whose request was processed from early data goes away before
+    // finishing the handshake. The server closes the connection right away
+    // rather than after the early data timeout.
+    {
+        websocketpp::lib::asio::ip::tcp::socket sock(raw_ios);
+        int fd = f.raw_connect(raw_ios, sock);
+        BOOST_REQUIRE(fd >= 0);
+
+        SSL * ssl = SSL_new(f.client_ctx->native_handle());
+        SSL_set_tlsext_host_name(ssl, "localhost");
+        SSL_set_session(ssl, session);
+        SSL_set_fd(ssl, fd);
+        SSL_set_connect_state(ssl);
+
+        std::string req = f.request();
+        size_t written = 0;
+        BOOST_REQUIRE_EQUAL(SSL_write_early_data(ssl, req.data(), req.size(),
+            &written), 1);
+
+        BOOST_REQUIRE(f.wait("early:/raw"));
+        BOOST_REQUIRE(f.wait("server_open", 2));
+        BOOST_CHECK_EQUAL(f.server_status, SSL_EARLY_DATA_ACCEPTED);
+
+        SSL_free(ssl);
+        sock.close();
+        BOOST_CHECK(f.wait("server_close", 2));
+    }
+
+    SSL_SESSION_free(session);
+    BOOST_CHECK_EQUAL(f.count("server_fail"), 0);
+}
+
+#endif // _WEBSOCKETPP_TLS_EARLY_DATA_
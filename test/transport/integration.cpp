@@ -35,6 +35,7 @@
 #include <websocketpp/config/asio.hpp>
 #include <websocketpp/config/asio_client.hpp>
 #include <websocketpp/config/debug_asio.hpp>
+#include <websocketpp/idle/sweeper.hpp>
 #include <websocketpp/server.hpp>
 #include <websocketpp/client.hpp>
 
@@ -638,6 +639,147 @@ BOOST_AUTO_TEST_CASE( pause_reading ) {
 }
 
 
+void store_hdl(websocketpp::connection_hdl * out, websocketpp::connection_hdl hdl)
+{
+    *out = hdl;
+}
+
+void connect_client(client * c, std::string uri) {
+    websocketpp::lib::error_code ec;
+    c->connect(c->get_connection(uri, ec));
+    BOOST_CHECK( !ec );
+}
+
+BOOST_AUTO_TEST_CASE( idle_table_close_from_another_thread ) {
+    websocketpp::lib::asio::io_service ios;
+    server s;
+    client c;
+    websocketpp::idle::sweeper<server> sweeper(s);
+    websocketpp::idle::sweeper<client> client_sweeper(c);
+    websocketpp::idle::table const & t = sweeper.get_table();
+    websocketpp::idle::table const & ct = client_sweeper.get_table();
+    test_deadline_timer deadline(10);
+
+    websocketpp::connection_hdl hdl;
+    websocketpp::connection_hdl closed;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ios);
+    s.set_reuse_addr(true);
+    s.set_open_handler(bind(&store_hdl,&hdl,::_1));
+    s.set_close_handler(bind(&store_hdl,&closed,::_1));
+    s.listen(9006);
+    s.start_accept();
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio(&ios);
+
+    // the client's table is only touched by the io thread
+    websocketpp::lib::thread connector(bind(&connect_client,&c,
+        "ws://localhost:9006"));
+    connector.join();
+    BOOST_CHECK_EQUAL( ct.size(), 0 );
+
+    while (hdl.expired() && ios.run_one()) {}
+    BOOST_REQUIRE( !hdl.expired() );
+    BOOST_REQUIRE_EQUAL( t.size(), 1 );
+    BOOST_CHECK_EQUAL( t.get_state(0), websocketpp::idle::state::open );
+    BOOST_REQUIRE_EQUAL( ct.size(), 1 );
+
+    // the table is left alone until the io thread runs the update
+    websocketpp::lib::thread closer(bind(&close<server>,&s,hdl));
+    closer.join();
+    BOOST_CHECK_EQUAL( t.get_state(0), websocketpp::idle::state::open );
+
+    while (t.get_state(0) == websocketpp::idle::state::open && ios.run_one()) {}
+    BOOST_CHECK_EQUAL( t.get_state(0), websocketpp::idle::state::closing );
+
+    while (closed.expired() && ios.run_one()) {}
+    ios.poll();
+    BOOST_CHECK_EQUAL( t.size(), 0 );
+
+    websocketpp::lib::error_code ec;
+    s.stop_listening(ec);
+    ios.run();
+    BOOST_CHECK_EQUAL( ct.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( sweeper_destroyed_before_its_timer_runs ) {
+    websocketpp::lib::asio::io_service ios;
+    server s;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ios);
+
+    {
+        websocketpp::idle::sweeper<server> sweeper(s);
+        sweeper.start(10);
+    }
+
+    // the cancelled timer handler runs after the sweeper is gone
+    BOOST_CHECK_EQUAL( ios.run(), 1 );
+}
+
+template <typename T>
+void fast_close(T * e, websocketpp::connection_hdl hdl) {
+    websocketpp::lib::error_code ec;
+    e->fast_close(hdl,websocketpp::close::status::going_away,"",ec);
+    BOOST_CHECK( !ec );
+}
+
+void count_close(int * count, websocketpp::connection_hdl) {
+    (*count)++;
+}
+
+BOOST_AUTO_TEST_CASE( fast_close_from_another_thread ) {
+    websocketpp::lib::asio::io_service ios;
+    server s;
+    client c;
+    test_deadline_timer deadline(10);
+
+    websocketpp::connection_hdl hdl;
+    int closed = 0;
+    s.clear_access_channels(websocketpp::log::alevel::all);
+    s.clear_error_channels(websocketpp::log::elevel::all);
+    s.init_asio(&ios);
+    s.set_reuse_addr(true);
+    s.set_open_handler(bind(&store_hdl,&hdl,::_1));
+    s.set_close_handler(bind(&count_close,&closed,::_1));
+    s.listen(9007);
+    s.start_accept();
+
+    c.clear_access_channels(websocketpp::log::alevel::all);
+    c.clear_error_channels(websocketpp::log::elevel::all);
+    c.init_asio(&ios);
+
+    websocketpp::lib::thread connector(bind(&connect_client,&c,
+        "ws://localhost:9007"));
+    connector.join();
+
+    while (hdl.expired() && ios.run_one()) {}
+    BOOST_REQUIRE( !hdl.expired() );
+
+    // the close frame is queued, the client's reply has not been read yet
+    server::connection_ptr con = s.get_con_from_hdl(hdl);
+    con->close(websocketpp::close::status::normal,"");
+    BOOST_REQUIRE_EQUAL( con->get_state(), websocketpp::session::state::closing );
+
+    // the connection is torn down by the io thread, not the caller
+    websocketpp::lib::thread closer(bind(&fast_close<server>,&s,hdl));
+    closer.join();
+    BOOST_CHECK_EQUAL( closed, 0 );
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closing );
+
+    while (closed == 0 && ios.run_one()) {}
+    BOOST_CHECK_EQUAL( con->get_state(), websocketpp::session::state::closed );
+
+    websocketpp::lib::error_code ec;
+    s.stop_listening(ec);
+    ios.run();
+    BOOST_CHECK_EQUAL( closed, 1 );
+}
+
 BOOST_AUTO_TEST_CASE( server_connection_cleanup ) {
     server_tls s;
 }
@@ -94,6 +94,22 @@ BOOST_AUTO_TEST_CASE( uri_valid_ipv6_literal ) {
     BOOST_CHECK_EQUAL( uri.get_resource(), "/chat" );
 }
 
+// IPv6 literals keep their brackets when the URI is written out
+BOOST_AUTO_TEST_CASE( uri_ipv6_literal_str ) {
+    websocketpp::uri uri("wss://[::1]:9000/chat");
+
+    BOOST_CHECK_EQUAL( uri.str(), "wss://[::1]:9000/chat" );
+    BOOST_CHECK_EQUAL( uri.get_host_port(), "[::1]:9000" );
+    BOOST_CHECK_EQUAL( uri.get_authority(), "[::1]:9000" );
+
+    websocketpp::uri default_port("ws://[::1]/");
+    BOOST_CHECK_EQUAL( default_port.get_host_port(), "[::1]" );
+
+    websocketpp::uri reparsed(uri.str());
+    BOOST_CHECK( reparsed.get_valid() );
+    BOOST_CHECK_EQUAL( reparsed.get_host(), "::1" );
+}
+
 // Valid URI with more complicated host
 BOOST_AUTO_TEST_CASE( uri_valid_2 ) {
     websocketpp::uri uri("wss://thor-websocket.zaphoyd.net:88/");
@@ -0,0 +1,162 @@
+#include <websocketpp/metrics/shared_stats.hpp>
+
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Prints the statistics an endpoint publishes with metrics::stats_publisher.
+//
+// Usage: wsppstat [-i interval_ms] [-n count] [-t] name
+//
+//   -i  Time between lines in milliseconds (default 1000)
+//   -n  Stop after this many lines (default: run until interrupted)
+//   -t  Also print the loop lag of each io thread
+//
+// Rates are computed between the publishes seen by consecutive reads, so an
+// interval shorter than the publisher's shows zero rates in between. Reading
+// never blocks or slows down the process being watched.
+
+using websocketpp::metrics::stats_snapshot;
+
+namespace {
+
+void usage() {
+    std::cerr << "Usage: wsppstat [-i interval_ms] [-n count] [-t] name"
+              << std::endl;
+}
+
+uint64_t now_us() {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+double rate(uint64_t now, uint64_t before, double seconds) {
+    return seconds > 0 ? static_cast<double>(now - before) / seconds : 0;
+}
+
+void print_header() {
+    std::printf("%8s %8s %8s %8s %8s %10s %10s %10s %10s %10s %9s\n",
+        "active", "connect", "open/s", "fail/s", "http/s", "msg_in/s",
+        "msg_out/s", "kB_in/s", "kB_out/s", "queued_kB", "lag_ms");
+}
+
+void print_line(stats_snapshot const & s, stats_snapshot const & prev) {
+    double seconds = static_cast<double>(s.updated_us - prev.updated_us) /
+        1000000;
+    websocketpp::metrics::endpoint_counters const & c = s.counters;
+    websocketpp::metrics::endpoint_counters const & p = prev.counters;
+
+    uint64_t lag = 0;
+    for (uint64_t i = 0; i < s.threads; ++i) {
+        if (s.lag[i].last_us > lag) {
+            lag = s.lag[i].last_us;
+        }
+    }
+
+    std::printf("%8llu %8llu %8.1f %8.1f %8.1f %10.1f %10.1f %10.1f %10.1f "
+        "%10.1f %9.2f\n",
+        static_cast<unsigned long long>(c.connections_active()),
+        static_cast<unsigned long long>(c.connections_connecting()),
+        rate(c.connections_opened, p.connections_opened, seconds),
+        rate(c.connections_failed, p.connections_failed, seconds),
+        rate(c.http_requests, p.http_requests, seconds),
+        rate(c.messages_in, p.messages_in, seconds),
+        rate(c.messages_out, p.messages_out, seconds),
+        rate(c.bytes_in, p.bytes_in, seconds) / 1024,
+        rate(c.bytes_out, p.bytes_out, seconds) / 1024,
+        static_cast<double>(c.queued_bytes) / 1024,
+        static_cast<double>(lag) / 1000);
+}
+
+void print_threads(stats_snapshot const & s) {
+    for (uint64_t i = 0; i < s.threads; ++i) {
+        websocketpp::metrics::thread_lag const & l = s.lag[i];
+        std::printf("  thread %llu lag ms: last %.2f max %.2f mean %.2f "
+            "(%llu samples)\n",
+            static_cast<unsigned long long>(i),
+            static_cast<double>(l.last_us) / 1000,
+            static_cast<double>(l.max_us) / 1000,
+            l.samples ? static_cast<double>(l.total_us) / l.samples / 1000 : 0,
+            static_cast<unsigned long long>(l.samples));
+    }
+}
+
+} // namespace
+
+int main(int argc, char * argv[]) {
+    long interval = 1000;
+    long count = -1;
+    bool threads = false;
+    std::string name;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-i" && i + 1 < argc) {
+            interval = std::atol(argv[++i]);
+        } else if (arg == "-n" && i + 1 < argc) {
+            count = std::atol(argv[++i]);
+        } else if (arg == "-t") {
+            threads = true;
+        } else if (name.empty() && arg[0] != '-') {
+            name = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (name.empty() || interval <= 0) {
+        usage();
+        return 1;
+    }
+    if (name[0] != '/') {
+        name = "/" + name;
+    }
+
+    websocketpp::metrics::shared_stats_reader reader;
+    websocketpp::lib::error_code ec;
+    reader.open(name, ec);
+    if (ec) {
+        std::cerr << "wsppstat: " << name << ": " << ec.message() << std::endl;
+        return 1;
+    }
+
+    stats_snapshot prev;
+    reader.read(prev, ec);
+
+    for (long line = 0; count < 0 || line < count; ++line) {
+        if (line % 20 == 0) {
+            print_header();
+        }
+        usleep(static_cast<useconds_t>(interval) * 1000);
+
+        stats_snapshot s;
+        reader.read(s, ec);
+        if (ec) {
+            std::cerr << "wsppstat: " << ec.message() << std::endl;
+            continue;
+        }
+        print_line(s, prev);
+        if (threads) {
+            print_threads(s);
+        }
+        if (kill(static_cast<pid_t>(reader.get_pid()), 0) == -1 &&
+            errno == ESRCH)
+        {
+            std::printf("  process %llu has exited, last update %.1f s ago\n",
+                static_cast<unsigned long long>(reader.get_pid()),
+                static_cast<double>(now_us() - s.updated_us) / 1000000);
+            break;
+        }
+        std::fflush(stdout);
+
+        prev = s;
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_BROADCAST_BATCH_HPP
+#define WEBSOCKETPP_BROADCAST_BATCH_HPP
+
+#include <websocketpp/frame.hpp>
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <string>
+
+namespace websocketpp {
+namespace broadcast {
+
+/// Errors related to bridging broadcasts between nodes
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// A batch received from a peer node could not be decoded
+    invalid_batch,
+
+    /// A peer node is not keeping up and its queue is full
+    backpressure,
+
+    /// A text message is not valid UTF-8
+    invalid_payload
+};
+
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.broadcast";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic broadcast error";
+            case invalid_batch:
+                return "Invalid batch from a peer node";
+            case backpressure:
+                return "A peer node queue is full";
+            case invalid_payload:
+                return "Text message payload is not valid UTF-8";
+            default:
+                return "Unknown";
+        }
+    }
+};
+
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+
+/// Builds the batches of topic messages sent between bridged nodes
+/**
+ * A batch is the payload of one binary WebSocket message. It is a sequence
+ * of records, each made of:
+ * - the topic length as LEB128, then the topic
+ * - one byte with the message opcode, text or binary
+ * - the payload length as LEB128, then the payload
+ *
+ * Records are in the order they were appended.
+ */
+class batch_writer {
+public:
+    batch_writer() : m_count(0) {}
+
+    /// Append a message to the batch
+    void append(std::string const & topic, frame::opcode::value op,
+        std::string const & payload)
+    {
+        put_length(topic.size());
+        m_buffer.append(topic);
+        m_buffer.push_back(static_cast<char>(op));
+        put_length(payload.size());
+        m_buffer.append(payload);
+        ++m_count;
+    }
+
+    /// Encoded size of the batch in bytes
+    size_t size() const {
+        return m_buffer.size();
+    }
+
+    /// Number of messages in the batch
+    size_t count() const {
+        return m_count;
+    }
+
+    bool empty() const {
+        return m_count == 0;
+    }
+
+    /// Move the encoded batch into `out` and start a new one
+    void take(std::string & out) {
+        out.clear();
+        out.swap(m_buffer);
+        m_count = 0;
+    }
+
+    /// Encoded size of a record, to check limits before appending
+    static size_t record_size(std::string const & topic,
+        std::string const & payload)
+    {
+        return length_size(topic.size()) + topic.size() + 1 +
+            length_size(payload.size()) + payload.size();
+    }
+private:
+    static size_t length_size(uint64_t value) {
+        size_t n = 1;
+        while (value >= 0x80) {
+            value >>= 7;
+            ++n;
+        }
+        return n;
+    }
+
+    void put_length(uint64_t value) {
+        while (value >= 0x80) {
+            m_buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        m_buffer.push_back(static_cast<char>(value));
+    }
+
+    std::string m_buffer;
+    size_t m_count;
+};
+
+/// Reads the records of a batch built by batch_writer
+class batch_reader {
+public:
+    batch_reader(std::string const & batch)
+      : m_batch(batch)
+      , m_offset(0) {}
+
+    /// Read the next record
+    /**
+     * @param [out] topic The topic of the message
+     * @param [out] op The opcode of the message
+     * @param [out] payload The payload of the message
+     * @param [out] ec Set to error::invalid_batch if the record is malformed
+     * @return Whether a record was read. False at the end of the batch or on
+     * error.
+     */
+    bool next(std::string & topic, frame::opcode::value & op,
+        std::string & payload, lib::error_code & ec)
+    {
+        ec = lib::error_code();
+        if (m_offset == m_batch.size()) {
+            return false;
+        }
+
+        uint64_t len;
+        if (!get_length(len) || len > m_batch.size() - m_offset) {
+            ec = error::make_error_code(error::invalid_batch);
+            return false;
+        }
+        topic.assign(m_batch, m_offset, static_cast<size_t>(len));
+        m_offset += static_cast<size_t>(len);
+
+        if (m_offset == m_batch.size()) {
+            ec = error::make_error_code(error::invalid_batch);
+            return false;
+        }
+        op = static_cast<frame::opcode::value>(
+            static_cast<uint8_t>(m_batch[m_offset++]));
+        if (op != frame::opcode::text && op != frame::opcode::binary) {
+            ec = error::make_error_code(error::invalid_batch);
+            return false;
+        }
+
+        if (!get_length(len) || len > m_batch.size() - m_offset) {
+            ec = error::make_error_code(error::invalid_batch);
+            return false;
+        }
+        payload.assign(m_batch, m_offset, static_cast<size_t>(len));
+        m_offset += static_cast<size_t>(len);
+        return true;
+    }
+private:
+    bool get_length(uint64_t & value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (m_offset == m_batch.size()) {
+                return false;
+            }
+            uint8_t byte = static_cast<uint8_t>(m_batch[m_offset++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string const & m_batch;
+    size_t m_offset;
+};
+
+} // namespace broadcast
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_BROADCAST_BATCH_HPP
@@ -0,0 +1,736 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_BROADCAST_BRIDGE_HPP
+#define WEBSOCKETPP_BROADCAST_BRIDGE_HPP
+
+#include <websocketpp/broadcast/batch.hpp>
+
+#include <websocketpp/close.hpp>
+#include <websocketpp/error.hpp>
+#include <websocketpp/frame.hpp>
+#include <websocketpp/utf8_validator.hpp>
+
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+namespace broadcast {
+
+/// Tracks which local connections are subscribed to which topics
+/**
+ * topic_registry is not synchronized. The bridge guards its registry with
+ * its own lock.
+ */
+class topic_registry {
+public:
+    typedef std::set<connection_hdl, lib::owner_less<connection_hdl> >
+        subscriber_set;
+
+    /// Subscribe a connection to a topic
+    void subscribe(std::string const & topic, connection_hdl hdl) {
+        m_topics[topic].insert(hdl);
+        m_connections[hdl].insert(topic);
+    }
+
+    /// Unsubscribe a connection from a topic
+    void unsubscribe(std::string const & topic, connection_hdl hdl) {
+        topic_map::iterator t = m_topics.find(topic);
+        if (t != m_topics.end()) {
+            t->second.erase(hdl);
+            if (t->second.empty()) {
+                m_topics.erase(t);
+            }
+        }
+
+        connection_map::iterator c = m_connections.find(hdl);
+        if (c != m_connections.end()) {
+            c->second.erase(topic);
+            if (c->second.empty()) {
+                m_connections.erase(c);
+            }
+        }
+    }
+
+    /// Unsubscribe a connection from all of its topics
+    void unsubscribe_all(connection_hdl hdl) {
+        connection_map::iterator c = m_connections.find(hdl);
+        if (c == m_connections.end()) {
+            return;
+        }
+
+        std::set<std::string>::const_iterator it;
+        for (it = c->second.begin(); it != c->second.end(); ++it) {
+            topic_map::iterator t = m_topics.find(*it);
+            if (t != m_topics.end()) {
+                t->second.erase(hdl);
+                if (t->second.empty()) {
+                    m_topics.erase(t);
+                }
+            }
+        }
+        m_connections.erase(c);
+    }
+
+    /// Get the subscribers of a topic, or null if there are none
+    subscriber_set const * subscribers(std::string const & topic) const {
+        topic_map::const_iterator t = m_topics.find(topic);
+        return (t == m_topics.end() ? NULL : &t->second);
+    }
+
+    /// Number of topics with at least one subscriber
+    size_t topics() const {
+        return m_topics.size();
+    }
+private:
+    typedef std::map<std::string,subscriber_set> topic_map;
+    typedef std::map<connection_hdl,std::set<std::string>,
+        lib::owner_less<connection_hdl> > connection_map;
+
+    topic_map m_topics;
+    connection_map m_connections;
+};
+
+/// Bridges topic broadcasts between several server instances
+/**
+ * Each node runs a server endpoint for its own subscribers and a client
+ * endpoint with one persistent connection to every peer node. A message
+ * published on a node is delivered to its local subscribers with a single
+ * prepared frame and appended to a batch for each peer. Batches are sent as
+ * one binary message per peer, so a burst of publishes costs one write per
+ * peer rather than one per message. Peers deliver the messages of a batch to
+ * their own subscribers and do not forward them further; every node must
+ * list every other node as a peer.
+ *
+ * Deliveries are serialized by a delivery lock, so messages published on a
+ * node reach the subscribers of every node in the order they were
+ * published. There is no ordering between messages published on different
+ * nodes. Subscribers are looked up and batches appended under a second lock,
+ * which is not held while sending to subscribers, so subscriptions and peer
+ * links are not held up by sends.
+ *
+ * A peer whose connection has more than the high water mark buffered is not
+ * sent more batches until it drains. Once the queue for a connected peer
+ * would exceed the queue limit, publish fails with error::backpressure and
+ * the message is delivered nowhere. While a peer is disconnected its queue is
+ * kept and the oldest batches are dropped once it is full. Batches in flight
+ * when a link drops are lost, delivery to peers is at most once.
+ *
+ * The server endpoint's handlers forward to validate, on_message and on_close
+ * and the bridge installs its own handlers on the client endpoint. The bridge
+ * must outlive both endpoints' processing. Peer links are identified only by
+ * the subprotocol; restrict who can reach the server or use TLS with client
+ * certificates when nodes are not on a trusted network.
+ *
+ * @since 0.8.2
+ */
+template <typename server_type, typename client_type>
+class bridge {
+public:
+    typedef typename server_type::concurrency_type concurrency_type;
+    typedef typename concurrency_type::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency_type::mutex_type mutex_type;
+    typedef typename server_type::connection_ptr connection_ptr;
+    typedef typename server_type::message_ptr message_ptr;
+    typedef typename client_type::connection_ptr client_connection_ptr;
+
+    /// The state of the link to a peer node
+    struct peer_status {
+        std::string uri;
+        bool connected;
+        /// Bytes waiting to be sent to the peer
+        size_t queued;
+        uint64_t batches_sent;
+        uint64_t messages_sent;
+        /// Messages dropped from a full queue while the peer was down
+        uint64_t messages_dropped;
+    };
+
+    bridge(server_type & server, client_type & client)
+      : m_server(server)
+      , m_client(client)
+      , m_max_batch_size(64 * 1024)
+      , m_max_queued(4 * 1024 * 1024)
+      , m_high_water(1024 * 1024)
+      , m_reconnect_delay(1000)
+      , m_retry_interval(10)
+    {
+        m_client.set_open_handler(lib::bind(&bridge::handle_peer_open,this,
+            lib::placeholders::_1));
+        m_client.set_close_handler(lib::bind(&bridge::handle_peer_down,this,
+            lib::placeholders::_1));
+        m_client.set_fail_handler(lib::bind(&bridge::handle_peer_down,this,
+            lib::placeholders::_1));
+        m_client.set_interrupt_handler(lib::bind(
+            &bridge::handle_peer_interrupt,this,lib::placeholders::_1));
+    }
+
+    /// The subprotocol that identifies a peer link
+    static char const * subprotocol() {
+        return "websocketpp.bridge";
+    }
+
+    /// Set the size at which a batch is sent without waiting (default 64KiB)
+    void set_max_batch_size(size_t bytes) {
+        scoped_lock_type lock(m_lock);
+        m_max_batch_size = bytes;
+    }
+
+    /// Set the limit on bytes queued for one peer (default 4MiB)
+    void set_max_queued(size_t bytes) {
+        scoped_lock_type lock(m_lock);
+        m_max_queued = bytes;
+    }
+
+    /// Set the buffered amount above which a peer is not sent more batches
+    /**
+     * Default is 1MiB.
+     */
+    void set_high_water(size_t bytes) {
+        scoped_lock_type lock(m_lock);
+        m_high_water = bytes;
+    }
+
+    /// Set the delay before reconnecting to a peer, in ms (default 1000)
+    void set_reconnect_delay(long ms) {
+        scoped_lock_type lock(m_lock);
+        m_reconnect_delay = ms;
+    }
+
+    /// Add a peer node and start connecting to it
+    /**
+     * @param uri The WebSocket URI of the peer's server endpoint
+     * @param ec Set to the error, if any, creating the connection
+     */
+    void add_peer(std::string const & uri, lib::error_code & ec) {
+        size_t index;
+        {
+            scoped_lock_type lock(m_lock);
+            index = m_peers.size();
+            lib::shared_ptr<peer> p = lib::make_shared<peer>();
+            p->uri = uri;
+            m_peers.push_back(p);
+        }
+        ec = connect(index);
+    }
+
+    /// Add a peer node, throwing on error
+    void add_peer(std::string const & uri) {
+        lib::error_code ec;
+        add_peer(uri, ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Subscribe a local connection to a topic
+    void subscribe(std::string const & topic, connection_hdl hdl) {
+        scoped_lock_type lock(m_lock);
+        m_registry.subscribe(topic, hdl);
+    }
+
+    /// Unsubscribe a local connection from a topic
+    void unsubscribe(std::string const & topic, connection_hdl hdl) {
+        scoped_lock_type lock(m_lock);
+        m_registry.unsubscribe(topic, hdl);
+    }
+
+    /// Publish a message to the subscribers of a topic on every node
+    /**
+     * @param topic The topic to publish to
+     * @param payload The message payload
+     * @param op The opcode, text or binary
+     * @param ec Set to error::backpressure if a connected peer's queue is
+     * full or error::invalid_payload if a text payload is not valid UTF-8.
+     * Nothing is delivered in either case.
+     */
+    void publish(std::string const & topic, std::string const & payload,
+        frame::opcode::value op, lib::error_code & ec)
+    {
+        if (op == frame::opcode::text && !utf8_validator::validate(payload)) {
+            ec = error::make_error_code(error::invalid_payload);
+            return;
+        }
+
+        size_t record = batch_writer::record_size(topic, payload);
+        std::vector<connection_hdl> wake;
+        {
+            scoped_lock_type deliver_lock(m_deliver_lock);
+            delivery d;
+            {
+                scoped_lock_type lock(m_lock);
+
+                typename peer_list::iterator it;
+                for (it = m_peers.begin(); it != m_peers.end(); ++it) {
+                    if ((*it)->connected &&
+                        (*it)->queued + record > m_max_queued)
+                    {
+                        ec = error::make_error_code(error::backpressure);
+                        return;
+                    }
+                }
+
+                collect(topic, op, payload, d);
+
+                for (it = m_peers.begin(); it != m_peers.end(); ++it) {
+                    peer & p = **it;
+                    if (!p.connected) {
+                        make_room(p, record);
+                    }
+                    p.pending.append(topic, op, payload);
+                    p.queued += record;
+
+                    if (p.pending.size() >= m_max_batch_size) {
+                        cut_batch(p);
+                        flush(p);
+                    } else if (p.connected && !p.flush_pending) {
+                        // Batch with whatever else is published before the
+                        // client endpoint gets to the interrupt
+                        p.flush_pending = true;
+                        wake.push_back(p.hdl);
+                    }
+                }
+            }
+
+            deliver(d);
+        }
+
+        // interrupt may run the handler immediately, so outside the lock
+        for (size_t i = 0; i < wake.size(); ++i) {
+            lib::error_code iec;
+            m_client.interrupt(wake[i], iec);
+        }
+        ec = lib::error_code();
+    }
+
+    /// Publish a message, throwing on error
+    void publish(std::string const & topic, std::string const & payload,
+        frame::opcode::value op = frame::opcode::text)
+    {
+        lib::error_code ec;
+        publish(topic, payload, op, ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Accept a peer link on the server endpoint
+    /**
+     * Call from the server's validate handler. Selects the bridge
+     * subprotocol if the client requested it.
+     *
+     * @return Whether the connection is a peer link
+     */
+    bool validate(connection_hdl hdl) {
+        lib::error_code ec;
+        connection_ptr con = m_server.get_con_from_hdl(hdl, ec);
+        if (ec) {
+            return false;
+        }
+
+        std::vector<std::string> const & requested =
+            con->get_requested_subprotocols();
+        if (std::find(requested.begin(), requested.end(), subprotocol()) ==
+            requested.end())
+        {
+            return false;
+        }
+        con->select_subprotocol(subprotocol(), ec);
+        return !ec;
+    }
+
+    /// Handle a message received by the server endpoint
+    /**
+     * Call from the server's message handler. Batches from peer links are
+     * delivered to local subscribers. A peer link that sends a malformed
+     * batch is closed after delivering the records before the error.
+     *
+     * @return Whether the message came from a peer link. Other messages are
+     * left to the application.
+     */
+    bool on_message(connection_hdl hdl, message_ptr msg) {
+        lib::error_code ec;
+        connection_ptr con = m_server.get_con_from_hdl(hdl, ec);
+        if (ec || con->get_subprotocol() != subprotocol()) {
+            return false;
+        }
+
+        bool valid = msg->get_opcode() == frame::opcode::binary;
+        if (valid) {
+            batch_reader reader(msg->get_payload());
+            std::string topic;
+            std::string payload;
+            frame::opcode::value op;
+
+            scoped_lock_type deliver_lock(m_deliver_lock);
+            std::vector<delivery> batch;
+            {
+                scoped_lock_type lock(m_lock);
+                while (reader.next(topic, op, payload, ec)) {
+                    if (op == frame::opcode::text &&
+                        !utf8_validator::validate(payload))
+                    {
+                        ec = error::make_error_code(error::invalid_payload);
+                        break;
+                    }
+                    batch.push_back(delivery());
+                    collect(topic, op, payload, batch.back());
+                }
+            }
+            for (size_t i = 0; i < batch.size(); ++i) {
+                deliver(batch[i]);
+            }
+            valid = !ec;
+        }
+
+        if (!valid) {
+            m_server.close(hdl, close::status::policy_violation,
+                "invalid batch", ec);
+        }
+        return true;
+    }
+
+    /// Forget the subscriptions of a closed connection
+    /**
+     * Call from the server's close handler.
+     */
+    void on_close(connection_hdl hdl) {
+        scoped_lock_type lock(m_lock);
+        m_registry.unsubscribe_all(hdl);
+    }
+
+    /// Get the state of the links to each peer
+    std::vector<peer_status> get_peers() const {
+        scoped_lock_type lock(m_lock);
+        std::vector<peer_status> ret;
+        typename peer_list::const_iterator it;
+        for (it = m_peers.begin(); it != m_peers.end(); ++it) {
+            ret.push_back((*it)->status);
+            ret.back().uri = (*it)->uri;
+            ret.back().connected = (*it)->connected;
+            ret.back().queued = (*it)->queued;
+        }
+        return ret;
+    }
+private:
+    struct peer {
+        peer() : connected(false), flush_pending(false), retry_pending(false)
+          , queued(0)
+        {
+            status.connected = false;
+            status.queued = 0;
+            status.batches_sent = 0;
+            status.messages_sent = 0;
+            status.messages_dropped = 0;
+        }
+
+        std::string uri;
+        connection_hdl hdl;
+        bool connected;
+        bool flush_pending;
+        bool retry_pending;
+        batch_writer pending;
+        /// Encoded batches and the number of messages in each
+        std::deque<std::pair<std::string,size_t> > ready;
+        size_t queued;
+        peer_status status;
+    };
+
+    typedef std::vector<lib::shared_ptr<peer> > peer_list;
+
+    /// A message and the local subscribers it is sent to
+    struct delivery {
+        delivery() : op(frame::opcode::text) {}
+
+        /// The frame sent to hybi13 subscribers
+        message_ptr prepared;
+        std::vector<connection_ptr> framed;
+        /// Opcode and payload for hybi00 subscribers
+        frame::opcode::value op;
+        std::string payload;
+        std::vector<connection_ptr> legacy;
+    };
+
+    static bool same(connection_hdl a, connection_hdl b) {
+        lib::owner_less<connection_hdl> less;
+        return !less(a, b) && !less(b, a);
+    }
+
+    /// Find the peer a client connection belongs to. Requires the lock.
+    peer * find_peer(connection_hdl hdl) {
+        typename peer_list::iterator it;
+        for (it = m_peers.begin(); it != m_peers.end(); ++it) {
+            if (same((*it)->hdl, hdl)) {
+                return it->get();
+            }
+        }
+        return NULL;
+    }
+
+    /// Find the local subscribers of a message and prepare its frame.
+    /// Requires the lock.
+    void collect(std::string const & topic, frame::opcode::value op,
+        std::string const & payload, delivery & d)
+    {
+        topic_registry::subscriber_set const * subs =
+            m_registry.subscribers(topic);
+        if (!subs) {
+            return;
+        }
+
+        topic_registry::subscriber_set::const_iterator it;
+        for (it = subs->begin(); it != subs->end(); ++it) {
+            lib::error_code ec;
+            connection_ptr con = m_server.get_con_from_hdl(*it, ec);
+            if (ec) {
+                continue;
+            }
+
+            // Hybi00 connections frame messages differently
+            if (con->get_request_header("Sec-WebSocket-Version").empty()) {
+                if (d.legacy.empty()) {
+                    d.op = op;
+                    d.payload = payload;
+                }
+                d.legacy.push_back(con);
+                continue;
+            }
+
+            if (!d.prepared) {
+                d.prepared = con->get_message(op, payload.size());
+                d.prepared->set_header(frame::prepare_header(
+                    frame::basic_header(op, payload.size(), true, false),
+                    frame::extended_header(payload.size())));
+                d.prepared->set_payload(payload);
+                d.prepared->set_prepared(true);
+            }
+            d.framed.push_back(con);
+        }
+    }
+
+    /// Send a message to the subscribers found by collect. Requires the
+    /// delivery lock and must not hold the lock.
+    static void deliver(delivery const & d) {
+        typename std::vector<connection_ptr>::const_iterator it;
+        for (it = d.framed.begin(); it != d.framed.end(); ++it) {
+            (*it)->send(d.prepared);
+        }
+        for (it = d.legacy.begin(); it != d.legacy.end(); ++it) {
+            (*it)->send(d.payload, d.op);
+        }
+    }
+
+    /// Drop the oldest batches of a disconnected peer until a record fits.
+    /// Requires the lock.
+    void make_room(peer & p, size_t record) {
+        while (p.queued + record > m_max_queued && !p.ready.empty()) {
+            p.queued -= p.ready.front().first.size();
+            p.status.messages_dropped += p.ready.front().second;
+            p.ready.pop_front();
+        }
+        if (p.queued + record > m_max_queued && !p.pending.empty()) {
+            p.status.messages_dropped += p.pending.count();
+            std::string discard;
+            p.pending.take(discard);
+            p.queued = 0;
+        }
+    }
+
+    /// Move the pending batch to the send queue. Requires the lock.
+    void cut_batch(peer & p) {
+        if (p.pending.empty()) {
+            return;
+        }
+        size_t count = p.pending.count();
+        p.ready.push_back(std::make_pair(std::string(), count));
+        p.pending.take(p.ready.back().first);
+    }
+
+    /// Send queued batches to a connected peer. Requires the lock.
+    void flush(peer & p) {
+        if (!p.connected) {
+            return;
+        }
+
+        lib::error_code ec;
+        client_connection_ptr con = m_client.get_con_from_hdl(p.hdl, ec);
+        if (ec) {
+            return;
+        }
+
+        while (!p.ready.empty()) {
+            if (con->get_buffered_amount() > m_high_water) {
+                if (!p.retry_pending) {
+                    p.retry_pending = true;
+                    con->set_timer(m_retry_interval, lib::bind(
+                        &bridge::handle_retry, this, p.hdl,
+                        lib::placeholders::_1));
+                }
+                return;
+            }
+
+            ec = con->send(p.ready.front().first, frame::opcode::binary);
+            if (ec) {
+                return;
+            }
+            p.queued -= p.ready.front().first.size();
+            p.status.batches_sent++;
+            p.status.messages_sent += p.ready.front().second;
+            p.ready.pop_front();
+        }
+    }
+
+    /// Start a connection to the peer at index. Must not hold the lock.
+    lib::error_code connect(size_t index) {
+        std::string uri;
+        {
+            scoped_lock_type lock(m_lock);
+            uri = m_peers[index]->uri;
+        }
+
+        lib::error_code ec;
+        client_connection_ptr con = m_client.get_connection(uri, ec);
+        if (ec) {
+            return ec;
+        }
+        con->add_subprotocol(subprotocol(), ec);
+        if (ec) {
+            return ec;
+        }
+
+        {
+            scoped_lock_type lock(m_lock);
+            m_peers[index]->hdl = con->get_handle();
+        }
+        m_client.connect(con);
+        return lib::error_code();
+    }
+
+    void handle_peer_open(connection_hdl hdl) {
+        scoped_lock_type lock(m_lock);
+        peer * p = find_peer(hdl);
+        if (!p) {
+            return;
+        }
+        p->connected = true;
+        p->flush_pending = false;
+        p->retry_pending = false;
+        cut_batch(*p);
+        flush(*p);
+    }
+
+    void handle_peer_down(connection_hdl hdl) {
+        long delay;
+        size_t index = 0;
+        {
+            scoped_lock_type lock(m_lock);
+            peer * p = find_peer(hdl);
+            if (!p) {
+                return;
+            }
+            p->connected = false;
+            p->hdl.reset();
+            delay = m_reconnect_delay;
+            while (m_peers[index].get() != p) {
+                ++index;
+            }
+        }
+
+        m_client.set_timer(delay, lib::bind(&bridge::handle_reconnect, this,
+            index, lib::placeholders::_1));
+    }
+
+    void handle_reconnect(size_t index, lib::error_code const & ec) {
+        if (ec) {
+            return;
+        }
+        if (connect(index)) {
+            // Could not even create the connection, try again later
+            long delay;
+            {
+                scoped_lock_type lock(m_lock);
+                delay = m_reconnect_delay;
+            }
+            m_client.set_timer(delay, lib::bind(&bridge::handle_reconnect,
+                this, index, lib::placeholders::_1));
+        }
+    }
+
+    void handle_peer_interrupt(connection_hdl hdl) {
+        scoped_lock_type lock(m_lock);
+        peer * p = find_peer(hdl);
+        if (!p) {
+            return;
+        }
+        p->flush_pending = false;
+        cut_batch(*p);
+        flush(*p);
+    }
+
+    void handle_retry(connection_hdl hdl, lib::error_code const & ec) {
+        scoped_lock_type lock(m_lock);
+        peer * p = find_peer(hdl);
+        if (!p) {
+            return;
+        }
+        p->retry_pending = false;
+        if (!ec) {
+            flush(*p);
+        }
+    }
+
+    server_type & m_server;
+    client_type & m_client;
+
+    /// Serializes sends to local subscribers. Taken before m_lock.
+    mutex_type m_deliver_lock;
+    mutable mutex_type m_lock;
+    topic_registry m_registry;
+    peer_list m_peers;
+
+    size_t m_max_batch_size;
+    size_t m_max_queued;
+    size_t m_high_water;
+    long m_reconnect_delay;
+    long m_retry_interval;
+};
+
+} // namespace broadcast
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_BROADCAST_BRIDGE_HPP
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_BROADCAST_DEFLATE_STREAM_HPP
+#define WEBSOCKETPP_BROADCAST_DEFLATE_STREAM_HPP
+
+#include <websocketpp/broadcast/message.hpp>
+
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/processors/base.hpp>
+#include <websocketpp/utf8_validator.hpp>
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include "zlib.h"
+
+#include <string>
+
+namespace websocketpp {
+namespace broadcast {
+
+/// Compresses a broadcast topic once for all of its subscribers
+/**
+ * With context takeover every permessage-deflate connection has its own
+ * compressor history, so a message broadcast to N subscribers is normally
+ * compressed N times. A deflate_stream keeps one compressor for the topic
+ * instead. Subscribers whose decompressor has seen the same sequence of
+ * stream messages can all be sent the same compressed bytes.
+ *
+ * The stream resets its compressor every `reset_interval` messages. A
+ * message prepared right after a reset does not refer to earlier ones, so
+ * any connection can start receiving compressed bytes there. Connections that
+ * join between reset points, or that fall out of step, are sent the plain
+ * payload until the next one. `request_reset` makes the next message a reset
+ * point, for example right after a subscriber joins.
+ *
+ * The window size must not exceed the one negotiated with a connection for
+ * the connection to receive compressed bytes. Connections that negotiated
+ * no context takeover only receive compressed bytes for reset points.
+ *
+ * Safe to use from multiple threads. Messages must be sent to each
+ * connection in the order they were prepared to be sent compressed.
+ *
+ * @tparam concurrency The concurrency policy used to protect the compressor
+ */
+template <typename concurrency>
+class deflate_stream {
+public:
+    typedef typename concurrency::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency::mutex_type mutex_type;
+
+    /// Construct a deflate stream
+    /**
+     * @param window_bits LZ77 window size, 9 to 15. Lower values let the
+     * stream be shared with connections that negotiated smaller windows.
+     * @param reset_interval Number of messages between compressor resets
+     * @param level zlib compression level
+     */
+    explicit deflate_stream(uint8_t window_bits = 15,
+        size_t reset_interval = 64, int level = Z_DEFAULT_COMPRESSION)
+      : m_window_bits(window_bits < 9 ? 9 :
+            (window_bits > 15 ? 15 : window_bits))
+      , m_reset_interval(reset_interval ? reset_interval : 1)
+      , m_level(level)
+      , m_initialized(false)
+      , m_reset_pending(true)
+      , m_sequence(0)
+      , m_since_reset(0)
+      , m_identity(lib::make_shared<char>(0))
+    {
+        m_dstate.zalloc = Z_NULL;
+        m_dstate.zfree = Z_NULL;
+        m_dstate.opaque = Z_NULL;
+    }
+
+    ~deflate_stream() {
+        if (m_initialized) {
+            deflateEnd(&m_dstate);
+        }
+    }
+
+    /// Compress a message for all subscribers
+    /**
+     * @param payload The message payload
+     * @param op The message opcode, text or binary
+     * @param ec Set to the error that occurred, if any
+     * @return The message to pass to `connection::send_broadcast`, or an
+     * empty pointer on error
+     */
+    message_ptr prepare(std::string const & payload, frame::opcode::value op,
+        lib::error_code & ec)
+    {
+        if (frame::opcode::is_control(op) ||
+            op == frame::opcode::continuation)
+        {
+            ec = processor::error::make_error_code(
+                processor::error::invalid_opcode);
+            return message_ptr();
+        }
+
+        if (op == frame::opcode::text && !utf8_validator::validate(payload)) {
+            ec = processor::error::make_error_code(
+                processor::error::invalid_payload);
+            return message_ptr();
+        }
+
+        lib::shared_ptr<message> msg = lib::make_shared<message>();
+        msg->opcode = op;
+        msg->payload = payload;
+        msg->window_bits = m_window_bits;
+        msg->stream = m_identity;
+
+        scoped_lock_type lock(m_lock);
+
+        ec = compress(payload, msg->compressed, msg->reset);
+        if (ec) {
+            // the compressor state is unknown, start over
+            m_reset_pending = true;
+            return message_ptr();
+        }
+
+        msg->sequence = m_sequence++;
+        return msg;
+    }
+
+    /// Make the next message a reset point
+    void request_reset() {
+        scoped_lock_type lock(m_lock);
+        m_reset_pending = true;
+    }
+
+    /// Get the LZ77 window size of the stream
+    uint8_t get_window_bits() const {
+        return m_window_bits;
+    }
+
+    /// Get the number of messages between compressor resets
+    size_t get_reset_interval() const {
+        return m_reset_interval;
+    }
+private:
+    lib::error_code compress(std::string const & in, std::string & out,
+        bool & reset)
+    {
+        namespace pmd = extensions::permessage_deflate;
+
+        if (!m_initialized) {
+            int ret = deflateInit2(&m_dstate, m_level, Z_DEFLATED,
+                -1*m_window_bits, 8, Z_DEFAULT_STRATEGY);
+            if (ret != Z_OK) {
+                return pmd::error::make_error_code(
+                    pmd::error::zlib_error);
+            }
+            m_initialized = true;
+        }
+
+        reset = m_reset_pending || m_since_reset >= m_reset_interval;
+        if (reset) {
+            if (deflateReset(&m_dstate) != Z_OK) {
+                return pmd::error::make_error_code(
+                    pmd::error::zlib_error);
+            }
+            m_reset_pending = false;
+            m_since_reset = 0;
+        }
+        m_since_reset++;
+
+        if (in.empty()) {
+            // an empty block that leaves the history unchanged
+            out.assign("\x02\x00",2);
+            return lib::error_code();
+        }
+
+        m_dstate.avail_in = static_cast<uInt>(in.size());
+        m_dstate.next_in = reinterpret_cast<Bytef *>(
+            const_cast<char *>(in.data()));
+
+        size_t chunk = deflateBound(&m_dstate, in.size()) + 16;
+        do {
+            size_t used = out.size();
+            out.resize(used + chunk);
+
+            m_dstate.avail_out = static_cast<uInt>(chunk);
+            m_dstate.next_out = reinterpret_cast<Bytef *>(&out[used]);
+
+            if (deflate(&m_dstate, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+                return pmd::error::make_error_code(
+                    pmd::error::zlib_error);
+            }
+
+            out.resize(used + chunk - m_dstate.avail_out);
+        } while (m_dstate.avail_out == 0);
+
+        // Strip the 0x00 0x00 0xff 0xff sync flush trailer
+        if (out.size() < 4) {
+            return pmd::error::make_error_code(
+                pmd::error::zlib_error);
+        }
+        out.resize(out.size()-4);
+
+        return lib::error_code();
+    }
+
+    uint8_t const m_window_bits;
+    size_t const m_reset_interval;
+    int const m_level;
+
+    mutex_type m_lock;
+    z_stream m_dstate;
+    bool m_initialized;
+    bool m_reset_pending;
+    uint64_t m_sequence;
+    size_t m_since_reset;
+    lib::shared_ptr<void const> m_identity;
+};
+
+} // namespace broadcast
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_BROADCAST_DEFLATE_STREAM_HPP
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_BROADCAST_MESSAGE_HPP
+#define WEBSOCKETPP_BROADCAST_MESSAGE_HPP
+
+#include <websocketpp/frame.hpp>
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <string>
+
+namespace websocketpp {
+namespace broadcast {
+
+/// A broadcast message compressed once for all subscribers of a stream
+/**
+ * Created by broadcast::deflate_stream and sent with
+ * `connection::send_broadcast`. Connections that have received every message
+ * of the stream since its last reset point write the shared compressed bytes.
+ * Others write the plain payload until the next reset point lets them join.
+ *
+ * Messages are immutable once created and may be sent to any number of
+ * connections from any thread.
+ */
+struct message {
+    /// Opcode of the message, text or binary
+    frame::opcode::value opcode;
+
+    /// The uncompressed payload
+    std::string payload;
+
+    /// The raw deflate output for the payload, without the 4 byte trailer
+    std::string compressed;
+
+    /// Identifies the stream. Held by synchronized connections so that the
+    /// identity is not reused while they depend on it.
+    lib::shared_ptr<void const> stream;
+
+    /// Position of the message in its stream, starting at 0
+    uint64_t sequence;
+
+    /// LZ77 window size the stream compresses with
+    uint8_t window_bits;
+
+    /// Whether the message was compressed without reference to earlier ones
+    bool reset;
+};
+
+/// Type of a pointer to a broadcast message
+typedef lib::shared_ptr<message const> message_ptr;
+
+} // namespace broadcast
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_BROADCAST_MESSAGE_HPP
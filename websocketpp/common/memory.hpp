@@ -57,6 +57,7 @@
     #include <boost/scoped_array.hpp>
     #include <boost/enable_shared_from_this.hpp>
     #include <boost/pointer_cast.hpp>
+    #include <boost/smart_ptr/owner_less.hpp>
 #endif
 
 namespace websocketpp {
@@ -69,6 +70,7 @@ namespace lib {
     using std::static_pointer_cast;
     using std::make_shared;
     using std::unique_ptr;
+    using std::owner_less;
 
     typedef std::unique_ptr<unsigned char[]> unique_ptr_uchar_array;
 #else
@@ -78,6 +80,7 @@ namespace lib {
     using boost::enable_shared_from_this;
     using boost::static_pointer_cast;
     using boost::make_shared;
+    using boost::owner_less;
 
     typedef boost::scoped_array<unsigned char> unique_ptr_uchar_array;
 #endif
@@ -34,6 +34,9 @@
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/stdint.hpp>
 
+// Role
+#include <websocketpp/roles/role.hpp>
+
 // Concurrency
 #include <websocketpp/concurrency/basic.hpp>
 
@@ -60,6 +63,7 @@
 
 // Extensions
 #include <websocketpp/extensions/permessage_deflate/disabled.hpp>
+#include <websocketpp/extensions/message_batching/disabled.hpp>
 
 namespace websocketpp {
 namespace config {
@@ -192,6 +196,45 @@ struct debug_core {
     ///
     static const size_t connection_read_buffer_size = 16384;
 
+    /// Maximum number of bytes gathered into one transport write
+    /**
+     * Each write may gather this many bytes of queued messages plus whatever
+     * the connection left unused on its previous write (deficit round robin).
+     * At least one message is always written, so a message larger than the
+     * quantum goes out by itself. When more messages remain, the next write is
+     * started through the transport's dispatch, which on the asio transport
+     * queues it behind other pending work on the io thread. This keeps a
+     * connection with a large backlog from delaying other connections served
+     * by the same thread.
+     *
+     * The default, 0, gathers every queued message into one write.
+     *
+     * @since 0.8.2
+     */
+    static const size_t write_quantum = 0;
+
+    /// Maximum number of messages gathered into one transport write
+    /**
+     * Like write_quantum, but counts messages. 0 (the default) means no limit.
+     *
+     * @since 0.8.2
+     */
+    static const size_t write_quantum_messages = 0;
+
+    /// Maximum number of messages dispatched per read before yielding
+    /**
+     * A single read can hold many small messages. After passing this many to
+     * the message handler the connection hands the rest of the read buffer to
+     * the transport's dispatch and continues from there, letting other
+     * connections on the io thread run in between. No new read is started
+     * until the buffer has been consumed.
+     *
+     * The default, 0, dispatches every message that was read at once.
+     *
+     * @since 0.8.2
+     */
+    static const size_t read_quantum_messages = 0;
+
     /// Drop connections immediately on protocol error.
     /**
      * Drop connections on protocol error rather than sending a close frame.
@@ -240,6 +283,67 @@ struct debug_core {
      */
     static const size_t max_http_body_size = 32000000;
 
+    /// Default maximum outbound frame size
+    /**
+     * Default value for the connection's maximum outbound frame size. Data
+     * messages with larger payloads are split into continuation frames of at
+     * most this many payload bytes as they are written, so that control frames
+     * do not have to wait for the whole message.
+     *
+     * The default, 0, never splits messages.
+     *
+     * @since 0.8.2
+     */
+    static const size_t max_outbound_frame_size = 0;
+
+    /// Enable per connection resource accounting
+    /**
+     * When enabled, connections count the bytes and messages they read and
+     * write and the cycles spent parsing, in the message handler and preparing
+     * outgoing messages. Each endpoint keeps an approximate list of its most
+     * expensive connections. See `connection::get_resource_stats` and
+     * `endpoint::get_heavy_connections`.
+     *
+     * Off by default. When off no counters are updated and no cycle counter
+     * is read. The per connection counters remain members of the connection.
+     *
+     * @since 0.8.2
+     */
+    static const bool enable_resource_accounting = false;
+
+    /// Number of connections tracked by the endpoint's heavy hitter list
+    /**
+     * Only used if enable_resource_accounting is true.
+     *
+     * @since 0.8.2
+     */
+    static const size_t heavy_hitter_capacity = 32;
+
+    /// Cycles a connection accumulates before reporting to the heavy hitters
+    /**
+     * Connections report to the endpoint wide list in batches of at least this
+     * many cycles to keep contention on its lock low. Connections that used
+     * fewer cycles do not appear in the list yet. Only used if
+     * enable_resource_accounting is true.
+     *
+     * @since 0.8.2
+     */
+    static const uint64_t heavy_hitter_report_cycles = 100000;
+
+    /// Endpoint role this config is compiled for
+    /**
+     * With role::any both the client and server code paths are compiled in and
+     * every connection checks its role at runtime. Configs used only for
+     * servers (or only for clients) may set role::server (or role::client) so
+     * that those checks become compile time constants and the other role's
+     * masking, random number generation and handshake code drops out of the
+     * hot path. Using such a config for the other endpoint role fails to
+     * compile.
+     *
+     * @since 0.8.2
+     */
+    static const role::value endpoint_role = role::any;
+
     /// Global flag for enabling/disabling extensions
     static const bool enable_extensions = true;
 
@@ -264,6 +368,18 @@ struct debug_core {
     typedef websocketpp::extensions::permessage_deflate::disabled
         <permessage_deflate_config> permessage_deflate_type;
 
+    /// message batching extension
+    struct message_batching_config {
+        /// Messages with payloads up to this size are packed into batches
+        static const size_t max_message_size = 512;
+
+        /// Largest batch payload, in bytes
+        static const size_t max_batch_size = 16384;
+    };
+
+    typedef websocketpp::extensions::message_batching::disabled
+        <message_batching_config> message_batching_type;
+
     /// Autonegotiate permessage-deflate
     /**
      * Automatically enables the permessage-deflate extension.
@@ -28,12 +28,23 @@
 #ifndef WEBSOCKETPP_CONNECTION_HPP
 #define WEBSOCKETPP_CONNECTION_HPP
 
+#include <websocketpp/broadcast/message.hpp>
 #include <websocketpp/close.hpp>
 #include <websocketpp/error.hpp>
+#include <websocketpp/extensions/permessage_deflate/policy.hpp>
 #include <websocketpp/frame.hpp>
+#include <websocketpp/idle/table.hpp>
 
+#include <websocketpp/logger/keyed.hpp>
 #include <websocketpp/logger/levels.hpp>
+#include <websocketpp/metrics/connection_stats.hpp>
+#include <websocketpp/metrics/endpoint_counters.hpp>
+#include <websocketpp/metrics/cycles.hpp>
+#include <websocketpp/metrics/probes.hpp>
+#include <websocketpp/metrics/stage_profile.hpp>
 #include <websocketpp/processors/processor.hpp>
+#include <websocketpp/roles/role.hpp>
+#include <websocketpp/tenant/registry.hpp>
 #include <websocketpp/transport/base/connection.hpp>
 #include <websocketpp/http/constants.hpp>
 
@@ -41,6 +52,7 @@
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/functional.hpp>
 
+#include <deque>
 #include <queue>
 #include <sstream>
 #include <string>
@@ -150,6 +162,20 @@ typedef lib::function<bool(connection_hdl)> validate_handler;
  */
 typedef lib::function<void(connection_hdl)> http_handler;
 
+/// The type and function signature of a deflate policy handler
+/**
+ * The deflate policy handler is called on the server side before the
+ * permessage-deflate offers of a handshake are negotiated. It receives the
+ * current deflate memory use of the endpoint and the settings picked by the
+ * default policy, which it may change. Setting `decline` refuses
+ * compression for this connection.
+ *
+ * @since 0.8.2
+ */
+typedef lib::function<void(connection_hdl,
+    extensions::permessage_deflate::usage const &,
+    extensions::permessage_deflate::settings &)> deflate_policy_handler;
+
 //
 typedef lib::function<void(lib::error_code const & ec, size_t bytes_transferred)> read_handler;
 typedef lib::function<void(lib::error_code const & ec)> write_frame_handler;
@@ -274,15 +300,45 @@ public:
     /// Type of RNG
     typedef typename config::rng_type rng_type;
 
+    /// Type of the message batching extension
+    typedef typename config::message_batching_type message_batching_type;
+
     typedef processor::processor<config> processor_type;
     typedef lib::shared_ptr<processor_type> processor_ptr;
 
     // Message handler (needs to know message type)
     typedef lib::function<void(connection_hdl,message_ptr)> message_handler;
 
+    /// The type and function signature of a message expired handler
+    /**
+     * The message expired handler is called when an outgoing data message is
+     * dropped from the write queue because its deadline passed before it could
+     * be written, or because fast close discarded the write queue. The message
+     * passed is the one given to send(), not its prepared (wire format) form.
+     */
+    typedef lib::function<void(connection_hdl,message_ptr)> message_expired_handler;
+
     /// Type of a pointer to a transport timer handle
     typedef typename transport_con_type::timer_ptr timer_ptr;
 
+    /// Type of the endpoint wide list of expensive connections
+    typedef metrics::heavy_hitters<concurrency_type> heavy_hitters_type;
+    /// Type of a pointer to the endpoint wide list of expensive connections
+    typedef lib::shared_ptr<heavy_hitters_type> heavy_hitters_ptr;
+
+    /// Type of the endpoint wide set of tenants
+    typedef tenant::registry<concurrency_type> tenant_registry_type;
+    /// Type of a pointer to the endpoint wide set of tenants
+    typedef lib::shared_ptr<tenant_registry_type> tenant_registry_ptr;
+    /// Type of a pointer to the account of a tenant
+    typedef typename tenant_registry_type::account_ptr tenant_account_ptr;
+
+    /// Type of the endpoint wide deflate memory tracker
+    typedef extensions::permessage_deflate::tracker<concurrency_type>
+        deflate_tracker_type;
+    /// Type of a pointer to the endpoint wide deflate memory tracker
+    typedef lib::shared_ptr<deflate_tracker_type> deflate_tracker_ptr;
+
     // Misc Convenience Types
     typedef session::internal_state::value istate_type;
 
@@ -313,12 +369,22 @@ public:
       , m_close_handshake_timeout_dur(config::timeout_close_handshake)
       , m_pong_timeout_dur(config::timeout_pong)
       , m_max_message_size(config::max_message_size)
+      , m_max_outbound_frame_size(config::max_outbound_frame_size)
       , m_state(session::state::connecting)
       , m_internal_state(session::internal_state::USER_INIT)
       , m_msg_manager(new con_msg_manager_type())
       , m_send_buffer_size(0)
+      , m_expired_message_count(0)
       , m_write_flag(false)
+      , m_write_deficit(0)
+      , m_fragment_offset(0)
+      , m_deferred_messages(0)
+      , m_preparing_fragment(false)
+      , m_broadcast_next(0)
+      , m_fragment_in_progress(false)
+      , m_drop_fragments(false)
       , m_read_flag(true)
+      , m_read_busy(false)
       , m_is_server(p_is_server)
       , m_alog(alog)
       , m_elog(elog)
@@ -328,10 +394,29 @@ public:
       , m_is_http(false)
       , m_http_state(session::http_state::init)
       , m_was_clean(false)
+      , m_fast_close(false)
+      , m_unreported_cycles(0)
+      , m_counters(NULL)
+      , m_idle_table(NULL)
+      , m_idle_slot(idle::table::no_slot)
+      , m_counted_queued(0)
+      , m_queue_released(false)
+      , m_deflate_charged(0)
+      , m_tenant_weight(1)
+      , m_tenant_deflate(0)
+      , m_tenant_queued(0)
+      , m_tenant_admitted(false)
+      , m_tenant_rejected(false)
+      , m_read_delayed(false)
     {
         m_alog->write(log::alevel::devel,"connection constructor");
     }
 
+    ~connection() {
+        release_tenant();
+        release_deflate();
+    }
+
     /// Get a shared pointer to this component
     ptr get_shared() {
         return lib::static_pointer_cast<type>(transport_con_type::get_shared());
@@ -464,6 +549,20 @@ public:
         m_validate_handler = h;
     }
 
+    /// Set deflate policy handler
+    /**
+     * The deflate policy handler picks the permessage-deflate parameters
+     * of a server connection before they are negotiated. Without one the
+     * default policy, extensions::permessage_deflate::fit_budget, is used.
+     *
+     * @since 0.8.2
+     *
+     * @param h The new deflate_policy_handler
+     */
+    void set_deflate_policy_handler(deflate_policy_handler h) {
+        m_deflate_policy_handler = h;
+    }
+
     /// Set message handler
     /**
      * The message handler is called after a new message has been received.
@@ -474,6 +573,28 @@ public:
         m_message_handler = h;
     }
 
+    /// Set message expired handler
+    /**
+     * The message expired handler is called after an outgoing message has been
+     * dropped because its deadline passed while it was waiting in the write
+     * queue. With fast close it is also called for the data messages still
+     * queued when the write queue is discarded, including a message whose
+     * first fragments were already written.
+     *
+     * The handler is given the message that was passed to send(). While a
+     * handler is set the frames prepared when a message is sent keep a
+     * reference to that message until they are written.
+     *
+     * @see message::set_deadline()
+     *
+     * @since 0.8.2
+     *
+     * @param h The new message_expired_handler
+     */
+    void set_message_expired_handler(message_expired_handler h) {
+        m_message_expired_handler = h;
+    }
+
     //////////////////////////////////////////
     // Connection timeouts and other limits //
     //////////////////////////////////////////
@@ -579,6 +700,40 @@ public:
         }
     }
     
+    /// Get maximum outbound frame size
+    /**
+     * Get maximum outbound frame size. Data messages with larger payloads are
+     * split into continuation frames of at most this many payload bytes as
+     * they are written. Zero means messages are never split.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @since 0.8.2
+     *
+     * @return The maximum outbound frame size
+     */
+    size_t get_max_outbound_frame_size() const {
+        return m_max_outbound_frame_size;
+    }
+
+    /// Set maximum outbound frame size
+    /**
+     * Set maximum outbound frame size. Data messages with larger payloads are
+     * split into continuation frames of at most this many payload bytes as
+     * they are written. Masking and compression are applied per fragment.
+     * Control frames queued while a message is being split are written
+     * between its fragments. Zero means messages are never split.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * @since 0.8.2
+     *
+     * @param new_value The value to set as the maximum outbound frame size.
+     */
+    void set_max_outbound_frame_size(size_t new_value) {
+        m_max_outbound_frame_size = new_value;
+    }
+
     /// Get maximum HTTP message body size
     /**
      * Get maximum HTTP message body size. Maximum message body size determines
@@ -636,6 +791,149 @@ public:
         return get_buffered_amount();
     }
 
+    /// Get the number of outgoing messages dropped due to expired deadlines
+    /**
+     * This method invokes the m_write_lock mutex
+     *
+     * @see message::set_deadline()
+     *
+     * @since 0.8.2
+     *
+     * @return The number of messages dropped from the write queue so far
+     */
+    size_t get_expired_message_count() const;
+
+    /// Get the resources consumed by this connection so far
+    /**
+     * Returns all zeros unless the `enable_resource_accounting` config value
+     * is true.
+     *
+     * @since 0.8.2
+     *
+     * @return A snapshot of the connection's resource usage counters
+     */
+    metrics::connection_stats get_resource_stats() const;
+
+    /// Set the list this connection reports its cost to
+    /**
+     * Typically called by the endpoint that creates the connection.
+     *
+     * @since 0.8.2
+     *
+     * @param list The endpoint wide list of expensive connections
+     */
+    void set_heavy_hitters(heavy_hitters_ptr list) {
+        m_heavy_hitters = list;
+    }
+
+    /// Set the traffic totals this connection adds to
+    /**
+     * Typically called by the endpoint that creates the connection. The
+     * counters are updated without locking, see metrics::endpoint_counters.
+     *
+     * @since 0.8.2
+     *
+     * @param counters The endpoint wide counters, or NULL for none
+     */
+    void set_counters(metrics::endpoint_counters * counters) {
+        m_counters = counters;
+    }
+
+    /// Set the idle table this connection is timed by
+    /**
+     * Typically called by the endpoint that creates the connection. Must be
+     * called before the connection is started.
+     *
+     * @since 0.8.2
+     *
+     * @param table The endpoint wide table, or NULL to use timers
+     */
+    void set_idle_table(idle::table * table) {
+        m_idle_table = table;
+    }
+
+    /// Ask the connection to carry out an action found by an idle table sweep
+    /**
+     * Used by idle::sweeper. The action runs within the transport's event
+     * system, on the connection's strand if it has one, rather than on the
+     * thread that swept the table.
+     *
+     * @since 0.8.2
+     *
+     * @param action The action to take
+     * @return Whether the action could be dispatched
+     */
+    lib::error_code idle_action(idle::action::value action);
+
+    /// Set the set of tenants this connection may be assigned to
+    /**
+     * Typically called by the endpoint that creates the connection.
+     *
+     * @since 0.8.2
+     *
+     * @param tenants The endpoint wide set of tenants
+     */
+    void set_tenant_registry(tenant_registry_ptr tenants) {
+        m_tenants = tenants;
+    }
+
+    /// Set the tracker of the deflate memory of the endpoint
+    /**
+     * Typically called by the endpoint that creates the connection. Its
+     * usage and budget drive the permessage-deflate negotiation policy and
+     * the connection charges its deflate memory to it.
+     *
+     * @since 0.8.2
+     *
+     * @param tracker The endpoint wide deflate memory tracker
+     */
+    void set_deflate_tracker(deflate_tracker_ptr tracker) {
+        m_deflate_tracker = tracker;
+    }
+
+    /// Assign this connection to a tenant
+    /**
+     * The connection takes one of the tenant's connection slots and, if
+     * permessage-deflate was negotiated, its estimated deflate memory. Both
+     * are given back when the connection is terminated. From then on its
+     * reads, writes and send queue count against the tenant's quota and its
+     * read and write quanta are scaled by the tenant's weight.
+     *
+     * On the server side this is intended to be called from the validate
+     * handler, after the permessage-deflate negotiation. If the tenant has
+     * no room left the handshake is rejected with 503 Service Unavailable,
+     * whatever the validate handler returns.
+     *
+     * A connection can be assigned to a tenant only once.
+     *
+     * @since 0.8.2
+     *
+     * @param name The name of the tenant
+     * @param ec Set to error::tenant_quota_exceeded if the tenant has no room
+     * for the connection, or error::invalid_state if the connection already
+     * has a tenant or was created without a tenant registry
+     */
+    void set_tenant(std::string const & name, lib::error_code & ec);
+
+    /// Assign this connection to a tenant (exception)
+    /**
+     * @since 0.8.2
+     *
+     * @param name The name of the tenant
+     * @see set_tenant(std::string const &, lib::error_code &)
+     */
+    void set_tenant(std::string const & name);
+
+    /// Get the name of the tenant of this connection
+    /**
+     * @since 0.8.2
+     *
+     * @return The name of the tenant, empty if none was assigned
+     */
+    std::string const & get_tenant() const {
+        return m_tenant_name;
+    }
+
     ////////////////////
     // Action Methods //
     ////////////////////
@@ -687,6 +985,27 @@ public:
      */
     lib::error_code send(message_ptr msg);
 
+    /// Add a broadcast message to the outgoing send queue
+    /**
+     * Sends the bytes compressed once by the message's deflate stream if this
+     * connection negotiated permessage-deflate and its decompressor is in step
+     * with the stream, either because it received every stream message since
+     * the last reset point or because msg is a reset point. Otherwise the
+     * payload is sent uncompressed, which leaves the remote decompressor
+     * untouched.
+     *
+     * Sending a compressed message of its own takes the connection out of
+     * step until the next reset point.
+     *
+     * This method locks the m_write_lock mutex
+     *
+     * @since 0.8.2
+     *
+     * @param msg A message prepared by a broadcast::deflate_stream
+     * @return Status code, zero on success, non-zero on failure
+     */
+    lib::error_code send_broadcast(broadcast::message_ptr msg);
+
     /// Asyncronously invoke handler::on_inturrupt
     /**
      * Signals to the connection to asyncronously invoke the on_inturrupt
@@ -803,6 +1122,63 @@ public:
     void close(close::status::value const code, std::string const & reason,
         lib::error_code & ec);
 
+    /// Close the connection without waiting for the close handshake
+    /**
+     * Closes the connection and, if that succeeds, turns on fast close for it
+     * (see set_fast_close) and discards the messages that have not been handed
+     * to the transport yet. The close frame is written if possible and the
+     * connection is dropped as soon as that write completes, without waiting
+     * for the remote endpoint's close frame. If the close handshake is already
+     * in progress the connection stops waiting for it and is dropped by the
+     * transport's thread, like a write queued by send.
+     *
+     * The handler's on_close callback is called once the connection has been
+     * dropped.
+     *
+     * @since 0.8.2
+     *
+     * @param code The close code to send
+     * @param reason The close reason to send
+     */
+    void fast_close(close::status::value const code, std::string const & reason);
+
+    /// exception free variant of fast_close
+    void fast_close(close::status::value const code, std::string const & reason,
+        lib::error_code & ec);
+
+    /// Get whether this connection closes abortively
+    /**
+     * @since 0.8.2
+     *
+     * @return Whether fast close is enabled for this connection
+     */
+    bool get_fast_close() const {
+        return m_fast_close;
+    }
+
+    /// Set whether this connection closes abortively
+    /**
+     * With fast close enabled, close() behaves like fast_close() and the
+     * connection's transport is torn down abortively when the connection
+     * ends for any reason. On the asio transport that means no TLS
+     * close_notify and a TCP reset (SO_LINGER 0) instead of a graceful
+     * shutdown, so no timeout_socket_shutdown wait and no socket left in
+     * TIME_WAIT. Peers will see an abnormal close if their copy of the close
+     * frame was lost.
+     *
+     * The default is set by the endpoint that creates the connection.
+     *
+     * May only be called before start(). Use fast_close() to close a
+     * connection that is already running abortively.
+     *
+     * @since 0.8.2
+     *
+     * @param value Whether or not to enable fast close
+     */
+    void set_fast_close(bool value) {
+        m_fast_close = value;
+    }
+
     ////////////////////////////////////////////////
     // Pass-through access to the uri information //
     ////////////////////////////////////////////////
@@ -1186,10 +1562,13 @@ public:
 
     /// Get whether or not this connection is part of a server or client
     /**
+     * For configs compiled for a single role (see `endpoint_role`) this is a
+     * compile time constant.
+     *
      * @return whether or not the connection is attached to a server endpoint
      */
     bool is_server() const {
-        return m_is_server;
+        return role::is_server(config::endpoint_role, m_is_server);
     }
 
     /// Return the same origin policy origin value from the opening request.
@@ -1301,10 +1680,36 @@ public:
 
     void handle_open_handshake_timeout(lib::error_code const & ec);
     void handle_close_handshake_timeout(lib::error_code const & ec);
+    /// Carry out an action requested by a sweep of the idle table
+    void handle_idle_action(idle::action::value action);
+    /// Apply an idle table update from a path other threads may run
+    /**
+     * close and terminate dispatch their updates so that m_idle_slot is only
+     * used within the transport's event system. state::free frees the slot.
+     */
+    void handle_idle_update(idle::state::value s, uint32_t ms);
+    /// Take an idle table slot and initialize the transport
+    /**
+     * Dispatched by start so that the slot is taken within the transport's
+     * event system, like every later use of it
+     */
+    void handle_idle_start();
 
     void handle_read_frame(lib::error_code const & ec, size_t bytes_transferred);
     void read_frame();
 
+    /// Process the bytes in m_buf from begin to end
+    /**
+     * Dispatches at most config::read_quantum_messages messages before
+     * handing the rest of the buffer back to the transport's dispatch. Starts
+     * the next read once the buffer is consumed; until then read_frame will
+     * not start another one.
+     *
+     * @param begin Offset of the first unprocessed byte
+     * @param end Offset one past the last byte read
+     */
+    void process_read_buffer(size_t begin, size_t end);
+
     /// Get array of WebSocket protocol versions that this connection supports.
     std::vector<int> const & get_supported_versions() const;
 
@@ -1358,6 +1763,8 @@ public:
         transport_con_type::set_handle(hdl);
     }
 protected:
+    /// Start initializing the transport, handle_transport_init is called next
+    void init_transport();
     void handle_transport_init(lib::error_code const & ec);
 
     /// Set m_processor based on information in m_request. Set m_response
@@ -1411,12 +1818,20 @@ private:
      *
      * @param code The close code to send
      * @param reason The close reason to send
+     * If dropped is set the send queue is discarded into it once the close
+     * frame has been prepared, so that the close frame is written next. The
+     * queue is left alone if preparing the frame fails.
+     *
+     * @param code The close code to send
+     * @param reason The close reason to send
      * @param ack Whether or not this is an acknowledgement close frame
+     * @param terminal Whether to drop the connection once it is written
+     * @param dropped Where to put discarded messages, or NULL to keep them
      * @return A status code, zero on success, non-zero otherwise
      */
     lib::error_code send_close_frame(close::status::value code =
         close::status::blank, std::string const & reason = std::string(), bool ack = false,
-        bool terminal = false);
+        bool terminal = false, std::vector<message_ptr> * dropped = NULL);
 
     /// Get a pointer to a new WebSocket protocol processor for a given version
     /**
@@ -1430,6 +1845,46 @@ private:
      */
     processor_ptr get_processor(int version) const;
 
+    /// Decide whether a message popped from the write queue should be dropped
+    /**
+     * Applies the message deadline rules. Control frames, frames that continue
+     * a fragmented message already partially written, and compressed frames are
+     * never dropped. Once the first frame of a fragmented message is dropped
+     * all remaining frames of that message are dropped too.
+     *
+     * Must be called while holding m_write_lock
+     *
+     * @param msg The message to test
+     * @param now The current time
+     * @return Whether or not the message should be dropped
+     */
+    bool write_expire(message_ptr msg,
+        typename message_type::time_point const & now);
+
+    /// Report messages that were dropped from the write queue
+    /**
+     * Must not be called while holding m_write_lock
+     *
+     * @param msgs The messages that were dropped
+     */
+    void write_expired(std::vector<message_ptr> const & msgs);
+
+    /// Get the number of bytes in the buffers of the current transport write
+    size_t send_buffer_bytes() const;
+
+    /// Add the cycles elapsed since start to a resource accounting counter
+    /**
+     * Only called if config::enable_resource_accounting is true. Cycles are
+     * forwarded to the heavy hitter list in batches to keep contention on it
+     * low.
+     *
+     * @param stage The counter to add to
+     * @param start The counter value at the start of the stage
+     * @param compressed Whether to also count the cycles as compression
+     */
+    void account_cycles(uint64_t metrics::connection_stats::* stage,
+        uint64_t start, bool compressed = false);
+
     /// Add a message to the write queue
     /**
      * Adds a message to the write queue and updates any associated shared state
@@ -1455,6 +1910,172 @@ private:
      */
     message_ptr write_pop();
 
+    /// Get the next message to write
+    /**
+     * Like write_pop, but while a message is being split into fragments the
+     * control frames queued behind it are returned first, followed by the
+     * message being split itself. Close frames only skip ahead of the
+     * remaining fragments, not of other queued messages.
+     *
+     * Must be called while holding m_write_lock
+     *
+     * @return The next message to write or an empty pointer
+     */
+    message_ptr write_next();
+
+    /// Prepare the next fragment of a deferred data message
+    /**
+     * Same as claim_fragment followed by prepare_fragment.
+     *
+     * Must be called while holding m_write_lock
+     *
+     * @param msg The deferred message
+     * @param ec Set to the error that occurred, if any
+     * @return The prepared fragment
+     */
+    message_ptr write_fragment(message_ptr msg, lib::error_code & ec);
+
+    /// A fragment taken by claim_fragment that is yet to be prepared
+    struct claimed_fragment {
+        /// The deferred message the fragment is taken from
+        message_ptr source;
+        /// Offset of the fragment in the payload of source
+        size_t offset;
+        /// Length of the fragment
+        size_t len;
+        /// The message to prepare the fragment in
+        message_ptr out;
+    };
+
+    /// Take the next fragment of a deferred data message for writing
+    /**
+     * Advances the split of msg past the fragment and sets
+     * m_preparing_fragment, which keeps other data messages from being
+     * prepared until the fragment is. The fragment itself is prepared by
+     * prepare_fragment, which may be called after m_write_lock is released.
+     * The returned message has the fin bit of the fragment but is not
+     * prepared yet.
+     *
+     * Must be called while holding m_write_lock
+     *
+     * @param msg The deferred message
+     * @param f Set to the fragment taken
+     * @return The message to prepare the fragment in, or an empty pointer if
+     * there are no outgoing buffers
+     */
+    message_ptr claim_fragment(message_ptr msg, claimed_fragment & f);
+
+    /// Prepare a fragment taken by claim_fragment
+    /**
+     * Masks and compresses the fragment. Does not need m_write_lock.
+     *
+     * @param f The fragment
+     * @return Status code, zero on success, non-zero on error
+     */
+    lib::error_code prepare_fragment(claimed_fragment const & f);
+
+    /// Pack a deferred message and the ones queued behind it into a batch
+    /**
+     * Takes the unprepared messages at the front of the send queue that can
+     * share a batch frame with msg. Falls back to write_fragment if there are
+     * none.
+     *
+     * Must be called while holding m_write_lock
+     *
+     * @param msg The deferred message that starts the batch
+     * @param ec Set to the error that occurred, if any
+     * @return The prepared batch frame
+     */
+    message_ptr write_batch(message_ptr msg, lib::error_code & ec);
+
+    /// Close the connection, abortively if `fast` or fast close is enabled
+    /**
+     * Shared by close and fast_close. m_fast_close is only set once the state
+     * check passed, while holding m_connection_state_lock.
+     */
+    void close_connection(close::status::value const code,
+        std::string const & reason, bool fast, lib::error_code & ec);
+
+    /// Drop all messages that have not been handed to the transport yet
+    /**
+     * Used by fast close. Locks m_write_lock. The dropped data messages are
+     * appended to `dropped` so the caller can report them with write_expired
+     * once it holds no locks.
+     *
+     * @param dropped A vector to append the dropped data messages to
+     */
+    void discard_send_queue(std::vector<message_ptr> & dropped);
+
+    /// Selects abort_transport by whether the transport has async_abort
+    template <bool has_abort>
+    struct abort_support {};
+
+    /// Close the transport of a fast closed connection
+    /**
+     * Uses the transport's async_abort, or async_shutdown for transports
+     * without it.
+     *
+     * @param handler The handler to call when the transport is closed
+     */
+    void abort_transport(transport::shutdown_handler handler);
+    void abort_transport(transport::shutdown_handler handler,
+        abort_support<true>);
+    void abort_transport(transport::shutdown_handler handler,
+        abort_support<false>);
+
+    /// Charge a message to the tenant's queued bytes quota
+    /**
+     * The charge is counted as already reported to the tenant, so the next
+     * sync_send_queue only corrects it to what was actually queued. Must be
+     * called while holding m_write_lock
+     *
+     * @param bytes The payload size of the message
+     * @return Whether the message fits, always true without a tenant
+     */
+    bool reserve_queued(size_t bytes);
+
+    /// Report send queue changes to the tenant and the endpoint counters
+    /**
+     * Must be called while holding m_write_lock
+     */
+    void sync_send_queue();
+
+    /// Give back the tenant resources held by this connection
+    /**
+     * Safe to call more than once. Locks m_write_lock
+     */
+    void release_tenant();
+
+    /// Pick the permessage-deflate settings before negotiating
+    void apply_deflate_policy();
+
+    /// Charge the negotiated deflate memory to the endpoint tracker
+    void charge_deflate();
+
+    /// Give back the deflate memory charged to the endpoint tracker
+    void release_deflate();
+
+    /// Resume reading after a wait imposed by the tenant inbound rate
+    void handle_read_delay(lib::error_code const & ec);
+
+    /// Resume writing after a wait imposed by the tenant outbound rate
+    void handle_write_delay(lib::error_code const & ec);
+
+    /// Whether a data message should be prepared as it is written
+    /**
+     * True for messages larger than the maximum outbound frame size, for small
+     * messages that may be batched when message batching was negotiated, for
+     * messages with a deadline and for any data message sent while such a
+     * message is still queued. Never true for hybi00, whose messages with a
+     * deadline are prepared when sent and dropped in their prepared form.
+     *
+     * Must be called while holding m_write_lock
+     *
+     * @param msg The unprepared message being sent
+     * @return Whether to defer preparing msg
+     */
+    bool defer_message(message_ptr msg) const;
+
     /// Prints information about the incoming connection to the access log
     /**
      * Prints information about the incoming connection to the access log.
@@ -1484,6 +2105,9 @@ private:
     /// Prints information about an arbitrary error code on the specified channel
     template <typename error_type>
     void log_err(log::level l, char const * msg, error_type const & ec) {
+        if (!log::test(*m_elog, l, msg, ec.value(), ec.category().name())) {
+            return;
+        }
         std::stringstream s;
         s << msg << " error: " << ec << " (" << ec.message() << ")";
         m_elog->write(l, s.str());
@@ -1509,13 +2133,16 @@ private:
     interrupt_handler       m_interrupt_handler;
     http_handler            m_http_handler;
     validate_handler        m_validate_handler;
+    deflate_policy_handler  m_deflate_policy_handler;
     message_handler         m_message_handler;
+    message_expired_handler m_message_expired_handler;
 
     /// constant values
     long                    m_open_handshake_timeout_dur;
     long                    m_close_handshake_timeout_dur;
     long                    m_pong_timeout_dur;
     size_t                  m_max_message_size;
+    size_t                  m_max_outbound_frame_size;
 
     /// External connection state
     /**
@@ -1536,7 +2163,7 @@ private:
      * Serializes access to the write queue as well as shared state within the
      * processor.
      */
-    mutex_type              m_write_lock;
+    mutable mutex_type      m_write_lock;
 
     // connection resources
     char                    m_buf[config::connection_read_buffer_size];
@@ -1565,7 +2192,7 @@ private:
     /**
      * Lock: m_write_lock
      */
-    std::queue<message_ptr> m_send_queue;
+    std::deque<message_ptr> m_send_queue;
 
     /// Size in bytes of the outstanding payloads in the write queue
     /**
@@ -1573,6 +2200,12 @@ private:
      */
     size_t m_send_buffer_size;
 
+    /// Number of outgoing messages dropped because their deadline passed
+    /**
+     * Lock: m_write_lock
+     */
+    size_t m_expired_message_count;
+
     /// buffer holding the various parts of the current message being writen
     /**
      * Lock m_write_lock
@@ -1589,8 +2222,73 @@ private:
      */
     bool m_write_flag;
 
+    /// Bytes of write quantum left unused by the previous write
+    /**
+     * Lock m_write_lock
+     */
+    size_t m_write_deficit;
+
+    /// Data message currently being split into fragments
+    /**
+     * Lock m_write_lock
+     */
+    message_ptr m_fragment_source;
+
+    /// Payload bytes of m_fragment_source already written
+    /**
+     * Lock m_write_lock
+     */
+    size_t m_fragment_offset;
+
+    /// Number of data messages that will be prepared as they are written
+    /**
+     * Includes m_fragment_source. While any are outstanding, new data messages
+     * are deferred as well so that compression runs in wire order.
+     *
+     * Lock m_write_lock
+     */
+    size_t m_deferred_messages;
+
+    /// True while a fragment taken by claim_fragment is being prepared
+    /**
+     * The fragment is prepared without m_write_lock. New data messages are
+     * deferred in the meantime, as if a deferred message were queued, so
+     * that nothing else uses the compression context.
+     *
+     * Lock m_write_lock
+     */
+    bool m_preparing_fragment;
+
+    /// The broadcast stream the remote decompressor is in step with, if any
+    /**
+     * Lock m_write_lock
+     */
+    lib::shared_ptr<void const> m_broadcast_stream;
+
+    /// Sequence number of the next message of m_broadcast_stream
+    /**
+     * Lock m_write_lock
+     */
+    uint64_t m_broadcast_next;
+
+    /// True if the first frame of a fragmented message has been handed to the
+    /// transport and its final frame has not
+    /**
+     * Lock m_write_lock
+     */
+    bool m_fragment_in_progress;
+
+    /// True if the first frame of a fragmented message was dropped and the
+    /// remaining frames of that message must be dropped as well
+    /**
+     * Lock m_write_lock
+     */
+    bool m_drop_fragments;
+
     /// True if this connection is presently reading new data
     bool m_read_flag;
+    /// True while a frame read is outstanding or m_buf is still being processed
+    bool m_read_busy;
 
     // connection data
     request_type            m_request;
@@ -1633,6 +2331,87 @@ private:
     session::http_state::value m_http_state;
 
     bool m_was_clean;
+
+    /// Whether close and terminate skip the graceful shutdown steps
+    /**
+     * Set by set_fast_close before start() or by close_connection while
+     * holding m_connection_state_lock. Once the connection has started it
+     * only ever changes from false to true.
+     */
+    bool m_fast_close;
+
+    /// Resource usage counters
+    /**
+     * Only updated if config::enable_resource_accounting is true
+     *
+     * Lock: m_stats_lock
+     */
+    metrics::connection_stats m_stats;
+
+    /// Cycles not yet reported to the heavy hitter list
+    /**
+     * Lock: m_stats_lock
+     */
+    uint64_t m_unreported_cycles;
+
+    /// Endpoint wide list of expensive connections, may be null
+    heavy_hitters_ptr m_heavy_hitters;
+
+    /// Endpoint wide traffic totals, may be null
+    metrics::endpoint_counters * m_counters;
+    /// Endpoint wide timer state, may be null
+    idle::table * m_idle_table;
+    /// This connection's slot in m_idle_table
+    /**
+     * Only read and written by the thread running the endpoint
+     */
+    uint32_t m_idle_slot;
+    /// Queued bytes last added to m_counters
+    /**
+     * Lock: m_write_lock
+     */
+    size_t m_counted_queued;
+    /// Whether the queue stopped counting towards m_counters at termination
+    /**
+     * Lock: m_write_lock
+     */
+    bool m_queue_released;
+
+    mutable mutex_type m_stats_lock;
+
+    /// Endpoint wide deflate memory tracker, may be null
+    deflate_tracker_ptr m_deflate_tracker;
+    /// Deflate memory charged to m_deflate_tracker
+    /**
+     * Lock: m_write_lock
+     */
+    size_t m_deflate_charged;
+
+    /// Endpoint wide set of tenants, may be null
+    tenant_registry_ptr m_tenants;
+    /// Account of the tenant of this connection, null if none
+    tenant_account_ptr m_tenant;
+    std::string m_tenant_name;
+    /// Multiplier of the read and write quanta
+    size_t m_tenant_weight;
+    /// Deflate memory charged to the tenant
+    size_t m_tenant_deflate;
+    /// Queued bytes last reported or charged to the tenant
+    /**
+     * Lock: m_write_lock
+     */
+    size_t m_tenant_queued;
+    /// Whether the connection holds a slot of its tenant
+    /**
+     * Lock: m_write_lock
+     */
+    bool m_tenant_admitted;
+    /// Whether set_tenant was refused during the handshake
+    bool m_tenant_rejected;
+    /// Whether the next read waits for m_read_delay_timer
+    bool m_read_delayed;
+    timer_ptr m_read_delay_timer;
+    timer_ptr m_write_delay_timer;
 };
 
 } // namespace websocketpp
@@ -66,6 +66,9 @@ public:
 
     /// Type of message_handler
     typedef typename connection_type::message_handler message_handler;
+    /// Type of message_expired_handler
+    typedef typename connection_type::message_expired_handler
+        message_expired_handler;
     /// Type of message pointers that this endpoint uses
     typedef typename connection_type::message_ptr message_ptr;
 
@@ -82,6 +85,17 @@ public:
     /// Type of RNG
     typedef typename config::rng_type rng_type;
 
+    /// Type of the list of expensive connections
+    typedef typename connection_type::heavy_hitters_type heavy_hitters_type;
+    /// Type of an entry in the list of expensive connections
+    typedef typename heavy_hitters_type::entry heavy_connection;
+
+    /// Type of the set of tenants
+    typedef typename connection_type::tenant_registry_type tenant_registry_type;
+
+    /// Type of the deflate memory tracker
+    typedef typename connection_type::deflate_tracker_type deflate_tracker_type;
+
     // TODO: organize these
     typedef typename connection_type::termination_handler termination_handler;
 
@@ -96,9 +110,20 @@ public:
       , m_close_handshake_timeout_dur(config::timeout_close_handshake)
       , m_pong_timeout_dur(config::timeout_pong)
       , m_max_message_size(config::max_message_size)
+      , m_max_outbound_frame_size(config::max_outbound_frame_size)
       , m_max_http_body_size(config::max_http_body_size)
+      , m_fast_close(false)
       , m_is_server(p_is_server)
+      , m_tenants(lib::make_shared<tenant_registry_type>())
+      , m_deflate_tracker(lib::make_shared<deflate_tracker_type>())
+      , m_counters(NULL)
+      , m_idle_table(NULL)
     {
+        if (config::enable_resource_accounting) {
+            m_heavy_hitters.reset(
+                new heavy_hitters_type(config::heavy_hitter_capacity));
+        }
+
         m_alog->set_channels(config::alog_level);
         m_elog->set_channels(config::elog_level);
 
@@ -138,15 +163,24 @@ public:
          , m_http_handler(std::move(o.m_http_handler))
          , m_validate_handler(std::move(o.m_validate_handler))
          , m_message_handler(std::move(o.m_message_handler))
+         , m_message_expired_handler(std::move(o.m_message_expired_handler))
+         , m_deflate_policy_handler(std::move(o.m_deflate_policy_handler))
 
          , m_open_handshake_timeout_dur(o.m_open_handshake_timeout_dur)
          , m_close_handshake_timeout_dur(o.m_close_handshake_timeout_dur)
          , m_pong_timeout_dur(o.m_pong_timeout_dur)
          , m_max_message_size(o.m_max_message_size)
+         , m_max_outbound_frame_size(o.m_max_outbound_frame_size)
          , m_max_http_body_size(o.m_max_http_body_size)
+         , m_fast_close(o.m_fast_close)
 
          , m_rng(std::move(o.m_rng))
          , m_is_server(o.m_is_server)         
+         , m_heavy_hitters(std::move(o.m_heavy_hitters))
+         , m_tenants(std::move(o.m_tenants))
+         , m_deflate_tracker(std::move(o.m_deflate_tracker))
+         , m_counters(o.m_counters)
+         , m_idle_table(o.m_idle_table)
         {}
 
     #ifdef _WEBSOCKETPP_DEFAULT_DELETE_FUNCTIONS_
@@ -203,7 +237,7 @@ public:
      * @return Whether or not this endpoint is a server
      */
     bool is_server() const {
-        return m_is_server;
+        return role::is_server(config::endpoint_role, m_is_server);
     }
 
     /********************************/
@@ -324,6 +358,16 @@ public:
         scoped_lock_type guard(m_mutex);
         m_message_handler = h;
     }
+    void set_message_expired_handler(message_expired_handler h) {
+        m_alog->write(log::alevel::devel,"set_message_expired_handler");
+        scoped_lock_type guard(m_mutex);
+        m_message_expired_handler = h;
+    }
+    void set_deflate_policy_handler(deflate_policy_handler h) {
+        m_alog->write(log::alevel::devel,"set_deflate_policy_handler");
+        scoped_lock_type guard(m_mutex);
+        m_deflate_policy_handler = h;
+    }
 
     //////////////////////////////////////////
     // Connection timeouts and other limits //
@@ -433,6 +477,188 @@ public:
         m_max_message_size = new_value;
     }
 
+    /// Get default maximum outbound frame size
+    /**
+     * Get the default maximum outbound frame size that will be used for new
+     * connections created by this endpoint. Data messages with larger payloads
+     * are split into continuation frames as they are written.
+     *
+     * The default is set by the max_outbound_frame_size value from the
+     * template config
+     *
+     * @since 0.8.2
+     */
+    size_t get_max_outbound_frame_size() const {
+        return m_max_outbound_frame_size;
+    }
+
+    /// Set default maximum outbound frame size
+    /**
+     * Set the default maximum outbound frame size that will be used for new
+     * connections created by this endpoint. Data messages with larger payloads
+     * are split into continuation frames of at most this many payload bytes as
+     * they are written, letting control frames go out in between. Zero means
+     * messages are never split.
+     *
+     * The default is set by the max_outbound_frame_size value from the
+     * template config
+     *
+     * @since 0.8.2
+     *
+     * @param new_value The value to set as the maximum outbound frame size.
+     */
+    void set_max_outbound_frame_size(size_t new_value) {
+        m_max_outbound_frame_size = new_value;
+    }
+
+    /// Attach traffic totals to the endpoint
+    /**
+     * Connections created after this call add their opens, closes, failures,
+     * bytes and data messages to `counters`. The counters are updated with
+     * relaxed atomic adds, so the endpoint may run on several threads; read
+     * them with endpoint_counters::snapshot while it runs.
+     * prefork::supervisor uses this to collect the totals of its worker
+     * processes in shared memory.
+     *
+     * @since 0.8.2
+     *
+     * @param counters The counters to update, or NULL to stop counting. Must
+     * outlive the connections that use it.
+     */
+    void set_counters(metrics::endpoint_counters * counters) {
+        m_counters = counters;
+    }
+
+    /// Time the connections with an idle table
+    /**
+     * Connections created after this call record their activity in `table`
+     * and time their handshakes there rather than with a timer each. It is
+     * usually attached by idle::sweeper, which also sweeps it. The table is
+     * locked, so the endpoint may be run by several threads. Actions found by
+     * a sweep are dispatched to the connection's strand.
+     *
+     * @since 0.8.2
+     *
+     * @param table The table to use, or NULL to use a timer per connection.
+     * Must outlive the connections that use it.
+     */
+    void set_idle_table(idle::table * table) {
+        m_idle_table = table;
+    }
+
+    /// Get the connections that have consumed the most CPU
+    /**
+     * Returns an approximate list of this endpoint's most expensive open
+     * connections, most expensive first. Cost is the number of cycles spent
+     * parsing, in the message handler and preparing outgoing messages on
+     * behalf of a connection. Each entry's count may overestimate the true
+     * cost by at most its error.
+     *
+     * Returns an empty list unless the `enable_resource_accounting` config
+     * value is true.
+     *
+     * @since 0.8.2
+     *
+     * @param n The maximum number of connections to return
+     * @return Up to n entries, most expensive first
+     */
+    std::vector<heavy_connection> get_heavy_connections(size_t n) const {
+        if (!m_heavy_hitters) {
+            return std::vector<heavy_connection>();
+        }
+        return m_heavy_hitters->top(n);
+    }
+
+    /// Set the limits of a tenant
+    /**
+     * Connections are assigned to tenants with connection::set_tenant. New
+     * limits apply to the tenant's existing connections, except that
+     * connections already admitted are never dropped and a connection keeps
+     * the weight it was admitted with.
+     *
+     * @since 0.8.2
+     *
+     * @param name The name of the tenant
+     * @param q The limits of the tenant
+     */
+    void set_tenant_quota(std::string const & name, tenant::quota const & q) {
+        m_tenants->set_quota(name, q);
+    }
+
+    /// Set the limits shared by tenants without a quota of their own
+    /**
+     * Connections assigned to a tenant that set_tenant_quota was not called
+     * for share one set of limits and counters. The default is unlimited.
+     *
+     * @since 0.8.2
+     *
+     * @param q The limits shared by unconfigured tenants
+     */
+    void set_default_tenant_quota(tenant::quota const & q) {
+        m_tenants->set_default_quota(q);
+    }
+
+    /// Get the limits of a tenant
+    /**
+     * @since 0.8.2
+     *
+     * @param name The name of the tenant
+     * @return The limits of the tenant, the default limits if it was not
+     * configured
+     */
+    tenant::quota get_tenant_quota(std::string const & name) const {
+        return m_tenants->get_quota(name);
+    }
+
+    /// Get the usage counters of a tenant
+    /**
+     * @since 0.8.2
+     *
+     * @param name The name of the tenant
+     * @return A snapshot of the tenant's counters, those shared by all
+     * unconfigured tenants if it was not configured
+     */
+    tenant::stats get_tenant_stats(std::string const & name) const {
+        return m_tenants->get_stats(name);
+    }
+
+    /// Get the names of all tenants that have a quota or had a connection
+    /**
+     * @since 0.8.2
+     */
+    std::vector<std::string> get_tenants() const {
+        return m_tenants->get_names();
+    }
+
+    /// Set the memory budget of permessage-deflate
+    /**
+     * New server connections pick their permessage-deflate window sizes and
+     * memory level so that the estimated memory of all compressed
+     * connections stays within the budget, or decline compression. Existing
+     * connections are not affected. The default of 0 means unlimited.
+     *
+     * @see extensions::permessage_deflate::fit_budget
+     * @see set_deflate_policy_handler
+     *
+     * @since 0.8.2
+     *
+     * @param budget The budget in bytes, 0 for unlimited
+     */
+    void set_deflate_memory_budget(size_t budget) {
+        m_deflate_tracker->set_budget(budget);
+    }
+
+    /// Get the permessage-deflate memory use of the endpoint
+    /**
+     * @since 0.8.2
+     *
+     * @return A snapshot of the estimated memory, compressed connections and
+     * budget
+     */
+    extensions::permessage_deflate::usage get_deflate_usage() const {
+        return m_deflate_tracker->get_usage();
+    }
+
     /// Get maximum HTTP message body size
     /**
      * Get maximum HTTP message body size. Maximum message body size determines
@@ -467,6 +693,34 @@ public:
         m_max_http_body_size = new_value;
     }
 
+    /// Get whether new connections close abortively
+    /**
+     * @since 0.8.2
+     *
+     * @return Whether fast close is enabled for new connections
+     */
+    bool get_fast_close() const {
+        return m_fast_close;
+    }
+
+    /// Set whether new connections close abortively
+    /**
+     * Sets the fast close default for connections created by this endpoint
+     * from now on. Intended for shedding load: every close skips the close
+     * handshake wait and every connection end tears the socket down without a
+     * graceful shutdown. See connection::set_fast_close for details.
+     *
+     * Existing connections are not affected, use fast_close on them to shed
+     * them.
+     *
+     * @since 0.8.2
+     *
+     * @param value Whether or not to enable fast close
+     */
+    void set_fast_close(bool value) {
+        m_fast_close = value;
+    }
+
     /*************************************/
     /* Connection pass through functions */
     /*************************************/
@@ -579,11 +833,51 @@ public:
     void send(connection_hdl hdl, message_ptr msg, lib::error_code & ec);
     void send(connection_hdl hdl, message_ptr msg);
 
+    /// Send a broadcast message (exception free)
+    /**
+     * @see connection::send_broadcast
+     *
+     * @since 0.8.2
+     *
+     * @param [in] hdl The handle identifying the connection to send via.
+     * @param [in] msg A message prepared by a broadcast::deflate_stream
+     * @param [out] ec A code to fill in for errors
+     */
+    void send_broadcast(connection_hdl hdl, broadcast::message_ptr msg,
+        lib::error_code & ec);
+
+    /// Send a broadcast message
+    /**
+     * @see connection::send_broadcast
+     *
+     * @since 0.8.2
+     *
+     * @param [in] hdl The handle identifying the connection to send via.
+     * @param [in] msg A message prepared by a broadcast::deflate_stream
+     */
+    void send_broadcast(connection_hdl hdl, broadcast::message_ptr msg);
+
     void close(connection_hdl hdl, close::status::value const code,
         std::string const & reason, lib::error_code & ec);
     void close(connection_hdl hdl, close::status::value const code,
         std::string const & reason);
 
+    /// Close a connection without waiting for the close handshake
+    /**
+     * @since 0.8.2
+     *
+     * @see connection::fast_close
+     *
+     * @param [in] hdl The handle identifying the connection to close.
+     * @param [in] code The close code to send
+     * @param [in] reason The close reason to send
+     * @param [out] ec A code to fill in for errors
+     */
+    void fast_close(connection_hdl hdl, close::status::value const code,
+        std::string const & reason, lib::error_code & ec);
+    void fast_close(connection_hdl hdl, close::status::value const code,
+        std::string const & reason);
+
     /// Send a ping to a specific connection
     /**
      * @since 0.3.0-alpha3
@@ -677,18 +971,37 @@ private:
     http_handler                m_http_handler;
     validate_handler            m_validate_handler;
     message_handler             m_message_handler;
+    message_expired_handler     m_message_expired_handler;
+    deflate_policy_handler      m_deflate_policy_handler;
 
     long                        m_open_handshake_timeout_dur;
     long                        m_close_handshake_timeout_dur;
     long                        m_pong_timeout_dur;
     size_t                      m_max_message_size;
+    size_t                      m_max_outbound_frame_size;
     size_t                      m_max_http_body_size;
+    bool                        m_fast_close;
 
     rng_type m_rng;
 
     // static settings
     bool const                  m_is_server;
 
+    /// List of the most expensive connections, null unless accounting is on
+    lib::shared_ptr<heavy_hitters_type> m_heavy_hitters;
+
+    /// Tenants that connections may be assigned to
+    lib::shared_ptr<tenant_registry_type> m_tenants;
+
+    /// Deflate memory of the connections and its budget
+    lib::shared_ptr<deflate_tracker_type> m_deflate_tracker;
+
+    /// Traffic totals of the connections, may be null
+    metrics::endpoint_counters * m_counters;
+
+    /// Timer state of the connections, may be null
+    idle::table * m_idle_table;
+
     // endpoint state
     mutable mutex_type          m_mutex;
 };
@@ -143,7 +143,13 @@ enum value {
     http_parse_error,
     
     /// Extension negotiation failed
-    extension_neg_failed
+    extension_neg_failed,
+
+    /// A tenant quota does not allow the connection or message
+    tenant_quota_exceeded,
+
+    /// Nothing was read in time after a keepalive ping
+    keepalive_timeout
 }; // enum value
 
 
@@ -221,6 +227,10 @@ public:
                 return "HTTP parse error";
             case error::extension_neg_failed:
                 return "Extension negotiation failed";
+            case error::tenant_quota_exceeded:
+                return "Tenant quota exceeded";
+            case error::keepalive_timeout:
+                return "The keepalive ping was not answered";
             default:
                 return "Unknown";
         }
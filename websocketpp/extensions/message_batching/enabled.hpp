@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_MESSAGE_BATCHING_ENABLED_HPP
+#define WEBSOCKETPP_EXTENSION_MESSAGE_BATCHING_ENABLED_HPP
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <websocketpp/http/constants.hpp>
+#include <websocketpp/extensions/extension.hpp>
+
+#include <string>
+#include <utility>
+
+namespace websocketpp {
+namespace extensions {
+
+/// Packs several small data messages into one frame
+/**
+ * A private extension for use between WebSocket++ endpoints, negotiated with
+ * the `x-websocketpp-batch` token and no parameters. Peers that do not offer
+ * or accept it keep using plain frames.
+ *
+ * A batch is a single data frame with the RSV2 bit set. Its payload is a
+ * sequence of records, each a LEB128 encoded length followed by that many
+ * bytes of message payload. Every record is delivered to the application as
+ * a separate message with the opcode of the frame. Batch frames may be
+ * compressed by permessage-deflate like any other message.
+ *
+ * ### message batching interface
+ *
+ * **max_message_size**, **max_batch_size**\n
+ * Limits on the messages packed into a batch and on the batch payload
+ *
+ * **negotiate**\n
+ * `err_str_pair negotiate(http::attribute_list const & attributes)`\n
+ * Negotiate the use of the extension
+ *
+ * **pack**\n
+ * `lib::error_code pack(uint8_t const * buf, size_t len, std::string & out)`\n
+ * Append a record to a batch payload
+ *
+ * **unpack**\n
+ * `lib::error_code unpack(std::string const & in, size_t & offset, size_t &
+ * len)`\n
+ * Read the next record of a batch payload
+ */
+namespace message_batching {
+
+/// Message batching error values
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// Invalid extension attributes
+    invalid_attributes,
+
+    /// A record length runs past the end of the batch
+    malformed_batch
+};
+
+/// Message batching error category
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.extension.message-batching";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic message batching error";
+            case invalid_attributes:
+                return "Invalid extension attributes";
+            case malformed_batch:
+                return "Malformed message batch";
+            default:
+                return "Unknown message batching error";
+        }
+    }
+};
+
+/// Get a reference to a static copy of the message batching error category
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+/// Create an error code in the message batching category
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+} // namespace message_batching
+} // namespace extensions
+} // namespace websocketpp
+
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_START_
+template<> struct is_error_code_enum
+    <websocketpp::extensions::message_batching::error::value>
+{
+    static bool const value = true;
+};
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_END_
+namespace websocketpp {
+namespace extensions {
+namespace message_batching {
+
+/// Message batching extension class
+/**
+ * @tparam config A configuration type with the `max_message_size` and
+ * `max_batch_size` static members
+ */
+template <typename config>
+class enabled {
+public:
+    typedef std::pair<lib::error_code,std::string> err_str_pair;
+
+    /// Largest payload that is packed into a batch
+    static size_t const max_message_size = config::max_message_size;
+
+    /// Largest batch payload
+    static size_t const max_batch_size = config::max_batch_size;
+
+    enabled() : m_enabled(false) {}
+
+    /// Negotiate extension
+    /**
+     * The extension has no parameters, offers with any are declined.
+     *
+     * @param offer Attributes from the remote endpoint's offer or response
+     * @return Status code and value to return to remote endpoint
+     */
+    err_str_pair negotiate(http::attribute_list const & offer) {
+        err_str_pair ret;
+
+        if (!offer.empty()) {
+            ret.first = make_error_code(error::invalid_attributes);
+            return ret;
+        }
+
+        ret.second = get_name();
+        return ret;
+    }
+
+    /// Initialize state
+    /**
+     * Called after a successful negotiation.
+     *
+     * @param is_server True to initialize as a server, false for a client.
+     * @return A code representing the error that occurred, if any
+     */
+    lib::error_code init(bool) {
+        m_enabled = true;
+        return lib::error_code();
+    }
+
+    /// Returns true if the extension is capable of providing message batching
+    bool is_implemented() const {
+        return true;
+    }
+
+    /// Returns true if message batching is active for this connection
+    bool is_enabled() const {
+        return m_enabled;
+    }
+
+    /// Returns the extension token used in the Sec-WebSocket-Extensions header
+    char const * get_name() const {
+        return "x-websocketpp-batch";
+    }
+
+    /// Generate extension offer
+    /**
+     * @return A WebSocket extension offer string for this extension
+     */
+    std::string generate_offer() const {
+        return get_name();
+    }
+
+    /// Append a message to a batch
+    /**
+     * @param [in] buf The message payload
+     * @param [in] len Length of buf
+     * @param [out] out String to append the record to
+     * @return Error or status code
+     */
+    lib::error_code pack(uint8_t const * buf, size_t len, std::string & out)
+        const
+    {
+        uint64_t v = len;
+        while (v >= 0x80) {
+            out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<char>(v));
+
+        out.append(reinterpret_cast<char const *>(buf),len);
+        return lib::error_code();
+    }
+
+    /// Find the next message in a batch
+    /**
+     * @param [in] in The batch payload
+     * @param [in,out] offset The offset of the next record, advanced past it
+     * @param [out] len The length of the message payload, which starts at the
+     * new offset minus len
+     * @return Error or status code
+     */
+    lib::error_code unpack(std::string const & in, size_t & offset,
+        size_t & len) const
+    {
+        uint64_t v = 0;
+        unsigned int shift = 0;
+        size_t p = offset;
+
+        for (;;) {
+            if (p >= in.size() || shift > 63) {
+                return make_error_code(error::malformed_batch);
+            }
+
+            uint8_t byte = static_cast<uint8_t>(in[p++]);
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+
+        if (v > in.size() - p) {
+            return make_error_code(error::malformed_batch);
+        }
+
+        len = static_cast<size_t>(v);
+        offset = p + len;
+        return lib::error_code();
+    }
+private:
+    bool m_enabled;
+};
+
+} // namespace message_batching
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_MESSAGE_BATCHING_ENABLED_HPP
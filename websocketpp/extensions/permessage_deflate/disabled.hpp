@@ -34,6 +34,7 @@
 
 #include <websocketpp/http/constants.hpp>
 #include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_deflate/policy.hpp>
 
 #include <map>
 #include <string>
@@ -63,7 +64,8 @@ public:
      * @return Status code and value to return to remote endpoint
      */
     err_str_pair negotiate(http::attribute_list const &) {
-        return make_pair(make_error_code(error::disabled),std::string());
+        return make_pair(make_error_code(extensions::error::disabled),
+            std::string());
     }
 
     /// Initialize state
@@ -100,6 +102,44 @@ public:
         return "";
     }
 
+    /// Test whether bytes from a shared compressor may be sent
+    /**
+     * @since 0.8.2
+     *
+     * @return Always false for the disabled extension
+     */
+    bool accepts_shared_deflate(uint8_t, bool) const {
+        return false;
+    }
+
+    /// Reset the outgoing compression history
+    /**
+     * For the disabled extension this is a no-op.
+     *
+     * @since 0.8.2
+     */
+    void reset_deflate() {}
+
+    /// Estimate the memory used by the compression state
+    /**
+     * @since 0.8.2
+     *
+     * @return Always 0 for the disabled extension
+     */
+    size_t estimate_memory() const {
+        return 0;
+    }
+
+    /// Apply the settings picked by a negotiation policy
+    /**
+     * @since 0.8.2
+     *
+     * @return Always extensions::error::disabled
+     */
+    lib::error_code apply_settings(settings const &) {
+        return make_error_code(extensions::error::disabled);
+    }
+
     /// Compress bytes
     /**
      * @param [in] in String to compress
@@ -107,7 +147,18 @@ public:
      * @return Error or status code
      */
     lib::error_code compress(std::string const &, std::string &) {
-        return make_error_code(error::disabled);
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Compress bytes
+    /**
+     * @param [in] buf Byte buffer to compress
+     * @param [in] len Length of buf
+     * @param [out] out String to append compressed bytes to
+     * @return Error or status code
+     */
+    lib::error_code compress(uint8_t const *, size_t, std::string &) {
+        return make_error_code(extensions::error::disabled);
     }
 
     /// Decompress bytes
@@ -118,7 +169,22 @@ public:
      * @return Error or status code
      */
     lib::error_code decompress(uint8_t const *, size_t, std::string &) {
-        return make_error_code(error::disabled);
+        return make_error_code(extensions::error::disabled);
+    }
+
+    /// Decompress bytes up to a limit
+    /**
+     * @since 0.8.2
+     *
+     * @param buf Byte buffer to decompress
+     * @param len Length of buf
+     * @param out String to append decompressed bytes to
+     * @param limit Size of out at which to stop decompressing
+     * @return Error or status code
+     */
+    lib::error_code decompress(uint8_t const *, size_t, std::string &, size_t)
+    {
+        return make_error_code(extensions::error::disabled);
     }
 };
 
@@ -37,6 +37,8 @@
 #include <websocketpp/error.hpp>
 
 #include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_deflate/policy.hpp>
+#include <websocketpp/http/constants.hpp>
 
 #include "zlib.h"
 
@@ -76,6 +78,14 @@ namespace extensions {
  * `err_str_pair negotiate(http::attribute_list const & attributes)`\n
  * Negotiate the parameters of extension use
  *
+ * **apply_settings**\n
+ * `lib::error_code apply_settings(settings const & s)`\n
+ * Apply the parameters picked by a negotiation policy before negotiating
+ *
+ * **estimate_memory**\n
+ * `size_t estimate_memory() const`\n
+ * Estimate the memory used by the compression state
+ *
  * **compress**\n
  * `lib::error_code compress(std::string const & in, std::string & out)`\n
  * Compress the bytes in `in` and append them to `out`
@@ -84,6 +94,10 @@ namespace extensions {
  * `lib::error_code decompress(uint8_t const * buf, size_t len, std::string &
  * out)`\n
  * Decompress `len` bytes from `buf` and append them to string `out`
+ *
+ * `lib::error_code decompress(uint8_t const * buf, size_t len, std::string &
+ * out, size_t limit)`\n
+ * As above, but stop once `out` is longer than `limit` bytes
  */
 namespace permessage_deflate {
 
@@ -113,6 +127,12 @@ enum value {
 
     /// Uninitialized
     uninitialized,
+
+    /// Compression declined by the negotiation policy
+    declined,
+
+    /// Invalid zlib memory level
+    invalid_memory_level
 };
 
 /// Permessage-deflate error category
@@ -142,6 +162,10 @@ public:
                 return "A zlib function returned an error";
             case uninitialized:
                 return "Deflate extension must be initialized before use";
+            case declined:
+                return "Compression declined by the negotiation policy";
+            case invalid_memory_level:
+                return "Invalid value for memory level";
             default:
                 return "Unknown permessage-compress error";
         }
@@ -225,7 +249,12 @@ public:
       , m_client_max_window_bits(15)
       , m_server_max_window_bits_mode(mode::accept)
       , m_client_max_window_bits_mode(mode::accept)
+      , m_client_max_window_bits_offered(false)
+      , m_declined(false)
+      , m_memory_level(4)
       , m_initialized(false)
+      , m_deflate_bits(15)
+      , m_inflate_bits(15)
       , m_compress_buffer_size(8192)
     {
         m_dstate.zalloc = Z_NULL;
@@ -265,7 +294,7 @@ public:
      * information from the negotiation to determine how to initialize the zlib
      * data structures.
      *
-     * @todo memory level, strategy, etc are hardcoded
+     * @todo strategy, etc are hardcoded
      *
      * @param is_server True to initialize as a server, false for a client.
      * @return A code representing the error that occurred, if any
@@ -276,18 +305,24 @@ public:
 
         if (is_server) {
             deflate_bits = m_server_max_window_bits;
-            inflate_bits = m_client_max_window_bits;
+            // A client that did not offer client_max_window_bits may use
+            // the full window whatever our preference is
+            inflate_bits = m_client_max_window_bits_offered ?
+                m_client_max_window_bits : default_client_max_window_bits;
         } else {
             deflate_bits = m_client_max_window_bits;
             inflate_bits = m_server_max_window_bits;
         }
 
+        m_deflate_bits = deflate_bits;
+        m_inflate_bits = inflate_bits;
+
         int ret = deflateInit2(
             &m_dstate,
             Z_DEFAULT_COMPRESSION,
             Z_DEFLATED,
             -1*deflate_bits,
-            4, // memory level 1-9
+            m_memory_level,
             Z_DEFAULT_STRATEGY
         );
 
@@ -338,6 +373,89 @@ public:
         return m_enabled;
     }
 
+    /// Test whether bytes from a shared compressor may be sent
+    /**
+     * The remote endpoint can decompress a message compressed by another
+     * compressor if the window used is no larger than the negotiated one. With
+     * no context takeover the message must also not refer to earlier ones.
+     *
+     * @since 0.8.2
+     *
+     * @param window_bits LZ77 window size of the shared compressor
+     * @param reset Whether the message was compressed without history
+     * @return Whether the shared bytes may be sent
+     */
+    bool accepts_shared_deflate(uint8_t window_bits, bool reset) const {
+        return m_initialized && window_bits <= m_deflate_bits &&
+            (reset || m_flush != Z_FULL_FLUSH);
+    }
+
+    /// Reset the outgoing compression history
+    /**
+     * Called after bytes from another compressor were sent. The remote
+     * decompressor's history no longer matches the local compressor, so the
+     * next message must not refer to earlier ones.
+     *
+     * @since 0.8.2
+     */
+    void reset_deflate() {
+        if (m_initialized) {
+            deflateReset(&m_dstate);
+        }
+    }
+
+    /// Estimate the memory used by the zlib contexts
+    /**
+     * @since 0.8.2
+     *
+     * @return The estimated memory in bytes, 0 before initialization
+     */
+    size_t estimate_memory() const {
+        if (!m_initialized) {
+            return 0;
+        }
+        return permessage_deflate::estimate_memory(m_deflate_bits,
+            m_inflate_bits, m_memory_level);
+    }
+
+    /// Apply the settings picked by a negotiation policy
+    /**
+     * Window sizes are applied in largest mode: the smaller of the setting
+     * and the value the remote endpoint asks for is negotiated. If the
+     * settings decline compression, negotiate fails with error::declined.
+     *
+     * Must be called before negotiate.
+     *
+     * @since 0.8.2
+     *
+     * @param s The settings to apply
+     * @return A status code
+     */
+    lib::error_code apply_settings(settings const & s) {
+        if (s.memory_level < 1 || s.memory_level > 9) {
+            return make_error_code(error::invalid_memory_level);
+        }
+
+        lib::error_code ec = set_server_max_window_bits(
+            s.server_max_window_bits, mode::largest);
+        if (ec) {
+            return ec;
+        }
+
+        ec = set_client_max_window_bits(s.client_max_window_bits,
+            mode::largest);
+        if (ec) {
+            return ec;
+        }
+
+        m_server_no_context_takeover = s.server_no_context_takeover;
+        m_client_no_context_takeover = s.client_no_context_takeover;
+        m_memory_level = s.memory_level;
+        m_declined = s.decline;
+
+        return lib::error_code();
+    }
+
     /// Reset server's outgoing LZ77 sliding window for each new message
     /**
      * Enabling this setting will cause the server's compressor to reset the
@@ -509,6 +627,13 @@ public:
     err_str_pair negotiate(http::attribute_list const & offer) {
         err_str_pair ret;
 
+        if (m_declined) {
+            ret.first = make_error_code(error::declined);
+            return ret;
+        }
+
+        m_client_max_window_bits_offered = false;
+
         http::attribute_list::const_iterator it;
         for (it = offer.begin(); it != offer.end(); ++it) {
             if (it->first == "server_no_context_takeover") {
@@ -546,20 +671,35 @@ public:
      * @return Error or status code
      */
     lib::error_code compress(std::string const & in, std::string & out) {
+        return compress(reinterpret_cast<uint8_t const *>(in.data()),
+            in.size(), out);
+    }
+
+    /// Compress bytes
+    /**
+     * @since 0.8.2
+     *
+     * @param [in] buf Byte buffer to compress
+     * @param [in] len Length of buf
+     * @param [out] out String to append compressed bytes to
+     * @return Error or status code
+     */
+    lib::error_code compress(uint8_t const * buf, size_t len, std::string & out)
+    {
         if (!m_initialized) {
             return make_error_code(error::uninitialized);
         }
 
         size_t output;
 
-        if (in.empty()) {
-            uint8_t buf[6] = {0x02, 0x00, 0x00, 0x00, 0xff, 0xff};
-            out.append((char *)(buf),6);
+        if (len == 0) {
+            uint8_t empty[6] = {0x02, 0x00, 0x00, 0x00, 0xff, 0xff};
+            out.append((char *)(empty),6);
             return lib::error_code();
         }
 
-        m_dstate.avail_in = in.size();
-        m_dstate.next_in = (unsigned char *)(const_cast<char *>(in.data()));
+        m_dstate.avail_in = len;
+        m_dstate.next_in = const_cast<unsigned char *>(buf);
 
         do {
             // Output to local buffer
@@ -585,6 +725,27 @@ public:
      */
     lib::error_code decompress(uint8_t const * buf, size_t len, std::string &
         out)
+    {
+        return decompress(buf, len, out, out.max_size());
+    }
+
+    /// Decompress bytes up to a limit
+    /**
+     * Stops once `out` holds more than `limit` bytes, which bounds the memory
+     * and time spent on a message with a high compression ratio. At most one
+     * internal buffer of output is appended past the limit. The caller is
+     * expected to check the size of `out` and discard the message.
+     *
+     * @since 0.8.2
+     *
+     * @param buf Byte buffer to decompress
+     * @param len Length of buf
+     * @param out String to append decompressed bytes to
+     * @param limit Size of `out` at which to stop decompressing
+     * @return Error or status code
+     */
+    lib::error_code decompress(uint8_t const * buf, size_t len, std::string &
+        out, size_t limit)
     {
         if (!m_initialized) {
             return make_error_code(error::uninitialized);
@@ -609,7 +770,7 @@ public:
                 reinterpret_cast<char *>(m_decompress_buffer.get()),
                 m_compress_buffer_size - m_istate.avail_out
             );
-        } while (m_istate.avail_out == 0);
+        } while (m_istate.avail_out == 0 && out.size() <= limit);
 
         return lib::error_code();
     }
@@ -635,7 +796,9 @@ private:
             ret += "; server_max_window_bits="+s.str();
         }
 
-        if (m_client_max_window_bits < default_client_max_window_bits) {
+        if (m_client_max_window_bits < default_client_max_window_bits &&
+            m_client_max_window_bits_offered)
+        {
             std::stringstream s;
             s << int(m_client_max_window_bits);
             ret += "; client_max_window_bits="+s.str();
@@ -759,6 +922,8 @@ private:
     {
         uint8_t bits = uint8_t(atoi(value.c_str()));
 
+        m_client_max_window_bits_offered = true;
+
         if (value.empty()) {
             bits = default_client_max_window_bits;
         } else if (bits < min_client_max_window_bits ||
@@ -800,9 +965,14 @@ private:
     uint8_t m_client_max_window_bits;
     mode::value m_server_max_window_bits_mode;
     mode::value m_client_max_window_bits_mode;
+    bool m_client_max_window_bits_offered;
+    bool m_declined;
+    uint8_t m_memory_level;
 
     bool m_initialized;
     int m_flush;
+    uint8_t m_deflate_bits;
+    uint8_t m_inflate_bits;
     size_t m_compress_buffer_size;
     lib::unique_ptr_uchar_array m_compress_buffer;
     lib::unique_ptr_uchar_array m_decompress_buffer;
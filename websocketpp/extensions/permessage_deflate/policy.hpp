@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_POLICY_HPP
+#define WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_POLICY_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#include <cstddef>
+
+namespace websocketpp {
+namespace extensions {
+namespace permessage_deflate {
+
+/// Parameters a server offers to negotiate for one connection
+/**
+ * Window sizes are upper bounds. The remote endpoint may still ask for a
+ * smaller window. A client that does not offer client_max_window_bits
+ * always compresses with a 32KiB window, whatever client_max_window_bits is.
+ *
+ * In this implementation the compression contexts live as long as the
+ * connection, so no_context_takeover does not lower memory use. It trades
+ * compression ratio for less work for peers that keep their own state.
+ *
+ * @since 0.8.2
+ */
+struct settings {
+    settings()
+      : decline(false)
+      , server_max_window_bits(15)
+      , client_max_window_bits(15)
+      , server_no_context_takeover(false)
+      , client_no_context_takeover(false)
+      , memory_level(4) {}
+
+    /// Refuse all permessage-deflate offers
+    bool decline;
+    /// Largest server compressor window, 9 to 15
+    uint8_t server_max_window_bits;
+    /// Largest client compressor window, 9 to 15
+    uint8_t client_max_window_bits;
+    /// Reset the server compressor after each message
+    bool server_no_context_takeover;
+    /// Ask the client to reset its compressor after each message
+    bool client_no_context_takeover;
+    /// zlib memory level of the local compressor, 1 to 9
+    uint8_t memory_level;
+};
+
+/// Deflate memory in use when a connection negotiates
+/**
+ * @since 0.8.2
+ */
+struct usage {
+    usage()
+      : memory(0)
+      , connections(0)
+      , budget(0) {}
+
+    /// Estimated memory of the compression contexts in use
+    size_t memory;
+    /// Connections that negotiated permessage-deflate
+    size_t connections;
+    /// Memory the contexts may use in total, 0 for unlimited
+    size_t budget;
+};
+
+/// Estimate the memory used by a compressor and decompressor pair
+/**
+ * Based on the zlib formulas: a compressor uses 2^(window_bits+2) bytes
+ * plus 2^(memory_level+9) bytes, a decompressor 2^window_bits bytes. Both
+ * add a few KiB of state.
+ *
+ * @since 0.8.2
+ *
+ * @param deflate_bits The compressor window bits
+ * @param inflate_bits The decompressor window bits
+ * @param memory_level The compressor memory level
+ * @return The estimated memory in bytes
+ */
+inline size_t estimate_memory(uint8_t deflate_bits, uint8_t inflate_bits,
+    uint8_t memory_level = 4)
+{
+    return (size_t(1) << (deflate_bits + 2))
+        + (size_t(1) << (memory_level + 9)) + 6 * 1024
+        + (size_t(1) << inflate_bits) + 7 * 1024;
+}
+
+/// Estimate the memory a connection would use with the given settings
+/**
+ * @since 0.8.2
+ *
+ * @param s The settings to estimate
+ * @param is_server Whether the local endpoint is the server
+ * @return The estimated memory in bytes, 0 if compression is declined
+ */
+inline size_t estimate_memory(settings const & s, bool is_server) {
+    if (s.decline) {
+        return 0;
+    }
+    if (is_server) {
+        return estimate_memory(s.server_max_window_bits,
+            s.client_max_window_bits, s.memory_level);
+    } else {
+        return estimate_memory(s.client_max_window_bits,
+            s.server_max_window_bits, s.memory_level);
+    }
+}
+
+/// Default negotiation policy: shrink the settings to fit a memory budget
+/**
+ * A new connection may use at most its fair share of the budget, the
+ * budget divided by the number of compressed connections including itself,
+ * and never more than what is left of it. While the settings do not fit,
+ * the larger of the two windows is halved, then the memory level is
+ * lowered. If they still do not fit compression is declined.
+ *
+ * The fair share keeps memory bounded as connections grow: early
+ * connections get full windows and later ones get smaller windows before
+ * the budget is exhausted.
+ *
+ * The remote window can only be limited if the remote endpoint offered to
+ * limit it. Otherwise it is budgeted at 15 bits and left alone.
+ *
+ * @since 0.8.2
+ *
+ * @param s The preferred settings
+ * @param u The current usage and budget
+ * @param is_server Whether the local endpoint is the server
+ * @param remote_offered Whether the remote endpoint offered the max window
+ * bits parameter for its own compressor
+ * @return The settings to negotiate
+ */
+inline settings fit_budget(settings s, usage const & u, bool is_server,
+    bool remote_offered = true)
+{
+    if (s.decline || u.budget == 0) {
+        return s;
+    }
+
+    size_t limit = u.budget / (u.connections + 1);
+    if (u.memory >= u.budget) {
+        limit = 0;
+    } else if (u.budget - u.memory < limit) {
+        limit = u.budget - u.memory;
+    }
+
+    uint8_t & local = is_server ? s.server_max_window_bits
+                                : s.client_max_window_bits;
+    uint8_t & remote = is_server ? s.client_max_window_bits
+                                 : s.server_max_window_bits;
+
+    if (!remote_offered) {
+        remote = 15;
+    }
+
+    while (estimate_memory(s, is_server) > limit) {
+        if (local > 9 && (local >= remote || !remote_offered)) {
+            local--;
+        } else if (remote > 9 && remote_offered) {
+            remote--;
+        } else if (s.memory_level > 1) {
+            s.memory_level--;
+        } else {
+            s.decline = true;
+        }
+    }
+
+    return s;
+}
+
+/// Tracks the deflate memory of the connections of an endpoint
+/**
+ * Thread safe. Servers pick their settings and reserve the estimated memory
+ * in one step with reserve, so connections negotiating at the same time
+ * each see the reservations of the others. The charge is corrected with
+ * adjust once negotiation is done and given back when the connection
+ * terminates.
+ *
+ * @since 0.8.2
+ *
+ * @tparam concurrency The concurrency policy used to protect the counters
+ */
+template <typename concurrency>
+class tracker {
+public:
+    typedef typename concurrency::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency::mutex_type mutex_type;
+
+    /// Set the memory budget, 0 for unlimited
+    void set_budget(size_t budget) {
+        scoped_lock_type lock(m_lock);
+        m_usage.budget = budget;
+    }
+
+    /// Get a snapshot of the usage
+    usage get_usage() const {
+        scoped_lock_type lock(m_lock);
+        return m_usage;
+    }
+
+    /// Pick settings with fit_budget and reserve their memory
+    /**
+     * @param s The preferred settings, replaced with the fitted settings
+     * @param is_server Whether the local endpoint is the server
+     * @param remote_offered Passed to fit_budget
+     * @param u Set to the usage before the reservation
+     * @return The memory reserved, 0 if compression is declined
+     */
+    size_t reserve(settings & s, bool is_server, bool remote_offered,
+        usage & u)
+    {
+        scoped_lock_type lock(m_lock);
+        u = m_usage;
+        s = fit_budget(s, m_usage, is_server, remote_offered);
+        size_t memory = estimate_memory(s, is_server);
+        charge(0, memory);
+        return memory;
+    }
+
+    /// Replace a charge with another, either may be 0
+    void adjust(size_t from, size_t to) {
+        scoped_lock_type lock(m_lock);
+        charge(from, to);
+    }
+
+    /// Charge the memory of a connection that negotiated compression
+    void acquire(size_t memory) {
+        adjust(0, memory);
+    }
+
+    /// Give back memory charged with acquire or reserve
+    void release(size_t memory) {
+        adjust(memory, 0);
+    }
+private:
+    void charge(size_t from, size_t to) {
+        m_usage.memory = m_usage.memory - from + to;
+        if (from == 0 && to != 0) {
+            m_usage.connections++;
+        } else if (from != 0 && to == 0) {
+            m_usage.connections--;
+        }
+    }
+
+    mutable mutex_type m_lock;
+    usage m_usage;
+};
+
+} // namespace permessage_deflate
+} // namespace extensions
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_EXTENSION_PERMESSAGE_DEFLATE_POLICY_HPP
@@ -46,6 +46,9 @@ inline size_t response::consume(char const * buf, size_t len) {
         return this->process_body(buf,len);
     }
 
+    // bytes left in the buffer by earlier calls hold no delimiter
+    size_t buffered = m_buf->size();
+
     // copy new header bytes into buffer
     m_buf->append(buf,len);
 
@@ -53,11 +56,15 @@ inline size_t response::consume(char const * buf, size_t len) {
     std::string::iterator begin = m_buf->begin();
     std::string::iterator end = begin;
 
+    // Resume the search at the last buffered byte, which may be the first
+    // half of a delimiter, so that input fed in small pieces is only scanned
+    // once.
+    std::string::iterator cursor = begin + (buffered ? buffered - 1 : 0);
 
     for (;;) {
         // search for delimiter
         end = std::search(
-            begin,
+            cursor,
             m_buf->end(),
             header_delimiter,
             header_delimiter + sizeof(header_delimiter) - 1
@@ -78,7 +85,9 @@ inline size_t response::consume(char const * buf, size_t len) {
             m_buf->resize(static_cast<std::string::size_type>(end-begin));
 
             m_read += len;
-            m_header_bytes -= m_buf->size();
+            // the delimiter counted for the unfinished line has not been
+            // read yet
+            m_header_bytes -= m_buf->size() + sizeof(header_delimiter);
 
             return len;
         }
@@ -133,6 +142,7 @@ inline size_t response::consume(char const * buf, size_t len) {
         }
 
         begin = end+(sizeof(header_delimiter) - 1);
+        cursor = begin;
     }
 }
 
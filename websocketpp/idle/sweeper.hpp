@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_IDLE_SWEEPER_HPP
+#define WEBSOCKETPP_IDLE_SWEEPER_HPP
+
+#include <websocketpp/idle/table.hpp>
+
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <utility>
+#include <vector>
+
+namespace websocketpp {
+namespace idle {
+
+/// Periodically sweeps the idle table of an Asio endpoint
+/**
+ * Attaches a table to the endpoint with `endpoint::set_idle_table`.
+ * Connections created afterwards record their reads and writes in the table
+ * and time their opening and closing handshakes there instead of with a
+ * timer each. Every interval one timer on the endpoint sweeps the table and
+ * asks the connections that need it to send a keepalive ping, close for
+ * inactivity or time out.
+ *
+ * The table is locked, so the endpoint may be run by several threads. Each
+ * action a sweep finds is dispatched to its connection and runs on that
+ * connection's strand. With many threads the table lock becomes a point of
+ * contention; one endpoint and sweeper per thread, or prefork::supervisor,
+ * avoids it.
+ *
+ * The sweeper must outlive the connections of the endpoint. Destroying it
+ * cancels its timer and waits for a sweep in progress to finish; a cancelled
+ * timer handler that runs afterwards does nothing.
+ *
+ * @since 0.8.2
+ */
+template <typename endpoint_type>
+class sweeper {
+public:
+    typedef typename endpoint_type::connection_ptr connection_ptr;
+    typedef typename endpoint_type::timer_ptr timer_ptr;
+
+    explicit sweeper(endpoint_type & endpoint)
+      : m_endpoint(endpoint)
+      , m_guard(lib::make_shared<guard>(this))
+      , m_interval(1000)
+      , m_running(false)
+    {
+        m_endpoint.set_idle_table(&m_table);
+    }
+
+    /// Stop sweeping and detach the table from the endpoint
+    ~sweeper() {
+        {
+            lib::lock_guard<lib::mutex> lock(m_guard->lock);
+            m_guard->owner = NULL;
+        }
+        stop();
+        m_endpoint.set_idle_table(NULL);
+    }
+
+    /// Send a keepalive ping after `ms` milliseconds without reading
+    /**
+     * A connection that reads nothing for `pong_timeout` milliseconds after
+     * the ping is terminated with error::keepalive_timeout.
+     *
+     * @param ms Milliseconds, 0 to send no keepalive pings
+     * @param pong_timeout Milliseconds to wait for an answer
+     */
+    void set_keepalive(uint32_t ms, uint32_t pong_timeout) {
+        m_table.set_ping_interval(ms);
+        m_table.set_pong_timeout(pong_timeout);
+    }
+
+    /// Close connections that neither read nor write for `ms` milliseconds
+    /**
+     * @param ms Milliseconds, 0 to never close idle connections
+     */
+    void set_idle_timeout(uint32_t ms) {
+        m_table.set_idle_timeout(ms);
+    }
+
+    /// Sweep every `interval` milliseconds
+    /**
+     * Timeouts fire up to one interval late and inactivity is measured to
+     * within one interval.
+     */
+    void start(long interval) {
+        lib::lock_guard<lib::mutex> lock(m_guard->lock);
+        m_interval = interval;
+        if (!m_running) {
+            m_running = true;
+            schedule();
+        }
+    }
+
+    /// Stop sweeping
+    void stop() {
+        lib::lock_guard<lib::mutex> lock(m_guard->lock);
+        m_running = false;
+        if (m_timer) {
+            m_timer->cancel();
+            m_timer.reset();
+        }
+    }
+
+    /// Sweep the table now
+    /**
+     * @return The number of connections asked to take action
+     */
+    size_t sweep() {
+        std::vector<pending> actions;
+        {
+            lib::lock_guard<lib::mutex> lock(m_guard->lock);
+            collect(actions);
+        }
+        return run(actions);
+    }
+
+    /// Get the table
+    table const & get_table() const {
+        return m_table;
+    }
+private:
+    /// Lets timer handlers find out whether the sweeper still exists
+    struct guard {
+        explicit guard(sweeper * s) : owner(s) {}
+
+        lib::mutex lock;
+        sweeper * owner;
+    };
+    typedef lib::shared_ptr<guard> guard_ptr;
+
+    /// An action and the connection to take it
+    typedef std::pair<connection_ptr,action::value> pending;
+
+    /// Sweep the table. Must be called while holding m_guard->lock
+    void collect(std::vector<pending> & actions) {
+        m_hits.clear();
+        m_table.sweep(m_table.tick(), m_hits);
+
+        for (size_t i = 0; i < m_hits.size(); ++i) {
+            lib::error_code ec;
+            connection_ptr con = m_endpoint.get_con_from_hdl(m_hits[i].hdl,
+                ec);
+            if (!ec && con) {
+                actions.push_back(std::make_pair(con, m_hits[i].what));
+            }
+        }
+    }
+
+    /// Hand the actions to their connections
+    /**
+     * Called without the lock and without touching the sweeper, as the
+     * actions may run right away and their handlers may stop or destroy it.
+     */
+    static size_t run(std::vector<pending> const & actions) {
+        for (size_t i = 0; i < actions.size(); ++i) {
+            actions[i].first->idle_action(actions[i].second);
+        }
+        return actions.size();
+    }
+
+    /// Start the timer. Must be called while holding m_guard->lock
+    void schedule() {
+        m_timer = m_endpoint.set_timer(m_interval, lib::bind(
+            &sweeper::handle_timer, m_guard, lib::placeholders::_1));
+    }
+
+    static void handle_timer(guard_ptr g, lib::error_code const & ec) {
+        std::vector<pending> actions;
+        {
+            lib::lock_guard<lib::mutex> lock(g->lock);
+            sweeper * s = g->owner;
+            if (ec || !s || !s->m_running) {
+                return;
+            }
+            s->collect(actions);
+            s->schedule();
+        }
+        run(actions);
+    }
+
+    endpoint_type & m_endpoint;
+    table m_table;
+    std::vector<hit> m_hits;
+    guard_ptr m_guard;
+
+    long m_interval;
+    bool m_running;
+    timer_ptr m_timer;
+};
+
+} // namespace idle
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_IDLE_SWEEPER_HPP
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_IDLE_TABLE_HPP
+#define WEBSOCKETPP_IDLE_TABLE_HPP
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace websocketpp {
+/// Idle detection, keepalive and timeouts for many connections at once
+namespace idle {
+
+/// Timer states of a table slot
+/**
+ * Bit 0 marks states watched for inactivity and bit 1 states with a
+ * deadline, so that a sweep tests them without branching.
+ */
+namespace state {
+enum value {
+    /// Slot is not in use
+    free = 0x00,
+    /// Open connection, watched for inactivity
+    open = 0x01,
+    /// Open connection that has not answered a keepalive ping yet
+    ping_sent = 0x03,
+    /// Opening handshake with a deadline
+    handshake = 0x06,
+    /// Closing handshake with a deadline
+    closing = 0x0a,
+    /// In use but neither watched nor timed
+    inactive = 0x10
+};
+} // namespace state
+
+/// Actions a sweep asks the connection in a slot to take
+namespace action {
+enum value {
+    /// Send a keepalive ping
+    ping = 1,
+    /// Start a closing handshake, nothing was read or written for too long
+    idle_close,
+    /// The opening handshake timed out
+    handshake_timeout,
+    /// The closing handshake timed out
+    close_timeout,
+    /// The keepalive ping was not answered in time
+    keepalive_timeout
+};
+} // namespace action
+
+/// A slot that needs action
+struct hit {
+    uint32_t slot;
+    action::value what;
+    /// The connection in the slot when the sweep found it
+    connection_hdl hdl;
+};
+
+/// Compact timer state for the connections of one endpoint
+/**
+ * Replaces a timer object per connection with a row in a structure of
+ * arrays: last read tick, last write tick, state and deadline, 13 bytes per
+ * connection. Ticks are milliseconds since the table was created and wrap
+ * after 49 days, differences are taken modulo 2^32. A periodic `sweep` scans
+ * the arrays front to back in blocks, computing a flag byte per slot in a
+ * branch free loop the compiler can vectorize, then skips blocks of eight
+ * clear flags with one load. Only the slots that need action touch their
+ * connection, so a sweep of a million mostly idle connections reads about
+ * 13MB sequentially.
+ *
+ * Reads, writes and opens are recorded with the tick of the last sweep, which
+ * costs one store and no clock read, so inactivity is measured to within one
+ * sweep interval. Deadlines are set from the clock.
+ *
+ * All methods are thread safe. Every update and the sweep take one lock, so
+ * connections on several io threads may share a table. The lock is
+ * uncontended when the endpoint is run by one thread.
+ *
+ * @since 0.8.2
+ */
+class table {
+public:
+    typedef lib::chrono::steady_clock clock_type;
+
+    /// Slot value for connections without a slot
+    static uint32_t const no_slot = 0xffffffff;
+
+    table()
+      : m_epoch(clock_type::now())
+      , m_now(0)
+      , m_ping_after(disabled)
+      , m_pong_timeout(10000)
+      , m_idle_after(disabled)
+      , m_used(0) {}
+
+    /// Set how long a connection may go without reading before it is pinged
+    /**
+     * @param ms Milliseconds, 0 to send no keepalive pings
+     */
+    void set_ping_interval(uint32_t ms) {
+        m_ping_after = ms ? ms : disabled;
+    }
+
+    /// Set how long to wait for any data after a keepalive ping
+    /**
+     * @param ms Milliseconds, at least 1
+     */
+    void set_pong_timeout(uint32_t ms) {
+        m_pong_timeout = ms ? ms : 1;
+    }
+
+    /// Set how long a connection may go without reading or writing
+    /**
+     * @param ms Milliseconds, 0 to never close idle connections
+     */
+    void set_idle_timeout(uint32_t ms) {
+        m_idle_after = ms ? ms : disabled;
+    }
+
+    /// Get the current tick from the clock
+    uint32_t tick() const {
+        return static_cast<uint32_t>(lib::chrono::duration_cast<
+            lib::chrono::milliseconds>(clock_type::now() - m_epoch).count());
+    }
+
+    /// Add a connection in the inactive state
+    /**
+     * @param hdl The connection
+     * @return Its slot
+     */
+    uint32_t add(connection_hdl hdl) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        uint32_t slot;
+        if (m_free.empty()) {
+            slot = static_cast<uint32_t>(m_state.size());
+            m_last_read.push_back(m_now);
+            m_last_write.push_back(m_now);
+            m_deadline.push_back(0);
+            m_state.push_back(state::inactive);
+            m_hdl.push_back(hdl);
+        } else {
+            slot = m_free.back();
+            m_free.pop_back();
+            m_last_read[slot] = m_now;
+            m_last_write[slot] = m_now;
+            m_deadline[slot] = 0;
+            m_state[slot] = state::inactive;
+            m_hdl[slot] = hdl;
+        }
+        m_used++;
+        return slot;
+    }
+
+    /// Free a slot
+    void remove(uint32_t slot) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_state[slot] = state::free;
+        m_hdl[slot].reset();
+        m_free.push_back(slot);
+        m_used--;
+    }
+
+    /// Record that a connection read data
+    void touch_read(uint32_t slot) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_last_read[slot] = m_now;
+        if (m_state[slot] == state::ping_sent) {
+            m_state[slot] = state::open;
+        }
+    }
+
+    /// Record that a connection wrote data
+    void touch_write(uint32_t slot) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_last_write[slot] = m_now;
+    }
+
+    /// Mark a connection open, watched for inactivity from now on
+    void set_open(uint32_t slot) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_last_read[slot] = m_last_write[slot] = m_now;
+        m_state[slot] = state::open;
+    }
+
+    /// Stop watching a connection until its state is set again
+    void set_inactive(uint32_t slot) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_state[slot] = state::inactive;
+    }
+
+    /// Time a handshake
+    /**
+     * @param slot The connection's slot
+     * @param s state::handshake or state::closing
+     * @param ms Milliseconds from now until the handshake times out
+     */
+    void set_deadline(uint32_t slot, state::value s, uint32_t ms) {
+        uint32_t deadline = tick() + ms;
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_deadline[slot] = deadline;
+        m_state[slot] = static_cast<uint8_t>(s);
+    }
+
+    /// Get the state of a slot
+    state::value get_state(uint32_t slot) const {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        return static_cast<state::value>(m_state[slot]);
+    }
+
+    /// Get the connection in a slot
+    connection_hdl get_hdl(uint32_t slot) const {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        return m_hdl[slot];
+    }
+
+    /// Get the number of slots in use
+    size_t size() const {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        return m_used;
+    }
+
+    /// Find the slots that need action at tick `now`
+    /**
+     * Slots that time out or go idle become inactive and slots that get
+     * pinged wait for an answer, so each condition is reported once. Reads
+     * and writes recorded afterwards carry the tick `now`.
+     *
+     * @param now The current tick
+     * @param hits Appended with the slots that need action
+     */
+    void sweep(uint32_t now, std::vector<hit> & hits) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_now = now;
+
+        uint8_t flags[block_size];
+        size_t const n = m_state.size();
+
+        for (size_t begin = 0; begin < n; begin += block_size) {
+            size_t const count = n - begin < block_size ? n - begin :
+                block_size;
+            mark(begin, count, now, flags);
+            std::fill(flags + count, flags + block_size, 0);
+
+            for (size_t i = 0; i < count; i += 8) {
+                uint64_t word;
+                std::memcpy(&word, flags + i, sizeof(word));
+                if (word == 0) {
+                    continue;
+                }
+                for (size_t j = i; j < i + 8 && j < count; ++j) {
+                    if (flags[j]) {
+                        resolve(static_cast<uint32_t>(begin + j), flags[j],
+                            now, hits);
+                    }
+                }
+            }
+        }
+    }
+private:
+    static size_t const block_size = 256;
+    static uint32_t const disabled = 0xffffffff;
+
+    static uint8_t const flag_ping = 0x01;
+    static uint8_t const flag_idle = 0x02;
+    static uint8_t const flag_expired = 0x04;
+
+    /// Compute the flags of `count` slots starting at `begin`
+    void mark(size_t begin, size_t count, uint32_t now, uint8_t * flags) const
+    {
+        uint32_t const * read = &m_last_read[begin];
+        uint32_t const * write = &m_last_write[begin];
+        uint32_t const * deadline = &m_deadline[begin];
+        uint8_t const * st = &m_state[begin];
+
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t read_age = now - read[i];
+            uint32_t write_age = now - write[i];
+            uint32_t active_age = read_age < write_age ? read_age : write_age;
+            uint32_t watched = st[i] & 0x01;
+            uint32_t timed = (st[i] >> 1) & 0x01;
+
+            uint32_t ping = (st[i] == state::open) & (read_age >= m_ping_after);
+            uint32_t idle = watched & (active_age >= m_idle_after);
+            uint32_t expired = timed &
+                (static_cast<int32_t>(now - deadline[i]) >= 0);
+
+            flags[i] = static_cast<uint8_t>(ping | (idle << 1) |
+                (expired << 2));
+        }
+    }
+
+    /// Turn the flags of a slot into an action and advance its state
+    void resolve(uint32_t slot, uint8_t flags, uint32_t now,
+        std::vector<hit> & hits)
+    {
+        hit h;
+        h.slot = slot;
+        h.hdl = m_hdl[slot];
+
+        if (flags & flag_expired) {
+            switch (m_state[slot]) {
+                case state::handshake:
+                    h.what = action::handshake_timeout;
+                    break;
+                case state::closing:
+                    h.what = action::close_timeout;
+                    break;
+                default:
+                    h.what = action::keepalive_timeout;
+                    break;
+            }
+            m_state[slot] = state::inactive;
+        } else if (flags & flag_idle) {
+            h.what = action::idle_close;
+            m_state[slot] = state::inactive;
+        } else {
+            h.what = action::ping;
+            m_deadline[slot] = now + m_pong_timeout;
+            m_state[slot] = state::ping_sent;
+        }
+
+        hits.push_back(h);
+    }
+
+    clock_type::time_point const m_epoch;
+    uint32_t m_now;
+
+    uint32_t m_ping_after;
+    uint32_t m_pong_timeout;
+    uint32_t m_idle_after;
+
+    // scanned every sweep
+    std::vector<uint32_t> m_last_read;
+    std::vector<uint32_t> m_last_write;
+    std::vector<uint32_t> m_deadline;
+    std::vector<uint8_t> m_state;
+
+    // touched only for slots that need action
+    std::vector<connection_hdl> m_hdl;
+    std::vector<uint32_t> m_free;
+    size_t m_used;
+
+    mutable lib::mutex m_lock;
+};
+
+} // namespace idle
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_IDLE_TABLE_HPP
@@ -73,6 +73,27 @@ size_t connection<config>::get_buffered_amount() const {
     return m_send_buffer_size;
 }
 
+template <typename config>
+size_t connection<config>::get_expired_message_count() const {
+    scoped_lock_type lock(m_write_lock);
+    return m_expired_message_count;
+}
+
+template <typename config>
+metrics::connection_stats connection<config>::get_resource_stats() const {
+    metrics::connection_stats stats;
+
+    if (config::enable_resource_accounting) {
+        {
+            scoped_lock_type lock(m_stats_lock);
+            stats = m_stats;
+        }
+        stats.queue_bytes = get_buffered_amount();
+    }
+
+    return stats;
+}
+
 template <typename config>
 session::state::value connection<config>::get_state() const {
     //scoped_lock_type lock(m_connection_state_lock);
@@ -121,22 +142,169 @@ lib::error_code connection<config>::send(typename config::message_type::ptr msg)
         outgoing_msg = msg;
 
         scoped_lock_type lock(m_write_lock);
+        if (!reserve_queued(msg->get_payload().size())) {
+            return error::make_error_code(error::tenant_quota_exceeded);
+        }
         write_push(outgoing_msg);
         needs_writing = !m_write_flag && !m_send_queue.empty();
     } else {
-        outgoing_msg = m_msg_manager->get_message();
+        scoped_lock_type lock(m_write_lock);
+
+        if (msg->get_compressed() && m_processor->permessage_compress_enabled())
+        {
+            // the remote decompressor history diverges from any broadcast
+            // stream
+            m_broadcast_stream.reset();
+        }
+
+        if (defer_message(msg)) {
+            // The message is prepared fragment by fragment as it is written.
+            // Validate it now so that errors are still reported to the caller.
+            if (frame::opcode::is_control(msg->get_opcode())) {
+                return processor::error::make_error_code(
+                    processor::error::invalid_opcode);
+            }
+            if (msg->get_opcode() == frame::opcode::text &&
+                !utf8_validator::validate(msg->get_payload()))
+            {
+                return processor::error::make_error_code(
+                    processor::error::invalid_payload);
+            }
+
+            if (!reserve_queued(msg->get_payload().size())) {
+                return error::make_error_code(error::tenant_quota_exceeded);
+            }
+
+            m_deferred_messages++;
+            write_push(msg);
+            needs_writing = !m_write_flag && !m_send_queue.empty();
+        } else {
+            outgoing_msg = m_msg_manager->get_message();
+
+            if (!outgoing_msg) {
+                return error::make_error_code(error::no_outgoing_buffers);
+            }
+
+            // Charged before compressing, a compressed message can not be
+            // taken back once the deflate context has seen it
+            if (!reserve_queued(msg->get_payload().size())) {
+                return error::make_error_code(error::tenant_quota_exceeded);
+            }
+
+            uint64_t start = 0;
+            if (config::enable_resource_accounting) {
+                start = metrics::cycles();
+            }
+
+            lib::error_code ec = m_processor->prepare_data_frame(msg,outgoing_msg);
+
+            if (ec) {
+                // give the charge back
+                sync_send_queue();
+                return ec;
+            }
+
+            if (config::enable_resource_accounting) {
+                std::string const & h = outgoing_msg->get_header();
+                account_cycles(&metrics::connection_stats::prepare_cycles, start,
+                    !h.empty() && frame::get_rsv1(frame::basic_header(h[0],0)));
+            }
+
+            if (msg->has_deadline()) {
+                outgoing_msg->set_deadline(msg->get_deadline());
+            }
+            if (m_message_expired_handler) {
+                // report the message that was sent if the copy is dropped
+                outgoing_msg->set_source(msg);
+            }
+
+            write_push(outgoing_msg);
+            needs_writing = !m_write_flag && !m_send_queue.empty();
+        }
+    }
+
+    if (needs_writing) {
+        transport_con_type::dispatch(lib::bind(
+            &type::write_frame,
+            type::get_shared()
+        ));
+    }
+
+    return lib::error_code();
+}
+
+template <typename config>
+lib::error_code connection<config>::send_broadcast(broadcast::message_ptr msg)
+{
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection send_broadcast");
+    }
 
-        if (!outgoing_msg) {
-            return error::make_error_code(error::no_outgoing_buffers);
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+        if (m_state != session::state::open) {
+           return error::make_error_code(error::invalid_state);
         }
+    }
+
+    message_ptr outgoing_msg = m_msg_manager->get_message();
+    if (!outgoing_msg) {
+        return error::make_error_code(error::no_outgoing_buffers);
+    }
+
+    bool needs_writing = false;
 
+    {
         scoped_lock_type lock(m_write_lock);
-        lib::error_code ec = m_processor->prepare_data_frame(msg,outgoing_msg);
+
+        if (!reserve_queued(msg->payload.size())) {
+            return error::make_error_code(error::tenant_quota_exceeded);
+        }
+
+        uint64_t start = 0;
+        if (config::enable_resource_accounting) {
+            start = metrics::cycles();
+        }
+
+        // Deferred messages are compressed when they are written, after this
+        // one, so the shared bytes can not be used while any are queued.
+        bool shared = false;
+        if (m_deferred_messages == 0 && !m_preparing_fragment &&
+            m_processor->accepts_shared_deflate(msg->window_bits,msg->reset))
+        {
+            shared = msg->reset || (m_broadcast_stream == msg->stream &&
+                m_broadcast_next == msg->sequence);
+        }
+
+        lib::error_code ec;
+        if (shared) {
+            ec = m_processor->prepare_shared_deflate(msg->opcode,
+                msg->compressed, outgoing_msg);
+            if (!ec) {
+                m_broadcast_stream = msg->stream;
+                m_broadcast_next = msg->sequence + 1;
+            }
+        } else {
+            message_ptr plain = m_msg_manager->get_message(msg->opcode,
+                msg->payload.size());
+            if (plain) {
+                plain->set_payload(msg->payload);
+                ec = m_processor->prepare_data_frame(plain,outgoing_msg);
+            } else {
+                ec = error::make_error_code(error::no_outgoing_buffers);
+            }
+        }
 
         if (ec) {
+            // give the charge back
+            sync_send_queue();
             return ec;
         }
 
+        if (config::enable_resource_accounting) {
+            account_cycles(&metrics::connection_stats::prepare_cycles, start);
+        }
+
         write_push(outgoing_msg);
         needs_writing = !m_write_flag && !m_send_queue.empty();
     }
@@ -243,6 +411,9 @@ void connection<config>::handle_pong_timeout(std::string payload,
         return;
     }
 
+    _WEBSOCKETPP_PROBE2_(timer_fired, static_cast<void *>(this),
+        static_cast<int>(metrics::probe_timer::pong));
+
     if (m_pong_timeout_handler) {
         m_pong_timeout_handler(m_connection_hdl,payload);
     }
@@ -308,18 +479,59 @@ void connection<config>::close(close::status::value const code,
         m_alog->write(log::alevel::devel,"connection close");
     }
 
+    close_connection(code,reason,false,ec);
+}
+
+template <typename config>
+void connection<config>::close_connection(close::status::value const code,
+    std::string const & reason, bool fast, lib::error_code & ec)
+{
     // Truncate reason to maximum size allowable in a close frame.
     std::string tr(reason,0,std::min<size_t>(reason.size(),
         frame::limits::close_reason_size));
 
-    scoped_lock_type lock(m_connection_state_lock);
+    std::vector<message_ptr> dropped;
+    bool abort = false;
+    {
+        scoped_lock_type lock(m_connection_state_lock);
+
+        fast = fast || m_fast_close;
+
+        if (fast && m_state == session::state::closing) {
+            // stop waiting for the close handshake
+            m_fast_close = true;
+            abort = true;
+        } else if (m_state != session::state::open) {
+            ec = error::make_error_code(error::invalid_state);
+            return;
+        } else if (fast) {
+            // Write the close frame ahead of any backlog and drop the
+            // connection as soon as it is out. The close handshake timer still
+            // bounds the wait in case the write itself stalls. Nothing changes
+            // if the close frame cannot be sent.
+            ec = this->send_close_frame(code,tr,false,true,&dropped);
+            if (!ec) {
+                m_fast_close = true;
+            }
+        } else {
+            ec = this->send_close_frame(code,tr,false,
+                close::status::terminal(code));
+            return;
+        }
+    }
 
-    if (m_state != session::state::open) {
-       ec = error::make_error_code(error::invalid_state);
-       return;
+    if (!abort) {
+        write_expired(dropped);
+        return;
     }
 
-    ec = this->send_close_frame(code,tr,false,close::status::terminal(code));
+    // terminate is not thread safe, run it where the read handler and the
+    // close handshake timer run theirs
+    ec = transport_con_type::dispatch(lib::bind(
+        &type::terminate,
+        type::get_shared(),
+        lib::error_code()
+    ));
 }
 
 template<typename config>
@@ -333,6 +545,70 @@ void connection<config>::close(close::status::value const code,
     }
 }
 
+template <typename config>
+void connection<config>::fast_close(close::status::value const code,
+    std::string const & reason, lib::error_code & ec)
+{
+    if (m_alog->static_test(log::alevel::devel)) {
+        m_alog->write(log::alevel::devel,"connection fast_close");
+    }
+
+    close_connection(code,reason,true,ec);
+}
+
+template<typename config>
+void connection<config>::fast_close(close::status::value const code,
+    std::string const & reason)
+{
+    lib::error_code ec;
+    fast_close(code,reason,ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+
+template <typename config>
+void connection<config>::set_tenant(std::string const & name,
+    lib::error_code & ec)
+{
+    if (!m_tenants || m_tenant) {
+        ec = error::make_error_code(error::invalid_state);
+        return;
+    }
+
+    tenant_account_ptr account = m_tenants->get(name);
+
+    size_t deflate = 0;
+    if (m_processor && m_processor->permessage_compress_enabled()) {
+        deflate = m_processor->permessage_compress_memory();
+    }
+
+    ec = account->admit(deflate);
+    if (ec) {
+        m_tenant_rejected = true;
+        return;
+    }
+
+    scoped_lock_type lock(m_write_lock);
+
+    m_tenant = account;
+    m_tenant_name = name;
+    m_tenant_weight = account->get_weight();
+    m_tenant_deflate = deflate;
+    m_tenant_admitted = true;
+    m_tenant_rejected = false;
+    sync_send_queue();
+}
+
+template <typename config>
+void connection<config>::set_tenant(std::string const & name) {
+    lib::error_code ec;
+    set_tenant(name,ec);
+    if (ec) {
+        throw exception(ec);
+    }
+}
+
 /// Trigger the on_interrupt handler
 /**
  * This is thread safe if the transport is thread safe
@@ -458,7 +734,7 @@ template <typename config>
 void connection<config>::add_subprotocol(std::string const & value,
     lib::error_code & ec)
 {
-    if (m_is_server) {
+    if (is_server()) {
         ec = error::make_error_code(error::client_only);
         return;
     }
@@ -488,7 +764,7 @@ template <typename config>
 void connection<config>::select_subprotocol(std::string const & value,
     lib::error_code & ec)
 {
-    if (!m_is_server) {
+    if (!is_server()) {
         ec = error::make_error_code(error::server_only);
         return;
     }
@@ -580,7 +856,7 @@ template <typename config>
 void connection<config>::append_header(std::string const & key,
     std::string const & val)
 {
-    if (m_is_server) {
+    if (is_server()) {
         if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
             // we are setting response headers for an incoming server connection
             m_response.append_header(key,val);
@@ -604,7 +880,7 @@ template <typename config>
 void connection<config>::replace_header(std::string const & key,
     std::string const & val)
 {
-    if (m_is_server) {
+    if (is_server()) {
         if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
             // we are setting response headers for an incoming server connection
             m_response.replace_header(key,val);
@@ -627,7 +903,7 @@ void connection<config>::replace_header(std::string const & key,
 template <typename config>
 void connection<config>::remove_header(std::string const & key)
 {
-    if (m_is_server) {
+    if (is_server()) {
         if (m_internal_state == istate::PROCESS_HTTP_REQUEST) {
             // we are setting response headers for an incoming server connection
             m_response.remove_header(key);
@@ -665,6 +941,9 @@ lib::error_code connection<config>::defer_http_response() {
         m_handshake_timer->cancel();
         m_handshake_timer.reset();
     }
+    if (m_idle_slot != idle::table::no_slot) {
+        m_idle_table->set_inactive(m_idle_slot);
+    }
     
     // Do something to signal deferral
     m_http_state = session::http_state::deferred;
@@ -724,6 +1003,31 @@ void connection<config>::start() {
 
     m_internal_state = istate::TRANSPORT_INIT;
 
+    if (m_counters) {
+        metrics::counter_add(m_counters->connections_started, 1);
+    }
+
+    if (m_idle_table) {
+        // start may be called from any thread. Take the slot within the
+        // transport's event system and initialize the transport after it, so
+        // that every use of m_idle_slot is serialized there.
+        transport_con_type::dispatch(lib::bind(
+            &type::handle_idle_start,
+            type::get_shared()
+        ));
+    } else {
+        init_transport();
+    }
+}
+
+template <typename config>
+void connection<config>::handle_idle_start() {
+    m_idle_slot = m_idle_table->add(m_connection_hdl);
+    init_transport();
+}
+
+template <typename config>
+void connection<config>::init_transport() {
     // Depending on how the transport implements init this function may return
     // immediately and call handle_transport_init later or call
     // handle_transport_init from this function.
@@ -749,16 +1053,20 @@ void connection<config>::handle_transport_init(lib::error_code const & ec) {
     }
 
     if (ecm) {
-        std::stringstream s;
-        s << "handle_transport_init received error: "<< ecm.message();
-        m_elog->write(log::elevel::rerror,s.str());
+        if (log::test(*m_elog, log::elevel::rerror, "handle_transport_init",
+            ecm.value(), ecm.category().name()))
+        {
+            std::stringstream s;
+            s << "handle_transport_init received error: "<< ecm.message();
+            m_elog->write(log::elevel::rerror,s.str());
+        }
 
         this->terminate(ecm);
         return;
     }
 
     // At this point the transport is ready to read and write bytes.
-    if (m_is_server) {
+    if (is_server()) {
         m_internal_state = istate::READ_HTTP_REQUEST;
         this->read_handshake(1);
     } else {
@@ -775,14 +1083,19 @@ void connection<config>::read_handshake(size_t num_bytes) {
     m_alog->write(log::alevel::devel,"connection read_handshake");
 
     if (m_open_handshake_timeout_dur > 0) {
-        m_handshake_timer = transport_con_type::set_timer(
-            m_open_handshake_timeout_dur,
-            lib::bind(
-                &type::handle_open_handshake_timeout,
-                type::get_shared(),
-                lib::placeholders::_1
-            )
-        );
+        if (m_idle_slot != idle::table::no_slot) {
+            m_idle_table->set_deadline(m_idle_slot, idle::state::handshake,
+                static_cast<uint32_t>(m_open_handshake_timeout_dur));
+        } else {
+            m_handshake_timer = transport_con_type::set_timer(
+                m_open_handshake_timeout_dur,
+                lib::bind(
+                    &type::handle_open_handshake_timeout,
+                    type::get_shared(),
+                    lib::placeholders::_1
+                )
+            );
+        }
     }
 
     transport_con_type::async_read_at_least(
@@ -966,6 +1279,7 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
     size_t bytes_transferred)
 {
     //m_alog->write(log::alevel::devel,"connection handle_read_frame");
+    _WEBSOCKETPP_PROFILE_STAGE_(read_completion);
 
     lib::error_code ecm = ec;
 
@@ -975,6 +1289,13 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
 
     if (ecm) {
         log::level echannel = log::elevel::rerror;
+
+        if (m_fast_close && m_state == session::state::closed) {
+            // reads still pending when the transport was aborted
+            m_alog->write(log::alevel::devel,
+                "handle_read_frame: read ended by fast close");
+            return;
+        }
         
         if (ecm == transport::error::eof) {
             if (m_state == session::state::closed) {
@@ -982,7 +1303,7 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
                 // just ignore it
                 m_alog->write(log::alevel::devel,"got eof from closed con");
                 return;
-            } else if (m_state == session::state::closing && !m_is_server) {
+            } else if (m_state == session::state::closing && !is_server()) {
                 // If we are a client we expect to get eof in the closing state,
                 // this is a signal to terminate our end of the connection after
                 // the closing handshake
@@ -1021,7 +1342,32 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
         return;
     }*/
 
-    size_t p = 0;
+    if (config::enable_resource_accounting) {
+        scoped_lock_type lock(m_stats_lock);
+        m_stats.bytes_in += bytes_transferred;
+    }
+    if (m_counters) {
+        metrics::counter_add(m_counters->bytes_in, bytes_transferred);
+    }
+    if (m_idle_slot != idle::table::no_slot && bytes_transferred > 0) {
+        m_idle_table->touch_read(m_idle_slot);
+    }
+
+    if (m_tenant) {
+        m_tenant->consume_inbound(bytes_transferred,
+            tenant::token_bucket::clock_type::now());
+    }
+
+    process_read_buffer(0, bytes_transferred);
+}
+
+template <typename config>
+void connection<config>::process_read_buffer(size_t p, size_t bytes_transferred)
+{
+    if (m_internal_state != istate::PROCESS_CONNECTION) {
+        // terminated while this buffer was waiting for its next turn
+        return;
+    }
 
     if (m_alog->static_test(log::alevel::devel)) {
         std::stringstream s;
@@ -1029,7 +1375,79 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
         m_alog->write(log::alevel::devel,s.str());
     }
 
-    while (p < bytes_transferred) {
+    // m_buf holds unprocessed bytes until the loop below finishes, possibly
+    // over several turns. resume_reading must not read over them.
+    m_read_busy = true;
+
+    size_t dispatched = 0;
+
+    // Messages the processor has ready are handed out before any more bytes
+    // are consumed. A batch frame yields several, so the quantum is checked
+    // before each of them and a continuation starts with the rest.
+    while (p < bytes_transferred || m_processor->ready()) {
+        if (config::read_quantum_messages > 0 &&
+            dispatched >= config::read_quantum_messages * m_tenant_weight)
+        {
+            // Let other work on this thread run before continuing
+            transport_con_type::dispatch(lib::bind(
+                &type::process_read_buffer,
+                type::get_shared(),
+                p,
+                bytes_transferred
+            ));
+            return;
+        }
+
+        if (m_processor->ready()) {
+            if (m_alog->static_test(log::alevel::devel)) {
+                std::stringstream s;
+                s << "Complete message received. Dispatching";
+                m_alog->write(log::alevel::devel,s.str());
+            }
+
+            message_ptr msg = m_processor->get_message();
+            dispatched++;
+
+            if (!msg) {
+                m_alog->write(log::alevel::devel, "null message from m_processor");
+            } else if (!is_control(msg->get_opcode())) {
+                // data message, dispatch to user
+                if (m_state != session::state::open) {
+                    m_elog->write(log::elevel::warn, "got non-close frame while closing");
+                } else if (m_message_handler) {
+                    _WEBSOCKETPP_PROBE3_(message_delivered,
+                        static_cast<void *>(this),
+                        static_cast<int>(msg->get_opcode()),
+                        static_cast<uint64_t>(msg->get_payload().size()));
+
+                    uint64_t start = 0;
+                    if (config::enable_resource_accounting) {
+                        start = metrics::cycles();
+                    }
+
+                    {
+                        _WEBSOCKETPP_PROFILE_STAGE_(handler);
+                        m_message_handler(m_connection_hdl, msg);
+                    }
+
+                    if (config::enable_resource_accounting) {
+                        account_cycles(
+                            &metrics::connection_stats::handler_cycles, start);
+
+                        scoped_lock_type lock(m_stats_lock);
+                        m_stats.messages_in++;
+                    }
+
+                    if (m_counters) {
+                        metrics::counter_add(m_counters->messages_in, 1);
+                    }
+                }
+            } else {
+                process_control_frame(msg);
+            }
+            continue;
+        }
+
         if (m_alog->static_test(log::alevel::devel)) {
             std::stringstream s;
             s << "calling consume with " << bytes_transferred-p << " bytes";
@@ -1044,12 +1462,21 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
             m_alog->write(log::alevel::devel,s.str());
         }
 
+        uint64_t start = 0;
+        if (config::enable_resource_accounting) {
+            start = metrics::cycles();
+        }
+
         p += m_processor->consume(
             reinterpret_cast<uint8_t*>(m_buf)+p,
             bytes_transferred-p,
             consume_ec
         );
 
+        if (config::enable_resource_accounting) {
+            account_cycles(&metrics::connection_stats::parse_cycles, start);
+        }
+
         if (m_alog->static_test(log::alevel::devel)) {
             std::stringstream s;
             s << "bytes left after consume: " << bytes_transferred-p;
@@ -1077,41 +1504,51 @@ void connection<config>::handle_read_frame(lib::error_code const & ec,
             }
             return;
         }
-
-        if (m_processor->ready()) {
-            if (m_alog->static_test(log::alevel::devel)) {
-                std::stringstream s;
-                s << "Complete message received. Dispatching";
-                m_alog->write(log::alevel::devel,s.str());
-            }
-
-            message_ptr msg = m_processor->get_message();
-
-            if (!msg) {
-                m_alog->write(log::alevel::devel, "null message from m_processor");
-            } else if (!is_control(msg->get_opcode())) {
-                // data message, dispatch to user
-                if (m_state != session::state::open) {
-                    m_elog->write(log::elevel::warn, "got non-close frame while closing");
-                } else if (m_message_handler) {
-                    m_message_handler(m_connection_hdl, msg);
-                }
-            } else {
-                process_control_frame(msg);
-            }
-        }
     }
 
+    m_read_busy = false;
     read_frame();
 }
 
-/// Issue a new transport read unless reading is paused.
+/// Issue a new transport read unless reading is paused or already under way.
 template <typename config>
 void connection<config>::read_frame() {
-    if (!m_read_flag) {
+    if (!m_read_flag || m_read_delayed || m_read_busy) {
         return;
     }
-    
+
+    size_t len = config::connection_read_buffer_size;
+
+    if (m_tenant) {
+        tenant::token_bucket::time_point now =
+            tenant::token_bucket::clock_type::now();
+        long delay = m_tenant->inbound_delay(now);
+
+        if (delay > 0) {
+            m_read_delay_timer = transport_con_type::set_timer(
+                delay,
+                lib::bind(
+                    &type::handle_read_delay,
+                    type::get_shared(),
+                    lib::placeholders::_1
+                )
+            );
+
+            // transports without timers are not rate limited
+            if (m_read_delay_timer) {
+                m_read_delayed = true;
+                return;
+            }
+        } else {
+            // don't read much more than the rate allows in one go
+            uint64_t allowance = m_tenant->inbound_allowance(now);
+            if (allowance < len) {
+                len = allowance > 0 ? static_cast<size_t>(allowance) : 1;
+            }
+        }
+    }
+
+    m_read_busy = true;
     transport_con_type::async_read_at_least(
         // std::min wont work with undefined static const values.
         // TODO: is there a more elegant way to do this?
@@ -1122,7 +1559,7 @@ void connection<config>::read_frame() {
          config::connection_read_buffer_size : m_processor->get_bytes_needed())*/
         1,
         m_buf,
-        config::connection_read_buffer_size,
+        len,
         m_handle_read_frame
     );
 }
@@ -1217,20 +1654,30 @@ lib::error_code connection<config>::process_handshake_request() {
     // Read extension parameters and set up values necessary for the end user
     // to complete extension negotiation.
     std::pair<lib::error_code,std::string> neg_results;
+    apply_deflate_policy();
     neg_results = m_processor->negotiate_extensions(m_request);
 
     if (neg_results.first == processor::error::make_error_code(processor::error::extension_parse_error)) {
         // There was a fatal error in extension parsing that should result in
         // a failed connection attempt.
-        m_elog->write(log::elevel::info, "Bad request: " + neg_results.first.message());
+        if (log::test(*m_elog, log::elevel::info, "Bad request")) {
+            m_elog->write(log::elevel::info,
+                "Bad request: " + neg_results.first.message());
+        }
         m_response.set_status(http::status_code::bad_request);
+        release_deflate();
         return neg_results.first;
     } else if (neg_results.first) {
         // There was a fatal error in extension processing that is probably our
         // fault. Consider extension negotiation to have failed and continue as
         // if extensions were not supported
-        m_elog->write(log::elevel::info, 
-            "Extension negotiation failed: " + neg_results.first.message());
+        if (log::test(*m_elog, log::elevel::info, "Extension negotiation failed",
+            neg_results.first.value(), neg_results.first.category().name()))
+        {
+            m_elog->write(log::elevel::info, "Extension negotiation failed: "
+                + neg_results.first.message());
+        }
+        release_deflate();
     } else {
         // extension negotiation succeeded, set response header accordingly
         // we don't send an empty extensions header because it breaks many
@@ -1239,6 +1686,7 @@ lib::error_code connection<config>::process_handshake_request() {
             m_response.replace_header("Sec-WebSocket-Extensions",
                 neg_results.second);
         }
+        charge_deflate();
     }
 
     // extract URI from request
@@ -1260,7 +1708,9 @@ lib::error_code connection<config>::process_handshake_request() {
     }
 
     // Ask application to validate the connection
-    if (!m_validate_handler || m_validate_handler(m_connection_hdl)) {
+    bool valid = !m_validate_handler || m_validate_handler(m_connection_hdl);
+
+    if (valid && !m_tenant_rejected) {
         m_response.set_status(http::status_code::switching_protocols);
 
         // Write the appropriate response headers based on request and
@@ -1279,6 +1729,13 @@ lib::error_code connection<config>::process_handshake_request() {
         // User application has rejected the handshake
         m_alog->write(log::alevel::devel, "USER REJECT");
 
+        if (m_tenant_rejected &&
+            m_response.get_status_code() == http::status_code::uninitialized)
+        {
+            // the tenant of the connection had no room left
+            m_response.set_status(http::status_code::service_unavailable);
+        }
+
         // Use Bad Request if the user handler did not provide a more
         // specific http response error code.
         // TODO: is there a better default?
@@ -1389,6 +1846,9 @@ void connection<config>::handle_write_http_response(lib::error_code const & ec)
         m_handshake_timer->cancel();
         m_handshake_timer.reset();
     }
+    if (m_idle_slot != idle::table::no_slot) {
+        m_idle_table->set_inactive(m_idle_slot);
+    }
 
     if (m_response.get_status_code() != http::status_code::switching_protocols)
     {
@@ -1397,10 +1857,15 @@ void connection<config>::handle_write_http_response(lib::error_code const & ec)
             || m_ec == error::upgrade_required)
         {*/
         if (!m_is_http) {
-            std::stringstream s;
-            s << "Handshake ended with HTTP error: "
-              << m_response.get_status_code();
-            m_elog->write(log::elevel::rerror,s.str());
+            if (log::test(*m_elog, log::elevel::rerror,
+                "Handshake ended with HTTP error",
+                m_response.get_status_code()))
+            {
+                std::stringstream s;
+                s << "Handshake ended with HTTP error: "
+                  << m_response.get_status_code();
+                m_elog->write(log::elevel::rerror,s.str());
+            }
         } else {
             // if this was not a websocket connection, we have written
             // the expected response and the connection can be closed.
@@ -1423,6 +1888,17 @@ void connection<config>::handle_write_http_response(lib::error_code const & ec)
     m_internal_state = istate::PROCESS_CONNECTION;
     m_state = session::state::open;
 
+    _WEBSOCKETPP_PROBE2_(handshake_complete, static_cast<void *>(this),
+        static_cast<int>(is_server()));
+
+    if (m_counters) {
+        metrics::counter_add(m_counters->connections_opened, 1);
+    }
+
+    if (m_idle_slot != idle::table::no_slot) {
+        m_idle_table->set_open(m_idle_slot);
+    }
+
     if (m_open_handler) {
         m_open_handler(m_connection_hdl);
     }
@@ -1468,14 +1944,19 @@ void connection<config>::send_http_request() {
     }
 
     if (m_open_handshake_timeout_dur > 0) {
-        m_handshake_timer = transport_con_type::set_timer(
-            m_open_handshake_timeout_dur,
-            lib::bind(
-                &type::handle_open_handshake_timeout,
-                type::get_shared(),
-                lib::placeholders::_1
-            )
-        );
+        if (m_idle_slot != idle::table::no_slot) {
+            m_idle_table->set_deadline(m_idle_slot, idle::state::handshake,
+                static_cast<uint32_t>(m_open_handshake_timeout_dur));
+        } else {
+            m_handshake_timer = transport_con_type::set_timer(
+                m_open_handshake_timeout_dur,
+                lib::bind(
+                    &type::handle_open_handshake_timeout,
+                    type::get_shared(),
+                    lib::placeholders::_1
+                )
+            );
+        }
     }
 
     transport_con_type::async_write(
@@ -1600,6 +2081,9 @@ void connection<config>::handle_read_http_response(lib::error_code const & ec,
             m_handshake_timer->cancel();
             m_handshake_timer.reset();
         }
+        if (m_idle_slot != idle::table::no_slot) {
+            m_idle_table->set_inactive(m_idle_slot);
+        }
 
         lib::error_code validate_ec = m_processor->validate_server_handshake_response(
             m_request,
@@ -1628,14 +2112,27 @@ void connection<config>::handle_read_http_response(lib::error_code const & ec,
                 + neg_results.first.message());
             this->terminate(make_error_code(error::extension_neg_failed));
             // TODO: close connection with reason 1010 (and list extensions)
+        } else {
+            charge_deflate();
         }
 
         // response is valid, connection can now be assumed to be open      
         m_internal_state = istate::PROCESS_CONNECTION;
         m_state = session::state::open;
 
+        _WEBSOCKETPP_PROBE2_(handshake_complete, static_cast<void *>(this),
+            static_cast<int>(is_server()));
+
         this->log_open_result();
 
+        if (m_counters) {
+            metrics::counter_add(m_counters->connections_opened, 1);
+        }
+
+        if (m_idle_slot != idle::table::no_slot) {
+            m_idle_table->set_open(m_idle_slot);
+        }
+
         if (m_open_handler) {
             m_open_handler(m_connection_hdl);
         }
@@ -1674,6 +2171,8 @@ void connection<config>::handle_open_handshake_timeout(
         // TODO: ignore or fail here?
     } else {
         m_alog->write(log::alevel::devel,"open handshake timer expired");
+        _WEBSOCKETPP_PROBE2_(timer_fired, static_cast<void *>(this),
+            static_cast<int>(metrics::probe_timer::open_handshake));
         terminate(make_error_code(error::open_handshake_timeout));
     }
 }
@@ -1690,10 +2189,97 @@ void connection<config>::handle_close_handshake_timeout(
         // TODO: ignore or fail here?
     } else {
         m_alog->write(log::alevel::devel, "asio close handshake timer expired");
+        _WEBSOCKETPP_PROBE2_(timer_fired, static_cast<void *>(this),
+            static_cast<int>(metrics::probe_timer::close_handshake));
         terminate(make_error_code(error::close_handshake_timeout));
     }
 }
 
+template <typename config>
+void connection<config>::handle_idle_update(idle::state::value s, uint32_t ms)
+{
+    if (m_idle_slot == idle::table::no_slot) {
+        return;
+    }
+
+    switch (s) {
+        case idle::state::free:
+            m_idle_table->remove(m_idle_slot);
+            m_idle_slot = idle::table::no_slot;
+            break;
+        case idle::state::handshake:
+        case idle::state::closing:
+            m_idle_table->set_deadline(m_idle_slot, s, ms);
+            break;
+        default:
+            m_idle_table->set_inactive(m_idle_slot);
+            break;
+    }
+}
+
+template <typename config>
+lib::error_code connection<config>::idle_action(idle::action::value action) {
+    return transport_con_type::dispatch(lib::bind(
+        &type::handle_idle_action,
+        type::get_shared(),
+        action
+    ));
+}
+
+template <typename config>
+void connection<config>::handle_idle_action(idle::action::value action) {
+    switch (action) {
+        case idle::action::handshake_timeout:
+            handle_open_handshake_timeout(lib::error_code());
+            break;
+        case idle::action::close_timeout:
+            handle_close_handshake_timeout(lib::error_code());
+            break;
+        case idle::action::keepalive_timeout:
+            m_alog->write(log::alevel::devel,"keepalive ping not answered");
+            terminate(make_error_code(error::keepalive_timeout));
+            break;
+        case idle::action::idle_close: {
+            lib::error_code ec;
+            close(close::status::going_away, "Idle timeout", ec);
+            if (ec) {
+                terminate(ec);
+            }
+            break;
+        }
+        case idle::action::ping: {
+            // Unlike ping() this does not start a pong timer, the sweep
+            // times the answer
+            {
+                scoped_lock_type lock(m_connection_state_lock);
+                if (m_state != session::state::open) {
+                    return;
+                }
+            }
+
+            message_ptr msg = m_msg_manager->get_message();
+            if (!msg || m_processor->prepare_ping(std::string(), msg)) {
+                return;
+            }
+
+            bool needs_writing = false;
+            {
+                scoped_lock_type lock(m_write_lock);
+                write_push(msg);
+                needs_writing = !m_write_flag && !m_send_queue.empty();
+            }
+
+            if (needs_writing) {
+                transport_con_type::dispatch(lib::bind(
+                    &type::write_frame,
+                    type::get_shared()
+                ));
+            }
+            break;
+        }
+    }
+}
+
 template <typename config>
 void connection<config>::terminate(lib::error_code const & ec) {
     if (m_alog->static_test(log::alevel::devel)) {
@@ -1735,8 +2321,58 @@ void connection<config>::terminate(lib::error_code const & ec) {
         return;
     }
 
+    // give the tenant its connection slot back as soon as possible
+    release_tenant();
+    release_deflate();
+
+    if (m_idle_table) {
+        transport_con_type::dispatch(lib::bind(
+            &type::handle_idle_update,
+            type::get_shared(),
+            idle::state::free,
+            0
+        ));
+    }
+
+    if (m_counters) {
+        // whatever is still queued will never be written
+        scoped_lock_type lock(m_write_lock);
+        metrics::counter_sub(m_counters->queued_bytes, m_counted_queued);
+        m_counted_queued = 0;
+        m_queue_released = true;
+    }
+
+    if (m_read_delay_timer) {
+        m_read_delay_timer->cancel();
+    }
+
+    {
+        // write_frame sets the write delay timer while holding m_write_lock
+        scoped_lock_type lock(m_write_lock);
+        if (m_write_delay_timer) {
+            m_write_delay_timer->cancel();
+        }
+    }
+
     // TODO: choose between shutdown and close based on error code sent
 
+    if (m_fast_close) {
+        // release queued messages now rather than with the connection
+        std::vector<message_ptr> dropped;
+        discard_send_queue(dropped);
+        write_expired(dropped);
+
+        abort_transport(
+            lib::bind(
+                &type::handle_terminate,
+                type::get_shared(),
+                tstat,
+                lib::placeholders::_1
+            )
+        );
+        return;
+    }
+
     transport_con_type::async_shutdown(
         lib::bind(
             &type::handle_terminate,
@@ -1747,6 +2383,27 @@ void connection<config>::terminate(lib::error_code const & ec) {
     );
 }
 
+template <typename config>
+void connection<config>::abort_transport(transport::shutdown_handler handler)
+{
+    abort_transport(handler, abort_support<
+        transport::has_async_abort<transport_con_type>::value>());
+}
+
+template <typename config>
+void connection<config>::abort_transport(transport::shutdown_handler handler,
+    abort_support<true>)
+{
+    transport_con_type::async_abort(handler);
+}
+
+template <typename config>
+void connection<config>::abort_transport(transport::shutdown_handler handler,
+    abort_support<false>)
+{
+    transport_con_type::async_shutdown(handler);
+}
+
 template <typename config>
 void connection<config>::handle_terminate(terminate_status tstat,
     lib::error_code const & ec)
@@ -1763,11 +2420,19 @@ void connection<config>::handle_terminate(terminate_status tstat,
     // clean shutdown
     if (tstat == failed) {
         if (m_ec != error::http_connection_ended) {
+            if (m_counters) {
+                metrics::counter_add(m_counters->connections_failed, 1);
+            }
             if (m_fail_handler) {
                 m_fail_handler(m_connection_hdl);
             }
+        } else if (m_counters) {
+            metrics::counter_add(m_counters->http_requests, 1);
         }
     } else if (tstat == closed) {
+        if (m_counters) {
+            metrics::counter_add(m_counters->connections_closed, 1);
+        }
         if (m_close_handler) {
             m_close_handler(m_connection_hdl);
         }
@@ -1776,6 +2441,14 @@ void connection<config>::handle_terminate(terminate_status tstat,
         m_elog->write(log::elevel::rerror,"Unknown terminate_status");
     }
 
+    _WEBSOCKETPP_PROBE3_(close, static_cast<void *>(this),
+        static_cast<int>(m_local_close_code),
+        static_cast<int>(m_remote_close_code));
+
+    if (config::enable_resource_accounting && m_heavy_hitters) {
+        m_heavy_hitters->remove(m_connection_hdl);
+    }
+
     // call the termination handler if it exists
     // if it exists it might (but shouldn't) refer to a bad memory location.
     // If it does, we don't care and should catch and ignore it.
@@ -1792,6 +2465,13 @@ void connection<config>::handle_terminate(terminate_status tstat,
 template <typename config>
 void connection<config>::write_frame() {
     //m_alog->write(log::alevel::devel,"connection write_frame");
+    _WEBSOCKETPP_PROFILE_STAGE_(write_batch);
+
+    std::vector<message_ptr> expired_msgs;
+    lib::error_code prepare_ec;
+
+    // fragments claimed under m_write_lock and prepared after releasing it
+    std::vector<claimed_fragment> fragments;
 
     {
         scoped_lock_type lock(m_write_lock);
@@ -1804,20 +2484,152 @@ void connection<config>::write_frame() {
             return;
         }
 
+        uint64_t tenant_allowance = 0;
+
+        if (m_tenant) {
+            tenant::token_bucket::time_point now =
+                tenant::token_bucket::clock_type::now();
+            long delay = m_tenant->outbound_delay(now);
+
+            if (delay > 0) {
+                m_write_delay_timer = transport_con_type::set_timer(
+                    delay,
+                    lib::bind(
+                        &type::handle_write_delay,
+                        type::get_shared(),
+                        lib::placeholders::_1
+                    )
+                );
+
+                // Hold the write flag until the timer expires. Transports
+                // without timers are not rate limited.
+                if (m_write_delay_timer) {
+                    m_write_flag = true;
+                    return;
+                }
+            }
+
+            tenant_allowance = m_tenant->outbound_allowance(now);
+        }
+
         // pull off all the messages that are ready to write.
-        // stop if we get a message marked terminal
-        message_ptr next_message = write_pop();
+        // stop if we get a message marked terminal or the write quantum for
+        // this turn is used up
+        bool now_valid = false;
+        typename message_type::time_point now;
+
+        size_t allowance = m_write_deficit +
+            config::write_quantum * m_tenant_weight;
+        size_t gathered = 0;
+
+        message_ptr next_message = write_next();
         while (next_message) {
+            bool split = false;
+
+            // once the start of a fragmented message is dropped the rest of
+            // it must be dropped too, whether or not it has a deadline
+            if (next_message->has_deadline() || m_drop_fragments) {
+                if (!now_valid) {
+                    now = message_type::clock_type::now();
+                    now_valid = true;
+                }
+                if (write_expire(next_message, now)) {
+                    if (!next_message->get_prepared()) {
+                        m_deferred_messages--;
+                    }
+                    expired_msgs.push_back(next_message);
+                    next_message = write_next();
+                    continue;
+                }
+            }
+
+            if (!next_message->get_prepared()) {
+                // deferred data message, prepare its next fragment or pack it
+                // with the small messages behind it
+                if (next_message != m_fragment_source && fragments.empty() &&
+                    m_processor->message_batching_enabled() &&
+                    next_message->get_fin() &&
+                    next_message->get_payload().size() <=
+                    message_batching_type::max_message_size)
+                {
+                    next_message = write_batch(next_message, prepare_ec);
+                    if (prepare_ec) {
+                        break;
+                    }
+                    split = true;
+                } else {
+                    // Masking and compressing a fragment is the expensive
+                    // part of a write. It is done after releasing
+                    // m_write_lock so that send() and the transport are not
+                    // held up by it. Batches are still packed under the lock,
+                    // so none may follow a claimed fragment.
+                    claimed_fragment f;
+                    next_message = claim_fragment(next_message, f);
+                    if (!next_message) {
+                        prepare_ec = error::make_error_code(
+                            error::no_outgoing_buffers);
+                        break;
+                    }
+                    fragments.push_back(f);
+                    gathered += f.len;
+                    split = true;
+                }
+            }
+
+            if (!frame::opcode::is_control(next_message->get_opcode())) {
+                m_fragment_in_progress = !next_message->get_fin();
+            }
+
             m_current_msgs.push_back(next_message);
-            if (!next_message->get_terminal()) {
-                next_message = write_pop();
-            } else {
+            gathered += next_message->get_header().size() +
+                next_message->get_payload().size();
+
+            if (next_message->get_terminal()) {
+                next_message = message_ptr();
+            } else if (split && m_fragment_source) {
+                // one fragment per write lets control frames queued in the
+                // meantime go out before the next one
                 next_message = message_ptr();
+            } else if (config::write_quantum_messages > 0 &&
+                m_current_msgs.size() >=
+                config::write_quantum_messages * m_tenant_weight)
+            {
+                next_message = message_ptr();
+            } else if (config::write_quantum > 0 && !m_send_queue.empty() &&
+                gathered + m_send_queue.front()->get_header().size() +
+                m_send_queue.front()->get_payload().size() > allowance)
+            {
+                next_message = message_ptr();
+            } else if (m_tenant && !m_send_queue.empty() &&
+                gathered + m_send_queue.front()->get_header().size() +
+                m_send_queue.front()->get_payload().size() > tenant_allowance)
+            {
+                // the rest waits for the tenant's outbound rate
+                next_message = message_ptr();
+            } else {
+                next_message = write_next();
             }
         }
-        
-        if (m_current_msgs.empty()) {
+
+        if (config::write_quantum > 0) {
+            // carry unused quantum over only while there is a backlog
+            if ((m_send_queue.empty() && !m_fragment_source) ||
+                gathered >= allowance)
+            {
+                m_write_deficit = 0;
+            } else {
+                m_write_deficit = allowance - gathered;
+            }
+        }
+
+        sync_send_queue();
+
+        if (prepare_ec) {
+            // a partially written message can not be finished
+            m_current_msgs.clear();
+        } else if (m_current_msgs.empty()) {
             // there was nothing to send
+            write_expired(expired_msgs);
             return;
         } else {
             // At this point we own the next messages to be sent and are
@@ -1827,6 +2639,30 @@ void connection<config>::write_frame() {
         }
     }
 
+    write_expired(expired_msgs);
+
+    if (!fragments.empty()) {
+        // the claimed fragments are already in m_current_msgs, which this
+        // write owns while it holds the write flag
+        typename std::vector<claimed_fragment>::const_iterator f;
+        for (f = fragments.begin(); f != fragments.end() && !prepare_ec; ++f) {
+            prepare_ec = prepare_fragment(*f);
+        }
+
+        scoped_lock_type lock(m_write_lock);
+        m_preparing_fragment = false;
+        if (prepare_ec) {
+            m_current_msgs.clear();
+            m_write_flag = false;
+        }
+    }
+
+    if (prepare_ec) {
+        log_err(log::elevel::fatal,"write_frame",prepare_ec);
+        this->terminate(prepare_ec);
+        return;
+    }
+
     typename std::vector<message_ptr>::iterator it;
     for (it = m_current_msgs.begin(); it != m_current_msgs.end(); ++it) {
         std::string const & header = (*it)->get_header();
@@ -1836,6 +2672,10 @@ void connection<config>::write_frame() {
         m_send_buffer.push_back(transport::buffer(payload.c_str(),payload.size()));   
     }
 
+    _WEBSOCKETPP_PROBE3_(write_issued, static_cast<void *>(this),
+        static_cast<uint64_t>(send_buffer_bytes()),
+        static_cast<uint64_t>(m_current_msgs.size()));
+
     // Print detailed send stats if those log levels are enabled
     if (m_alog->static_test(log::alevel::frame_header)) {
     if (m_alog->dynamic_test(log::alevel::frame_header)) {
@@ -1888,16 +2728,61 @@ void connection<config>::write_frame() {
 template <typename config>
 void connection<config>::handle_write_frame(lib::error_code const & ec)
 {
+    _WEBSOCKETPP_PROFILE_STAGE_(write_completion);
+
     if (m_alog->static_test(log::alevel::devel)) {
         m_alog->write(log::alevel::devel,"connection handle_write_frame");
     }
 
     bool terminal = m_current_msgs.back()->get_terminal();
 
+    _WEBSOCKETPP_PROBE4_(write_completed, static_cast<void *>(this),
+        static_cast<uint64_t>(send_buffer_bytes()),
+        static_cast<uint64_t>(m_current_msgs.size()), ec.value());
+
+    if (m_idle_slot != idle::table::no_slot && !ec) {
+        m_idle_table->touch_write(m_idle_slot);
+    }
+
+    if ((config::enable_resource_accounting || m_counters) && !ec) {
+        uint64_t bytes = send_buffer_bytes();
+        uint64_t messages = 0;
+
+        typename std::vector<message_ptr>::const_iterator m;
+        for (m = m_current_msgs.begin(); m != m_current_msgs.end(); ++m) {
+            if (!frame::opcode::is_control((*m)->get_opcode())) {
+                messages++;
+            }
+        }
+
+        if (m_counters) {
+            metrics::counter_add(m_counters->bytes_out, bytes);
+            metrics::counter_add(m_counters->messages_out, messages);
+        }
+
+        if (config::enable_resource_accounting) {
+            scoped_lock_type lock(m_stats_lock);
+            m_stats.bytes_out += bytes;
+            m_stats.messages_out += messages;
+        }
+    }
+
+    if (m_tenant && !ec) {
+        m_tenant->consume_outbound(send_buffer_bytes(),
+            tenant::token_bucket::clock_type::now());
+    }
+
     m_send_buffer.clear();
     m_current_msgs.clear();
     // TODO: recycle instead of deleting
 
+    if (ec && m_fast_close && m_state == session::state::closed) {
+        // write cut short when the transport was aborted
+        m_alog->write(log::alevel::devel,
+            "handle_write_frame: write ended by fast close");
+        return;
+    }
+
     if (ec) {
         log_err(log::elevel::fatal,"handle_write_frame",ec);
         this->terminate(ec);
@@ -1916,7 +2801,7 @@ void connection<config>::handle_write_frame(lib::error_code const & ec)
         // release write flag
         m_write_flag = false;
 
-        needs_writing = !m_send_queue.empty();
+        needs_writing = !m_send_queue.empty() || m_fragment_source;
     }
 
     if (needs_writing) {
@@ -2040,7 +2925,7 @@ void connection<config>::process_control_frame(typename config::message_type::pt
             //
             // TODO: different behavior if the underlying transport doesn't
             // support timers?
-            if (m_is_server) {
+            if (is_server()) {
                 terminate(lib::error_code());
             }
         } else {
@@ -2058,12 +2943,13 @@ template <typename config>
 lib::error_code connection<config>::send_close_ack(close::status::value code,
     std::string const & reason)
 {
-    return send_close_frame(code,reason,true,m_is_server);
+    return send_close_frame(code,reason,true,is_server());
 }
 
 template <typename config>
 lib::error_code connection<config>::send_close_frame(close::status::value code,
-    std::string const & reason, bool ack, bool terminal)
+    std::string const & reason, bool ack, bool terminal,
+    std::vector<message_ptr> * dropped)
 {
     m_alog->write(log::alevel::devel,"send_close_frame");
 
@@ -2121,6 +3007,10 @@ lib::error_code connection<config>::send_close_frame(close::status::value code,
         msg->set_terminal(true);
     }
 
+    if (dropped) {
+        discard_send_queue(*dropped);
+    }
+
     m_state = session::state::closing;
 
     if (ack) {
@@ -2130,14 +3020,30 @@ lib::error_code connection<config>::send_close_frame(close::status::value code,
     // Start a timer so we don't wait forever for the acknowledgement close
     // frame
     if (m_close_handshake_timeout_dur > 0) {
-        m_handshake_timer = transport_con_type::set_timer(
-            m_close_handshake_timeout_dur,
-            lib::bind(
-                &type::handle_close_handshake_timeout,
+        if (m_idle_table) {
+            transport_con_type::dispatch(lib::bind(
+                &type::handle_idle_update,
                 type::get_shared(),
-                lib::placeholders::_1
-            )
-        );
+                idle::state::closing,
+                static_cast<uint32_t>(m_close_handshake_timeout_dur)
+            ));
+        } else {
+            m_handshake_timer = transport_con_type::set_timer(
+                m_close_handshake_timeout_dur,
+                lib::bind(
+                    &type::handle_close_handshake_timeout,
+                    type::get_shared(),
+                    lib::placeholders::_1
+                )
+            );
+        }
+    } else if (m_idle_table) {
+        transport_con_type::dispatch(lib::bind(
+            &type::handle_idle_update,
+            type::get_shared(),
+            idle::state::inactive,
+            0
+        ));
     }
 
     bool needs_writing = false;
@@ -2168,14 +3074,14 @@ connection<config>::get_processor(int version) const {
         case 0:
             p = lib::make_shared<processor::hybi00<config> >(
                 transport_con_type::is_secure(),
-                m_is_server,
+                is_server(),
                 m_msg_manager
             );
             break;
         case 7:
             p = lib::make_shared<processor::hybi07<config> >(
                 transport_con_type::is_secure(),
-                m_is_server,
+                is_server(),
                 m_msg_manager,
                 lib::ref(m_rng)
             );
@@ -2183,7 +3089,7 @@ connection<config>::get_processor(int version) const {
         case 8:
             p = lib::make_shared<processor::hybi08<config> >(
                 transport_con_type::is_secure(),
-                m_is_server,
+                is_server(),
                 m_msg_manager,
                 lib::ref(m_rng)
             );
@@ -2191,7 +3097,7 @@ connection<config>::get_processor(int version) const {
         case 13:
             p = lib::make_shared<processor::hybi13<config> >(
                 transport_con_type::is_secure(),
-                m_is_server,
+                is_server(),
                 m_msg_manager,
                 lib::ref(m_rng)
             );
@@ -2206,6 +3112,107 @@ connection<config>::get_processor(int version) const {
     return p;
 }
 
+template <typename config>
+bool connection<config>::write_expire(message_ptr msg,
+    typename message_type::time_point const & now)
+{
+    if (frame::opcode::is_control(msg->get_opcode())) {
+        return false;
+    }
+
+    bool drop;
+    if (m_drop_fragments) {
+        // the start of this message was already dropped. The rest of it must
+        // follow regardless of its own deadline.
+        drop = true;
+    } else if (m_fragment_in_progress) {
+        // part of this message is already on the wire. Dropping the rest would
+        // truncate it.
+        drop = false;
+    } else if (msg->get_header().size() > 0 &&
+        frame::get_rsv1(frame::basic_header(msg->get_header()[0],0)))
+    {
+        // compressed frames may be referenced by the compression context of
+        // frames that follow. Dropping one would corrupt the stream.
+        drop = false;
+    } else {
+        drop = msg->expired(now);
+    }
+
+    if (!drop) {
+        return false;
+    }
+
+    m_drop_fragments = !msg->get_fin();
+    m_expired_message_count++;
+    return true;
+}
+
+template <typename config>
+void connection<config>::write_expired(std::vector<message_ptr> const & msgs)
+{
+    if (msgs.empty()) {
+        return;
+    }
+
+    if (m_alog->static_test(log::alevel::devel)) {
+        std::stringstream s;
+        s << "write_frame dropped " << msgs.size() << " expired message(s)";
+        m_alog->write(log::alevel::devel,s.str());
+    }
+
+    if (!m_message_expired_handler) {
+        return;
+    }
+
+    typename std::vector<message_ptr>::const_iterator it;
+    for (it = msgs.begin(); it != msgs.end(); ++it) {
+        message_ptr source = (*it)->get_source();
+        m_message_expired_handler(m_connection_hdl, source ? source : *it);
+    }
+}
+
+template <typename config>
+size_t connection<config>::send_buffer_bytes() const {
+    size_t bytes = 0;
+
+    std::vector<transport::buffer>::const_iterator it;
+    for (it = m_send_buffer.begin(); it != m_send_buffer.end(); ++it) {
+        bytes += it->len;
+    }
+
+    return bytes;
+}
+
+template <typename config>
+void connection<config>::account_cycles(
+    uint64_t metrics::connection_stats::* stage, uint64_t start, bool compressed)
+{
+    uint64_t elapsed = metrics::cycles() - start;
+    uint64_t report = 0;
+
+    {
+        scoped_lock_type lock(m_stats_lock);
+
+        m_stats.*stage += elapsed;
+        if (compressed) {
+            m_stats.compress_cycles += elapsed;
+        }
+
+        // Batch reports to the endpoint wide list so that connections on
+        // different threads rarely contend for its lock.
+        m_unreported_cycles += elapsed;
+        if (m_unreported_cycles >= config::heavy_hitter_report_cycles) {
+            report = m_unreported_cycles;
+            m_unreported_cycles = 0;
+        }
+    }
+
+    if (report && m_heavy_hitters) {
+        m_heavy_hitters->report(m_connection_hdl, report);
+    }
+}
+
 template <typename config>
 void connection<config>::write_push(typename config::message_type::ptr msg)
 {
@@ -2214,7 +3221,12 @@ void connection<config>::write_push(typename config::message_type::ptr msg)
     }
 
     m_send_buffer_size += msg->get_payload().size();
-    m_send_queue.push(msg);
+    m_send_queue.push_back(msg);
+    sync_send_queue();
+
+    _WEBSOCKETPP_PROBE3_(send_enqueued, static_cast<void *>(this),
+        static_cast<uint64_t>(m_send_queue.size()),
+        static_cast<uint64_t>(m_send_buffer_size));
 
     if (m_alog->static_test(log::alevel::devel)) {
         std::stringstream s;
@@ -2236,7 +3248,7 @@ typename config::message_type::ptr connection<config>::write_pop()
     msg = m_send_queue.front();
 
     m_send_buffer_size -= msg->get_payload().size();
-    m_send_queue.pop();
+    m_send_queue.pop_front();
 
     if (m_alog->static_test(log::alevel::devel)) {
         std::stringstream s;
@@ -2247,6 +3259,432 @@ typename config::message_type::ptr connection<config>::write_pop()
     return msg;
 }
 
+template <typename config>
+typename config::message_type::ptr connection<config>::write_next()
+{
+    if (!m_fragment_source) {
+        return write_pop();
+    }
+
+    // Control frames may go out between the fragments of the message being
+    // split. A close frame ends that message early, so it may only skip ahead
+    // of the rest of it and not of other queued messages.
+    typename std::deque<message_ptr>::iterator it;
+    for (it = m_send_queue.begin(); it != m_send_queue.end(); ++it) {
+        frame::opcode::value op = (*it)->get_opcode();
+
+        if (op == frame::opcode::close) {
+            if (it != m_send_queue.begin()) {
+                break;
+            }
+        } else if (!frame::opcode::is_control(op)) {
+            continue;
+        }
+
+        message_ptr msg = *it;
+        m_send_queue.erase(it);
+        m_send_buffer_size -= msg->get_payload().size();
+
+        if (op == frame::opcode::close) {
+            // no data frames may follow a close frame
+            m_send_buffer_size -= m_fragment_source->get_payload().size() -
+                m_fragment_offset;
+            m_fragment_source.reset();
+            m_fragment_offset = 0;
+            m_deferred_messages--;
+        }
+
+        return msg;
+    }
+
+    return m_fragment_source;
+}
+
+template <typename config>
+typename config::message_type::ptr connection<config>::write_fragment(
+    message_ptr msg, lib::error_code & ec)
+{
+    claimed_fragment f;
+    message_ptr out = claim_fragment(msg, f);
+    if (!out) {
+        ec = error::make_error_code(error::no_outgoing_buffers);
+        return out;
+    }
+
+    ec = prepare_fragment(f);
+    m_preparing_fragment = false;
+    if (ec) {
+        return message_ptr();
+    }
+
+    return out;
+}
+
+template <typename config>
+typename config::message_type::ptr connection<config>::claim_fragment(
+    message_ptr msg, claimed_fragment & f)
+{
+    message_ptr out = m_msg_manager->get_message();
+    if (!out) {
+        return out;
+    }
+
+    size_t size = msg->get_payload().size();
+
+    if (msg != m_fragment_source) {
+        // write_pop already removed this message from the buffered amount,
+        // count it again until its fragments are written
+        m_fragment_source = msg;
+        m_fragment_offset = 0;
+        m_send_buffer_size += size;
+    }
+
+    size_t len = size - m_fragment_offset;
+    if (m_max_outbound_frame_size > 0 && len > m_max_outbound_frame_size) {
+        len = m_max_outbound_frame_size;
+    }
+
+    f.source = msg;
+    f.offset = m_fragment_offset;
+    f.len = len;
+    f.out = out;
+
+    m_fragment_offset += len;
+    m_send_buffer_size -= len;
+    m_preparing_fragment = true;
+
+    out->set_opcode(msg->get_opcode());
+    out->set_fin(msg->get_fin() && m_fragment_offset == size);
+
+    if (m_fragment_offset == size) {
+        m_fragment_source.reset();
+        m_fragment_offset = 0;
+        m_deferred_messages--;
+    }
+
+    return out;
+}
+
+template <typename config>
+lib::error_code connection<config>::prepare_fragment(
+    claimed_fragment const & f)
+{
+    uint64_t start = 0;
+    if (config::enable_resource_accounting) {
+        start = metrics::cycles();
+    }
+
+    lib::error_code ec = m_processor->prepare_data_fragment(f.source,
+        f.offset, f.len, f.out);
+    if (ec) {
+        return ec;
+    }
+
+    if (config::enable_resource_accounting) {
+        std::string const & h = f.out->get_header();
+        account_cycles(&metrics::connection_stats::prepare_cycles, start,
+            !h.empty() && frame::get_rsv1(frame::basic_header(h[0],0)));
+    }
+
+    return ec;
+}
+
+template <typename config>
+typename config::message_type::ptr connection<config>::write_batch(
+    message_ptr msg, lib::error_code & ec)
+{
+    std::vector<message_ptr> batch(1,msg);
+    size_t total = msg->get_payload().size();
+
+    while (!m_send_queue.empty()) {
+        message_ptr next = m_send_queue.front();
+        size_t size = next->get_payload().size();
+
+        // messages with deadlines are left alone so they still expire
+        if (next->get_prepared() || !next->get_fin() ||
+            next->get_opcode() != msg->get_opcode() ||
+            next->has_deadline() ||
+            size > message_batching_type::max_message_size ||
+            total + size > message_batching_type::max_batch_size)
+        {
+            break;
+        }
+
+        write_pop();
+        batch.push_back(next);
+        total += size;
+    }
+
+    if (batch.size() == 1) {
+        return write_fragment(msg, ec);
+    }
+
+    message_ptr out = m_msg_manager->get_message();
+    if (!out) {
+        ec = error::make_error_code(error::no_outgoing_buffers);
+        return out;
+    }
+
+    uint64_t start = 0;
+    if (config::enable_resource_accounting) {
+        start = metrics::cycles();
+    }
+
+    ec = m_processor->prepare_batch(batch,out);
+    if (ec) {
+        return message_ptr();
+    }
+
+    if (config::enable_resource_accounting) {
+        std::string const & h = out->get_header();
+        account_cycles(&metrics::connection_stats::prepare_cycles, start,
+            !h.empty() && frame::get_rsv1(frame::basic_header(h[0],0)));
+    }
+
+    m_deferred_messages -= batch.size();
+
+    return out;
+}
+
+template <typename config>
+void connection<config>::discard_send_queue(std::vector<message_ptr> & dropped)
+{
+    scoped_lock_type lock(m_write_lock);
+
+    // the rest of a message whose first fragments are already out is lost too
+    if (m_fragment_source) {
+        dropped.push_back(m_fragment_source);
+    }
+
+    typename std::deque<message_ptr>::const_iterator it;
+    for (it = m_send_queue.begin(); it != m_send_queue.end(); ++it) {
+        if (!frame::opcode::is_control((*it)->get_opcode())) {
+            dropped.push_back(*it);
+        }
+    }
+
+    m_send_queue.clear();
+    m_send_buffer_size = 0;
+    m_fragment_source.reset();
+    m_fragment_offset = 0;
+    m_deferred_messages = 0;
+    sync_send_queue();
+}
+
+template <typename config>
+bool connection<config>::reserve_queued(size_t bytes)
+{
+    if (!m_tenant_admitted) {
+        return true;
+    }
+
+    if (!m_tenant->try_queue(bytes)) {
+        return false;
+    }
+
+    m_tenant_queued += bytes;
+    return true;
+}
+
+template <typename config>
+void connection<config>::sync_send_queue()
+{
+    if (m_counters && !m_queue_released &&
+        m_counted_queued != m_send_buffer_size)
+    {
+        metrics::counter_add(m_counters->queued_bytes, m_send_buffer_size);
+        metrics::counter_sub(m_counters->queued_bytes, m_counted_queued);
+        m_counted_queued = m_send_buffer_size;
+    }
+
+    if (!m_tenant_admitted || m_tenant_queued == m_send_buffer_size) {
+        return;
+    }
+
+    m_tenant->update_queued(m_tenant_queued, m_send_buffer_size);
+    m_tenant_queued = m_send_buffer_size;
+}
+
+template <typename config>
+void connection<config>::release_tenant()
+{
+    scoped_lock_type lock(m_write_lock);
+
+    if (!m_tenant_admitted) {
+        return;
+    }
+
+    m_tenant->update_queued(m_tenant_queued, 0);
+    m_tenant->release(m_tenant_deflate);
+    m_tenant_queued = 0;
+    m_tenant_admitted = false;
+}
+
+template <typename config>
+void connection<config>::apply_deflate_policy()
+{
+    if (!is_server()) {
+        return;
+    }
+
+    extensions::permessage_deflate::usage usage;
+    if (m_deflate_tracker) {
+        usage = m_deflate_tracker->get_usage();
+    }
+
+    // without a budget or handler the static settings are negotiated as is
+    if (usage.budget == 0 && !m_deflate_policy_handler) {
+        return;
+    }
+
+    // A client that does not offer client_max_window_bits compresses with a
+    // 15 bit window, so its decompressor here can not be made smaller. Any
+    // offer without it may be the one that is accepted.
+    bool offered = true;
+    http::parameter_list p;
+    if (!m_request.get_header_as_plist("Sec-WebSocket-Extensions", p)) {
+        http::parameter_list::const_iterator it;
+        for (it = p.begin(); it != p.end(); ++it) {
+            if (it->first == "permessage-deflate" &&
+                it->second.find("client_max_window_bits") == it->second.end())
+            {
+                offered = false;
+            }
+        }
+    }
+
+    // fit and reserve in one step so that concurrent handshakes do not all
+    // claim the same share of the budget
+    extensions::permessage_deflate::settings settings;
+    size_t reserved = 0;
+    if (m_deflate_tracker) {
+        reserved = m_deflate_tracker->reserve(settings, true, offered, usage);
+    } else {
+        settings = extensions::permessage_deflate::fit_budget(settings, usage,
+            true, offered);
+    }
+
+    if (m_deflate_policy_handler) {
+        m_deflate_policy_handler(m_connection_hdl, usage, settings);
+    }
+
+    if (m_deflate_tracker) {
+        extensions::permessage_deflate::settings estimated = settings;
+        if (!offered) {
+            estimated.client_max_window_bits = 15;
+        }
+        size_t memory = extensions::permessage_deflate::estimate_memory(
+            estimated, true);
+        m_deflate_tracker->adjust(reserved, memory);
+
+        scoped_lock_type lock(m_write_lock);
+        m_deflate_charged = memory;
+    }
+
+    lib::error_code ec = m_processor->set_permessage_compress_settings(
+        settings);
+    if (ec && ec != extensions::error::make_error_code(
+        extensions::error::disabled))
+    {
+        m_elog->write(log::elevel::info,
+            "Deflate policy settings rejected: " + ec.message());
+    }
+}
+
+template <typename config>
+void connection<config>::charge_deflate()
+{
+    if (!m_deflate_tracker) {
+        return;
+    }
+
+    // replace the reservation, if any, with the negotiated estimate
+    size_t memory = m_processor->permessage_compress_memory();
+
+    scoped_lock_type lock(m_write_lock);
+    m_deflate_tracker->adjust(m_deflate_charged, memory);
+    m_deflate_charged = memory;
+}
+
+template <typename config>
+void connection<config>::release_deflate()
+{
+    scoped_lock_type lock(m_write_lock);
+
+    if (m_deflate_charged == 0) {
+        return;
+    }
+
+    m_deflate_tracker->release(m_deflate_charged);
+    m_deflate_charged = 0;
+}
+
+template <typename config>
+void connection<config>::handle_read_delay(lib::error_code const & ec)
+{
+    m_read_delayed = false;
+
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"read delay timer cancelled");
+        return;
+    } else if (ec) {
+        log_err(log::elevel::devel,"handle_read_delay",ec);
+    }
+
+    if (m_internal_state != istate::PROCESS_CONNECTION) {
+        return;
+    }
+
+    read_frame();
+}
+
+template <typename config>
+void connection<config>::handle_write_delay(lib::error_code const & ec)
+{
+    if (ec == transport::error::operation_aborted) {
+        m_alog->write(log::alevel::devel,"write delay timer cancelled");
+        return;
+    } else if (ec) {
+        log_err(log::elevel::devel,"handle_write_delay",ec);
+    }
+
+    {
+        scoped_lock_type lock(m_write_lock);
+        m_write_flag = false;
+    }
+
+    write_frame();
+}
+
+template <typename config>
+bool connection<config>::defer_message(message_ptr msg) const
+{
+    if (m_deferred_messages > 0 || m_preparing_fragment) {
+        // keep data messages in order behind the deferred ones
+        return true;
+    }
+
+    if (m_processor->message_batching_enabled() &&
+        msg->get_payload().size() <= message_batching_type::max_message_size)
+    {
+        // small messages are packed into batches as they are written
+        return true;
+    }
+
+    if (m_processor->get_version() == 0) {
+        // hybi00 can not prepare a message piecewise
+        return false;
+    }
+
+    if (msg->has_deadline()) {
+        // a message that may expire is not prepared for nothing
+        return true;
+    }
+
+    return m_max_outbound_frame_size > 0 &&
+        msg->get_payload().size() > m_max_outbound_frame_size;
+}
+
 template <typename config>
 void connection<config>::log_open_result()
 {
@@ -2305,6 +3743,14 @@ void connection<config>::log_close_result()
 template <typename config>
 void connection<config>::log_fail_result()
 {
+    // failures are keyed by error so that a flood of the same failure is
+    // summarized rather than formatted and written each time
+    if (!log::test(*m_alog, log::alevel::fail, m_ec.category().name(),
+        m_ec.value()))
+    {
+        return;
+    }
+
     std::stringstream s;
     
     int version = processor::get_websocket_version(m_request);
@@ -66,6 +66,8 @@ endpoint<connection,config>::create_connection() {
     con->set_http_handler(m_http_handler);
     con->set_validate_handler(m_validate_handler);
     con->set_message_handler(m_message_handler);
+    con->set_message_expired_handler(m_message_expired_handler);
+    con->set_deflate_policy_handler(m_deflate_policy_handler);
 
     if (m_open_handshake_timeout_dur != config::timeout_open_handshake) {
         con->set_open_handshake_timeout(m_open_handshake_timeout_dur);
@@ -79,7 +81,21 @@ endpoint<connection,config>::create_connection() {
     if (m_max_message_size != config::max_message_size) {
         con->set_max_message_size(m_max_message_size);
     }
+    if (m_max_outbound_frame_size != config::max_outbound_frame_size) {
+        con->set_max_outbound_frame_size(m_max_outbound_frame_size);
+    }
     con->set_max_http_body_size(m_max_http_body_size);
+    if (m_fast_close) {
+        con->set_fast_close(true);
+    }
+
+    if (config::enable_resource_accounting) {
+        con->set_heavy_hitters(m_heavy_hitters);
+    }
+    con->set_tenant_registry(m_tenants);
+    con->set_deflate_tracker(m_deflate_tracker);
+    con->set_counters(m_counters);
+    con->set_idle_table(m_idle_table);
 
     lib::error_code ec;
 
@@ -211,6 +227,24 @@ void endpoint<connection,config>::send(connection_hdl hdl, message_ptr msg) {
     if (ec) { throw exception(ec); }
 }
 
+template <typename connection, typename config>
+void endpoint<connection,config>::send_broadcast(connection_hdl hdl,
+    broadcast::message_ptr msg, lib::error_code & ec)
+{
+    connection_ptr con = get_con_from_hdl(hdl,ec);
+    if (ec) {return;}
+    ec = con->send_broadcast(msg);
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::send_broadcast(connection_hdl hdl,
+    broadcast::message_ptr msg)
+{
+    lib::error_code ec;
+    send_broadcast(hdl,msg,ec);
+    if (ec) { throw exception(ec); }
+}
+
 template <typename connection, typename config>
 void endpoint<connection,config>::close(connection_hdl hdl, close::status::value
     const code, std::string const & reason,
@@ -230,6 +264,25 @@ void endpoint<connection,config>::close(connection_hdl hdl, close::status::value
     if (ec) { throw exception(ec); }
 }
 
+template <typename connection, typename config>
+void endpoint<connection,config>::fast_close(connection_hdl hdl,
+    close::status::value const code, std::string const & reason,
+    lib::error_code & ec)
+{
+    connection_ptr con = get_con_from_hdl(hdl,ec);
+    if (ec) {return;}
+    con->fast_close(code,reason,ec);
+}
+
+template <typename connection, typename config>
+void endpoint<connection,config>::fast_close(connection_hdl hdl,
+    close::status::value const code, std::string const & reason)
+{
+    lib::error_code ec;
+    fast_close(hdl,code,reason,ec);
+    if (ec) { throw exception(ec); }
+}
+
 template <typename connection, typename config>
 void endpoint<connection,config>::ping(connection_hdl hdl, std::string const &
     payload, lib::error_code & ec)
@@ -41,6 +41,7 @@
  */
 
 #include <websocketpp/logger/levels.hpp>
+#include <websocketpp/logger/rate_limiter.hpp>
 
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/common/stdint.hpp>
@@ -50,6 +51,7 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace log {
@@ -85,7 +87,8 @@ public:
 
     /// Copy constructor
     basic<concurrency,names>(basic<concurrency,names> const & other)
-     : m_static_channels(other.m_static_channels)
+     : m_limiter(other.m_limiter)
+     , m_static_channels(other.m_static_channels)
      , m_dynamic_channels(other.m_dynamic_channels)
      , m_out(other.m_out)
     {}
@@ -98,7 +101,8 @@ public:
 #ifdef _WEBSOCKETPP_MOVE_SEMANTICS_
     /// Move constructor
     basic<concurrency,names>(basic<concurrency,names> && other)
-     : m_static_channels(other.m_static_channels)
+     : m_limiter(other.m_limiter)
+     , m_static_channels(other.m_static_channels)
      , m_dynamic_channels(other.m_dynamic_channels)
      , m_out(other.m_out)
     {}
@@ -157,6 +161,78 @@ public:
         m_out->flush();
     }
 
+    /// Limit the rate of keyed messages
+    /**
+     * Applies to messages checked with `test`. In each interval the first
+     * `burst` messages with the same key and code are allowed, and one in
+     * every `sample` of the rest. A summary line with the number of
+     * suppressed messages is written for each key when the interval ends.
+     *
+     * @since 0.8.2
+     *
+     * @param burst Messages of a key allowed per interval, 0 for unlimited
+     * @param interval Length of an interval in milliseconds
+     * @param sample Allow one in every `sample` suppressed messages, 0 for
+     * none
+     */
+    void set_rate_limit(uint64_t burst, long interval = 1000,
+        uint64_t sample = 0)
+    {
+        scoped_lock_type lock(m_limit_lock);
+        m_limiter.set_limit(burst, interval, sample);
+    }
+
+    /// Test whether a keyed message should be formatted and written
+    /**
+     * Callers that build a message from error details call this first so
+     * that messages on disabled channels or over the rate limit cost no
+     * formatting. Summaries of an interval that ended are written here.
+     *
+     * The rate limit has its own lock, so checking a message never waits
+     * for a write in progress and a suppressed message never takes the
+     * lock that `write` holds. An allowed message takes that lock once,
+     * when it is written.
+     *
+     * @since 0.8.2
+     *
+     * @param channel The channel of the message
+     * @param key The fixed part of the message
+     * @param code An error code that further distinguishes the message
+     * @param category The name of the category of code, if any
+     * @return Whether the message should be written
+     */
+    bool test(level channel, char const * key, int code = 0,
+        char const * category = NULL)
+    {
+        if (!this->dynamic_test(channel)) { return false; }
+
+        std::vector<rate_limiter::summary> ended;
+        bool ret = limit(channel, key, code, category, ended);
+        if (!ended.empty()) {
+            scoped_lock_type lock(m_lock);
+            write_summaries(ended);
+        }
+        return ret;
+    }
+
+    /// Write summaries of the messages suppressed so far
+    /**
+     * Summaries are otherwise written by the first `test` after the
+     * interval ends. Call this on shutdown or from a timer so that the
+     * last interval of a burst is reported.
+     *
+     * @since 0.8.2
+     */
+    void flush_suppressed() {
+        std::vector<rate_limiter::summary> ended;
+        {
+            scoped_lock_type lock(m_limit_lock);
+            m_limiter.flush(ended);
+        }
+        scoped_lock_type lock(m_lock);
+        write_summaries(ended);
+    }
+
     _WEBSOCKETPP_CONSTEXPR_TOKEN_ bool static_test(level channel) const {
         return ((channel & m_static_channels) != 0);
     }
@@ -168,9 +244,46 @@ public:
 protected:
     typedef typename concurrency::scoped_lock_type scoped_lock_type;
     typedef typename concurrency::mutex_type mutex_type;
+    /// Lock for writing
     mutex_type m_lock;
+    /// Lock for the rate limit, never held together with m_lock
+    mutex_type m_limit_lock;
+    /// Lock: m_limit_lock
+    rate_limiter m_limiter;
+
+    /// Count a keyed message against the rate limit
+    /**
+     * Takes m_limit_lock only. The clock is read only while a limit is set.
+     *
+     * @param ended Summaries of an interval that ended are appended here,
+     * for the caller to write
+     * @return Whether the message should be written
+     */
+    bool limit(level channel, char const * key, int code,
+        char const * category, std::vector<rate_limiter::summary> & ended)
+    {
+        scoped_lock_type lock(m_limit_lock);
+        if (!m_limiter.enabled()) { return true; }
+        return m_limiter.allow(channel, key, code,
+            rate_limiter::clock_type::now(), ended, category);
+    }
 
 private:
+    /// Write summaries of suppressed messages. Lock m_lock first.
+    void write_summaries(std::vector<rate_limiter::summary> const & ended) {
+        if (ended.empty()) {
+            return;
+        }
+        std::vector<rate_limiter::summary>::const_iterator it;
+        for (it = ended.begin(); it != ended.end(); ++it) {
+            if (!this->dynamic_test(it->channel)) { continue; }
+            *m_out << "[" << timestamp << "] "
+                      << "[" << names::channel_name(it->channel) << "] "
+                      << format_summary(*it) << "\n";
+        }
+        m_out->flush();
+    }
+
     // The timestamp does not include the time zone, because on Windows with the
     // default registry settings, the time zone would be written out in full,
     // which would be obnoxiously verbose.
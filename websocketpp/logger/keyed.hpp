@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_LOGGER_KEYED_HPP
+#define WEBSOCKETPP_LOGGER_KEYED_HPP
+
+#include <websocketpp/logger/levels.hpp>
+
+#include <cstddef>
+
+namespace websocketpp {
+namespace log {
+
+/// Whether a logger policy can rate limit keyed messages
+/**
+ * True if `logger` has a member
+ * `bool test(level, char const *, int, char const *)`, as the bundled
+ * loggers do. The member is optional, so logger policies written before it
+ * was added still work; their keyed messages are simply not rate limited.
+ *
+ * @since 0.8.2
+ */
+template <typename logger>
+struct has_keyed_test {
+private:
+    typedef char yes[1];
+    typedef char no[2];
+
+    template <typename T, bool (T::*)(level, char const *, int, char const *)>
+    struct check;
+
+    template <typename T>
+    static yes & probe(check<T, &T::test> *);
+    template <typename T>
+    static no & probe(...);
+public:
+    static bool const value = sizeof(probe<logger>(0)) == sizeof(yes);
+};
+
+namespace detail {
+
+template <typename logger, bool keyed = has_keyed_test<logger>::value>
+struct keyed_test {
+    static bool run(logger & l, level channel, char const * key, int code,
+        char const * category)
+    {
+        return l.test(channel, key, code, category);
+    }
+};
+
+template <typename logger>
+struct keyed_test<logger, false> {
+    static bool run(logger & l, level channel, char const *, int,
+        char const *)
+    {
+        return l.static_test(channel) && l.dynamic_test(channel);
+    }
+};
+
+} // namespace detail
+
+/// Test whether a keyed message should be formatted and written
+/**
+ * Calls `l.test` if the logger has it, see has_keyed_test. Otherwise only
+ * checks whether the channel is enabled.
+ *
+ * @since 0.8.2
+ *
+ * @param l The logger
+ * @param channel The channel of the message
+ * @param key The fixed part of the message
+ * @param code An error code that further distinguishes the message
+ * @param category The name of the category of code, if any
+ * @return Whether the message should be written
+ */
+template <typename logger>
+bool test(logger & l, level channel, char const * key, int code = 0,
+    char const * category = NULL)
+{
+    return detail::keyed_test<logger>::run(l, channel, key, code, category);
+}
+
+} // namespace log
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_LOGGER_KEYED_HPP
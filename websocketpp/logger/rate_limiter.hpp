@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_LOGGER_RATE_LIMITER_HPP
+#define WEBSOCKETPP_LOGGER_RATE_LIMITER_HPP
+
+#include <websocketpp/logger/levels.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+namespace log {
+
+/// Per key limit on the number of log messages written
+/**
+ * Messages are grouped by a key, typically the fixed part of the message
+ * and an error code with its category. Time is split into fixed intervals. In each interval
+ * the first `burst` messages of a key are written. The rest are suppressed,
+ * except for one in every `sample` which is still written as a sample of
+ * the detail. When an interval ends, one summary per key with suppressed
+ * messages is produced.
+ *
+ * The cost of a suppressed message is a hash of its key, a map lookup and a
+ * comparison with the stored key. At most `max_keys` keys are tracked per
+ * interval. Messages with other keys are counted together.
+ *
+ * This class is not thread safe.
+ *
+ * @since 0.8.2
+ */
+class rate_limiter {
+public:
+    typedef lib::chrono::steady_clock clock_type;
+    typedef clock_type::time_point time_point;
+
+    /// Messages suppressed in one interval
+    struct summary {
+        /// The channel of the messages
+        level channel;
+        /// The key of the messages, empty for keys over max_keys
+        std::string key;
+        /// The category of the code, empty if none was given
+        std::string category;
+        /// The code of the messages
+        int code;
+        /// The number of messages not written
+        uint64_t suppressed;
+        /// The number of suppressed messages written as samples
+        uint64_t sampled;
+    };
+
+    rate_limiter()
+      : m_burst(0)
+      , m_interval(1000)
+      , m_sample(0)
+      , m_max_keys(256)
+      , m_started(false) {}
+
+    /// Set the limit
+    /**
+     * @param burst Messages of a key written per interval, 0 for unlimited
+     * @param interval Length of an interval in milliseconds
+     * @param sample Write one in every `sample` suppressed messages, 0 for
+     * none
+     */
+    void set_limit(uint64_t burst, long interval = 1000, uint64_t sample = 0)
+    {
+        m_burst = burst;
+        m_interval = interval > 0 ? interval : 1;
+        m_sample = sample;
+    }
+
+    /// Set the number of keys tracked per interval
+    void set_max_keys(size_t max_keys) {
+        m_max_keys = max_keys;
+    }
+
+    /// Whether a limit is set
+    bool enabled() const {
+        return m_burst > 0;
+    }
+
+    /// Count a message and check whether it should be written
+    /**
+     * Ends the current interval first if it is over. Its summaries are
+     * appended to `ended`.
+     *
+     * @param channel The channel of the message
+     * @param key The key of the message
+     * @param code The code of the message
+     * @param now The current time
+     * @param ended Summaries of the interval that ended
+     * @param category The name of the category of code, if any. Equal codes
+     * of different categories are counted separately.
+     * @return Whether the message should be written
+     */
+    bool allow(level channel, char const * key, int code, time_point now,
+        std::vector<summary> & ended, char const * category = NULL)
+    {
+        if (m_burst == 0) {
+            return true;
+        }
+
+        expire(now, ended);
+
+        key = key ? key : "";
+        category = category ? category : "";
+
+        // The hash only narrows the search, entries whose keys collide are
+        // kept apart
+        uint64_t h = hash(channel, key, category, code);
+        std::pair<entry_map::iterator,entry_map::iterator> range =
+            m_entries.equal_range(h);
+        entry_map::iterator it = m_entries.end();
+        for (entry_map::iterator i = range.first; i != range.second; ++i) {
+            if (i->second.matches(channel, key, category, code)) {
+                it = i;
+                break;
+            }
+        }
+
+        if (it == m_entries.end()) {
+            if (m_entries.size() >= m_max_keys) {
+                h = 0;
+                it = m_entries.find(h);
+            }
+            if (it == m_entries.end()) {
+                entry e;
+                e.channel = channel;
+                e.code = h == 0 ? 0 : code;
+                if (h != 0) {
+                    e.key = key;
+                    e.category = category;
+                }
+                it = m_entries.insert(std::make_pair(h, e));
+            }
+        }
+
+        entry & e = it->second;
+        if (e.count < m_burst) {
+            e.count++;
+            return true;
+        }
+
+        e.suppressed++;
+        if (m_sample > 0 && e.suppressed % m_sample == 0) {
+            e.sampled++;
+            return true;
+        }
+        return false;
+    }
+
+    /// End the current interval if it is over
+    /**
+     * @param now The current time
+     * @param ended Summaries of the interval that ended are appended here
+     */
+    void expire(time_point now, std::vector<summary> & ended) {
+        if (!m_started) {
+            m_start = now;
+            m_started = true;
+            return;
+        }
+
+        if (now - m_start < lib::chrono::milliseconds(m_interval)) {
+            return;
+        }
+
+        flush(ended);
+        m_start = now;
+    }
+
+    /// End the current interval now
+    /**
+     * @param ended Summaries of the interval are appended here
+     */
+    void flush(std::vector<summary> & ended) {
+        entry_map::const_iterator it;
+        for (it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->second.suppressed == it->second.sampled) {
+                continue;
+            }
+            summary s;
+            s.channel = it->second.channel;
+            s.key = it->second.key;
+            s.category = it->second.category;
+            s.code = it->second.code;
+            s.suppressed = it->second.suppressed - it->second.sampled;
+            s.sampled = it->second.sampled;
+            ended.push_back(s);
+        }
+        m_entries.clear();
+    }
+private:
+    struct entry {
+        entry() : channel(0), code(0), count(0), suppressed(0), sampled(0) {}
+
+        bool matches(level c, char const * k, char const * cat, int n) const {
+            return channel == c && code == n && key == k && category == cat;
+        }
+
+        level channel;
+        std::string key;
+        std::string category;
+        int code;
+        uint64_t count;
+        uint64_t suppressed;
+        uint64_t sampled;
+    };
+
+    /// Entries by the hash of their key. The entry for keys over max_keys
+    /// has hash 0.
+    typedef std::multimap<uint64_t,entry> entry_map;
+
+    /// FNV-1a hash of a message key, never 0
+    static uint64_t hash(level channel, char const * key,
+        char const * category, int code)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (; *key; ++key) {
+            h = (h ^ static_cast<unsigned char>(*key)) * 1099511628211ULL;
+        }
+        // separates the key from the category
+        h = h * 1099511628211ULL;
+        for (; *category; ++category) {
+            h = (h ^ static_cast<unsigned char>(*category)) * 1099511628211ULL;
+        }
+        h = (h ^ channel) * 1099511628211ULL;
+        h = (h ^ static_cast<uint32_t>(code)) * 1099511628211ULL;
+        return h == 0 ? 1 : h;
+    }
+
+    uint64_t m_burst;
+    long m_interval;
+    uint64_t m_sample;
+    size_t m_max_keys;
+    bool m_started;
+    time_point m_start;
+    entry_map m_entries;
+};
+
+/// Format the log message for a summary of suppressed messages
+/**
+ * @since 0.8.2
+ *
+ * @param s The summary to format
+ * @return The message to write
+ */
+inline std::string format_summary(rate_limiter::summary const & s) {
+    std::stringstream ss;
+    ss << "Suppressed " << s.suppressed << " similar messages: "
+       << (s.key.empty() ? "other" : s.key);
+    if (s.code != 0 && !s.category.empty()) {
+        ss << " (" << s.category << " code " << s.code << ")";
+    } else if (s.code != 0) {
+        ss << " (code " << s.code << ")";
+    }
+    if (s.sampled > 0) {
+        ss << ", " << s.sampled << " sampled";
+    }
+    return ss.str();
+}
+
+} // log
+} // websocketpp
+
+#endif // WEBSOCKETPP_LOGGER_RATE_LIMITER_HPP
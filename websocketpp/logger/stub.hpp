@@ -31,6 +31,7 @@
 #include <websocketpp/logger/levels.hpp>
 
 #include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/stdint.hpp>
 
 #include <string>
 
@@ -111,6 +112,38 @@ public:
     bool dynamic_test(level) {
         return false;
     }
+
+    /// Test whether a keyed message should be formatted and written
+    /**
+     * The stub logger writes nothing so `test` always returns false.
+     *
+     * @since 0.8.2
+     *
+     * @param channel The channel of the message
+     * @param key The fixed part of the message
+     * @param code An error code that further distinguishes the message
+     * @param category The name of the category of code, if any
+     */
+    bool test(level, char const *, int = 0, char const * = NULL) {
+        return false;
+    }
+
+    /// Limit the rate of keyed messages
+    /**
+     * All operations on the stub logger are no-ops and all arguments are
+     * ignored
+     *
+     * @since 0.8.2
+     */
+    void set_rate_limit(uint64_t, long = 1000, uint64_t = 0) {}
+
+    /// Write summaries of the messages suppressed so far
+    /**
+     * All operations on the stub logger are no-ops
+     *
+     * @since 0.8.2
+     */
+    void flush_suppressed() {}
 };
 
 } // log
@@ -37,6 +37,9 @@
 
 #include <websocketpp/common/cpp11.hpp>
 #include <websocketpp/logger/levels.hpp>
+#include <websocketpp/logger/rate_limiter.hpp>
+
+#include <vector>
 
 namespace websocketpp {
 namespace log {
@@ -84,9 +87,60 @@ public:
         ::syslog(syslog_priority(channel), "[%s] %s",
             names::channel_name(channel), msg);
     }
+
+    /// Test whether a keyed message should be formatted and written
+    /**
+     * Same as basic::test, except that summaries are written to syslog.
+     *
+     * @since 0.8.2
+     *
+     * @param channel The channel of the message
+     * @param key The fixed part of the message
+     * @param code An error code that further distinguishes the message
+     * @param category The name of the category of code, if any
+     * @return Whether the message should be written
+     */
+    bool test(level channel, char const * key, int code = 0,
+        char const * category = NULL)
+    {
+        if (!this->dynamic_test(channel)) { return false; }
+
+        std::vector<rate_limiter::summary> ended;
+        bool ret = base::limit(channel, key, code, category, ended);
+        if (!ended.empty()) {
+            scoped_lock_type lock(base::m_lock);
+            write_summaries(ended);
+        }
+        return ret;
+    }
+
+    /// Write summaries of the messages suppressed so far to syslog
+    /**
+     * @since 0.8.2
+     */
+    void flush_suppressed() {
+        std::vector<rate_limiter::summary> ended;
+        {
+            scoped_lock_type lock(base::m_limit_lock);
+            base::m_limiter.flush(ended);
+        }
+        scoped_lock_type lock(base::m_lock);
+        write_summaries(ended);
+    }
 private:
     typedef typename base::scoped_lock_type scoped_lock_type;
 
+    /// Write summaries of suppressed messages. Lock m_lock first.
+    void write_summaries(std::vector<rate_limiter::summary> const & ended) {
+        std::vector<rate_limiter::summary>::const_iterator it;
+        for (it = ended.begin(); it != ended.end(); ++it) {
+            if (!this->dynamic_test(it->channel)) { continue; }
+            ::syslog(syslog_priority(it->channel), "[%s] %s",
+                names::channel_name(it->channel),
+                format_summary(*it).c_str());
+        }
+    }
+
     /// The default level is used for all access logs and any error logs that
     /// don't trivially map to one of the standard syslog levels.
     static int const default_level = LOG_INFO;
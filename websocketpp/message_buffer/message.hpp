@@ -28,6 +28,7 @@
 #ifndef WEBSOCKETPP_MESSAGE_BUFFER_MESSAGE_HPP
 #define WEBSOCKETPP_MESSAGE_BUFFER_MESSAGE_HPP
 
+#include <websocketpp/common/chrono.hpp>
 #include <websocketpp/common/memory.hpp>
 #include <websocketpp/frame.hpp>
 
@@ -89,6 +90,11 @@ public:
     typedef typename con_msg_man_type::ptr con_msg_man_ptr;
     typedef typename con_msg_man_type::weak_ptr con_msg_man_weak_ptr;
 
+    /// Type of the clock used for message deadlines
+    typedef lib::chrono::steady_clock clock_type;
+    /// Type of a point in time on the deadline clock
+    typedef clock_type::time_point time_point;
+
     /// Construct an empty message
     /**
      * Construct an empty message
@@ -98,7 +104,8 @@ public:
       , m_prepared(false)
       , m_fin(true)
       , m_terminal(false)
-      , m_compressed(false) {}
+      , m_compressed(false)
+      , m_has_deadline(false) {}
 
     /// Construct a message and fill in some values
     /**
@@ -111,6 +118,7 @@ public:
       , m_fin(true)
       , m_terminal(false)
       , m_compressed(false)
+      , m_has_deadline(false)
     {
         m_payload.reserve(size);
     }
@@ -181,6 +189,108 @@ public:
     void set_terminal(bool value) {
         m_terminal = value;
     }
+
+    /// Get whether or not the message has a delivery deadline
+    /**
+     * @since 0.8.2
+     *
+     * @return Whether or not a deadline has been set for this message
+     */
+    bool has_deadline() const {
+        return m_has_deadline;
+    }
+
+    /// Get the delivery deadline
+    /**
+     * The return value is only meaningful if has_deadline() is true.
+     *
+     * @since 0.8.2
+     *
+     * @return The point in time after which this message is considered stale
+     */
+    time_point get_deadline() const {
+        return m_deadline;
+    }
+
+    /// Set the delivery deadline
+    /**
+     * Messages with a deadline that are still in a connection's outgoing queue
+     * when the deadline passes are dropped rather than written. This is useful
+     * for real time feeds where a stale update is worse than no update. Only
+     * data messages are subject to deadlines. Control messages are always
+     * written.
+     *
+     * A message is never dropped once part of it has been written or if
+     * dropping it would corrupt state shared with later messages (for example
+     * a compression context). Such messages are written late instead.
+     *
+     * @since 0.8.2
+     *
+     * @param deadline The point in time after which this message is stale
+     */
+    void set_deadline(time_point const & deadline) {
+        m_deadline = deadline;
+        m_has_deadline = true;
+    }
+
+    /// Set the delivery deadline relative to the current time
+    /**
+     * @see set_deadline()
+     *
+     * @since 0.8.2
+     *
+     * @param ttl The number of milliseconds from now after which this message
+     * is stale
+     */
+    void set_ttl(long ttl) {
+        set_deadline(clock_type::now() + lib::chrono::milliseconds(ttl));
+    }
+
+    /// Remove the delivery deadline
+    /**
+     * @since 0.8.2
+     */
+    void clear_deadline() {
+        m_has_deadline = false;
+    }
+
+    /// Get the message this message was prepared from
+    /**
+     * Set by connections that prepare a copy of a message passed to send()
+     * while a message expired handler is set, so that the handler can be
+     * given the original if the copy is dropped.
+     *
+     * @since 0.8.2
+     *
+     * @return The message this one was prepared from, or an empty pointer
+     */
+    ptr get_source() const {
+        return m_source;
+    }
+
+    /// Set the message this message was prepared from
+    /**
+     * @see get_source()
+     *
+     * @since 0.8.2
+     *
+     * @param source The message this one was prepared from
+     */
+    void set_source(ptr const & source) {
+        m_source = source;
+    }
+
+    /// Test whether the message deadline has passed
+    /**
+     * @since 0.8.2
+     *
+     * @param now The current time
+     * @return Whether the message has a deadline that is earlier than `now`
+     */
+    bool expired(time_point const & now) const {
+        return m_has_deadline && m_deadline < now;
+    }
+
     /// Read the fin bit
     /**
      * A message with the fin bit set will be sent as the last message of its
@@ -332,6 +442,9 @@ private:
     bool                        m_fin;
     bool                        m_terminal;
     bool                        m_compressed;
+    bool                        m_has_deadline;
+    time_point                  m_deadline;
+    ptr                         m_source;
 };
 
 } // namespace message_buffer
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_METRICS_CONNECTION_STATS_HPP
+#define WEBSOCKETPP_METRICS_CONNECTION_STATS_HPP
+
+#include <websocketpp/metrics/space_saving.hpp>
+
+#include <websocketpp/common/connection_hdl.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+#include <vector>
+
+namespace websocketpp {
+namespace metrics {
+
+/// Resources consumed by a single connection
+/**
+ * Cycle counts are in the unit of metrics::cycles() and cover the time spent
+ * by the library on behalf of the connection:
+ * - parse: decoding incoming frames, including unmasking, inflate and UTF-8
+ *   validation
+ * - handler: the application message handler
+ * - prepare: encoding outgoing messages, including deflate, masking and the
+ *   frame header
+ * - compress: the part of prepare spent on messages that were compressed
+ */
+struct connection_stats {
+    connection_stats()
+      : bytes_in(0)
+      , bytes_out(0)
+      , messages_in(0)
+      , messages_out(0)
+      , parse_cycles(0)
+      , handler_cycles(0)
+      , prepare_cycles(0)
+      , compress_cycles(0)
+      , queue_bytes(0) {}
+
+    /// Total cycles spent on behalf of the connection
+    uint64_t cycles() const {
+        return parse_cycles + handler_cycles + prepare_cycles;
+    }
+
+    /// WebSocket frame bytes read from the transport (excludes the handshake)
+    uint64_t bytes_in;
+    /// WebSocket frame bytes written to the transport (excludes the handshake)
+    uint64_t bytes_out;
+    /// Data messages delivered to the message handler
+    uint64_t messages_in;
+    /// Data frames written
+    uint64_t messages_out;
+
+    uint64_t parse_cycles;
+    uint64_t handler_cycles;
+    uint64_t prepare_cycles;
+    uint64_t compress_cycles;
+
+    /// Payload bytes waiting in the outgoing queue when the snapshot was taken
+    size_t queue_bytes;
+};
+
+/// Thread safe approximate list of the most expensive connections
+/**
+ * Connections report the cycles they consume in batches. The list is a space
+ * saving sketch, so the memory used is fixed regardless of the number of
+ * connections.
+ *
+ * @tparam concurrency The concurrency policy used to protect the sketch
+ */
+template <typename concurrency>
+class heavy_hitters {
+public:
+    typedef typename concurrency::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency::mutex_type mutex_type;
+
+    typedef space_saving<connection_hdl,lib::owner_less<connection_hdl> >
+        sketch_type;
+    typedef typename sketch_type::entry entry;
+
+    /// Construct a heavy hitter list
+    /**
+     * @param capacity The number of connections to track
+     */
+    explicit heavy_hitters(size_t capacity) : m_sketch(capacity) {}
+
+    /// Add to the cost of a connection
+    void report(connection_hdl hdl, uint64_t cycles) {
+        scoped_lock_type lock(m_lock);
+        m_sketch.update(hdl, cycles);
+    }
+
+    /// Stop tracking a connection
+    void remove(connection_hdl hdl) {
+        scoped_lock_type lock(m_lock);
+        m_sketch.erase(hdl);
+    }
+
+    /// Get the most expensive connections, heaviest first
+    /**
+     * @param n The maximum number of connections to return
+     */
+    std::vector<entry> top(size_t n) const {
+        scoped_lock_type lock(m_lock);
+        return m_sketch.top(n);
+    }
+private:
+    sketch_type         m_sketch;
+    mutable mutex_type  m_lock;
+};
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_CONNECTION_STATS_HPP
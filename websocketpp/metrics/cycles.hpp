@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_METRICS_CYCLES_HPP
+#define WEBSOCKETPP_METRICS_CYCLES_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+    #define _WEBSOCKETPP_RDTSC_ __rdtsc
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+      (defined(__x86_64__) || defined(__i386__))
+    #include <x86intrin.h>
+    #define _WEBSOCKETPP_RDTSC_ __rdtsc
+#elif !(defined(__GNUC__) && defined(__aarch64__))
+    #include <websocketpp/common/chrono.hpp>
+#endif
+
+namespace websocketpp {
+/// Lightweight instrumentation used by optional accounting features
+namespace metrics {
+
+/// Read a cheap monotonic cycle counter
+/**
+ * Returns the CPU time stamp counter on x86 and the virtual counter on
+ * AArch64. Other platforms fall back to the steady clock in nanoseconds. The
+ * unit is therefore platform dependent. Values are only meaningful as
+ * differences taken on the same machine.
+ *
+ * @return The current value of the counter
+ */
+inline uint64_t cycles() {
+#if defined(_WEBSOCKETPP_RDTSC_)
+    return _WEBSOCKETPP_RDTSC_();
+#elif defined(__GNUC__) && defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return static_cast<uint64_t>(
+        lib::chrono::duration_cast<lib::chrono::nanoseconds>(
+            lib::chrono::steady_clock::now().time_since_epoch()
+        ).count()
+    );
+#endif
+}
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_CYCLES_HPP
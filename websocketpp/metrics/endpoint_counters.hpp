@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_METRICS_ENDPOINT_COUNTERS_HPP
+#define WEBSOCKETPP_METRICS_ENDPOINT_COUNTERS_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace websocketpp {
+namespace metrics {
+
+/// Add to a counter that several threads may update
+/**
+ * A relaxed atomic add. It orders nothing else, so a reader may see the
+ * counters of one event change one after another. Compilers without the
+ * GCC/Clang __atomic builtins or the MSVC interlocked intrinsics get a plain
+ * add, and their counters may only be updated from one thread.
+ *
+ * @since 0.8.2
+ */
+inline void counter_add(uint64_t & counter, uint64_t n) {
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_fetch_add(&counter, n, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+    _InterlockedExchangeAdd64(reinterpret_cast<__int64 volatile *>(&counter),
+        static_cast<__int64>(n));
+#else
+    counter += n;
+#endif
+}
+
+/// Subtract from a counter that several threads may update
+/**
+ * @since 0.8.2
+ */
+inline void counter_sub(uint64_t & counter, uint64_t n) {
+    counter_add(counter, uint64_t(0) - n);
+}
+
+/// Read a counter that other threads may be updating
+/**
+ * @since 0.8.2
+ */
+inline uint64_t counter_load(uint64_t const & counter) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+    return static_cast<uint64_t>(_InterlockedCompareExchange64(
+        reinterpret_cast<__int64 volatile *>(const_cast<uint64_t *>(&counter)),
+        0, 0));
+#else
+    return counter;
+#endif
+}
+
+/// Running traffic totals for all connections of an endpoint
+/**
+ * Attached to an endpoint with `endpoint::set_counters`. Connections update
+ * the counters with counter_add and counter_sub, relaxed atomic operations,
+ * so the endpoint may run on any number of threads. Read them from other
+ * threads with snapshot. The totals are not updated together: a snapshot
+ * may show a message counted in messages_in before its bytes appear in
+ * bytes_in. The counters only hold integers, so they may live in memory
+ * shared with other processes.
+ */
+struct endpoint_counters {
+    endpoint_counters()
+      : connections_started(0)
+      , connections_opened(0)
+      , connections_closed(0)
+      , connections_failed(0)
+      , http_requests(0)
+      , bytes_in(0)
+      , bytes_out(0)
+      , messages_in(0)
+      , messages_out(0)
+      , queued_bytes(0) {}
+
+    /// Copy the counters while other threads may be updating them
+    endpoint_counters snapshot() const {
+        endpoint_counters ret;
+        ret.connections_started = counter_load(connections_started);
+        ret.connections_opened = counter_load(connections_opened);
+        ret.connections_closed = counter_load(connections_closed);
+        ret.connections_failed = counter_load(connections_failed);
+        ret.http_requests = counter_load(http_requests);
+        ret.bytes_in = counter_load(bytes_in);
+        ret.bytes_out = counter_load(bytes_out);
+        ret.messages_in = counter_load(messages_in);
+        ret.messages_out = counter_load(messages_out);
+        ret.queued_bytes = counter_load(queued_bytes);
+        return ret;
+    }
+
+    /// Number of connections currently open
+    uint64_t connections_active() const {
+        return counter_load(connections_opened)
+            - counter_load(connections_closed);
+    }
+
+    /// Number of connections in the opening handshake
+    uint64_t connections_connecting() const {
+        return counter_load(connections_started)
+            - counter_load(connections_opened)
+            - counter_load(connections_failed)
+            - counter_load(http_requests);
+    }
+
+    /// Connections that started their opening handshake
+    uint64_t connections_started;
+    /// WebSocket connections that completed the opening handshake
+    uint64_t connections_opened;
+    /// Opened connections that have since ended
+    uint64_t connections_closed;
+    /// Connections that ended before the opening handshake completed
+    uint64_t connections_failed;
+    /// Connections that were answered as plain HTTP requests
+    uint64_t http_requests;
+    /// WebSocket frame bytes read from the transport (excludes the handshake)
+    uint64_t bytes_in;
+    /// WebSocket frame bytes written to the transport (excludes the handshake)
+    uint64_t bytes_out;
+    /// Data messages delivered to the message handler
+    uint64_t messages_in;
+    /// Data frames written
+    uint64_t messages_out;
+    /// Payload bytes queued for sending by open connections but not yet
+    /// written. Unlike the other members this goes down as well as up.
+    uint64_t queued_bytes;
+};
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_ENDPOINT_COUNTERS_HPP
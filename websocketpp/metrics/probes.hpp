@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_METRICS_PROBES_HPP
+#define WEBSOCKETPP_METRICS_PROBES_HPP
+
+/**
+ * Optional USDT (user level statically defined tracing) probes
+ *
+ * Probes are compiled out unless `_WEBSOCKETPP_USDT_` is defined before any
+ * WebSocket++ header is included. Enabling them requires `sys/sdt.h`, which is
+ * provided by SystemTap (`systemtap-sdt-dev` on Debian based systems). An
+ * enabled probe that is not being traced costs a single `nop` instruction.
+ *
+ * All probes belong to the `websocketpp` provider. Connection probes take the
+ * address of the connection as their first argument so that events can be
+ * correlated per connection.
+ *
+ * | Probe              | Arguments                                           |
+ * | ------------------ | --------------------------------------------------- |
+ * | accept             | connection                                          |
+ * | handshake_complete | connection, is_server                               |
+ * | frame_parsed       | opcode, payload length                              |
+ * | message_delivered  | connection, opcode, payload length                  |
+ * | send_enqueued      | connection, queue depth, queued payload bytes       |
+ * | write_issued       | connection, bytes, frames in batch                  |
+ * | write_completed    | connection, bytes, frames in batch, error value     |
+ * | timer_fired        | connection, timer (see probe_timer)                 |
+ * | close              | connection, local close code, remote close code     |
+ *
+ * Example bpftrace scripts are in `tools/bpftrace`.
+ */
+
+#ifdef _WEBSOCKETPP_USDT_
+    #include <sys/sdt.h>
+
+    #define _WEBSOCKETPP_PROBE1_(name,a1) \
+        DTRACE_PROBE1(websocketpp,name,a1)
+    #define _WEBSOCKETPP_PROBE2_(name,a1,a2) \
+        DTRACE_PROBE2(websocketpp,name,a1,a2)
+    #define _WEBSOCKETPP_PROBE3_(name,a1,a2,a3) \
+        DTRACE_PROBE3(websocketpp,name,a1,a2,a3)
+    #define _WEBSOCKETPP_PROBE4_(name,a1,a2,a3,a4) \
+        DTRACE_PROBE4(websocketpp,name,a1,a2,a3,a4)
+#else
+    // Arguments are not evaluated when probes are compiled out
+    #define _WEBSOCKETPP_PROBE1_(name,a1)
+    #define _WEBSOCKETPP_PROBE2_(name,a1,a2)
+    #define _WEBSOCKETPP_PROBE3_(name,a1,a2,a3)
+    #define _WEBSOCKETPP_PROBE4_(name,a1,a2,a3,a4)
+#endif
+
+namespace websocketpp {
+namespace metrics {
+
+/// Identifiers of the timers reported by the timer_fired probe
+namespace probe_timer {
+enum value {
+    open_handshake = 1,
+    close_handshake = 2,
+    pong = 3
+};
+} // namespace probe_timer
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_PROBES_HPP
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_METRICS_SHARED_STATS_HPP
+#define WEBSOCKETPP_METRICS_SHARED_STATS_HPP
+
+#include <websocketpp/error.hpp>
+#include <websocketpp/metrics/endpoint_counters.hpp>
+
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#if !defined(__GNUC__) && !defined(__clang__)
+#error "shared_stats requires the GCC or Clang __atomic builtins"
+#endif
+
+namespace websocketpp {
+namespace metrics {
+
+/// Errors related to shared statistics segments
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// No segment exists with the given name
+    segment_not_found,
+
+    /// The segment could not be created or mapped
+    shared_memory_failed,
+
+    /// The segment was not created by shared_stats
+    invalid_segment,
+
+    /// The segment uses a layout version this build does not understand
+    version_mismatch,
+
+    /// The writer held the segment for the whole read
+    write_in_progress,
+
+    /// The segment has not been opened
+    not_open,
+
+    /// A running process owns a segment with that name
+    segment_in_use
+};
+
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.metrics";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic metrics error";
+            case segment_not_found:
+                return "No statistics segment with that name";
+            case shared_memory_failed:
+                return "Could not create or map the statistics segment";
+            case invalid_segment:
+                return "Not a statistics segment";
+            case version_mismatch:
+                return "Unsupported statistics segment version";
+            case write_in_progress:
+                return "The statistics segment is being written";
+            case not_open:
+                return "The statistics segment is not open";
+            case segment_in_use:
+                return "The statistics segment belongs to a running process";
+            default:
+                return "Unknown";
+        }
+    }
+};
+
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+
+/// Event loop lag measured on one io thread
+/**
+ * Lag is how late a periodic timer ran compared to when it was due. It grows
+ * when handlers on the thread run for long or the thread is starved of CPU.
+ */
+struct thread_lag {
+    thread_lag() : samples(0), last_us(0), max_us(0), total_us(0) {}
+
+    uint64_t samples;
+    uint64_t last_us;
+    uint64_t max_us;
+    uint64_t total_us;
+};
+
+/// The statistics published to a shared_stats segment
+/**
+ * Every member is a uint64_t so that the snapshot can be copied in and out
+ * of shared memory one word at a time.
+ */
+struct stats_snapshot {
+    /// Number of io threads that lag can be reported for
+    static size_t const max_threads = 16;
+
+    stats_snapshot() : updated_us(0), publishes(0), threads(0) {}
+
+    /// Wall clock time of the publish, in microseconds since the epoch
+    uint64_t updated_us;
+    /// Number of snapshots published since the segment was created
+    uint64_t publishes;
+    /// Traffic totals of the endpoint
+    endpoint_counters counters;
+    /// Number of entries of `lag` in use
+    uint64_t threads;
+    thread_lag lag[max_threads];
+};
+
+/// The layout of a statistics segment
+/**
+ * The header is written once when the segment is created. The snapshot is
+ * guarded by a sequence lock: the writer makes `sequence` odd while it
+ * updates the snapshot and even again when it is done. Readers retry when
+ * the sequence was odd or changed while they copied. Readers never write to
+ * the segment, so they do not slow the writer down.
+ *
+ * The version changes whenever the layout of the segment changes.
+ */
+struct stats_segment {
+    static uint32_t const version = 1;
+
+    struct header_type {
+        char magic[8];
+        uint32_t version;
+        /// sizeof(stats_segment) of the writer
+        uint32_t size;
+        /// Process id of the writer
+        uint64_t pid;
+        uint64_t sequence;
+        /// Keeps the snapshot off the cache line readers poll
+        uint64_t padding[4];
+    };
+
+    header_type header;
+    stats_snapshot snapshot;
+};
+
+namespace seqlock {
+
+static size_t const snapshot_words = sizeof(stats_snapshot) / sizeof(uint64_t);
+
+/// Write a snapshot to a segment. Only one writer may call this at a time.
+inline void write(stats_segment & seg, stats_snapshot const & s) {
+    uint64_t seq = __atomic_load_n(&seg.header.sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&seg.header.sequence, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint64_t * dst = reinterpret_cast<uint64_t *>(&seg.snapshot);
+    uint64_t const * src = reinterpret_cast<uint64_t const *>(&s);
+    for (size_t i = 0; i < snapshot_words; ++i) {
+        __atomic_store_n(dst + i, src[i], __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&seg.header.sequence, seq + 2, __ATOMIC_RELEASE);
+}
+
+/// Read a consistent snapshot from a segment
+/**
+ * @return false if the writer held the segment for every attempt
+ */
+inline bool read(stats_segment const & seg, stats_snapshot & s,
+    unsigned attempts = 10000)
+{
+    uint64_t * dst = reinterpret_cast<uint64_t *>(&s);
+    uint64_t const * src =
+        reinterpret_cast<uint64_t const *>(&seg.snapshot);
+
+    for (unsigned a = 0; a < attempts; ++a) {
+        uint64_t before =
+            __atomic_load_n(&seg.header.sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+
+        for (size_t i = 0; i < snapshot_words; ++i) {
+            dst[i] = __atomic_load_n(src + i, __ATOMIC_RELAXED);
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&seg.header.sequence, __ATOMIC_RELAXED) ==
+            before)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace seqlock
+
+/// Publishes statistics to a named POSIX shared memory segment
+/**
+ * Monitoring tools such as `wsppstat` open the segment by name and read it
+ * at any rate without any coordination with the process that writes it.
+ * The segment is removed when the shared_stats is destroyed, unless the name
+ * has since been taken over by another segment. A segment left behind by a
+ * process that crashed is replaced by the next create with the same name. A
+ * segment whose writer is still running is never replaced.
+ *
+ * @since 0.8.2
+ */
+class shared_stats {
+public:
+    shared_stats() : m_segment(NULL), m_dev(0), m_ino(0) {}
+
+    ~shared_stats() {
+        if (!m_segment) {
+            return;
+        }
+        munmap(m_segment, sizeof(stats_segment));
+
+        // Only remove the name if it still refers to this segment
+        int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+        if (fd == -1) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_dev == m_dev && st.st_ino == m_ino) {
+            shm_unlink(m_name.c_str());
+        }
+        ::close(fd);
+    }
+
+    /// Create the segment
+    /**
+     * @param name The name of the segment. It should start with a slash and
+     * contain no other slashes, for example "/myserver".
+     * @param ec Set to error::segment_in_use if a running process owns a
+     * segment with that name, or error::shared_memory_failed if the segment
+     * could not be created
+     */
+    void create(std::string const & name, lib::error_code & ec) {
+        if (m_segment) {
+            ec = error::make_error_code(error::general);
+            return;
+        }
+
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd == -1 && errno == EEXIST) {
+            if (!owner_gone(name)) {
+                ec = error::make_error_code(error::segment_in_use);
+                return;
+            }
+
+            // Start from a fresh segment in case readers still map the old one
+            shm_unlink(name.c_str());
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        }
+        if (fd == -1) {
+            ec = error::make_error_code(errno == EEXIST ?
+                error::segment_in_use : error::shared_memory_failed);
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 ||
+            ftruncate(fd, sizeof(stats_segment)) == -1)
+        {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            ec = error::make_error_code(error::shared_memory_failed);
+            return;
+        }
+        void * p = mmap(NULL, sizeof(stats_segment), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(name.c_str());
+            ec = error::make_error_code(error::shared_memory_failed);
+            return;
+        }
+
+        // The new segment is zero filled, which is an empty snapshot
+        m_segment = static_cast<stats_segment *>(p);
+        m_name = name;
+        m_dev = st.st_dev;
+        m_ino = st.st_ino;
+        m_segment->header.version = stats_segment::version;
+        m_segment->header.size = sizeof(stats_segment);
+        m_segment->header.pid = static_cast<uint64_t>(getpid());
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        std::memcpy(m_segment->header.magic, "WSPPSTAT", 8);
+        ec = lib::error_code();
+    }
+
+    /// Create the segment, throwing on error
+    void create(std::string const & name) {
+        lib::error_code ec;
+        create(name, ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Publish a snapshot
+    /**
+     * Safe to call from any thread.
+     */
+    void publish(stats_snapshot const & s) {
+        if (!m_segment) {
+            return;
+        }
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        seqlock::write(*m_segment, s);
+    }
+
+    bool is_open() const {
+        return m_segment != NULL;
+    }
+
+    std::string const & get_name() const {
+        return m_name;
+    }
+private:
+    // Segments are tied to their mapping
+    shared_stats(shared_stats const &);
+    shared_stats & operator=(shared_stats const &);
+
+    /// Whether the writer of an existing segment has exited
+    /**
+     * A segment without a complete header may still be being created and is
+     * treated as owned.
+     */
+    static bool owner_gone(std::string const & name) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) {
+            // removed in the meantime, nothing left to replace
+            return errno == ENOENT;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 ||
+            static_cast<size_t>(st.st_size) < sizeof(stats_segment::header_type))
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void * p = mmap(NULL, sizeof(stats_segment::header_type), PROT_READ,
+            MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        stats_segment::header_type header;
+        std::memcpy(&header, p, sizeof(header));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        munmap(p, sizeof(stats_segment::header_type));
+
+        if (std::memcmp(header.magic, "WSPPSTAT", 8) != 0 || header.pid == 0) {
+            return false;
+        }
+
+        // EPERM means the process exists but belongs to someone else
+        return kill(static_cast<pid_t>(header.pid), 0) == -1 && errno == ESRCH;
+    }
+
+    stats_segment * m_segment;
+    std::string m_name;
+    /// Identity of the segment, to tell whether m_name still refers to it
+    dev_t m_dev;
+    ino_t m_ino;
+    lib::mutex m_lock;
+};
+
+/// Reads a segment written by shared_stats
+/**
+ * @since 0.8.2
+ */
+class shared_stats_reader {
+public:
+    shared_stats_reader() : m_segment(NULL) {}
+
+    ~shared_stats_reader() {
+        if (m_segment) {
+            munmap(const_cast<stats_segment *>(m_segment),
+                sizeof(stats_segment));
+        }
+    }
+
+    /// Open an existing segment read only
+    /**
+     * @param name The name the segment was created with
+     * @param ec Set to error::segment_not_found, error::invalid_segment,
+     * error::version_mismatch or error::shared_memory_failed
+     */
+    void open(std::string const & name, lib::error_code & ec) {
+        if (m_segment) {
+            munmap(const_cast<stats_segment *>(m_segment),
+                sizeof(stats_segment));
+            m_segment = NULL;
+        }
+
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd == -1) {
+            ec = error::make_error_code(errno == ENOENT ?
+                error::segment_not_found : error::shared_memory_failed);
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == -1 ||
+            static_cast<size_t>(st.st_size) < sizeof(stats_segment::header_type))
+        {
+            ::close(fd);
+            ec = error::make_error_code(error::invalid_segment);
+            return;
+        }
+
+        // Map only the header until the layout is known to match
+        void * p = mmap(NULL, sizeof(stats_segment::header_type), PROT_READ,
+            MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            ec = error::make_error_code(error::shared_memory_failed);
+            return;
+        }
+        stats_segment::header_type header;
+        std::memcpy(&header, p, sizeof(header));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        munmap(p, sizeof(stats_segment::header_type));
+
+        if (std::memcmp(header.magic, "WSPPSTAT", 8) != 0) {
+            ::close(fd);
+            ec = error::make_error_code(error::invalid_segment);
+            return;
+        }
+        if (header.version != stats_segment::version ||
+            header.size != sizeof(stats_segment) ||
+            static_cast<size_t>(st.st_size) < sizeof(stats_segment))
+        {
+            ::close(fd);
+            ec = error::make_error_code(error::version_mismatch);
+            return;
+        }
+
+        p = mmap(NULL, sizeof(stats_segment), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            ec = error::make_error_code(error::shared_memory_failed);
+            return;
+        }
+        m_segment = static_cast<stats_segment const *>(p);
+        ec = lib::error_code();
+    }
+
+    /// Read the latest snapshot
+    /**
+     * @param [out] s The snapshot
+     * @param [out] ec Set to error::not_open or error::write_in_progress
+     */
+    void read(stats_snapshot & s, lib::error_code & ec) const {
+        if (!m_segment) {
+            ec = error::make_error_code(error::not_open);
+            return;
+        }
+        if (!seqlock::read(*m_segment, s)) {
+            ec = error::make_error_code(error::write_in_progress);
+            return;
+        }
+        ec = lib::error_code();
+    }
+
+    /// Process id of the writer
+    uint64_t get_pid() const {
+        return m_segment ? m_segment->header.pid : 0;
+    }
+private:
+    shared_stats_reader(shared_stats_reader const &);
+    shared_stats_reader & operator=(shared_stats_reader const &);
+
+    stats_segment const * m_segment;
+};
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_SHARED_STATS_HPP
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_METRICS_SPACE_SAVING_HPP
+#define WEBSOCKETPP_METRICS_SPACE_SAVING_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <vector>
+
+namespace websocketpp {
+namespace metrics {
+
+/// Approximate top-K of weighted keys using the space saving algorithm
+/**
+ * Tracks at most `capacity` keys. When a new key arrives and the table is full
+ * the key with the smallest count is replaced and the newcomer inherits that
+ * count as its error bound. Any key whose true weight exceeds the total weight
+ * seen divided by the capacity is guaranteed to be present. The count of a
+ * tracked key overestimates its true weight by at most its error.
+ *
+ * Updates cost O(log K) for tracked keys and O(K) when a key is replaced.
+ *
+ * This class is not thread safe.
+ *
+ * @tparam key_type The type of key to count
+ * @tparam compare A strict weak ordering of keys
+ */
+template <typename key_type, typename compare = std::less<key_type> >
+class space_saving {
+public:
+    /// A tracked key and its estimated weight
+    struct entry {
+        entry(key_type const & k, uint64_t c, uint64_t e)
+          : key(k), count(c), error(e) {}
+
+        /// The key
+        key_type key;
+        /// Estimated total weight, never less than the true weight
+        uint64_t count;
+        /// Maximum amount by which count overestimates the true weight
+        uint64_t error;
+    };
+
+    /// Construct a sketch
+    /**
+     * @param capacity The number of keys to track
+     */
+    explicit space_saving(size_t capacity)
+      : m_capacity(capacity ? capacity : 1) {}
+
+    /// Add weight to a key
+    /**
+     * @param key The key to update
+     * @param weight The weight to add
+     */
+    void update(key_type const & key, uint64_t weight) {
+        typename index_type::iterator it = m_index.find(key);
+
+        if (it != m_index.end()) {
+            m_entries[it->second].count += weight;
+            return;
+        }
+
+        if (m_entries.size() < m_capacity) {
+            m_index.insert(std::make_pair(key, m_entries.size()));
+            m_entries.push_back(entry(key, weight, 0));
+            return;
+        }
+
+        size_t min = 0;
+        for (size_t i = 1; i < m_entries.size(); ++i) {
+            if (m_entries[i].count < m_entries[min].count) {
+                min = i;
+            }
+        }
+
+        entry & victim = m_entries[min];
+        m_index.erase(victim.key);
+        m_index.insert(std::make_pair(key, min));
+
+        victim.key = key;
+        victim.error = victim.count;
+        victim.count += weight;
+    }
+
+    /// Stop tracking a key
+    /**
+     * Frees the slot held by a key that is known to be gone, for example a
+     * closed connection.
+     *
+     * @param key The key to remove
+     */
+    void erase(key_type const & key) {
+        typename index_type::iterator it = m_index.find(key);
+
+        if (it == m_index.end()) {
+            return;
+        }
+
+        size_t slot = it->second;
+        m_index.erase(it);
+
+        if (slot != m_entries.size() - 1) {
+            m_entries[slot] = m_entries.back();
+            m_index[m_entries[slot].key] = slot;
+        }
+        m_entries.pop_back();
+    }
+
+    /// Get the heaviest tracked keys
+    /**
+     * @param n The maximum number of entries to return
+     * @return Up to n entries, heaviest first
+     */
+    std::vector<entry> top(size_t n) const {
+        std::vector<entry> result(m_entries);
+        std::sort(result.begin(), result.end(), heavier);
+
+        if (result.size() > n) {
+            result.erase(result.begin() + n, result.end());
+        }
+        return result;
+    }
+
+    /// Get the number of tracked keys
+    size_t size() const {
+        return m_entries.size();
+    }
+
+    /// Stop tracking all keys
+    void clear() {
+        m_index.clear();
+        m_entries.clear();
+    }
+private:
+    typedef std::map<key_type,size_t,compare> index_type;
+
+    static bool heavier(entry const & a, entry const & b) {
+        return a.count > b.count;
+    }
+
+    size_t const        m_capacity;
+    index_type          m_index;
+    std::vector<entry>  m_entries;
+};
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_SPACE_SAVING_HPP
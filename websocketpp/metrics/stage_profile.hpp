@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef WEBSOCKETPP_METRICS_STAGE_PROFILE_HPP
+#define WEBSOCKETPP_METRICS_STAGE_PROFILE_HPP
+
+/**
+ * Optional per stage cycle accounting
+ *
+ * Stage profiling is compiled out unless `_WEBSOCKETPP_PROFILE_STAGES_` is
+ * defined before any WebSocket++ header is included. When enabled, the time
+ * spent in each stage of the read and write pipelines is measured with
+ * metrics::cycles() and accumulated into counters owned by the calling thread,
+ * so the hot path never takes a lock or touches a shared cache line.
+ *
+ * Stages nest. A stage is charged only for the cycles that were not charged to
+ * a stage nested inside it, so the totals of all stages add up to the time
+ * spent inside instrumented code without double counting. For example the
+ * cycles spent unmasking a frame are charged to `unmask` and not to
+ * `frame_parse` or `read_completion`.
+ *
+ * Use stage_profile::snapshot() to sum the counters of every thread that has
+ * recorded a stage so far, and stage_profile::reset() to zero them between
+ * measurement intervals.
+ */
+
+#ifdef _WEBSOCKETPP_PROFILE_STAGES_
+    #include <websocketpp/metrics/cycles.hpp>
+    #include <websocketpp/common/thread.hpp>
+    #include <vector>
+
+    #if defined(_WEBSOCKETPP_CPP11_INTERNAL_)
+        #define _WEBSOCKETPP_STAGE_TLS_ thread_local
+    #elif defined(_MSC_VER)
+        #define _WEBSOCKETPP_STAGE_TLS_ __declspec(thread)
+    #else
+        #define _WEBSOCKETPP_STAGE_TLS_ __thread
+    #endif
+
+    #define _WEBSOCKETPP_STAGE_CAT2_(a,b) a##b
+    #define _WEBSOCKETPP_STAGE_CAT_(a,b) _WEBSOCKETPP_STAGE_CAT2_(a,b)
+
+    /// Charge the rest of the enclosing scope to the given stage
+    #define _WEBSOCKETPP_PROFILE_STAGE_(name) \
+        ::websocketpp::metrics::stage_scope \
+            _WEBSOCKETPP_STAGE_CAT_(_wspp_stage_,__LINE__)( \
+                ::websocketpp::metrics::stage::name)
+#else
+    #define _WEBSOCKETPP_PROFILE_STAGE_(name)
+#endif
+
+#include <websocketpp/common/stdint.hpp>
+
+#include <cstddef>
+
+namespace websocketpp {
+namespace metrics {
+
+/// Pipeline stages measured by the stage profiler
+namespace stage {
+enum value {
+    /// Transport read completion, including issuing the next read
+    read_completion = 0,
+    /// Frame header parsing and the rest of the processor read loop
+    frame_parse,
+    /// Unmasking of incoming payload bytes
+    unmask,
+    /// permessage-deflate decompression of incoming payloads
+    inflate,
+    /// UTF-8 validation of incoming and outgoing text payloads
+    utf8_validate,
+    /// The application message handler
+    handler,
+    /// Outgoing message preparation not charged to a more specific stage
+    prepare,
+    /// permessage-deflate compression of outgoing payloads
+    deflate,
+    /// Masking of outgoing payloads
+    mask,
+    /// Serialization of outgoing frame headers
+    header,
+    /// Collecting queued frames into a single transport write
+    write_batch,
+    /// Transport write completion
+    write_completion,
+    /// Number of stages, not a stage itself
+    count
+};
+
+/// Get a short human readable name for a stage
+inline char const * name(value s) {
+    switch (s) {
+        case read_completion:
+            return "read_completion";
+        case frame_parse:
+            return "frame_parse";
+        case unmask:
+            return "unmask";
+        case inflate:
+            return "inflate";
+        case utf8_validate:
+            return "utf8_validate";
+        case handler:
+            return "handler";
+        case prepare:
+            return "prepare";
+        case deflate:
+            return "deflate";
+        case mask:
+            return "mask";
+        case header:
+            return "header";
+        case write_batch:
+            return "write_batch";
+        case write_completion:
+            return "write_completion";
+        default:
+            return "unknown";
+    }
+}
+} // namespace stage
+
+/// Accumulated cost of a single stage
+struct stage_counter {
+    stage_counter() : cycles(0), calls(0) {}
+
+    /// Cycles charged to the stage
+    uint64_t cycles;
+    /// Number of times the stage was entered
+    uint64_t calls;
+};
+
+/// Totals for every stage at a point in time
+struct stage_snapshot {
+    stage_counter stages[stage::count];
+
+    /// Get the counter for a stage
+    stage_counter const & operator[](stage::value s) const {
+        return stages[s];
+    }
+
+    /// Sum of the cycles charged to all stages
+    uint64_t total_cycles() const {
+        uint64_t total = 0;
+        for (size_t i = 0; i < stage::count; ++i) {
+            total += stages[i].cycles;
+        }
+        return total;
+    }
+};
+
+#ifdef _WEBSOCKETPP_PROFILE_STAGES_
+
+class stage_scope;
+
+/// Process wide access to the per thread stage counters
+class stage_profile {
+public:
+    /// Sum the counters of every thread that has recorded a stage
+    /**
+     * Counters of threads that have exited are kept and included. Values read
+     * from threads that are still running may be slightly stale.
+     *
+     * @return The summed counters
+     */
+    static stage_snapshot snapshot() {
+        stage_snapshot s;
+        registry & r = get_registry();
+        lib::lock_guard<lib::mutex> guard(r.lock);
+        for (size_t i = 0; i < r.blocks.size(); ++i) {
+            for (size_t j = 0; j < stage::count; ++j) {
+                s.stages[j].cycles += r.blocks[i]->stages[j].cycles;
+                s.stages[j].calls += r.blocks[i]->stages[j].calls;
+            }
+        }
+        return s;
+    }
+
+    /// Zero the counters of every thread
+    /**
+     * Intended to be called between measurement intervals. Stages that are
+     * being recorded concurrently may lose their update.
+     */
+    static void reset() {
+        registry & r = get_registry();
+        lib::lock_guard<lib::mutex> guard(r.lock);
+        for (size_t i = 0; i < r.blocks.size(); ++i) {
+            for (size_t j = 0; j < stage::count; ++j) {
+                r.blocks[i]->stages[j] = stage_counter();
+            }
+        }
+    }
+private:
+    friend class stage_scope;
+
+    struct block {
+        block() : current(NULL) {}
+
+        stage_counter stages[stage::count];
+        stage_scope * current;
+    };
+
+    struct registry {
+        lib::mutex lock;
+        std::vector<block *> blocks;
+    };
+
+    static registry & get_registry() {
+        // Intentionally leaked so that blocks remain valid for threads that
+        // outlive static destruction.
+        static registry * r = new registry();
+        return *r;
+    }
+
+    /// Get the counters of the calling thread, registering them on first use
+    static block & local() {
+        static _WEBSOCKETPP_STAGE_TLS_ block * b = NULL;
+        if (!b) {
+            b = new block();
+            registry & r = get_registry();
+            lib::lock_guard<lib::mutex> guard(r.lock);
+            r.blocks.push_back(b);
+        }
+        return *b;
+    }
+};
+
+/// Charges the lifetime of the object to a stage
+/**
+ * Instances are created by the _WEBSOCKETPP_PROFILE_STAGE_ macro and must
+ * not outlive the scope that created them.
+ */
+class stage_scope {
+public:
+    explicit stage_scope(stage::value s)
+      : m_block(stage_profile::local())
+      , m_parent(m_block.current)
+      , m_stage(s)
+      , m_nested(0)
+    {
+        m_block.current = this;
+        m_start = cycles();
+    }
+
+    ~stage_scope() {
+        uint64_t elapsed = cycles() - m_start;
+        stage_counter & c = m_block.stages[m_stage];
+        c.cycles += (elapsed > m_nested ? elapsed - m_nested : 0);
+        ++c.calls;
+
+        if (m_parent) {
+            m_parent->m_nested += elapsed;
+        }
+        m_block.current = m_parent;
+    }
+private:
+    stage_scope(stage_scope const &);
+    stage_scope & operator=(stage_scope const &);
+
+    stage_profile::block & m_block;
+    stage_scope * m_parent;
+    stage::value m_stage;
+    uint64_t m_nested;
+    uint64_t m_start;
+};
+
+#else
+
+/// Process wide access to the per thread stage counters
+/**
+ * Stage profiling is compiled out. Snapshots are always empty.
+ */
+class stage_profile {
+public:
+    static stage_snapshot snapshot() {
+        return stage_snapshot();
+    }
+
+    static void reset() {}
+};
+
+#endif // _WEBSOCKETPP_PROFILE_STAGES_
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_STAGE_PROFILE_HPP
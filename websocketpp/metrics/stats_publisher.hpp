@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef WEBSOCKETPP_METRICS_STATS_PUBLISHER_HPP
+#define WEBSOCKETPP_METRICS_STATS_PUBLISHER_HPP
+
+#include <websocketpp/metrics/endpoint_counters.hpp>
+#include <websocketpp/metrics/shared_stats.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/common/thread.hpp>
+
+#include <pthread.h>
+
+namespace websocketpp {
+namespace metrics {
+
+/// Periodically publishes the counters of an Asio endpoint to shared memory
+/**
+ * Every interval a timer on the endpoint copies the counters attached with
+ * `endpoint::set_counters` to a shared_stats segment, along with how late the
+ * timer ran on the thread that ran it. The copy is a few hundred bytes, so
+ * the cost to the io threads does not depend on how often the segment is
+ * read.
+ *
+ * When several threads run the endpoint's io_service each sample is credited
+ * to the thread that happened to run the timer, so lag is reported for the
+ * threads that ran it at least once. Up to stats_snapshot::max_threads
+ * threads are tracked.
+ *
+ * The publisher must outlive the endpoint's processing or be stopped first.
+ *
+ * @since 0.8.2
+ */
+template <typename endpoint_type>
+class stats_publisher {
+public:
+    typedef typename endpoint_type::timer_ptr timer_ptr;
+    typedef lib::chrono::steady_clock clock_type;
+
+    stats_publisher(endpoint_type & endpoint,
+        endpoint_counters const & counters, shared_stats & segment)
+      : m_endpoint(endpoint)
+      , m_counters(counters)
+      , m_segment(segment)
+      , m_interval(1000)
+      , m_running(false) {}
+
+    /// Start publishing every `interval` milliseconds
+    void start(long interval) {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_interval = interval;
+        if (!m_running) {
+            m_running = true;
+            schedule();
+        }
+    }
+
+    /// Stop publishing. The last snapshot stays in the segment.
+    void stop() {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        m_running = false;
+        if (m_timer) {
+            m_timer->cancel();
+            m_timer.reset();
+        }
+    }
+
+    /// Publish a snapshot now
+    void publish() {
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        publish_locked();
+    }
+private:
+    /// Requires m_lock
+    void schedule() {
+        m_due = clock_type::now() + lib::chrono::milliseconds(m_interval);
+        m_timer = m_endpoint.set_timer(m_interval, lib::bind(
+            &stats_publisher::handle_timer, this, lib::placeholders::_1));
+    }
+
+    void handle_timer(lib::error_code const & ec) {
+        clock_type::time_point now = clock_type::now();
+
+        lib::lock_guard<lib::mutex> lock(m_lock);
+        if (ec || !m_running) {
+            return;
+        }
+
+        uint64_t lag = 0;
+        if (now > m_due) {
+            lag = static_cast<uint64_t>(lib::chrono::duration_cast<
+                lib::chrono::microseconds>(now - m_due).count());
+        }
+        thread_lag * slot = find_slot();
+        if (slot) {
+            slot->samples++;
+            slot->last_us = lag;
+            slot->total_us += lag;
+            if (lag > slot->max_us) {
+                slot->max_us = lag;
+            }
+        }
+
+        publish_locked();
+        schedule();
+    }
+
+    /// Find or claim the lag slot of the calling thread. Requires m_lock.
+    thread_lag * find_slot() {
+        pthread_t self = pthread_self();
+        size_t i = 0;
+        for (; i < m_snapshot.threads; ++i) {
+            if (pthread_equal(m_threads[i], self)) {
+                return &m_snapshot.lag[i];
+            }
+        }
+        if (i == stats_snapshot::max_threads) {
+            return NULL;
+        }
+        m_threads[i] = self;
+        m_snapshot.threads++;
+        return &m_snapshot.lag[i];
+    }
+
+    /// Requires m_lock
+    void publish_locked() {
+        m_snapshot.updated_us = static_cast<uint64_t>(
+            lib::chrono::duration_cast<lib::chrono::microseconds>(
+                lib::chrono::system_clock::now().time_since_epoch()).count());
+        m_snapshot.publishes++;
+        m_snapshot.counters = m_counters.snapshot();
+        m_segment.publish(m_snapshot);
+    }
+
+    endpoint_type & m_endpoint;
+    endpoint_counters const & m_counters;
+    shared_stats & m_segment;
+
+    lib::mutex m_lock;
+    long m_interval;
+    bool m_running;
+    timer_ptr m_timer;
+    clock_type::time_point m_due;
+    stats_snapshot m_snapshot;
+    pthread_t m_threads[stats_snapshot::max_threads];
+};
+
+} // namespace metrics
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_METRICS_STATS_PUBLISHER_HPP
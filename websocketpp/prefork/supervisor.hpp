@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_PREFORK_SUPERVISOR_HPP
+#define WEBSOCKETPP_PREFORK_SUPERVISOR_HPP
+
+#include <websocketpp/error.hpp>
+#include <websocketpp/metrics/endpoint_counters.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/functional.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+/// Multi-process servers made of single threaded workers
+namespace prefork {
+
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// The worker count must be at least one
+    invalid_worker_count,
+
+    /// No worker handler was set
+    no_worker_handler,
+
+    /// The shared memory segment for the worker records could not be mapped
+    shared_memory_failed,
+
+    /// A worker process could not be started
+    fork_failed,
+
+    /// run was called while the supervisor was already running
+    already_running
+};
+
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.prefork";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic prefork error";
+            case invalid_worker_count:
+                return "The worker count must be at least one";
+            case no_worker_handler:
+                return "No worker handler was set";
+            case shared_memory_failed:
+                return "Could not map shared memory for the worker records";
+            case fork_failed:
+                return "Could not start a worker process";
+            case already_running:
+                return "The supervisor is already running";
+            default:
+                return "Unknown";
+        }
+    }
+};
+
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+
+/// The shared memory record of one worker slot
+/**
+ * Records live in memory shared by the supervisor and all workers. The
+ * worker in a slot is the only writer of its counters while it runs. The
+ * supervisor reads them with relaxed atomic loads, so a total may be briefly
+ * behind or mix values from before and after an update.
+ */
+struct worker_record {
+    worker_record() : pid(0), starts(0), crashes(0) {}
+
+    /// Traffic totals of every worker that has run in this slot
+    metrics::endpoint_counters counters;
+    /// Process id of the running worker, 0 if none is running
+    int64_t pid;
+    /// Number of times a worker was started in this slot
+    uint64_t starts;
+    /// Number of workers in this slot that crashed or exited with an error
+    uint64_t crashes;
+};
+
+/// The view a worker process has of its slot
+class worker {
+public:
+    worker(size_t index, worker_record & record)
+      : m_index(index)
+      , m_record(record) {}
+
+    /// The slot index of this worker, from 0 to the worker count - 1
+    size_t get_index() const {
+        return m_index;
+    }
+
+    /// How many times a worker has been started in this slot, including this
+    /// one
+    uint64_t get_starts() const {
+        return m_record.starts;
+    }
+
+    /// Counters in shared memory for this worker's endpoint
+    /**
+     * Pass to `endpoint::set_counters` to report the endpoint's traffic to the
+     * supervisor.
+     */
+    metrics::endpoint_counters & get_counters() {
+        return m_record.counters;
+    }
+private:
+    size_t const m_index;
+    worker_record & m_record;
+};
+
+namespace detail {
+
+/// Stop flag set by the signal handler that handle_signals installs
+inline sig_atomic_t volatile & signal_stop_flag() {
+    static sig_atomic_t volatile flag = 0;
+    return flag;
+}
+
+inline void on_stop_signal(int) {
+    signal_stop_flag() = 1;
+}
+
+} // namespace detail
+
+/// Starts and restarts a fixed number of single threaded worker processes
+/**
+ * A supervisor forks `worker_count` processes and calls the worker handler in
+ * each of them. A worker typically creates a `server<config::asio_prefork>`,
+ * enables `set_reuse_port`, listens on the shared port and runs the
+ * endpoint's io_service on its only thread. The kernel spreads incoming
+ * connections over the listening sockets of the workers, so a busy or crashed
+ * worker only affects the connections it accepted.
+ *
+ * The supervisor restarts workers that crash or return a non zero exit code
+ * after the restart delay. A worker that returns 0 has finished and is not
+ * restarted. `run` returns once no workers are left running.
+ *
+ * Workers report their traffic through counters in an anonymous shared
+ * memory segment that the supervisor sums in `get_totals`. When a worker
+ * dies, its open connections are counted as closed.
+ *
+ * POSIX only. The supervisor does not use threads, so it is safe to fork
+ * from. Start it before creating any threads or io_services in the parent.
+ */
+class supervisor {
+public:
+    /// Type of the function run in each worker, returns the exit code
+    typedef lib::function<int(worker &)> worker_handler;
+    /// Type of the function called periodically in the supervisor process
+    typedef lib::function<void()> report_handler;
+
+    typedef lib::chrono::steady_clock clock_type;
+
+    /// Create a supervisor
+    /**
+     * @param worker_count The number of worker processes to run
+     */
+    explicit supervisor(size_t worker_count)
+      : m_worker_count(worker_count)
+      , m_records(NULL)
+      , m_restart_delay(1000)
+      , m_shutdown_timeout(5000)
+      , m_poll_interval(50)
+      , m_report_interval(0)
+      , m_stopping(false)
+      , m_running(false) {}
+
+    ~supervisor() {
+        if (m_records) {
+            munmap(m_records, segment_size());
+        }
+    }
+
+    /// Set the function run in each worker process
+    void set_worker_handler(worker_handler h) {
+        m_worker_handler = h;
+    }
+
+    /// Set a function called in the supervisor process every interval
+    /**
+     * @param h The function to call, typically reads `get_totals`
+     * @param interval The interval in milliseconds
+     */
+    void set_report_handler(report_handler h, long interval) {
+        m_report_handler = h;
+        m_report_interval = interval;
+    }
+
+    /// Set the time to wait before restarting a failed worker (ms)
+    void set_restart_delay(long ms) {
+        m_restart_delay = ms;
+    }
+
+    /// Set how long stopping workers get to exit before they are killed (ms)
+    void set_shutdown_timeout(long ms) {
+        m_shutdown_timeout = ms;
+    }
+
+    /// Stop on SIGINT and SIGTERM
+    /**
+     * Installs signal handlers in the supervisor process that make `run` stop
+     * the workers and return. Workers are started with the default
+     * dispositions for both signals.
+     */
+    void handle_signals() {
+        struct sigaction sa;
+        sa.sa_handler = &detail::on_stop_signal;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = 0;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    /// Ask `run` to stop the workers and return
+    /**
+     * Workers are sent SIGTERM and are killed if they have not exited after
+     * the shutdown timeout. May be called from the report handler.
+     */
+    void stop() {
+        m_stopping = true;
+    }
+
+    /// Run and supervise the workers until all of them have finished
+    /**
+     * @param ec Set to indicate what error occurred, if any.
+     */
+    void run(lib::error_code & ec) {
+        if (m_running) {
+            ec = error::make_error_code(error::already_running);
+            return;
+        }
+        if (m_worker_count == 0) {
+            ec = error::make_error_code(error::invalid_worker_count);
+            return;
+        }
+        if (!m_worker_handler) {
+            ec = error::make_error_code(error::no_worker_handler);
+            return;
+        }
+        if (!m_records) {
+            void * p = mmap(NULL, segment_size(), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                ec = error::make_error_code(error::shared_memory_failed);
+                return;
+            }
+            m_records = static_cast<worker_record *>(p);
+            for (size_t i = 0; i < m_worker_count; ++i) {
+                new (&m_records[i]) worker_record();
+            }
+        }
+
+        m_running = true;
+        m_stopping = false;
+        detail::signal_stop_flag() = 0;
+        m_slots.assign(m_worker_count, slot());
+
+        for (size_t i = 0; i < m_worker_count; ++i) {
+            if (!spawn(i)) {
+                ec = error::make_error_code(error::fork_failed);
+                m_stopping = true;
+                break;
+            }
+        }
+
+        supervise();
+        m_running = false;
+    }
+
+    /// Run and supervise the workers until all of them have finished
+    /**
+     * @exception websocketpp::exception
+     */
+    void run() {
+        lib::error_code ec;
+        run(ec);
+        if (ec) {
+            throw exception(ec);
+        }
+    }
+
+    /// Get the number of worker slots
+    size_t get_worker_count() const {
+        return m_worker_count;
+    }
+
+    /// Get a copy of the record of one worker slot
+    worker_record get_worker(size_t index) const {
+        if (!m_records || index >= m_worker_count) {
+            return worker_record();
+        }
+        return m_records[index];
+    }
+
+    /// Get the sum of the counters of all workers
+    metrics::endpoint_counters get_totals() const {
+        metrics::endpoint_counters totals;
+        if (!m_records) {
+            return totals;
+        }
+        for (size_t i = 0; i < m_worker_count; ++i) {
+            metrics::endpoint_counters c = m_records[i].counters.snapshot();
+            totals.connections_started += c.connections_started;
+            totals.connections_opened += c.connections_opened;
+            totals.connections_closed += c.connections_closed;
+            totals.connections_failed += c.connections_failed;
+            totals.http_requests += c.http_requests;
+            totals.bytes_in += c.bytes_in;
+            totals.bytes_out += c.bytes_out;
+            totals.messages_in += c.messages_in;
+            totals.messages_out += c.messages_out;
+            totals.queued_bytes += c.queued_bytes;
+        }
+        return totals;
+    }
+
+    /// Get the total number of worker restarts
+    uint64_t get_restarts() const {
+        uint64_t restarts = 0;
+        for (size_t i = 0; m_records && i < m_worker_count; ++i) {
+            if (m_records[i].starts > 1) {
+                restarts += m_records[i].starts - 1;
+            }
+        }
+        return restarts;
+    }
+private:
+    /// Supervisor side state of a worker slot
+    struct slot {
+        slot() : pid(0), restart_pending(false) {}
+
+        pid_t pid;
+        bool restart_pending;
+        clock_type::time_point restart_at;
+    };
+
+    size_t segment_size() const {
+        return sizeof(worker_record) * m_worker_count;
+    }
+
+    /// Fork the worker for slot `index`, returns false if fork failed
+    bool spawn(size_t index) {
+        worker_record & record = m_records[index];
+        record.starts++;
+
+        // flush so that buffered output is not written by both processes
+        std::fflush(NULL);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            record.starts--;
+            return false;
+        }
+
+        if (pid == 0) {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+
+            int code = 1;
+            worker w(index, record);
+            try {
+                code = m_worker_handler(w);
+            } catch (...) {
+                code = 1;
+            }
+            std::fflush(NULL);
+            _exit(code);
+        }
+
+        record.pid = pid;
+        m_slots[index].pid = pid;
+        m_slots[index].restart_pending = false;
+        return true;
+    }
+
+    /// Handle the exit of the worker in slot `index`
+    void reap(size_t index, int status) {
+        worker_record & record = m_records[index];
+        metrics::endpoint_counters & c = record.counters;
+
+        // connections that were open or opening died with the process
+        c.connections_closed = c.connections_opened;
+        c.connections_failed = c.connections_started - c.connections_opened -
+            c.http_requests;
+        c.queued_bytes = 0;
+        record.pid = 0;
+        m_slots[index].pid = 0;
+
+        // workers stopped by the supervisor did not crash
+        bool finished = m_stopping ||
+            (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        if (!finished) {
+            record.crashes++;
+            m_slots[index].restart_pending = true;
+            m_slots[index].restart_at = clock_type::now() +
+                lib::chrono::milliseconds(m_restart_delay);
+        }
+    }
+
+    void signal_workers(int sig) {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i].pid > 0) {
+                kill(m_slots[i].pid, sig);
+            }
+        }
+    }
+
+    void supervise() {
+        bool terminated = false;
+        bool killed = false;
+        clock_type::time_point kill_at;
+        clock_type::time_point next_report = clock_type::now() +
+            lib::chrono::milliseconds(m_report_interval);
+
+        while (true) {
+            // Only wait for workers, other children of the process belong to
+            // the application
+            for (size_t i = 0; i < m_slots.size(); ++i) {
+                int status;
+                if (m_slots[i].pid > 0 &&
+                    waitpid(m_slots[i].pid, &status, WNOHANG) == m_slots[i].pid)
+                {
+                    reap(i, status);
+                }
+            }
+
+            if (detail::signal_stop_flag()) {
+                m_stopping = true;
+            }
+
+            clock_type::time_point now = clock_type::now();
+            bool running = false;
+            bool pending = false;
+
+            for (size_t i = 0; i < m_slots.size(); ++i) {
+                if (m_slots[i].restart_pending && m_stopping) {
+                    m_slots[i].restart_pending = false;
+                }
+                if (m_slots[i].restart_pending && now >= m_slots[i].restart_at)
+                {
+                    if (!spawn(i)) {
+                        m_slots[i].restart_at = now +
+                            lib::chrono::milliseconds(m_restart_delay);
+                    }
+                }
+                running = running || m_slots[i].pid > 0;
+                pending = pending || m_slots[i].restart_pending;
+            }
+
+            if (!running && !pending) {
+                break;
+            }
+
+            if (m_stopping) {
+                if (!terminated) {
+                    signal_workers(SIGTERM);
+                    terminated = true;
+                    kill_at = now +
+                        lib::chrono::milliseconds(m_shutdown_timeout);
+                } else if (!killed && now >= kill_at) {
+                    signal_workers(SIGKILL);
+                    killed = true;
+                }
+            }
+
+            if (m_report_handler && m_report_interval > 0 &&
+                now >= next_report)
+            {
+                m_report_handler();
+                next_report = now +
+                    lib::chrono::milliseconds(m_report_interval);
+            }
+
+            timespec ts;
+            ts.tv_sec = m_poll_interval / 1000;
+            ts.tv_nsec = (m_poll_interval % 1000) * 1000000;
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    size_t const m_worker_count;
+    worker_record * m_records;
+    std::vector<slot> m_slots;
+
+    worker_handler m_worker_handler;
+    report_handler m_report_handler;
+
+    long m_restart_delay;
+    long m_shutdown_timeout;
+    long m_poll_interval;
+    long m_report_interval;
+
+    bool m_stopping;
+    bool m_running;
+};
+
+} // namespace prefork
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_PREFORK_SUPERVISOR_HPP
@@ -357,6 +357,8 @@ public:
         // hybi00 doesn't support compression
         // hybi00 doesn't have masking
 
+        // the connection tells data frames from control frames by opcode
+        out->set_opcode(frame::opcode::text);
         out->set_prepared(true);
 
         return lib::error_code();
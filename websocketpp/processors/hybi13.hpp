@@ -33,6 +33,8 @@
 #include <websocketpp/frame.hpp>
 #include <websocketpp/http/constants.hpp>
 
+#include <websocketpp/metrics/probes.hpp>
+#include <websocketpp/metrics/stage_profile.hpp>
 #include <websocketpp/utf8_validator.hpp>
 #include <websocketpp/sha1/sha1.hpp>
 #include <websocketpp/base64/base64.hpp>
@@ -42,6 +44,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <deque>
 #include <string>
 #include <vector>
 #include <utility>
@@ -66,6 +69,7 @@ public:
     typedef typename config::rng_type rng_type;
 
     typedef typename config::permessage_deflate_type permessage_deflate_type;
+    typedef typename config::message_batching_type message_batching_type;
 
     typedef std::pair<lib::error_code,std::string> err_str_pair;
 
@@ -85,6 +89,29 @@ public:
         return m_permessage_deflate.is_implemented();
     }
 
+    bool permessage_compress_enabled() const {
+        return m_permessage_deflate.is_enabled();
+    }
+
+    bool message_batching_enabled() const {
+        return m_message_batching.is_enabled();
+    }
+
+    bool accepts_shared_deflate(uint8_t window_bits, bool reset) const {
+        return m_permessage_deflate.is_enabled() &&
+            m_permessage_deflate.accepts_shared_deflate(window_bits,reset);
+    }
+
+    lib::error_code set_permessage_compress_settings(
+        extensions::permessage_deflate::settings const & s)
+    {
+        return m_permessage_deflate.apply_settings(s);
+    }
+
+    size_t permessage_compress_memory() const {
+        return m_permessage_deflate.estimate_memory();
+    }
+
     err_str_pair negotiate_extensions(request_type const & request) {
         return negotiate_extensions_helper(request);
     }
@@ -155,7 +182,7 @@ public:
 
                 // Actually try to initialize the extension before we
                 // deem negotiation complete
-                lib::error_code ec = m_permessage_deflate.init(base::m_server);
+                lib::error_code ec = m_permessage_deflate.init(base::is_server());
 
                 if (ec) {
                     // Negotiation succeeded but initialization failed this is 
@@ -174,10 +201,40 @@ public:
             }
         }
 
+        // An init failure of an earlier extension stops negotiation of the
+        // ones after it
+        if (ret.first) {
+            return ret;
+        }
+
+        if (m_message_batching.is_implemented()) {
+            for (it = p.begin(); it != p.end(); ++it) {
+                if (it->first != m_message_batching.get_name()) {
+                    continue;
+                }
+
+                err_str_pair neg_ret = m_message_batching.negotiate(it->second);
+
+                if (neg_ret.first) {
+                    continue;
+                }
+
+                lib::error_code ec = m_message_batching.init(base::is_server());
+
+                if (ec) {
+                    ret.first = ec;
+                } else {
+                    if (!ret.second.empty()) {
+                        ret.second += ", ";
+                    }
+                    ret.second += neg_ret.second;
+                }
+                break;
+            }
+        }
+
         // support for future extensions would go here. Should check the value of 
-        // ret.first before continuing. Might need to consider whether failure of
-        // negotiation of an earlier extension should stop negotiation of subsequent
-        // ones
+        // ret.first before continuing.
 
         return ret;
     }
@@ -268,11 +325,22 @@ public:
 
         req.replace_header("Sec-WebSocket-Key",base64_encode(raw_key, 16));
 
+        std::string offer;
+
         if (m_permessage_deflate.is_implemented()) {
-            std::string offer = m_permessage_deflate.generate_offer();
-            if (!offer.empty()) {
-                req.replace_header("Sec-WebSocket-Extensions",offer);
+            offer = m_permessage_deflate.generate_offer();
+        }
+
+        if (m_message_batching.is_implemented()) {
+            std::string batch_offer = m_message_batching.generate_offer();
+            if (!offer.empty() && !batch_offer.empty()) {
+                offer += ", ";
             }
+            offer += batch_offer;
+        }
+
+        if (!offer.empty()) {
+            req.replace_header("Sec-WebSocket-Extensions",offer);
         }
 
         return lib::error_code();
@@ -380,6 +448,7 @@ public:
      * @return Number of bytes processed or zero on error
      */
     size_t consume(uint8_t * buf, size_t len, lib::error_code & ec) {
+        _WEBSOCKETPP_PROFILE_STAGE_(frame_parse);
         size_t p = 0;
 
         ec = lib::error_code();
@@ -392,6 +461,28 @@ public:
                (p < len || m_bytes_needed == 0))
         {
             if (m_state == HEADER_BASIC) {
+                // Fast path: when the whole header is in the buffer, which
+                // is the case for all but the frames split across reads,
+                // read and validate it in one step
+                size_t header_len = this->copy_full_header(buf+p,len-p);
+                if (header_len > 0) {
+                    p += header_len;
+
+                    ec = this->validate_incoming_basic_header(
+                        m_basic_header, base::is_server(), !m_data_msg.msg_ptr
+                    );
+                    if (ec) {break;}
+
+                    ec = validate_incoming_extended_header(m_basic_header,
+                        m_extended_header);
+                    if (ec) {break;}
+
+                    ec = this->begin_frame();
+                    if (ec) {break;}
+
+                    continue;
+                }
+
                 p += this->copy_basic_header_bytes(buf+p,len-p);
 
                 if (m_bytes_needed > 0) {
@@ -399,7 +490,7 @@ public:
                 }
 
                 ec = this->validate_incoming_basic_header(
-                    m_basic_header, base::m_server, !m_data_msg.msg_ptr
+                    m_basic_header, base::is_server(), !m_data_msg.msg_ptr
                 );
                 if (ec) {break;}
 
@@ -418,60 +509,8 @@ public:
                 ec = validate_incoming_extended_header(m_basic_header,m_extended_header);
                 if (ec){break;}
 
-                m_state = APPLICATION;
-                m_bytes_needed = static_cast<size_t>(get_payload_size(m_basic_header,m_extended_header));
-
-                // check if this frame is the start of a new message and set up
-                // the appropriate message metadata.
-                frame::opcode::value op = frame::get_opcode(m_basic_header);
-
-                // TODO: get_message failure conditions
-
-                if (frame::opcode::is_control(op)) {
-                    m_control_msg = msg_metadata(
-                        m_msg_manager->get_message(op,m_bytes_needed),
-                        frame::get_masking_key(m_basic_header,m_extended_header)
-                    );
-
-                    m_current_msg = &m_control_msg;
-                } else {
-                    if (!m_data_msg.msg_ptr) {
-                        if (m_bytes_needed > base::m_max_message_size) {
-                            ec = make_error_code(error::message_too_big);
-                            break;
-                        }
-                        
-                        m_data_msg = msg_metadata(
-                            m_msg_manager->get_message(op,m_bytes_needed),
-                            frame::get_masking_key(m_basic_header,m_extended_header)
-                        );
-                        
-                        if (m_permessage_deflate.is_enabled()) {
-                            m_data_msg.msg_ptr->set_compressed(frame::get_rsv1(m_basic_header));
-                        }
-                    } else {
-                        // Fetch the underlying payload buffer from the data message we
-                        // are writing into.
-                        std::string & out = m_data_msg.msg_ptr->get_raw_payload();
-                        
-                        if (out.size() + m_bytes_needed > base::m_max_message_size) {
-                            ec = make_error_code(error::message_too_big);
-                            break;
-                        }
-                        
-                        // Each frame starts a new masking key. All other state
-                        // remains between frames.
-                        m_data_msg.prepared_key = prepare_masking_key(
-                            frame::get_masking_key(
-                                m_basic_header,
-                                m_extended_header
-                            )
-                        );
-                        
-                        out.reserve(out.size() + m_bytes_needed);
-                    }
-                    m_current_msg = &m_data_msg;
-                }
+                ec = this->begin_frame();
+                if (ec){break;}
             } else if (m_state == EXTENSION) {
                 m_state = APPLICATION;
             } else if (m_state == APPLICATION) {
@@ -507,6 +546,74 @@ public:
         return p;
     }
 
+    /// Set up the state for the payload of a frame whose header was read
+    /**
+     * Called once both parts of the header are read and validated.
+     *
+     * @return A code indicating errors, if any
+     */
+    lib::error_code begin_frame() {
+        m_state = APPLICATION;
+        m_bytes_needed = static_cast<size_t>(get_payload_size(m_basic_header,m_extended_header));
+
+        // check if this frame is the start of a new message and set up
+        // the appropriate message metadata.
+        frame::opcode::value op = frame::get_opcode(m_basic_header);
+
+        _WEBSOCKETPP_PROBE2_(frame_parsed, static_cast<int>(op),
+            static_cast<uint64_t>(m_bytes_needed));
+
+        // TODO: get_message failure conditions
+
+        if (frame::opcode::is_control(op)) {
+            m_control_msg = msg_metadata(
+                m_msg_manager->get_message(op,m_bytes_needed),
+                frame::get_masking_key(m_basic_header,m_extended_header)
+            );
+
+            m_current_msg = &m_control_msg;
+        } else {
+            if (!m_data_msg.msg_ptr) {
+                if (m_bytes_needed > base::m_max_message_size) {
+                    return make_error_code(error::message_too_big);
+                }
+
+                m_data_msg = msg_metadata(
+                    m_msg_manager->get_message(op,m_bytes_needed),
+                    frame::get_masking_key(m_basic_header,m_extended_header)
+                );
+
+                if (m_permessage_deflate.is_enabled()) {
+                    m_data_msg.msg_ptr->set_compressed(frame::get_rsv1(m_basic_header));
+                }
+
+                m_data_msg.batched = frame::get_rsv2(m_basic_header);
+            } else {
+                // Fetch the underlying payload buffer from the data message we
+                // are writing into.
+                std::string & out = m_data_msg.msg_ptr->get_raw_payload();
+
+                if (out.size() + m_bytes_needed > base::m_max_message_size) {
+                    return make_error_code(error::message_too_big);
+                }
+
+                // Each frame starts a new masking key. All other state
+                // remains between frames.
+                m_data_msg.prepared_key = prepare_masking_key(
+                    frame::get_masking_key(
+                        m_basic_header,
+                        m_extended_header
+                    )
+                );
+
+                out.reserve(out.size() + m_bytes_needed);
+            }
+            m_current_msg = &m_data_msg;
+        }
+
+        return lib::error_code();
+    }
+
     /// Perform any finalization actions on an incoming message
     /**
      * Called after the full message is received. Provides the opportunity for
@@ -527,14 +634,25 @@ public:
 
             // Decompress current buffer into the message buffer
             lib::error_code ec;
-            ec = m_permessage_deflate.decompress(trailer,4,out);
+            ec = m_permessage_deflate.decompress(trailer,4,out,
+                base::m_max_message_size);
+
+            if (out.size() > base::m_max_message_size) {
+                ec = make_error_code(error::message_too_big);
+            }
             if (ec) {
                 return ec;
             }
         }
 
-        // ensure that text messages end on a valid UTF8 code point
-        if (frame::get_opcode(m_basic_header) == frame::opcode::TEXT) {
+        // Batches are validated per message as they are unpacked
+        if (m_current_msg->batched) {
+            lib::error_code ec = unpack_batch();
+            if (ec) {
+                return ec;
+            }
+        } else if (frame::get_opcode(m_basic_header) == frame::opcode::TEXT) {
+            // ensure that text messages end on a valid UTF8 code point
             if (!m_current_msg->validator.complete()) {
                 return make_error_code(error::invalid_utf8);
             }
@@ -568,6 +686,21 @@ public:
         if (!ready()) {
             return message_ptr();
         }
+
+        // Messages unpacked from a batch are handed out one per call. The
+        // processor stays ready until the last one is taken.
+        if (!m_batch.empty()) {
+            message_ptr ret = m_batch.front();
+            m_batch.pop_front();
+
+            if (m_batch.empty()) {
+                m_data_msg.msg_ptr.reset();
+                this->reset_headers();
+            }
+
+            return ret;
+        }
+
         message_ptr ret = m_current_msg->msg_ptr;
         m_current_msg->msg_ptr.reset();
 
@@ -604,6 +737,8 @@ public:
      */
     virtual lib::error_code prepare_data_frame(message_ptr in, message_ptr out)
     {
+        _WEBSOCKETPP_PROFILE_STAGE_(prepare);
+
         if (!in || !out) {
             return make_error_code(error::invalid_arguments);
         }
@@ -615,71 +750,145 @@ public:
             return make_error_code(error::invalid_opcode);
         }
 
-        std::string& i = in->get_raw_payload();
-        std::string& o = out->get_raw_payload();
+        std::string const & i = in->get_payload();
 
         // validate payload utf8
-        if (op == frame::opcode::TEXT && !utf8_validator::validate(i)) {
-            return make_error_code(error::invalid_payload);
+        if (op == frame::opcode::TEXT) {
+            _WEBSOCKETPP_PROFILE_STAGE_(utf8_validate);
+            if (!utf8_validator::validate(i)) {
+                return make_error_code(error::invalid_payload);
+            }
         }
 
-        frame::masking_key_type key;
-        bool masked = !base::m_server;
-        bool compressed = m_permessage_deflate.is_enabled()
-                          && in->get_compressed();
-        bool fin = in->get_fin();
+        return this->prepare_data(in,0,i.size(),out);
+    }
 
-        if (masked) {
-            // Generate masking key.
-            key.i = m_rng();
-        } else {
-            key.i = 0;
+    virtual lib::error_code prepare_data_fragment(message_ptr in, size_t offset,
+        size_t len, message_ptr out)
+    {
+        _WEBSOCKETPP_PROFILE_STAGE_(prepare);
+
+        if (!in || !out) {
+            return make_error_code(error::invalid_arguments);
         }
 
-        // prepare payload
-        if (compressed) {
-            // compress and store in o after header.
-            m_permessage_deflate.compress(i,o);
+        if (frame::opcode::is_control(in->get_opcode())) {
+            return make_error_code(error::invalid_opcode);
+        }
 
-            if (o.size() < 4) {
-                return make_error_code(error::general);
-            }
+        size_t size = in->get_payload().size();
+        if (offset > size || len > size - offset) {
+            return make_error_code(error::invalid_arguments);
+        }
 
-            // Strip trailing 4 0x00 0x00 0xff 0xff bytes before writing to the
-            // wire
-            o.resize(o.size()-4);
+        return this->prepare_data(in,offset,len,out);
+    }
 
-            // mask in place if necessary
-            if (masked) {
-                this->masked_copy(o,o,key);
+    virtual lib::error_code prepare_batch(std::vector<message_ptr> const & in,
+        message_ptr out)
+    {
+        _WEBSOCKETPP_PROFILE_STAGE_(prepare);
+
+        if (!m_message_batching.is_enabled()) {
+            return make_error_code(error::extensions_disabled);
+        }
+
+        if (in.empty() || !in.front() || !out) {
+            return make_error_code(error::invalid_arguments);
+        }
+
+        frame::opcode::value op = in.front()->get_opcode();
+
+        if (frame::opcode::is_control(op)) {
+            return make_error_code(error::invalid_opcode);
+        }
+
+        size_t total = 0;
+        bool compressed = false;
+
+        typename std::vector<message_ptr>::const_iterator it;
+        for (it = in.begin(); it != in.end(); ++it) {
+            if (!*it || !(*it)->get_fin()) {
+                return make_error_code(error::invalid_arguments);
+            }
+            if ((*it)->get_opcode() != op) {
+                return make_error_code(error::invalid_opcode);
             }
-        } else {
-            // no compression, just copy data into the output buffer
-            o.resize(i.size());
 
-            // if we are masked, have the masking function write to the output
-            // buffer directly to avoid another copy. If not masked, copy
-            // directly without masking.
-            if (masked) {
-                this->masked_copy(i,o,key);
-            } else {
-                std::copy(i.begin(),i.end(),o.begin());
+            // payload plus the largest length prefix
+            total += (*it)->get_payload().size() + 10;
+            compressed = compressed || (*it)->get_compressed();
+        }
+
+        message_ptr batch = m_msg_manager->get_message(op,total);
+        if (!batch) {
+            return make_error_code(error::general);
+        }
+
+        std::string & payload = batch->get_raw_payload();
+        for (it = in.begin(); it != in.end(); ++it) {
+            std::string const & i = (*it)->get_payload();
+            lib::error_code ec = m_message_batching.pack(
+                reinterpret_cast<uint8_t const *>(i.data()),i.size(),payload);
+            if (ec) {
+                return ec;
             }
         }
 
-        // generate header
-        frame::basic_header h(op,o.size(),fin,masked,compressed);
+        batch->set_compressed(compressed);
+
+        return this->prepare_data(batch,0,payload.size(),out,true);
+    }
+
+    virtual lib::error_code prepare_shared_deflate(frame::opcode::value op,
+        std::string const & payload, message_ptr out)
+    {
+        _WEBSOCKETPP_PROFILE_STAGE_(prepare);
+
+        if (!out) {
+            return make_error_code(error::invalid_arguments);
+        }
+
+        if (frame::opcode::is_control(op)) {
+            return make_error_code(error::invalid_opcode);
+        }
+
+        if (!m_permessage_deflate.is_enabled()) {
+            return make_error_code(error::extensions_disabled);
+        }
+
+        std::string & o = out->get_raw_payload();
+        o.resize(payload.size());
+
+        frame::masking_key_type key;
+        bool masked = !base::is_server();
 
         if (masked) {
-            frame::extended_header e(o.size(),key.i);
-            out->set_header(frame::prepare_header(h,e));
+            _WEBSOCKETPP_PROFILE_STAGE_(mask);
+            key.i = m_rng();
+            this->masked_copy(payload,o,key);
         } else {
-            frame::extended_header e(o.size());
-            out->set_header(frame::prepare_header(h,e));
+            std::copy(payload.begin(),payload.end(),o.begin());
+        }
+
+        {
+            _WEBSOCKETPP_PROFILE_STAGE_(header);
+            frame::basic_header h(op,o.size(),true,masked,true);
+
+            if (masked) {
+                frame::extended_header e(o.size(),key.i);
+                out->set_header(frame::prepare_header(h,e));
+            } else {
+                frame::extended_header e(o.size());
+                out->set_header(frame::prepare_header(h,e));
+            }
         }
 
         out->set_prepared(true);
         out->set_opcode(op);
+        out->set_fin(true);
+
+        m_permessage_deflate.reset_deflate();
 
         return lib::error_code();
     }
@@ -772,6 +981,37 @@ protected:
         }
     }
 
+    /// Reads a complete frame header from buf
+    /**
+     * Only reads anything at the start of a header and if the whole header,
+     * basic and extended, is in buf. Otherwise the header is read piecewise
+     * by copy_basic_header_bytes and copy_extended_header_bytes.
+     *
+     * @param buf Input buffer
+     * @param len Length of buf
+     * @return The length of the header read, or zero
+     */
+    size_t copy_full_header(uint8_t const * buf, size_t len) {
+        if (m_bytes_needed != frame::BASIC_HEADER_LENGTH ||
+            len < frame::BASIC_HEADER_LENGTH)
+        {
+            return 0;
+        }
+
+        frame::basic_header h(buf[0],buf[1]);
+        size_t header_len = frame::get_header_len(h);
+        if (len < header_len) {
+            return 0;
+        }
+
+        m_basic_header = h;
+        std::copy(buf+frame::BASIC_HEADER_LENGTH,buf+header_len,
+            m_extended_header.bytes);
+        m_bytes_needed = 0;
+
+        return header_len;
+    }
+
     /// Reads bytes from buf into m_extended_header
     size_t copy_extended_header_bytes(uint8_t const * buf, size_t len) {
         size_t bytes_to_read = (std::min)(m_bytes_needed,len);
@@ -800,6 +1040,7 @@ protected:
     {
         // unmask if masked
         if (frame::get_masked(m_basic_header)) {
+            _WEBSOCKETPP_PROFILE_STAGE_(unmask);
             m_current_msg->prepared_key = frame::byte_mask_circ(
                 buf, len, m_current_msg->prepared_key);
             // TODO: SIMD masking
@@ -813,7 +1054,14 @@ protected:
             && m_current_msg->msg_ptr->get_compressed())
         {
             // Decompress current buffer into the message buffer
-            ec = m_permessage_deflate.decompress(buf,len,out);
+            _WEBSOCKETPP_PROFILE_STAGE_(inflate);
+            ec = m_permessage_deflate.decompress(buf,len,out,
+                base::m_max_message_size);
+
+            // the frame size checks see only the compressed length
+            if (out.size() > base::m_max_message_size) {
+                ec = make_error_code(error::message_too_big);
+            }
             if (ec) {
                 return 0;
             }
@@ -822,8 +1070,12 @@ protected:
             out.append(reinterpret_cast<char *>(buf),len);
         }
 
-        // validate unmasked, decompressed values
-        if (m_current_msg->msg_ptr->get_opcode() == frame::opcode::TEXT) {
+        // validate unmasked, decompressed values. Batch payloads contain length
+        // prefixes and are validated per message in finalize_message.
+        if (m_current_msg->msg_ptr->get_opcode() == frame::opcode::TEXT
+            && !m_current_msg->batched)
+        {
+            _WEBSOCKETPP_PROFILE_STAGE_(utf8_validate);
             if (!m_current_msg->validator.decode(out.begin()+offset,out.end())) {
                 ec = make_error_code(error::invalid_utf8);
                 return 0;
@@ -869,7 +1121,16 @@ protected:
             return make_error_code(error::invalid_rsv_bit);
         }
 
-        if (frame::get_rsv2(h) || frame::get_rsv3(h)) {
+        // rsv2 marks a message batch. It is allowed on the first frame of a
+        // data message if message batching is enabled for this connection.
+        if (frame::get_rsv2(h) && (!m_message_batching.is_enabled()
+                || frame::opcode::is_control(op)
+                || op == frame::opcode::CONTINUATION || !new_msg))
+        {
+            return make_error_code(error::invalid_rsv_bit);
+        }
+
+        if (frame::get_rsv3(h)) {
             return make_error_code(error::invalid_rsv_bit);
         }
 
@@ -965,6 +1226,159 @@ protected:
         // TODO: SIMD masking
     }
 
+    /// Mask, compress and frame part of a data message payload
+    /**
+     * The first fragment keeps the message opcode and the compression bit, the
+     * rest are continuation frames. The deflate trailer is only stripped from
+     * the last fragment, so that the fragments concatenate into one valid
+     * compressed message.
+     *
+     * @param in The message to take the payload from
+     * @param offset Offset of the first payload byte to prepare
+     * @param len Number of payload bytes to prepare
+     * @param out The message buffer to store the prepared frame in
+     * @param batched Whether the payload is a message batch
+     * @return Status code, zero on success, non-zero on error
+     */
+    lib::error_code prepare_data(message_ptr in, size_t offset, size_t len,
+        message_ptr out, bool batched = false)
+    {
+        std::string const & i = in->get_payload();
+        std::string& o = out->get_raw_payload();
+
+        bool first = (offset == 0);
+        bool last = (offset + len == i.size());
+
+        frame::opcode::value op = first ? in->get_opcode() :
+            frame::opcode::CONTINUATION;
+
+        frame::masking_key_type key;
+        bool masked = !base::is_server();
+        bool compressed = m_permessage_deflate.is_enabled()
+                          && in->get_compressed();
+        bool fin = in->get_fin() && last;
+
+        if (masked) {
+            // Generate masking key.
+            key.i = m_rng();
+        } else {
+            key.i = 0;
+        }
+
+        // prepare payload
+        if (compressed) {
+            // compress and store in o after header.
+            {
+                _WEBSOCKETPP_PROFILE_STAGE_(deflate);
+                m_permessage_deflate.compress(
+                    reinterpret_cast<uint8_t const *>(i.data())+offset,len,o);
+            }
+
+            if (o.size() < 4) {
+                return make_error_code(error::general);
+            }
+
+            // Strip trailing 4 0x00 0x00 0xff 0xff bytes before writing to the
+            // wire
+            if (last) {
+                o.resize(o.size()-4);
+            }
+
+            // mask in place if necessary
+            if (masked) {
+                _WEBSOCKETPP_PROFILE_STAGE_(mask);
+                this->masked_copy(o,o,key);
+            }
+        } else {
+            // no compression, just copy data into the output buffer
+            o.resize(len);
+
+            // if we are masked, have the masking function write to the output
+            // buffer directly to avoid another copy. If not masked, copy
+            // directly without masking.
+            if (masked) {
+                _WEBSOCKETPP_PROFILE_STAGE_(mask);
+                frame::byte_mask(i.begin()+offset,i.begin()+offset+len,
+                    o.begin(),key);
+            } else {
+                std::copy(i.begin()+offset,i.begin()+offset+len,o.begin());
+            }
+        }
+
+        // generate header
+        {
+            _WEBSOCKETPP_PROFILE_STAGE_(header);
+            frame::basic_header h(op,o.size(),fin,masked,compressed && first,
+                batched && first);
+
+            if (masked) {
+                frame::extended_header e(o.size(),key.i);
+                out->set_header(frame::prepare_header(h,e));
+            } else {
+                frame::extended_header e(o.size());
+                out->set_header(frame::prepare_header(h,e));
+            }
+        }
+
+        out->set_prepared(true);
+        out->set_opcode(op);
+        out->set_fin(fin);
+
+        return lib::error_code();
+    }
+
+    /// Split a received batch into its messages
+    /**
+     * Unpacks the payload of the current data message into m_batch. Each
+     * message keeps the opcode and compression flag of the batch. Text
+     * messages are validated individually.
+     *
+     * @return Status code, zero on success, non-zero on error
+     */
+    lib::error_code unpack_batch() {
+        message_ptr msg = m_current_msg->msg_ptr;
+        std::string const & payload = msg->get_payload();
+        frame::opcode::value op = msg->get_opcode();
+
+        size_t offset = 0;
+        while (offset < payload.size()) {
+            size_t len = 0;
+            lib::error_code ec = m_message_batching.unpack(payload,offset,len);
+            if (ec) {
+                m_batch.clear();
+                return ec;
+            }
+
+            if (op == frame::opcode::TEXT) {
+                _WEBSOCKETPP_PROFILE_STAGE_(utf8_validate);
+                utf8_validator::validator v;
+                if (!v.decode(payload.begin()+(offset-len),
+                    payload.begin()+offset) || !v.complete())
+                {
+                    m_batch.clear();
+                    return make_error_code(error::invalid_utf8);
+                }
+            }
+
+            message_ptr m = m_msg_manager->get_message(op,len);
+            if (!m) {
+                m_batch.clear();
+                return make_error_code(error::general);
+            }
+            m->get_raw_payload().assign(payload,offset-len,len);
+            m->set_compressed(msg->get_compressed());
+
+            m_batch.push_back(m);
+        }
+
+        // A batch must carry at least one message
+        if (m_batch.empty()) {
+            return make_error_code(error::invalid_payload);
+        }
+
+        return lib::error_code();
+    }
+
     /// Generic prepare control frame with opcode and payload.
     /**
      * Internal control frame building method. Handles validation, masking, etc
@@ -990,7 +1404,7 @@ protected:
         }
 
         frame::masking_key_type key;
-        bool masked = !base::m_server;
+        bool masked = !base::is_server();
 
         frame::basic_header h(op,payload.size(),true,masked);
 
@@ -1029,15 +1443,20 @@ protected:
     /// the buffer it is being written to, its masking key, its UTF8 validation
     /// state, and sometimes its compression state.
     struct msg_metadata {
-        msg_metadata() {}
-        msg_metadata(message_ptr m, size_t p) : msg_ptr(m),prepared_key(p) {}
+        msg_metadata() : batched(false) {}
+        msg_metadata(message_ptr m, size_t p)
+          : msg_ptr(m)
+          , prepared_key(p)
+          , batched(false) {}
         msg_metadata(message_ptr m, frame::masking_key_type p)
           : msg_ptr(m)
-          , prepared_key(prepare_masking_key(p)) {}
+          , prepared_key(prepare_masking_key(p))
+          , batched(false) {}
 
         message_ptr msg_ptr;        // pointer to the message data buffer
         size_t      prepared_key;   // prepared masking key
         utf8_validator::validator validator; // utf8 validation state
+        bool        batched;        // payload is a message batch
     };
 
     // Basic header of the frame being read
@@ -1068,8 +1487,12 @@ protected:
     // Overall state of the processor
     state m_state;
 
+    // Messages unpacked from the last batch that are not yet handed out
+    std::deque<message_ptr> m_batch;
+
     // Extensions
     permessage_deflate_type m_permessage_deflate;
+    message_batching_type m_message_batching;
 };
 
 } // namespace processor
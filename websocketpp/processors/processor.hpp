@@ -29,9 +29,13 @@
 #define WEBSOCKETPP_PROCESSOR_HPP
 
 #include <websocketpp/processors/base.hpp>
+#include <websocketpp/roles/role.hpp>
 #include <websocketpp/common/system_error.hpp>
 
 #include <websocketpp/close.hpp>
+#include <websocketpp/extensions/extension.hpp>
+#include <websocketpp/extensions/permessage_deflate/policy.hpp>
+#include <websocketpp/frame.hpp>
 #include <websocketpp/utilities.hpp>
 #include <websocketpp/uri.hpp>
 
@@ -213,6 +217,61 @@ public:
         return false;
     }
 
+    /// Returns whether permessage_compress was negotiated for this connection
+    /**
+     * @since 0.8.2
+     */
+    virtual bool permessage_compress_enabled() const {
+        return false;
+    }
+
+    /// Returns whether message batching was negotiated for this connection
+    /**
+     * @since 0.8.2
+     */
+    virtual bool message_batching_enabled() const {
+        return false;
+    }
+
+    /// Test whether compressed broadcast bytes may be sent on this connection
+    /**
+     * @since 0.8.2
+     *
+     * @param window_bits LZ77 window size of the shared compressor
+     * @param reset Whether the message was compressed without history
+     * @return Whether the shared bytes may be sent
+     */
+    virtual bool accepts_shared_deflate(uint8_t, bool) const {
+        return false;
+    }
+
+    /// Apply the permessage_compress settings picked for this connection
+    /**
+     * Must be called before negotiate_extensions. By default
+     * permessage_compress is not implemented and this returns
+     * extensions::error::disabled.
+     *
+     * @since 0.8.2
+     *
+     * @param s The settings to negotiate with
+     * @return A status code
+     */
+    virtual lib::error_code set_permessage_compress_settings(
+        extensions::permessage_deflate::settings const &)
+    {
+        return extensions::error::make_error_code(extensions::error::disabled);
+    }
+
+    /// Estimate the memory used by the permessage_compress state
+    /**
+     * @since 0.8.2
+     *
+     * @return The estimated memory in bytes, 0 if not negotiated
+     */
+    virtual size_t permessage_compress_memory() const {
+        return 0;
+    }
+
     /// Initializes extensions based on the Sec-WebSocket-Extensions header
     /**
      * Reads the Sec-WebSocket-Extensions header and determines if any of the
@@ -357,6 +416,82 @@ public:
      */
     virtual lib::error_code prepare_data_frame(message_ptr in, message_ptr out) = 0;
 
+    /// Prepare one fragment of a data message for writing
+    /**
+     * Prepares `len` payload bytes of `in` starting at `offset` as a single
+     * frame. The fragment at offset zero carries the message's opcode, the
+     * rest are continuation frames. Only the fragment that ends the payload
+     * carries the message's fin bit. Fragments must be prepared in order and
+     * no other data message may be prepared until the last one is.
+     *
+     * The payload is not validated. Callers should check it before preparing
+     * the first fragment.
+     *
+     * Protocol versions that do not support fragmentation return
+     * `not_implemented`.
+     *
+     * @since 0.8.2
+     *
+     * @param in The message to take the fragment from
+     * @param offset Offset of the first payload byte of the fragment
+     * @param len Number of payload bytes in the fragment
+     * @param out The message buffer to prepare the fragment in
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_data_fragment(message_ptr, size_t, size_t,
+        message_ptr)
+    {
+        return make_error_code(error::not_implemented);
+    }
+
+    /// Prepare several data messages as a single batch frame
+    /**
+     * Packs the payloads of `in` into one frame that the remote endpoint
+     * unpacks into separate messages. All messages must be unfragmented data
+     * messages with the same opcode. Requires a negotiated message batching
+     * extension.
+     *
+     * The payloads are not validated. Callers should check them before
+     * queueing the messages.
+     *
+     * Processors that do not support message batching return
+     * `not_implemented`.
+     *
+     * @since 0.8.2
+     *
+     * @param in The messages to pack, in order
+     * @param out The message buffer to prepare the batch in
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_batch(std::vector<message_ptr> const &,
+        message_ptr)
+    {
+        return make_error_code(error::not_implemented);
+    }
+
+    /// Prepare a frame from bytes compressed by a shared compressor
+    /**
+     * Frames `payload`, raw deflate output without the trailer, as a
+     * compressed message. The connection's own compression history is reset,
+     * as the remote endpoint's decompressor now holds the shared history.
+     * Callers must check `accepts_shared_deflate` first.
+     *
+     * Processors that do not support permessage-deflate return
+     * `not_implemented`.
+     *
+     * @since 0.8.2
+     *
+     * @param op The message opcode
+     * @param payload The compressed payload
+     * @param out The message buffer to prepare the frame in
+     * @return Status code, zero on success, non-zero on failure
+     */
+    virtual lib::error_code prepare_shared_deflate(frame::opcode::value,
+        std::string const &, message_ptr)
+    {
+        return make_error_code(error::not_implemented);
+    }
+
     /// Prepare a ping frame
     /**
      * Ping preparation is entirely state free. There is no payload validation
@@ -396,6 +531,16 @@ public:
     virtual lib::error_code prepare_close(close::status::value code,
         std::string const & reason, message_ptr out) const = 0;
 protected:
+    /// Whether this processor belongs to a server
+    /**
+     * A compile time constant for configs compiled for a single role.
+     *
+     * @since 0.8.2
+     */
+    bool is_server() const {
+        return role::is_server(config::endpoint_role, m_server);
+    }
+
     bool const m_secure;
     bool const m_server;
     size_t m_max_message_size;
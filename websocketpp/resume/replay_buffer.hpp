@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_RESUME_REPLAY_BUFFER_HPP
+#define WEBSOCKETPP_RESUME_REPLAY_BUFFER_HPP
+
+#include <websocketpp/common/stdint.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace websocketpp {
+namespace resume {
+
+/// Bounded ring of recently sent messages, indexed by sequence number
+/**
+ * The replay buffer retains the last `capacity` outgoing data messages of a
+ * session. Each message pushed is assigned the next sequence number, starting
+ * at 1. Sequence numbers are implicit on the wire: both ends count the data
+ * messages of a session, so a client that has received N messages reports N as
+ * its last sequence number when it reconnects.
+ *
+ * Entries hold a reference to the message rather than a copy, so a message
+ * sent to many sessions is stored once. The byte count reported by `bytes()`
+ * is the sum of the payload sizes of the retained entries and is therefore an
+ * upper bound on the memory actually retained.
+ *
+ * The replay buffer is not thread safe. session_store serializes access.
+ *
+ * @tparam message_ptr A pointer to a websocketpp message type
+ */
+template <typename message_ptr>
+class replay_buffer {
+public:
+    /// Construct a replay buffer
+    /**
+     * @param capacity The maximum number of messages to retain. Must be
+     * greater than zero.
+     */
+    explicit replay_buffer(size_t capacity)
+      : m_entries(capacity ? capacity : 1)
+      , m_head(0)
+      , m_size(0)
+      , m_bytes(0)
+      , m_last_seq(0) {}
+
+    /// Append a message
+    /**
+     * If the buffer is full the oldest message is released.
+     *
+     * @param msg The message to retain
+     * @return The sequence number assigned to the message
+     */
+    uint64_t push(message_ptr msg) {
+        size_t index = (m_head + m_size) % m_entries.size();
+
+        if (m_size == m_entries.size()) {
+            pop();
+            index = (m_head + m_size) % m_entries.size();
+        }
+
+        m_entries[index] = msg;
+        m_bytes += msg ? msg->get_payload().size() : 0;
+        m_size++;
+
+        return ++m_last_seq;
+    }
+
+    /// Release the oldest retained message
+    /**
+     * The sequence numbers of the remaining messages are unchanged. Messages
+     * released this way can no longer be replayed.
+     *
+     * @return Whether or not there was a message to release
+     */
+    bool pop() {
+        if (m_size == 0) {
+            return false;
+        }
+
+        message_ptr & front = m_entries[m_head];
+        m_bytes -= front ? front->get_payload().size() : 0;
+        front = message_ptr();
+
+        m_head = (m_head + 1) % m_entries.size();
+        m_size--;
+        return true;
+    }
+
+    /// Remove a message that never reached the remote end
+    /**
+     * The newest retained entry holding `msg` is removed and the messages
+     * after it move down one sequence number, as does the next message
+     * pushed. This keeps the numbering in step with the count kept by the
+     * remote end when a message is dropped before it is written.
+     *
+     * @param msg The message to remove
+     * @return Whether or not the message was retained
+     */
+    bool erase(message_ptr msg) {
+        size_t i = m_size;
+        while (i > 0 && m_entries[(m_head + i - 1) % m_entries.size()] != msg) {
+            --i;
+        }
+
+        if (i == 0) {
+            return false;
+        }
+
+        for (; i < m_size; ++i) {
+            m_entries[(m_head + i - 1) % m_entries.size()] =
+                m_entries[(m_head + i) % m_entries.size()];
+        }
+
+        m_entries[(m_head + m_size - 1) % m_entries.size()] = message_ptr();
+        m_bytes -= msg ? msg->get_payload().size() : 0;
+        m_size--;
+        m_last_seq--;
+        return true;
+    }
+
+    /// Collect the messages sent after a given sequence number
+    /**
+     * @param last_seq The sequence number of the last message the remote end
+     * received.
+     * @param out A vector to append the missed messages to, oldest first.
+     * @return False if some of the missed messages are no longer retained or
+     * if `last_seq` is newer than the newest message. In that case nothing is
+     * appended to `out`.
+     */
+    bool replay(uint64_t last_seq, std::vector<message_ptr> & out) const {
+        if (last_seq > m_last_seq || last_seq + 1 < first_seq()) {
+            return false;
+        }
+
+        size_t skip = static_cast<size_t>(last_seq + 1 - first_seq());
+        for (size_t i = skip; i < m_size; ++i) {
+            out.push_back(m_entries[(m_head + i) % m_entries.size()]);
+        }
+
+        return true;
+    }
+
+    /// Release all retained messages
+    /**
+     * Sequence numbering continues from the last assigned value.
+     */
+    void clear() {
+        while (pop()) {}
+    }
+
+    /// Release all retained messages and restart numbering
+    /**
+     * Used when a client can no longer be sent the messages it missed. The
+     * next message pushed is numbered `last_seq + 1`, matching the count kept
+     * by the client.
+     *
+     * @param last_seq The sequence number to continue from
+     */
+    void reset(uint64_t last_seq) {
+        clear();
+        m_last_seq = last_seq;
+    }
+
+    /// Get the sequence number of the oldest retained message
+    /**
+     * If no messages are retained this is one greater than last_seq()
+     */
+    uint64_t first_seq() const {
+        return m_last_seq - m_size + 1;
+    }
+
+    /// Get the sequence number assigned to the most recent message
+    uint64_t last_seq() const {
+        return m_last_seq;
+    }
+
+    /// Get the number of retained messages
+    size_t size() const {
+        return m_size;
+    }
+
+    /// Get the maximum number of retained messages
+    size_t capacity() const {
+        return m_entries.size();
+    }
+
+    /// Get the total payload size of the retained messages
+    size_t bytes() const {
+        return m_bytes;
+    }
+private:
+    std::vector<message_ptr>    m_entries;
+    size_t                      m_head;
+    size_t                      m_size;
+    size_t                      m_bytes;
+    uint64_t                    m_last_seq;
+};
+
+} // namespace resume
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_RESUME_REPLAY_BUFFER_HPP
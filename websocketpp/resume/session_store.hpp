@@ -0,0 +1,723 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_RESUME_SESSION_STORE_HPP
+#define WEBSOCKETPP_RESUME_SESSION_STORE_HPP
+
+#include <websocketpp/resume/replay_buffer.hpp>
+
+#include <websocketpp/random/random_device.hpp>
+
+#include <websocketpp/error.hpp>
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/cpp11.hpp>
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+/// Optional support for resuming sessions across reconnects
+/**
+ * A session outlives the connection that created it. While a session exists,
+ * the data messages sent to it are numbered and retained in a bounded replay
+ * buffer. A client that reconnects presents its session token and the
+ * sequence number of the last message it received and only the messages it
+ * missed are sent again.
+ *
+ * Sequence numbers are implicit. Both ends count the data messages of a
+ * session starting at 1, so the message payloads do not need to change.
+ *
+ * The handshake uses a single header, `WebSocket-Session`. A client requests a
+ * new session by omitting it. A client resumes a session by sending
+ * `WebSocket-Session: <token>; last=<sequence>`. The server confirms the
+ * session in use, which may be a new one if resumption failed, by sending
+ * `WebSocket-Session: <token>` in its handshake response.
+ */
+namespace resume {
+
+/// Name of the handshake header used to request and confirm sessions
+static char const header_name[] = "WebSocket-Session";
+
+namespace error {
+enum value {
+    /// Catch all
+    general = 1,
+
+    /// The session token presented by the client is not known
+    unknown_session,
+
+    /// Some of the messages the client missed are no longer retained
+    replay_unavailable,
+
+    /// The session header could not be parsed
+    invalid_header,
+
+    /// The session is attached to another connection
+    session_in_use
+};
+
+class category : public lib::error_category {
+public:
+    category() {}
+
+    char const * name() const _WEBSOCKETPP_NOEXCEPT_TOKEN_ {
+        return "websocketpp.resume";
+    }
+
+    std::string message(int value) const {
+        switch(value) {
+            case general:
+                return "Generic session resumption error";
+            case unknown_session:
+                return "Unknown or expired session";
+            case replay_unavailable:
+                return "Missed messages are no longer available for replay";
+            case invalid_header:
+                return "Invalid session header";
+            case session_in_use:
+                return "Session is in use by another connection";
+            default:
+                return "Unknown";
+        }
+    }
+};
+
+inline lib::error_category const & get_category() {
+    static category instance;
+    return instance;
+}
+
+inline lib::error_code make_error_code(error::value e) {
+    return lib::error_code(static_cast<int>(e), get_category());
+}
+
+} // namespace error
+
+/// Parse the value of a session request header
+/**
+ * Parameters other than `last` are ignored. If the value has parameters one
+ * of them must be `last`, given once, with a decimal sequence number.
+ *
+ * @param [in] value The header value, `<token>; last=<sequence>`
+ * @param [out] token The session token
+ * @param [out] last_seq The last sequence number received by the client
+ * @return Whether or not the value could be parsed
+ */
+inline bool parse_header(std::string const & value, std::string & token,
+    uint64_t & last_seq)
+{
+    static char const whitespace[] = " \t";
+
+    std::string::size_type sep = value.find(';');
+    std::string const head = value.substr(0, sep);
+    std::string::size_type begin = head.find_first_not_of(whitespace);
+
+    if (begin == std::string::npos) {
+        return false;
+    }
+    token = head.substr(begin, head.find_last_not_of(whitespace) - begin + 1);
+
+    last_seq = 0;
+    if (sep == std::string::npos) {
+        return true;
+    }
+
+    bool found = false;
+    while (sep != std::string::npos) {
+        std::string::size_type next = value.find(';', sep + 1);
+        std::string const param = value.substr(sep + 1,
+            next == std::string::npos ? std::string::npos : next - sep - 1);
+        sep = next;
+
+        std::string::size_type eq = param.find('=');
+        std::string name = param.substr(0, eq);
+        begin = name.find_first_not_of(whitespace);
+        if (begin == std::string::npos || eq == std::string::npos) {
+            continue;
+        }
+        name = name.substr(begin, name.find_last_not_of(whitespace) - begin + 1);
+        if (name != "last") {
+            continue;
+        }
+
+        std::string num = param.substr(eq + 1);
+        begin = num.find_first_not_of(whitespace);
+        if (found || begin == std::string::npos) {
+            return false;
+        }
+        num = num.substr(begin, num.find_last_not_of(whitespace) - begin + 1);
+
+        // istream would accept a sign and wrap negative values around
+        if (num.find_first_not_of("0123456789") != std::string::npos) {
+            return false;
+        }
+
+        std::istringstream s(num);
+        s >> last_seq;
+        if (s.fail() || !s.eof()) {
+            return false;
+        }
+        found = true;
+    }
+
+    return found;
+}
+
+/// Server side store of resumable sessions
+/**
+ * The session store owns the replay buffers of all sessions on an endpoint.
+ * Sessions are attached while a connection is using them and detached when
+ * that connection closes. Detached sessions are evicted once they have been
+ * detached for longer than the session TTL, or earlier, oldest first, when the
+ * payload bytes retained by all sessions exceed the memory budget. Attached
+ * sessions are bounded by the replay buffer capacity only.
+ *
+ * All methods are thread safe if the concurrency policy of the config is.
+ *
+ * A session is attached to at most one connection at a time. A client that
+ * presents the token of a session that is still attached, for example because
+ * the server has not yet noticed that its previous connection is half open, is
+ * given a new session.
+ *
+ * Typical use from a server:
+ * - In the validate handler call `accept(con, ec)` and keep the returned token
+ *   with the connection. `ec` is set if the client asked to resume and could
+ *   not be, in which case the application should send a full state snapshot
+ *   once the connection is open.
+ * - In the open handler call `open(token, con)`. It sends the messages the
+ *   client missed, including those recorded during the handshake. If it
+ *   returns replay_unavailable send a full state snapshot.
+ * - Send data messages with `send(token, con, msg)`. Use `record` for sessions
+ *   that are currently detached.
+ * - In the message expired handler call `dropped(token, msg)`, so messages
+ *   that expire or are discarded by a fast close are not counted.
+ * - In the close and fail handlers call `detach(token)`.
+ *
+ * @tparam config The endpoint config. Its concurrency and message types are
+ * used.
+ */
+template <typename config>
+class session_store {
+public:
+    typedef session_store<config> type;
+
+    typedef typename config::concurrency_type concurrency_type;
+    typedef typename concurrency_type::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency_type::mutex_type mutex_type;
+
+    typedef typename config::message_type::ptr message_ptr;
+    typedef replay_buffer<message_ptr> buffer_type;
+
+    typedef lib::chrono::steady_clock clock_type;
+    typedef clock_type::time_point time_point;
+
+    /// Construct a session store
+    /**
+     * @param capacity The maximum number of messages retained per session
+     * @param budget The maximum number of payload bytes retained by all
+     * sessions before detached sessions are evicted early
+     * @param ttl The number of milliseconds a detached session is kept
+     */
+    session_store(size_t capacity, size_t budget, long ttl)
+      : m_capacity(capacity)
+      , m_budget(budget)
+      , m_ttl(ttl)
+      , m_bytes(0) {}
+
+    /// Create a new attached session
+    /**
+     * @return The token of the new session
+     */
+    std::string create() {
+        scoped_lock_type lock(m_lock);
+
+        std::string token;
+        do {
+            token = generate_token();
+        } while (m_sessions.find(token) != m_sessions.end());
+
+        m_sessions.insert(std::make_pair(token, session(m_capacity)));
+        return token;
+    }
+
+    /// Attach to an existing session and collect the messages to replay
+    /**
+     * On success the session is attached and `missed` holds the messages sent
+     * after `last_seq`, oldest first. Messages recorded after this call are not
+     * included, servers should use `accept` and `open` instead.
+     *
+     * A session that is already attached cannot be resumed.
+     *
+     * @param [in] token The session token
+     * @param [in] last_seq The last sequence number the client received
+     * @param [out] missed A vector to append the missed messages to
+     * @return A status code, zero on success
+     */
+    lib::error_code resume(std::string const & token, uint64_t last_seq,
+        std::vector<message_ptr> & missed)
+    {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::iterator it;
+        lib::error_code ec = attach(token, last_seq, it);
+        if (ec) {
+            return ec;
+        }
+
+        it->second.buffer.replay(last_seq, missed);
+        it->second.resume_from = it->second.buffer.last_seq();
+        return lib::error_code();
+    }
+
+    /// Assign a sequence number to an outgoing message and retain it
+    /**
+     * The message is retained by reference. It must not be modified after it
+     * has been recorded.
+     *
+     * The sequence number must match the order the client receives messages
+     * in. Use `send` for sessions that are attached to a connection.
+     *
+     * @param token The session the message is sent on
+     * @param msg The message to record
+     * @return The sequence number of the message, or zero if the session does
+     * not exist
+     */
+    uint64_t record(std::string const & token, message_ptr msg) {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::iterator it = m_sessions.find(token);
+        if (it == m_sessions.end()) {
+            return 0;
+        }
+
+        m_bytes -= it->second.buffer.bytes();
+        uint64_t seq = it->second.buffer.push(msg);
+        m_bytes += it->second.buffer.bytes();
+
+        if (m_bytes > m_budget) {
+            enforce_budget();
+        }
+
+        return seq;
+    }
+
+    /// Forget a message that was dropped before it was written
+    /**
+     * Must be called from the message expired handler of the connection the
+     * session is attached to, for every message reported there that was sent
+     * with `send` or `open`. The
+     * client never receives a dropped message, so it is removed from the
+     * replay buffer and the messages recorded after it are renumbered.
+     *
+     * If the message is no longer retained the numbering of the session can
+     * not be corrected. The session is then no longer resumable, a client
+     * that tries is given a new session.
+     *
+     * @param token The session the message was sent on
+     * @param msg The message that was dropped
+     */
+    void dropped(std::string const & token, message_ptr msg) {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::iterator it = m_sessions.find(token);
+        if (it == m_sessions.end()) {
+            return;
+        }
+
+        m_bytes -= it->second.buffer.bytes();
+        if (!it->second.buffer.erase(msg)) {
+            it->second.lost = true;
+        }
+        m_bytes += it->second.buffer.bytes();
+    }
+
+    /// Mark a session as no longer in use by a connection
+    /**
+     * The session remains available for resumption for the session TTL.
+     *
+     * @param token The session to detach
+     */
+    void detach(std::string const & token) {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::iterator it = m_sessions.find(token);
+        if (it == m_sessions.end()) {
+            return;
+        }
+
+        it->second.attached = false;
+        it->second.detached_at = clock_type::now();
+    }
+
+    /// Remove a session immediately
+    /**
+     * @param token The session to remove
+     */
+    void remove(std::string const & token) {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::iterator it = m_sessions.find(token);
+        if (it != m_sessions.end()) {
+            erase(it);
+        }
+    }
+
+    /// Evict detached sessions whose TTL has passed
+    /**
+     * Should be called periodically, for example from a timer.
+     *
+     * @return The number of sessions evicted
+     */
+    size_t expire() {
+        scoped_lock_type lock(m_lock);
+
+        time_point now = clock_type::now();
+        size_t count = 0;
+
+        typename session_map::iterator it = m_sessions.begin();
+        while (it != m_sessions.end()) {
+            if (expired(it->second, now)) {
+                erase(it++);
+                count++;
+            } else {
+                ++it;
+            }
+        }
+
+        return count;
+    }
+
+    /// Send a message on a connection and record it
+    /**
+     * The message is recorded before it is queued, so that it can be found by
+     * `dropped` however early the connection drops it. A message the
+     * connection refuses is removed again and does not use up a sequence
+     * number. A message refused because the connection is not open (yet or
+     * any more) stays recorded, the client receives it from the replay when
+     * it resumes or from `open`.
+     *
+     * Sends on the same session are serialized so that sequence numbers follow
+     * the order in which messages are queued on the connection. Must not be
+     * called from the message expired handler of the connection.
+     *
+     * @param token The session the message is sent on
+     * @param con The connection currently attached to the session
+     * @param msg The message to send
+     * @return A status code, zero on success
+     */
+    template <typename connection_ptr>
+    lib::error_code send(std::string const & token, connection_ptr con,
+        message_ptr msg)
+    {
+        mutex_ptr send_lock = get_send_lock(token);
+        if (!send_lock) {
+            return error::make_error_code(error::unknown_session);
+        }
+        scoped_lock_type guard(*send_lock);
+
+        if (record(token, msg) == 0) {
+            return error::make_error_code(error::unknown_session);
+        }
+
+        lib::error_code ec = con->send(msg);
+        if (ec && ec != websocketpp::error::invalid_state) {
+            dropped(token, msg);
+        }
+        return ec;
+    }
+
+    /// Send the messages a client missed once its connection is open
+    /**
+     * Must be called from the open handler for the token returned by
+     * `accept`. Sends, in order, the messages recorded after the last sequence
+     * number the client reported, including those recorded while the
+     * handshake was in progress. For a new session these are the messages
+     * recorded since it was created.
+     *
+     * If some of those messages were evicted in the meantime
+     * replay_unavailable is returned and nothing is sent. The session then
+     * continues numbering from the client's last sequence number, so the
+     * application can send a full state snapshot with `send`.
+     *
+     * @param token The session token
+     * @param con The connection attached to the session
+     * @return A status code, zero on success
+     */
+    template <typename connection_ptr>
+    lib::error_code open(std::string const & token, connection_ptr con) {
+        mutex_ptr send_lock = get_send_lock(token);
+        if (!send_lock) {
+            return error::make_error_code(error::unknown_session);
+        }
+        scoped_lock_type guard(*send_lock);
+
+        std::vector<message_ptr> missed;
+        lib::error_code ec;
+        {
+            scoped_lock_type lock(m_lock);
+
+            typename session_map::iterator it = m_sessions.find(token);
+            if (it == m_sessions.end()) {
+                return error::make_error_code(error::unknown_session);
+            }
+
+            session & s = it->second;
+            if (!s.buffer.replay(s.resume_from, missed)) {
+                m_bytes -= s.buffer.bytes();
+                s.buffer.reset(s.resume_from);
+                ec = error::make_error_code(error::replay_unavailable);
+            }
+            s.resume_from = s.buffer.last_seq();
+        }
+
+        typename std::vector<message_ptr>::iterator it;
+        for (it = missed.begin(); it != missed.end(); ++it) {
+            lib::error_code send_ec = con->send(*it);
+            if (send_ec) {
+                return send_ec;
+            }
+        }
+
+        return ec;
+    }
+
+    /// Negotiate a session during the opening handshake
+    /**
+     * Must be called from the validate handler. Reads the session header of
+     * the request and tries to resume the session it names. If the client did
+     * not ask to resume, or resumption fails, a new session is created. The
+     * token of the session in use is returned and sent to the client in the
+     * handshake response.
+     *
+     * The session is attached to the connection. The messages to replay are
+     * sent by `open` once the connection is open.
+     *
+     * @param [in] con The connection being validated
+     * @param [out] ec Set if the client asked to resume and a new session was
+     * created instead
+     * @return The token of the session in use
+     */
+    template <typename connection_ptr>
+    std::string accept(connection_ptr con, lib::error_code & ec) {
+        ec = lib::error_code();
+
+        std::string const & value = con->get_request_header(header_name);
+        std::string token;
+
+        if (!value.empty()) {
+            uint64_t last_seq;
+            if (!parse_header(value, token, last_seq)) {
+                ec = error::make_error_code(error::invalid_header);
+            } else {
+                scoped_lock_type lock(m_lock);
+                typename session_map::iterator it;
+                ec = attach(token, last_seq, it);
+            }
+        }
+
+        if (value.empty() || ec) {
+            token = create();
+        }
+
+        con->replace_header(header_name, token);
+        return token;
+    }
+
+    /// Get the number of sessions, attached or not
+    size_t size() const {
+        scoped_lock_type lock(m_lock);
+        return m_sessions.size();
+    }
+
+    /// Get the number of payload bytes retained by all sessions
+    size_t bytes() const {
+        scoped_lock_type lock(m_lock);
+        return m_bytes;
+    }
+
+    /// Get the last sequence number assigned on a session
+    /**
+     * @param token The session to query
+     * @return The last sequence number or zero if the session does not exist
+     */
+    uint64_t last_seq(std::string const & token) const {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::const_iterator it = m_sessions.find(token);
+        if (it == m_sessions.end()) {
+            return 0;
+        }
+        return it->second.buffer.last_seq();
+    }
+private:
+    typedef lib::shared_ptr<mutex_type> mutex_ptr;
+
+    struct session {
+        explicit session(size_t capacity)
+          : buffer(capacity)
+          , attached(true)
+          , lost(false)
+          , resume_from(0)
+          , send_lock(lib::make_shared<mutex_type>()) {}
+
+        buffer_type buffer;
+        bool        attached;
+        /// A dropped message was no longer retained, numbering is unknown
+        bool        lost;
+        time_point  detached_at;
+        /// Last sequence number the client is known to have received
+        uint64_t    resume_from;
+        /// Serializes sending and recording on this session
+        mutex_ptr   send_lock;
+    };
+
+    typedef std::map<std::string,session> session_map;
+
+    /// Attach a detached session for a client that received `last_seq`
+    /**
+     * Must be called while holding m_lock
+     */
+    lib::error_code attach(std::string const & token, uint64_t last_seq,
+        typename session_map::iterator & it)
+    {
+        it = m_sessions.find(token);
+        if (it == m_sessions.end() || expired(it->second, clock_type::now())) {
+            return error::make_error_code(error::unknown_session);
+        }
+
+        if (it->second.attached) {
+            return error::make_error_code(error::session_in_use);
+        }
+
+        if (it->second.lost) {
+            return error::make_error_code(error::replay_unavailable);
+        }
+
+        buffer_type const & buffer = it->second.buffer;
+        if (last_seq > buffer.last_seq() || last_seq + 1 < buffer.first_seq()) {
+            return error::make_error_code(error::replay_unavailable);
+        }
+
+        it->second.attached = true;
+        it->second.resume_from = last_seq;
+        return lib::error_code();
+    }
+
+    mutex_ptr get_send_lock(std::string const & token) const {
+        scoped_lock_type lock(m_lock);
+
+        typename session_map::const_iterator it = m_sessions.find(token);
+        if (it == m_sessions.end()) {
+            return mutex_ptr();
+        }
+        return it->second.send_lock;
+    }
+
+    bool expired(session const & s, time_point const & now) const {
+        return !s.attached &&
+            now - s.detached_at >= lib::chrono::milliseconds(m_ttl);
+    }
+
+    void erase(typename session_map::iterator it) {
+        m_bytes -= it->second.buffer.bytes();
+        m_sessions.erase(it);
+    }
+
+    /// Evict detached sessions, oldest first, until within budget
+    /**
+     * Must be called while holding m_lock
+     */
+    void enforce_budget() {
+        while (m_bytes > m_budget) {
+            typename session_map::iterator oldest = m_sessions.end();
+            typename session_map::iterator it;
+
+            for (it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+                if (it->second.attached) {
+                    continue;
+                }
+                if (oldest == m_sessions.end() ||
+                    it->second.detached_at < oldest->second.detached_at)
+                {
+                    oldest = it;
+                }
+            }
+
+            if (oldest == m_sessions.end()) {
+                return;
+            }
+            erase(oldest);
+        }
+    }
+
+    /// Generate a 128 bit random session token as a hex string
+    std::string generate_token() {
+        static char const hex[] = "0123456789abcdef";
+
+        std::string token;
+        token.reserve(32);
+
+        for (int i = 0; i < 4; i++) {
+            uint32_t r = m_rng();
+            for (int j = 0; j < 8; j++) {
+                token.push_back(hex[r & 0x0f]);
+                r >>= 4;
+            }
+        }
+        return token;
+    }
+
+    size_t const        m_capacity;
+    size_t const        m_budget;
+    long const          m_ttl;
+
+    session_map         m_sessions;
+    size_t              m_bytes;
+
+    random::random_device::int_generator<uint32_t,concurrency_type> m_rng;
+
+    mutable mutex_type  m_lock;
+};
+
+} // namespace resume
+} // namespace websocketpp
+
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_START_
+template<> struct is_error_code_enum
+    <websocketpp::resume::error::value>
+{
+    static const bool value = true;
+};
+_WEBSOCKETPP_ERROR_CODE_ENUM_NS_END_
+
+#endif // WEBSOCKETPP_RESUME_SESSION_STORE_HPP
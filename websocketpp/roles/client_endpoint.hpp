@@ -29,6 +29,7 @@
 #define WEBSOCKETPP_CLIENT_ENDPOINT_HPP
 
 #include <websocketpp/endpoint.hpp>
+#include <websocketpp/roles/role.hpp>
 #include <websocketpp/uri.hpp>
 
 #include <websocketpp/logger/levels.hpp>
@@ -69,6 +70,10 @@ public:
 
     friend class connection<config>;
 
+    /// Fails to compile if config is compiled for server endpoints only
+    typedef typename role::check<config::endpoint_role != role::server>::type
+        role_check;
+
     explicit client() : endpoint_type(false)
     {
         endpoint_type::m_alog->write(log::alevel::devel, "client constructor");
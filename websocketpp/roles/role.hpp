@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_ROLE_HPP
+#define WEBSOCKETPP_ROLE_HPP
+
+namespace websocketpp {
+/// Constants for the endpoint role that a config is compiled for
+namespace role {
+
+/// The endpoint roles a config may be compiled for
+enum value {
+    /// Both roles are compiled in and selected when the endpoint is created
+    any = 0,
+    /// Only the server code paths are used
+    server = 1,
+    /// Only the client code paths are used
+    client = 2
+};
+
+/// Determine whether an endpoint acts as a server
+/**
+ * For configs compiled for a single role the result is a compile time
+ * constant, which lets the compiler drop the branches for the other role.
+ *
+ * @since 0.8.2
+ *
+ * @param compiled The role the config is compiled for
+ * @param runtime Whether the endpoint was created as a server, used for
+ * role::any
+ * @return Whether or not the endpoint is a server
+ */
+inline bool is_server(value compiled, bool runtime) {
+    return compiled == any ? runtime : compiled == server;
+}
+
+/// Compile time check that a config can be used for an endpoint role
+/**
+ * Only the true specialization is defined. Instantiating a server with a
+ * config compiled for clients, or the reverse, fails to compile.
+ *
+ * @since 0.8.2
+ */
+template <bool allowed>
+struct check;
+
+template <>
+struct check<true> {
+    typedef void type;
+};
+
+} // namespace role
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_ROLE_HPP
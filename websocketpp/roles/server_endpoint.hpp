@@ -29,6 +29,7 @@
 #define WEBSOCKETPP_SERVER_ENDPOINT_HPP
 
 #include <websocketpp/endpoint.hpp>
+#include <websocketpp/roles/role.hpp>
 
 #include <websocketpp/logger/levels.hpp>
 
@@ -66,6 +67,10 @@ public:
 
     friend class connection<config>;
 
+    /// Fails to compile if config is compiled for client endpoints only
+    typedef typename role::check<config::endpoint_role != role::client>::type
+        role_check;
+
     explicit server() : endpoint_type(true)
     {
         endpoint_type::m_alog->write(log::alevel::devel, "server constructor");
@@ -175,6 +180,7 @@ public:
                     "handle_accept error: "+ec.message());
             }
         } else {
+            _WEBSOCKETPP_PROBE1_(accept, static_cast<void *>(con.get()));
             con->start();
         }
 
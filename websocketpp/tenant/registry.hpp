@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TENANT_REGISTRY_HPP
+#define WEBSOCKETPP_TENANT_REGISTRY_HPP
+
+#include <websocketpp/tenant/token_bucket.hpp>
+#include <websocketpp/extensions/permessage_deflate/policy.hpp>
+
+#include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/stdint.hpp>
+#include <websocketpp/common/system_error.hpp>
+#include <websocketpp/error.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace websocketpp {
+/// Grouping of connections for resource quotas
+/**
+ * Connections are assigned to a tenant by name, usually from the validate
+ * handler. All connections of a tenant share one set of limits and counters.
+ */
+namespace tenant {
+
+/// Limits shared by the connections of a tenant
+/**
+ * A value of 0 means unlimited for all fields except weight.
+ */
+struct quota {
+    quota()
+      : max_connections(0)
+      , inbound_rate(0)
+      , outbound_rate(0)
+      , max_queued_bytes(0)
+      , max_deflate_memory(0)
+      , weight(1) {}
+
+    /// Maximum number of connections, further handshakes are rejected
+    size_t max_connections;
+    /// Sustained frame bytes per second read, reads pause when exceeded
+    uint64_t inbound_rate;
+    /// Sustained frame bytes per second written, writes pause when exceeded
+    uint64_t outbound_rate;
+    /// Maximum bytes queued for sending, `send` fails when exceeded
+    /**
+     * Counted like connection::get_buffered_amount, as the payload bytes of
+     * the queued frames without their headers. A message is charged by its
+     * payload size when it is sent. If it is compressed at that point the
+     * charge is then corrected to its compressed size.
+     */
+    size_t max_queued_bytes;
+    /// Maximum estimated permessage-deflate memory, in bytes
+    size_t max_deflate_memory;
+    /// Multiplier applied to the read and write quanta of its connections
+    size_t weight;
+};
+
+/// Usage counters of a tenant
+struct stats {
+    stats()
+      : connections(0)
+      , queued_bytes(0)
+      , deflate_memory(0)
+      , bytes_in(0)
+      , bytes_out(0)
+      , rejected_connections(0)
+      , rejected_messages(0)
+      , delayed_reads(0)
+      , delayed_writes(0) {}
+
+    /// Connections currently assigned to the tenant
+    size_t connections;
+    /// Bytes currently waiting in the send queues of its connections
+    /**
+     * In the unit of quota::max_queued_bytes
+     */
+    size_t queued_bytes;
+    /// Estimated permessage-deflate memory of its connections
+    size_t deflate_memory;
+    /// WebSocket frame bytes read
+    uint64_t bytes_in;
+    /// WebSocket frame bytes written
+    uint64_t bytes_out;
+    /// Connections refused because of the connection or deflate memory quota
+    uint64_t rejected_connections;
+    /// Sends refused because of the queued bytes quota
+    uint64_t rejected_messages;
+    /// Reads postponed because of the inbound rate
+    uint64_t delayed_reads;
+    /// Writes postponed because of the outbound rate
+    uint64_t delayed_writes;
+};
+
+/// Estimate the memory used by a permessage-deflate context pair
+/**
+ * The estimate includes one compressor and one decompressor at the memory
+ * level used by the permessage-deflate extension.
+ *
+ * @param deflate_bits The compressor window bits
+ * @param inflate_bits The decompressor window bits
+ * @return The estimated memory in bytes
+ */
+inline size_t deflate_memory(uint8_t deflate_bits = 15,
+    uint8_t inflate_bits = 15)
+{
+    return extensions::permessage_deflate::estimate_memory(deflate_bits,
+        inflate_bits);
+}
+
+/// Limits and counters of one tenant
+/**
+ * Thread safe. Connections hold a pointer to the account of their tenant so
+ * that enforcement does not need to look the tenant up by name.
+ *
+ * @tparam concurrency The concurrency policy used to protect the account
+ */
+template <typename concurrency>
+class account {
+public:
+    typedef typename concurrency::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency::mutex_type mutex_type;
+
+    typedef token_bucket::time_point time_point;
+
+    explicit account(quota const & q) {
+        set_quota(q);
+    }
+
+    /// Replace the limits
+    /**
+     * Connections already admitted are kept even if the new limits are lower.
+     */
+    void set_quota(quota const & q) {
+        scoped_lock_type lock(m_lock);
+        m_quota = q;
+        if (m_quota.weight == 0) {
+            m_quota.weight = 1;
+        }
+        m_inbound.set_rate(q.inbound_rate);
+        m_outbound.set_rate(q.outbound_rate);
+    }
+
+    /// Get the limits
+    quota get_quota() const {
+        scoped_lock_type lock(m_lock);
+        return m_quota;
+    }
+
+    /// Get a snapshot of the usage counters
+    stats get_stats() const {
+        scoped_lock_type lock(m_lock);
+        return m_stats;
+    }
+
+    /// Get the quantum multiplier
+    size_t get_weight() const {
+        scoped_lock_type lock(m_lock);
+        return m_quota.weight;
+    }
+
+    /// Take a connection slot
+    /**
+     * @param deflate The estimated deflate memory of the connection
+     * @return error::tenant_quota_exceeded if the connection does not fit
+     */
+    lib::error_code admit(size_t deflate) {
+        scoped_lock_type lock(m_lock);
+
+        if ((m_quota.max_connections > 0 &&
+             m_stats.connections >= m_quota.max_connections) ||
+            (m_quota.max_deflate_memory > 0 &&
+             m_stats.deflate_memory + deflate > m_quota.max_deflate_memory))
+        {
+            m_stats.rejected_connections++;
+            return error::make_error_code(error::tenant_quota_exceeded);
+        }
+
+        m_stats.connections++;
+        m_stats.deflate_memory += deflate;
+        return lib::error_code();
+    }
+
+    /// Give back a connection slot taken with admit
+    void release(size_t deflate) {
+        scoped_lock_type lock(m_lock);
+        m_stats.connections--;
+        m_stats.deflate_memory -= deflate;
+    }
+
+    /// Charge a message to the queued bytes quota if it fits
+    /**
+     * Checks and charges in one step so that connections sending at the same
+     * time can not overrun the quota together. Counts a rejected message if
+     * it does not fit. The bytes are given back with update_queued.
+     *
+     * @param bytes The payload size of the message
+     * @return Whether the message was charged
+     */
+    bool try_queue(size_t bytes) {
+        scoped_lock_type lock(m_lock);
+
+        if (m_quota.max_queued_bytes > 0 &&
+            m_stats.queued_bytes + bytes > m_quota.max_queued_bytes)
+        {
+            m_stats.rejected_messages++;
+            return false;
+        }
+        m_stats.queued_bytes += bytes;
+        return true;
+    }
+
+    /// Update the queued bytes after a connection's send queue changed
+    /**
+     * @param before The bytes previously reported by the connection
+     * @param after The bytes now queued on the connection
+     */
+    void update_queued(size_t before, size_t after) {
+        scoped_lock_type lock(m_lock);
+        m_stats.queued_bytes = m_stats.queued_bytes - before + after;
+    }
+
+    /// Count bytes read
+    void consume_inbound(size_t bytes, time_point now) {
+        scoped_lock_type lock(m_lock);
+        m_stats.bytes_in += bytes;
+        m_inbound.consume(bytes, now);
+    }
+
+    /// Count bytes written
+    void consume_outbound(size_t bytes, time_point now) {
+        scoped_lock_type lock(m_lock);
+        m_stats.bytes_out += bytes;
+        m_outbound.consume(bytes, now);
+    }
+
+    /// Get the number of bytes that may be read now
+    uint64_t inbound_allowance(time_point now) {
+        scoped_lock_type lock(m_lock);
+        return m_inbound.available(now);
+    }
+
+    /// Get the number of bytes that may be written now
+    uint64_t outbound_allowance(time_point now) {
+        scoped_lock_type lock(m_lock);
+        return m_outbound.available(now);
+    }
+
+    /// Get the time to wait before the next read
+    /**
+     * @return The wait in milliseconds, 0 to read now
+     */
+    long inbound_delay(time_point now) {
+        scoped_lock_type lock(m_lock);
+        long delay = m_inbound.delay(now);
+        if (delay > 0) {
+            m_stats.delayed_reads++;
+        }
+        return delay;
+    }
+
+    /// Get the time to wait before the next write
+    /**
+     * @return The wait in milliseconds, 0 to write now
+     */
+    long outbound_delay(time_point now) {
+        scoped_lock_type lock(m_lock);
+        long delay = m_outbound.delay(now);
+        if (delay > 0) {
+            m_stats.delayed_writes++;
+        }
+        return delay;
+    }
+private:
+    quota               m_quota;
+    stats               m_stats;
+    token_bucket        m_inbound;
+    token_bucket        m_outbound;
+    mutable mutex_type  m_lock;
+};
+
+/// Endpoint wide set of tenants
+/**
+ * A tenant is configured by calling set_quota for it and is kept for the life
+ * of the registry so its counters survive its connections. Tenant names
+ * usually come from client input, so names without a quota are not added.
+ * Their connections all share one default account instead, limited by the
+ * default quota, which is unlimited until set_default_quota is called. That
+ * keeps the registry bounded and unconfigured tenants together can not take
+ * more than the default quota.
+ *
+ * @tparam concurrency The concurrency policy used to protect the registry
+ */
+template <typename concurrency>
+class registry {
+public:
+    typedef typename concurrency::scoped_lock_type scoped_lock_type;
+    typedef typename concurrency::mutex_type mutex_type;
+
+    typedef account<concurrency> account_type;
+    typedef lib::shared_ptr<account_type> account_ptr;
+
+    registry()
+      : m_default(lib::make_shared<account_type>(quota())) {}
+
+    /// Get the account of a tenant
+    /**
+     * @return The tenant's account, or the default account if no quota was set
+     * for it
+     */
+    account_ptr get(std::string const & name) {
+        account_ptr a = find(name);
+        return a ? a : m_default;
+    }
+
+    /// Set the limits of a tenant, configuring it if needed
+    /**
+     * Connections assigned to the tenant before it was configured stay with
+     * the default account.
+     */
+    void set_quota(std::string const & name, quota const & q) {
+        scoped_lock_type lock(m_lock);
+
+        typename account_map::iterator it = m_accounts.find(name);
+        if (it != m_accounts.end()) {
+            it->second->set_quota(q);
+        } else {
+            m_accounts.insert(std::make_pair(name,
+                lib::make_shared<account_type>(q)));
+        }
+    }
+
+    /// Set the limits shared by all tenants without a quota of their own
+    void set_default_quota(quota const & q) {
+        m_default->set_quota(q);
+    }
+
+    /// Get the limits of a tenant
+    /**
+     * @return The tenant's limits, or the default quota for a tenant that was
+     * not configured
+     */
+    quota get_quota(std::string const & name) const {
+        account_ptr a = find(name);
+        return a ? a->get_quota() : m_default->get_quota();
+    }
+
+    /// Get the usage counters of a tenant
+    /**
+     * @return The tenant's counters, or the counters of the default account
+     * for a tenant that was not configured
+     */
+    stats get_stats(std::string const & name) const {
+        account_ptr a = find(name);
+        return a ? a->get_stats() : m_default->get_stats();
+    }
+
+    /// Get the names of all configured tenants
+    std::vector<std::string> get_names() const {
+        scoped_lock_type lock(m_lock);
+
+        std::vector<std::string> names;
+        typename account_map::const_iterator it;
+        for (it = m_accounts.begin(); it != m_accounts.end(); ++it) {
+            names.push_back(it->first);
+        }
+        return names;
+    }
+private:
+    typedef std::map<std::string,account_ptr> account_map;
+
+    account_ptr find(std::string const & name) const {
+        scoped_lock_type lock(m_lock);
+
+        typename account_map::const_iterator it = m_accounts.find(name);
+        return it == m_accounts.end() ? account_ptr() : it->second;
+    }
+
+    account_map         m_accounts;
+    /// Shared by all tenants without a quota
+    account_ptr const   m_default;
+    mutable mutex_type  m_lock;
+};
+
+} // namespace tenant
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TENANT_REGISTRY_HPP
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018, Peter Thorson. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the WebSocket++ Project nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL PETER THORSON BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef WEBSOCKETPP_TENANT_TOKEN_BUCKET_HPP
+#define WEBSOCKETPP_TENANT_TOKEN_BUCKET_HPP
+
+#include <websocketpp/common/chrono.hpp>
+#include <websocketpp/common/stdint.hpp>
+
+namespace websocketpp {
+namespace tenant {
+
+/// Byte rate limiter
+/**
+ * Holds up to one second worth of bytes. Bytes already transferred are always
+ * taken, so the balance may go negative. The caller then waits for the time
+ * returned by `delay` before transferring more. The wait lasts until at least
+ * 50ms worth of bytes are available, so that a limited transfer continues in
+ * reasonably sized pieces rather than a byte at a time.
+ *
+ * This class is not thread safe.
+ */
+class token_bucket {
+public:
+    typedef lib::chrono::steady_clock clock_type;
+    typedef clock_type::time_point time_point;
+
+    token_bucket() : m_rate(0), m_tokens(0), m_started(false) {}
+
+    /// Set the rate
+    /**
+     * @param rate The sustained rate in bytes per second. 0 means unlimited.
+     */
+    void set_rate(uint64_t rate) {
+        m_rate = rate;
+        if (m_tokens > static_cast<int64_t>(rate)) {
+            m_tokens = static_cast<int64_t>(rate);
+        }
+    }
+
+    /// Get the rate in bytes per second
+    uint64_t get_rate() const {
+        return m_rate;
+    }
+
+    /// Take bytes from the bucket
+    /**
+     * @param bytes The number of bytes transferred
+     * @param now The current time
+     */
+    void consume(uint64_t bytes, time_point now) {
+        if (m_rate == 0) {
+            return;
+        }
+        refill(now);
+        m_tokens -= static_cast<int64_t>(bytes);
+    }
+
+    /// Get the number of bytes that may be transferred now
+    /**
+     * @param now The current time
+     * @return The balance, or the largest uint64_t value if unlimited
+     */
+    uint64_t available(time_point now) {
+        if (m_rate == 0) {
+            return static_cast<uint64_t>(-1);
+        }
+        refill(now);
+        return m_tokens > 0 ? static_cast<uint64_t>(m_tokens) : 0;
+    }
+
+    /// Get the time to wait before transferring more
+    /**
+     * @param now The current time
+     * @return The wait in milliseconds, 0 if bytes may be transferred now
+     */
+    long delay(time_point now) {
+        if (m_rate == 0) {
+            return 0;
+        }
+        refill(now);
+
+        int64_t min = static_cast<int64_t>(m_rate / 20);
+        if (m_tokens > 0 && m_tokens >= min) {
+            return 0;
+        }
+
+        uint64_t missing = static_cast<uint64_t>((min > 0 ? min : 1) - m_tokens);
+        return static_cast<long>((missing * 1000 + m_rate - 1) / m_rate);
+    }
+private:
+    void refill(time_point now) {
+        if (!m_started) {
+            m_tokens = static_cast<int64_t>(m_rate);
+            m_last = now;
+            m_started = true;
+            return;
+        }
+
+        int64_t elapsed = lib::chrono::duration_cast<
+            lib::chrono::microseconds>(now - m_last).count();
+
+        if (elapsed <= 0) {
+            return;
+        }
+
+        // time needed to fill the bucket, longer gaps add nothing more
+        uint64_t room = static_cast<uint64_t>(
+            static_cast<int64_t>(m_rate) - m_tokens);
+
+        if (static_cast<uint64_t>(elapsed) >= room * 1000000 / m_rate) {
+            m_tokens = static_cast<int64_t>(m_rate);
+            m_last = now;
+            return;
+        }
+
+        uint64_t added = static_cast<uint64_t>(elapsed) * m_rate / 1000000;
+
+        // only advance by the time the added bytes account for, so the
+        // remainder is kept for the next call
+        m_tokens += static_cast<int64_t>(added);
+        m_last += lib::chrono::microseconds(added * 1000000 / m_rate);
+    }
+
+    uint64_t    m_rate;
+    int64_t     m_tokens;
+    time_point  m_last;
+    bool        m_started;
+};
+
+} // namespace tenant
+} // namespace websocketpp
+
+#endif // WEBSOCKETPP_TENANT_TOKEN_BUCKET_HPP
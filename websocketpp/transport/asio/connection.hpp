@@ -32,6 +32,7 @@
 
 #include <websocketpp/transport/base/connection.hpp>
 
+#include <websocketpp/logger/keyed.hpp>
 #include <websocketpp/logger/levels.hpp>
 #include <websocketpp/http/constants.hpp>
 
@@ -312,7 +313,7 @@ public:
      */
     timer_ptr set_timer(long duration, timer_handler callback) {
         timer_ptr new_timer = lib::make_shared<lib::asio::steady_timer>(
-            lib::ref(*m_io_service),
+            *m_io_service,
             lib::asio::milliseconds(duration)
         );
 
@@ -462,7 +463,7 @@ protected:
 
         if (config::enable_multithreading) {
             m_strand = lib::make_shared<lib::asio::io_service::strand>(
-                lib::ref(*io_service));
+                *io_service);
         }
 
         lib::error_code ec = socket_con_type::init_asio(io_service, m_strand,
@@ -836,6 +837,17 @@ protected:
             return;
         }*/
 
+        if (socket_con_type::early_data_pending()) {
+            // The socket policy is still completing its handshake and may
+            // already hold application data (e.g. TLS 1.3 early data)
+            socket_con_type::async_read_early(num_bytes, buf, len, lib::bind(
+                &type::handle_async_read, get_shared(),
+                handler,
+                lib::placeholders::_1, lib::placeholders::_2
+            ));
+            return;
+        }
+
         if (config::enable_multithreading) {
             lib::asio::async_read(
                 socket_con_type::get_socket(),
@@ -906,6 +918,15 @@ protected:
     void async_write(const char* buf, size_t len, write_handler handler) {
         m_bufs.push_back(lib::asio::buffer(buf,len));
 
+        if (socket_con_type::early_data_pending()) {
+            socket_con_type::async_write_early(m_bufs, lib::bind(
+                &type::handle_async_write, get_shared(),
+                handler,
+                lib::placeholders::_1, lib::placeholders::_2
+            ));
+            return;
+        }
+
         if (config::enable_multithreading) {
             lib::asio::async_write(
                 socket_con_type::get_socket(),
@@ -943,6 +964,15 @@ protected:
             m_bufs.push_back(lib::asio::buffer((*it).buf,(*it).len));
         }
 
+        if (socket_con_type::early_data_pending()) {
+            socket_con_type::async_write_early(m_bufs, lib::bind(
+                &type::handle_async_write, get_shared(),
+                handler,
+                lib::placeholders::_1, lib::placeholders::_2
+            ));
+            return;
+        }
+
         if (config::enable_multithreading) {
             lib::asio::async_write(
                 socket_con_type::get_socket(),
@@ -1061,6 +1091,34 @@ protected:
         );
     }
 
+    /// Close the connection immediately
+    /**
+     * Closes the socket without a graceful shutdown (no TLS close_notify, no
+     * TCP FIN handshake) and calls back right away. Pending reads and writes
+     * complete with operation_aborted.
+     *
+     * @since 0.8.2
+     *
+     * @param callback Handler to call back with completion information
+     */
+    void async_abort(shutdown_handler callback) {
+        if (m_alog->static_test(log::alevel::devel)) {
+            m_alog->write(log::alevel::devel,"asio connection async_abort");
+        }
+
+        lib::asio::error_code ec = socket_con_type::abort_socket();
+
+        lib::error_code tec;
+        if (ec && ec != lib::asio::error::not_connected &&
+            ec != lib::asio::error::bad_descriptor)
+        {
+            tec = socket_con_type::translate_ec(ec);
+            m_tec = ec;
+            log_err(log::elevel::info,"asio async_abort",ec);
+        }
+        callback(tec);
+    }
+
     /// Async shutdown timeout handler
     /**
      * @param shutdown_timer A pointer to the timer to keep it in scope
@@ -1147,6 +1205,9 @@ private:
     /// Convenience method for logging the code and message for an error_code
     template <typename error_type>
     void log_err(log::level l, const char * msg, const error_type & ec) {
+        if (!log::test(*m_elog, l, msg, ec.value(), ec.category().name())) {
+            return;
+        }
         std::stringstream s;
         s << msg << " error: " << ec << " (" << ec.message() << ")";
         m_elog->write(l,s.str());
@@ -33,6 +33,7 @@
 #include <websocketpp/transport/asio/security/none.hpp>
 
 #include <websocketpp/uri.hpp>
+#include <websocketpp/logger/keyed.hpp>
 #include <websocketpp/logger/levels.hpp>
 
 #include <websocketpp/common/asio.hpp>
@@ -97,6 +98,7 @@ public:
       , m_external_io_service(false)
       , m_listen_backlog(lib::asio::socket_base::max_connections)
       , m_reuse_addr(false)
+      , m_reuse_port(false)
       , m_state(UNINITIALIZED)
     {
         //std::cout << "transport::asio::endpoint constructor" << std::endl;
@@ -137,6 +139,7 @@ public:
       , m_acceptor(src.m_acceptor)
       , m_listen_backlog(lib::asio::socket_base::max_connections)
       , m_reuse_addr(src.m_reuse_addr)
+      , m_reuse_port(src.m_reuse_port)
       , m_elog(src.m_elog)
       , m_alog(src.m_alog)
       , m_state(src.m_state)
@@ -196,7 +199,7 @@ public:
         m_io_service = ptr;
         m_external_io_service = true;
         m_acceptor = lib::make_shared<lib::asio::ip::tcp::acceptor>(
-            lib::ref(*m_io_service));
+            *m_io_service);
 
         m_state = READY;
         ec = lib::error_code();
@@ -365,6 +368,27 @@ public:
         m_reuse_addr = value;
     }
 
+    /// Sets whether to use the SO_REUSEPORT option
+    /**
+     * With SO_REUSEPORT several sockets, usually one per process, can listen
+     * on the same address and port. The kernel spreads incoming connections
+     * across them. This is how the workers of a prefork::supervisor share a
+     * port.
+     *
+     * New values affect future calls to listen only so set this value prior to
+     * calling listen. On platforms without SO_REUSEPORT, listen fails with
+     * `operation_not_supported` when this option is set.
+     *
+     * The default is false.
+     *
+     * @since 0.8.2
+     *
+     * @param value Whether or not to use the SO_REUSEPORT option
+     */
+    void set_reuse_port(bool value) {
+        m_reuse_port = value;
+    }
+
     /// Retrieve a reference to the endpoint's io_service
     /**
      * The io_service may be an internal or external one. This may be used to
@@ -429,6 +453,18 @@ public:
         
         m_acceptor->set_option(lib::asio::socket_base::reuse_address(m_reuse_addr),bec);
         if (bec) {ec = clean_up_listen_after_error(bec);return;}
+
+        if (m_reuse_port) {
+#ifdef SO_REUSEPORT
+            typedef lib::asio::detail::socket_option::boolean<SOL_SOCKET,
+                SO_REUSEPORT> reuse_port;
+            m_acceptor->set_option(reuse_port(true),bec);
+#else
+            bec = lib::asio::error::make_error_code(
+                lib::asio::error::operation_not_supported);
+#endif
+            if (bec) {ec = clean_up_listen_after_error(bec);return;}
+        }
         
         // if a TCP pre-bind handler is present, run it
         if (m_tcp_pre_bind_handler) {
@@ -689,7 +725,7 @@ public:
      */
     void start_perpetual() {
         m_work = lib::make_shared<lib::asio::io_service::work>(
-            lib::ref(*m_io_service)
+            *m_io_service
         );
     }
 
@@ -855,7 +891,7 @@ protected:
         // Create a resolver
         if (!m_resolver) {
             m_resolver = lib::make_shared<lib::asio::ip::tcp::resolver>(
-                lib::ref(*m_io_service));
+                *m_io_service);
         }
 
         tcon->set_uri(u);
@@ -1135,6 +1171,9 @@ private:
     /// Convenience method for logging the code and message for an error_code
     template <typename error_type>
     void log_err(log::level l, char const * msg, error_type const & ec) {
+        if (!log::test(*m_elog, l, msg, ec.value(), ec.category().name())) {
+            return;
+        }
         std::stringstream s;
         s << msg << " error: " << ec << " (" << ec.message() << ")";
         m_elog->write(l,s.str());
@@ -1171,6 +1210,7 @@ private:
     // Network constants
     int                 m_listen_backlog;
     bool                m_reuse_addr;
+    bool                m_reuse_port;
 
     lib::shared_ptr<elog_type> m_elog;
     lib::shared_ptr<alog_type> m_alog;
@@ -58,6 +58,9 @@
 // set_hostname(std::string hostname)
 // pre_init(init_handler);
 // post_init(init_handler);
+// bool early_data_pending() const;
+// async_read_early(size_t num_bytes, char * buf, size_t len, io_handler);
+// async_write_early(std::vector<lib::asio::const_buffer> const &, io_handler);
 
 namespace websocketpp {
 namespace transport {
@@ -66,6 +69,9 @@ namespace socket {
 
 typedef lib::function<void(lib::asio::error_code const &)> shutdown_handler;
 
+/// Type of the read and write handlers passed to socket policy io hooks
+typedef lib::function<void(lib::asio::error_code const &, size_t)> io_handler;
+
 /**
  * The transport::asio::socket::* classes are a set of security/socket related
  * policies and support code for the ASIO transport types.
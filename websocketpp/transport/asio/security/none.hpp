@@ -38,6 +38,7 @@
 
 #include <sstream>
 #include <string>
+#include <vector>
 
 namespace websocketpp {
 namespace transport {
@@ -169,7 +170,7 @@ protected:
         }
 
         m_socket = lib::make_shared<lib::asio::ip::tcp::socket>(
-            lib::ref(*service));
+            *service);
 
         if (m_socket_init_handler) {
             m_socket_init_handler(m_hdl, *m_socket);
@@ -257,6 +258,48 @@ protected:
         h(ec);
     }
 
+    /// Close the socket immediately
+    /**
+     * Sets SO_LINGER with a zero timeout before closing, so the connection is
+     * reset rather than closed gracefully and the socket does not linger in
+     * TIME_WAIT. Outstanding operations complete with operation_aborted.
+     *
+     * @since 0.8.2
+     *
+     * @return The error that occurred closing the socket, if any.
+     */
+    lib::asio::error_code abort_socket() {
+        lib::asio::error_code ec;
+
+        // failing to set linger still leaves an ordinary close
+        m_socket->set_option(lib::asio::socket_base::linger(true,0), ec);
+
+        m_socket->close(ec);
+        return ec;
+    }
+
+    /// Whether io is currently being handled by the socket policy
+    /**
+     * Plain sockets never intercept reads or writes.
+     *
+     * @since 0.8.2
+     */
+    bool early_data_pending() const {
+        return false;
+    }
+
+    /// Read hook for socket policies that intercept io (unused)
+    void async_read_early(size_t, char *, size_t, socket::io_handler h) {
+        h(lib::asio::error::operation_not_supported, 0);
+    }
+
+    /// Write hook for socket policies that intercept io (unused)
+    void async_write_early(std::vector<lib::asio::const_buffer> const &,
+        socket::io_handler h)
+    {
+        h(lib::asio::error::operation_not_supported, 0);
+    }
+
     lib::error_code get_ec() const {
         return lib::error_code();
     }
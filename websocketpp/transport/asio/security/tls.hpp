@@ -37,9 +37,19 @@
 #include <websocketpp/common/connection_hdl.hpp>
 #include <websocketpp/common/functional.hpp>
 #include <websocketpp/common/memory.hpp>
+#include <websocketpp/common/thread.hpp>
 
+#include <algorithm>
+#include <cstring>
+#include <map>
 #include <sstream>
 #include <string>
+#include <vector>
+
+// Session caching and TLS 1.3 early data use the OpenSSL 1.1.1 API
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+    #define _WEBSOCKETPP_TLS_EARLY_DATA_
+#endif
 
 namespace websocketpp {
 namespace transport {
@@ -54,6 +64,78 @@ typedef lib::function<void(connection_hdl,lib::asio::ssl::stream<
 /// The signature of the tls_init_handler for this socket policy
 typedef lib::function<lib::shared_ptr<lib::asio::ssl::context>(connection_hdl)>
     tls_init_handler;
+/// The signature of the early_data_handler for this socket policy
+/**
+ * Called by servers with the request target of an opening handshake that
+ * arrived as TLS 1.3 early data. Returning true processes the request before
+ * the TLS handshake completes.
+ *
+ * @since 0.8.2
+ */
+typedef lib::function<bool(connection_hdl, std::string const &)>
+    early_data_handler;
+
+/// Client side cache of resumable TLS sessions
+/**
+ * Shared by the connections of a client endpoint with session resumption
+ * enabled. Holds the most recent resumable session for each host and port.
+ *
+ * @since 0.8.2
+ */
+class session_cache {
+public:
+    ~session_cache() {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        session_map::iterator it;
+        for (it = m_sessions.begin(); it != m_sessions.end(); ++it) {
+            SSL_SESSION_free(it->second);
+        }
+#endif
+    }
+
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+    /// Get a new reference to the session stored for an authority
+    /**
+     * @param authority The host and port of the remote endpoint
+     * @return A session the caller must free, or NULL if none is stored
+     */
+    SSL_SESSION * get(std::string const & authority) {
+        scoped_lock_type lock(m_lock);
+
+        session_map::iterator it = m_sessions.find(authority);
+        if (it == m_sessions.end()) {
+            return NULL;
+        }
+        SSL_SESSION_up_ref(it->second);
+        return it->second;
+    }
+
+    /// Store the session for an authority
+    /**
+     * @param authority The host and port of the remote endpoint
+     * @param session The session to store. The cache takes ownership of the
+     * caller's reference.
+     */
+    void set(std::string const & authority, SSL_SESSION * session) {
+        scoped_lock_type lock(m_lock);
+
+        SSL_SESSION * & slot = m_sessions[authority];
+        if (slot) {
+            SSL_SESSION_free(slot);
+        }
+        slot = session;
+    }
+#endif
+private:
+    typedef lib::lock_guard<lib::mutex> scoped_lock_type;
+    typedef std::map<std::string, SSL_SESSION *> session_map;
+
+    lib::mutex  m_lock;
+    session_map m_sessions;
+};
+
+/// Type of a shared pointer to a session cache
+typedef lib::shared_ptr<session_cache> session_cache_ptr;
 
 /// TLS enabled Asio connection socket component
 /**
@@ -78,11 +160,39 @@ public:
     /// Type of a shared pointer to the ASIO TLS context being used
     typedef lib::shared_ptr<lib::asio::ssl::context> context_ptr;
 
-    explicit connection() {
+    explicit connection()
+      : m_release_buffers(true)
+      , m_early_data(false)
+      , m_early_data_timeout(5000)
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+      , m_early_state(early_none)
+      , m_wire_bio(NULL)
+      , m_output_bio(NULL)
+      , m_early_reading(false)
+      , m_early_decided(false)
+      , m_handshake_done(false)
+      , m_early_failed(false)
+      , m_reading_wire(false)
+      , m_writing_wire(false)
+      , m_write_size(0)
+      , m_parked_num_bytes(0)
+      , m_parked_buf(NULL)
+      , m_parked_len(0)
+#endif
+    {
         //std::cout << "transport::asio::tls_socket::connection constructor"
         //          << std::endl;
     }
 
+    ~connection() {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        if (m_socket) {
+            restore_wire_bio();
+            store_session();
+        }
+#endif
+    }
+
     /// Get a shared pointer to this component
     ptr get_shared() {
         return shared_from_this();
@@ -145,6 +255,61 @@ public:
         m_tls_init_handler = h;
     }
 
+    /// Set whether OpenSSL may release idle read and write buffers
+    /**
+     * @since 0.8.2
+     *
+     * @param value Whether or not to enable SSL_MODE_RELEASE_BUFFERS
+     * @see endpoint::set_release_buffers
+     */
+    void set_release_buffers(bool value) {
+        m_release_buffers = value;
+    }
+
+    /// Set the session cache used to resume client sessions
+    /**
+     * @since 0.8.2
+     *
+     * @param cache The cache to use, or an empty pointer to disable resumption
+     * @see endpoint::set_session_resumption
+     */
+    void set_session_cache(session_cache_ptr cache) {
+        m_session_cache = cache;
+    }
+
+    /// Set whether a client may send its opening handshake as early data
+    /**
+     * @since 0.8.2
+     *
+     * @param value Whether or not to send TLS 1.3 early data
+     * @see endpoint::set_early_data
+     */
+    void set_early_data(bool value) {
+        m_early_data = value;
+    }
+
+    /// Set the handler that decides whether servers act on early data
+    /**
+     * @since 0.8.2
+     *
+     * @param h The new early_data_handler
+     * @see endpoint::set_early_data_handler
+     */
+    void set_early_data_handler(early_data_handler h) {
+        m_early_data_handler = h;
+    }
+
+    /// Set how long an early request may wait for the handshake to finish
+    /**
+     * @since 0.8.2
+     *
+     * @param duration The timeout in milliseconds
+     * @see endpoint::set_early_data_timeout
+     */
+    void set_early_data_timeout(long duration) {
+        m_early_data_timeout = duration;
+    }
+
     /// Get the remote endpoint address
     /**
      * The iostream transport has no information about the ultimate remote
@@ -196,6 +361,18 @@ protected:
         m_socket = lib::make_shared<socket_type>(
             _WEBSOCKETPP_REF(*service),lib::ref(*m_context));
 
+#ifdef SSL_MODE_RELEASE_BUFFERS
+        // Some Asio versions already set this mode, so apply the setting in
+        // both directions. Done before the socket init handler so that it may
+        // still be overridden per connection.
+        if (m_release_buffers) {
+            SSL_set_mode(m_socket->native_handle(), SSL_MODE_RELEASE_BUFFERS);
+        } else {
+            SSL_clear_mode(m_socket->native_handle(),
+                SSL_MODE_RELEASE_BUFFERS);
+        }
+#endif
+
         if (m_socket_init_handler) {
             m_socket_init_handler(m_hdl, get_socket());
         }
@@ -248,6 +425,15 @@ protected:
             }
         }
 #endif
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        if (!m_is_server && m_session_cache) {
+            SSL_SESSION * session = m_session_cache->get(m_uri->get_authority());
+            if (session) {
+                SSL_set_session(get_socket().native_handle(), session);
+                SSL_SESSION_free(session);
+            }
+        }
+#endif
 
         callback(lib::error_code());
     }
@@ -263,6 +449,25 @@ protected:
     void post_init(init_handler callback) {
         m_ec = socket::make_error_code(socket::error::tls_handshake_timeout);
 
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        if (m_is_server && m_early_data_handler) {
+            start_early_accept(callback);
+            return;
+        }
+
+        if (!m_is_server && m_early_data) {
+            SSL_SESSION * session = SSL_get_session(m_socket->native_handle());
+            if (session && SSL_SESSION_get_max_early_data(session) > 0) {
+                // Defer the handshake so that the first write, the opening
+                // handshake request, can be sent along with the ClientHello.
+                m_early_state = early_client;
+                m_ec = lib::error_code();
+                callback(m_ec);
+                return;
+            }
+        }
+#endif
+
         // TLS handshake
         if (m_strand) {
             m_socket->async_handshake(
@@ -325,7 +530,46 @@ protected:
         return ec;
     }
 
+    /// Close the socket immediately
+    /**
+     * Skips the TLS close_notify exchange and resets the TCP connection
+     * (SO_LINGER with a zero timeout) so the socket does not linger in
+     * TIME_WAIT. Outstanding operations complete with operation_aborted.
+     *
+     * @since 0.8.2
+     *
+     * @return The error that occurred closing the socket, if any.
+     */
+    lib::asio::error_code abort_socket() {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        store_session();
+#endif
+        lib::asio::error_code ec;
+
+        // failing to set linger still leaves an ordinary close
+        get_raw_socket().set_option(lib::asio::socket_base::linger(true,0),ec);
+
+        get_raw_socket().close(ec);
+        return ec;
+    }
+
     void async_shutdown(socket::shutdown_handler callback) {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        store_session();
+
+        if (m_early_failed) {
+            // The handshake never finished so the peer will not answer a
+            // close_notify. Close the socket rather than wait for it.
+            lib::asio::error_code ec;
+            get_raw_socket().close(ec);
+            if (m_strand) {
+                m_io_service->post(m_strand->wrap(lib::bind(callback, ec)));
+            } else {
+                m_io_service->post(lib::bind(callback, ec));
+            }
+            return;
+        }
+#endif
         if (m_strand) {
             m_socket->async_shutdown(m_strand->wrap(callback));
         } else {
@@ -333,6 +577,98 @@ protected:
         }
     }
 
+    /// Whether io is currently being handled by the socket policy
+    /**
+     * True while an early data handshake is in progress and while data read
+     * during that handshake has not yet been consumed.
+     *
+     * @since 0.8.2
+     */
+    bool early_data_pending() const {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        return m_early_state != early_none || !m_early_input.empty();
+#else
+        return false;
+#endif
+    }
+
+    /// Read at least num_bytes while early_data_pending() is true
+    /**
+     * @since 0.8.2
+     *
+     * @param num_bytes The minimum number of bytes to read
+     * @param buf The buffer to read into
+     * @param len The size of buf
+     * @param handler The handler to call with the number of bytes read
+     */
+    void async_read_early(size_t num_bytes, char * buf, size_t len,
+        socket::io_handler handler)
+    {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        if (!m_early_input.empty() && (m_early_input.size() >= num_bytes ||
+            m_early_state == early_none))
+        {
+            size_t n = (std::min)(len, m_early_input.size());
+            std::memcpy(buf, m_early_input.data(), n);
+            m_early_input.erase(0, n);
+
+            if (n >= num_bytes) {
+                post_io(handler, lib::asio::error_code(), n);
+            } else {
+                lib::asio::async_read(
+                    *m_socket,
+                    lib::asio::buffer(buf + n, len - n),
+                    lib::asio::transfer_at_least(num_bytes - n),
+                    wrap_io(lib::bind(
+                        &type::handle_read_tail, get_shared(),
+                        handler, n,
+                        lib::placeholders::_1, lib::placeholders::_2
+                    ))
+                );
+            }
+        } else if (m_early_state == early_none) {
+            lib::asio::async_read(
+                *m_socket,
+                lib::asio::buffer(buf, len),
+                lib::asio::transfer_at_least(num_bytes),
+                wrap_io(handler)
+            );
+        } else {
+            // Wait for the handshake to make more data available
+            m_parked_num_bytes = num_bytes;
+            m_parked_buf = buf;
+            m_parked_len = len;
+            m_parked_handler = handler;
+        }
+#else
+        lib::asio::async_read(*m_socket, lib::asio::buffer(buf, len),
+            lib::asio::transfer_at_least(num_bytes), handler);
+#endif
+    }
+
+    /// Write buffers while early_data_pending() is true
+    /**
+     * @since 0.8.2
+     *
+     * @param bufs The buffers to write
+     * @param handler The handler to call once the buffers have been written
+     */
+    void async_write_early(std::vector<lib::asio::const_buffer> const & bufs,
+        socket::io_handler handler)
+    {
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+        if (m_early_state == early_client) {
+            write_early_client(bufs, handler);
+        } else if (m_early_state == early_server) {
+            write_early_server(bufs, handler);
+        } else {
+            lib::asio::async_write(*m_socket, bufs, wrap_io(handler));
+        }
+#else
+        lib::asio::async_write(*m_socket, bufs, handler);
+#endif
+    }
+
 public:
     /// Translate any security policy specific information about an error code
     /**
@@ -374,6 +710,526 @@ public:
         return ec;
     }
 private:
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+    /// States of the early data handshake
+    enum early_state {
+        /// All io goes through the ssl stream
+        early_none = 0,
+        /// Client handshake deferred until the first write
+        early_client,
+        /// Server handshake running over memory BIOs
+        early_server
+    };
+
+    /// Wrap an io handler in the connection's strand, if there is one
+    socket::io_handler wrap_io(socket::io_handler handler) {
+        if (m_strand) {
+            return m_strand->wrap(handler);
+        }
+        return handler;
+    }
+
+    /// Call an io handler from the io_service rather than inline
+    void post_io(socket::io_handler handler, lib::asio::error_code const & ec,
+        size_t bytes_transferred)
+    {
+        m_io_service->post(lib::bind(wrap_io(handler), ec, bytes_transferred));
+    }
+
+    void handle_read_tail(socket::io_handler handler, size_t copied,
+        lib::asio::error_code const & ec, size_t bytes_transferred)
+    {
+        handler(ec, copied + bytes_transferred);
+    }
+
+    /// Copy the buffers of a write into m_early_output
+    void gather_output(std::vector<lib::asio::const_buffer> const & bufs) {
+        m_early_output.clear();
+
+        std::vector<lib::asio::const_buffer>::const_iterator it;
+        for (it = bufs.begin(); it != bufs.end(); ++it) {
+            m_early_output.append(lib::asio::buffer_cast<char const *>(*it),
+                lib::asio::buffer_size(*it));
+        }
+    }
+
+    /// Save the client's session for the next connection to the same host
+    void store_session() {
+        if (m_is_server || !m_session_cache || !m_uri || !m_socket) {
+            return;
+        }
+
+        SSL_SESSION * session = SSL_get1_session(m_socket->native_handle());
+        if (!session) {
+            return;
+        }
+        if (SSL_SESSION_is_resumable(session)) {
+            m_session_cache->set(m_uri->get_authority(), session);
+        } else {
+            SSL_SESSION_free(session);
+        }
+    }
+
+    /// Send the first write as early data, then finish the handshake
+    /**
+     * The ClientHello and early data are produced into a memory BIO and
+     * written directly to the socket. The stream's own BIO is put back before
+     * the handshake continues through the ssl stream as usual.
+     */
+    void write_early_client(std::vector<lib::asio::const_buffer> const & bufs,
+        socket::io_handler handler)
+    {
+        SSL * ssl = m_socket->native_handle();
+
+        m_early_state = early_none;
+        gather_output(bufs);
+
+        if (m_early_output.size() >
+            SSL_SESSION_get_max_early_data(SSL_get_session(ssl)))
+        {
+            // Too large to send early, use a regular handshake
+            start_client_handshake(handler, false);
+            return;
+        }
+
+        BIO * staging = BIO_new(BIO_s_mem());
+        if (!staging) {
+            start_client_handshake(handler, false);
+            return;
+        }
+
+        // SSL_set0_wbio releases the reference that the shared read/write BIO
+        // holds as wbio. Take one so it survives as rbio and is handed back.
+        BIO * wire = SSL_get_wbio(ssl);
+        BIO_up_ref(wire);
+        SSL_set0_wbio(ssl, staging);
+
+        SSL_set_connect_state(ssl);
+        size_t written = 0;
+        int ret = SSL_write_early_data(ssl, m_early_output.data(),
+            m_early_output.size(), &written);
+
+        char * data = NULL;
+        long pending = BIO_get_mem_data(staging, &data);
+        m_wire_output.assign(data, pending > 0 ? pending : 0);
+
+        SSL_set0_wbio(ssl, wire);
+
+        if (ret != 1) {
+            m_ec = socket::make_error_code(socket::error::tls_handshake_failed);
+            post_io(handler, lib::asio::error::connection_aborted, 0);
+            return;
+        }
+
+        lib::asio::async_write(
+            get_next_layer(),
+            lib::asio::buffer(m_wire_output),
+            wrap_io(lib::bind(
+                &type::handle_client_early_write, get_shared(),
+                handler,
+                lib::placeholders::_1
+            ))
+        );
+    }
+
+    void handle_client_early_write(socket::io_handler handler,
+        lib::asio::error_code const & ec)
+    {
+        if (ec) {
+            handler(ec, 0);
+            return;
+        }
+        start_client_handshake(handler, true);
+    }
+
+    /// Finish the client handshake and then complete the deferred write
+    void start_client_handshake(socket::io_handler handler, bool sent_early) {
+        if (m_strand) {
+            m_socket->async_handshake(
+                lib::asio::ssl::stream_base::client,
+                m_strand->wrap(lib::bind(
+                    &type::handle_client_early_handshake, get_shared(),
+                    handler, sent_early,
+                    lib::placeholders::_1
+                ))
+            );
+        } else {
+            m_socket->async_handshake(
+                lib::asio::ssl::stream_base::client,
+                lib::bind(
+                    &type::handle_client_early_handshake, get_shared(),
+                    handler, sent_early,
+                    lib::placeholders::_1
+                )
+            );
+        }
+    }
+
+    void handle_client_early_handshake(socket::io_handler handler,
+        bool sent_early, lib::asio::error_code const & ec)
+    {
+        if (ec) {
+            m_ec = socket::make_error_code(socket::error::tls_handshake_failed);
+            handler(ec, 0);
+            return;
+        }
+
+        if (sent_early && SSL_get_early_data_status(m_socket->native_handle())
+            == SSL_EARLY_DATA_ACCEPTED)
+        {
+            std::string().swap(m_wire_output);
+            handler(ec, m_early_output.size());
+            return;
+        }
+
+        // The server rejected the early data, send it again
+        lib::asio::async_write(*m_socket, lib::asio::buffer(m_early_output),
+            wrap_io(handler));
+    }
+
+    /// Begin a server handshake that accepts early data
+    /**
+     * Asio's ssl stream drives the handshake with SSL_accept which cannot
+     * read early data. Instead the SSL object is pointed at a pair of memory
+     * BIOs and the handshake is run here, moving bytes between them and the
+     * socket, until the handshake is done and the stream can take over.
+     */
+    void start_early_accept(init_handler callback) {
+        SSL * ssl = m_socket->native_handle();
+
+        BIO * input = BIO_new(BIO_s_mem());
+        BIO * output = BIO_new(BIO_s_mem());
+        if (!input || !output) {
+            BIO_free(input);
+            BIO_free(output);
+            m_early_data_handler = early_data_handler();
+            post_init(callback);
+            return;
+        }
+
+        // The stream's BIO is shared by rbio and wbio but owned once. Replacing
+        // both releases it twice, so take two references: one to balance and
+        // one to give back in restore_wire_bio.
+        m_wire_bio = SSL_get_rbio(ssl);
+        BIO_up_ref(m_wire_bio);
+        BIO_up_ref(m_wire_bio);
+        SSL_set0_rbio(ssl, input);
+        SSL_set0_wbio(ssl, output);
+        m_output_bio = output;
+
+        SSL_set_max_early_data(ssl, SSL3_RT_MAX_PLAIN_LENGTH);
+        SSL_set_accept_state(ssl);
+
+        m_early_state = early_server;
+        m_early_reading = true;
+        m_early_callback = callback;
+        m_wire_input.resize(SSL3_RT_MAX_PLAIN_LENGTH);
+
+        advance_early_accept();
+    }
+
+    /// Run the server handshake as far as the data received so far allows
+    void advance_early_accept() {
+        SSL * ssl = m_socket->native_handle();
+        char buf[4096];
+
+        while (!m_handshake_done) {
+            if (m_early_reading) {
+                size_t n = 0;
+                int ret = SSL_read_early_data(ssl, buf, sizeof(buf), &n);
+                if (ret == SSL_READ_EARLY_DATA_SUCCESS) {
+                    m_early_input.append(buf, n);
+                    continue;
+                } else if (ret == SSL_READ_EARLY_DATA_FINISH) {
+                    m_early_reading = false;
+                    continue;
+                } else if (SSL_get_error(ssl, ret) != SSL_ERROR_WANT_READ) {
+                    fail_early_accept(lib::asio::error::connection_aborted);
+                    return;
+                }
+                break;
+            }
+
+            int ret = SSL_do_handshake(ssl);
+            if (ret == 1) {
+                m_handshake_done = true;
+                break;
+            } else if (SSL_get_error(ssl, ret) != SSL_ERROR_WANT_READ) {
+                fail_early_accept(lib::asio::error::connection_aborted);
+                return;
+            }
+            break;
+        }
+
+        if (m_handshake_done) {
+            // Collect application data that arrived along with the client's
+            // Finished message.
+            int ret;
+            while ((ret = SSL_read(ssl, buf, sizeof(buf))) > 0) {
+                m_early_input.append(buf, ret);
+            }
+            int err = SSL_get_error(ssl, ret);
+            if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_ZERO_RETURN) {
+                fail_early_accept(lib::asio::error::connection_aborted);
+                return;
+            }
+
+            if (m_early_callback) {
+                // The request, if any, was held back for the handshake. Let it
+                // be processed before sending the session tickets so that the
+                // response goes out in the same write rather than waiting
+                // behind them for an ACK.
+                complete_early_init(lib::error_code());
+                if (m_strand) {
+                    m_io_service->post(m_strand->wrap(lib::bind(
+                        &type::flush_wire_output, get_shared()
+                    )));
+                } else {
+                    m_io_service->post(lib::bind(
+                        &type::flush_wire_output, get_shared()
+                    ));
+                }
+                return;
+            }
+        } else {
+            read_wire_input();
+        }
+
+        flush_wire_output();
+        check_early_request();
+    }
+
+    void read_wire_input() {
+        if (m_reading_wire) {
+            return;
+        }
+        m_reading_wire = true;
+
+        get_next_layer().async_read_some(
+            lib::asio::buffer(m_wire_input),
+            wrap_io(lib::bind(
+                &type::handle_wire_input, get_shared(),
+                lib::placeholders::_1, lib::placeholders::_2
+            ))
+        );
+    }
+
+    void handle_wire_input(lib::asio::error_code const & ec,
+        size_t bytes_transferred)
+    {
+        m_reading_wire = false;
+
+        if (m_early_state != early_server) {
+            return;
+        }
+        if (ec) {
+            fail_early_accept(ec);
+            return;
+        }
+
+        BIO_write(SSL_get_rbio(m_socket->native_handle()), &m_wire_input[0],
+            static_cast<int>(bytes_transferred));
+        advance_early_accept();
+    }
+
+    /// Write everything pending in the output BIO to the socket
+    void flush_wire_output() {
+        if (m_writing_wire || m_early_state != early_server) {
+            return;
+        }
+
+        size_t pending = BIO_ctrl_pending(m_output_bio);
+        if (pending == 0) {
+            if (m_write_handler) {
+                socket::io_handler handler = m_write_handler;
+                m_write_handler = socket::io_handler();
+                post_io(handler, lib::asio::error_code(), m_write_size);
+            }
+            if (m_handshake_done) {
+                finish_early_accept();
+            }
+            return;
+        }
+
+        m_wire_output.resize(pending);
+        BIO_read(m_output_bio, &m_wire_output[0], static_cast<int>(pending));
+        m_writing_wire = true;
+
+        lib::asio::async_write(
+            get_next_layer(),
+            lib::asio::buffer(m_wire_output),
+            wrap_io(lib::bind(
+                &type::handle_wire_output, get_shared(),
+                lib::placeholders::_1, lib::placeholders::_2
+            ))
+        );
+    }
+
+    void handle_wire_output(lib::asio::error_code const & ec, size_t) {
+        m_writing_wire = false;
+
+        if (m_early_state != early_server) {
+            return;
+        }
+        if (ec) {
+            fail_early_accept(ec);
+            return;
+        }
+        flush_wire_output();
+    }
+
+    /// Write data before the server handshake has been handed to the stream
+    void write_early_server(std::vector<lib::asio::const_buffer> const &
+        bufs, socket::io_handler handler)
+    {
+        SSL * ssl = m_socket->native_handle();
+        gather_output(bufs);
+
+        size_t written = 0;
+        int ret;
+        if (SSL_is_init_finished(ssl)) {
+            ret = SSL_write_ex(ssl, m_early_output.data(),
+                m_early_output.size(), &written);
+        } else {
+            ret = SSL_write_early_data(ssl, m_early_output.data(),
+                m_early_output.size(), &written);
+        }
+
+        if (ret != 1) {
+            post_io(handler, lib::asio::error::connection_aborted, 0);
+            return;
+        }
+
+        m_write_size = written;
+        m_write_handler = handler;
+        flush_wire_output();
+    }
+
+    /// Decide whether an early opening handshake request may be processed
+    void check_early_request() {
+        if (m_early_decided || !m_early_callback || m_handshake_done ||
+            SSL_get_early_data_status(m_socket->native_handle()) !=
+            SSL_EARLY_DATA_ACCEPTED)
+        {
+            return;
+        }
+
+        if (m_early_input.find("\r\n\r\n") == std::string::npos) {
+            return;
+        }
+        m_early_decided = true;
+
+        // request-line = method SP request-target SP HTTP-version
+        std::string::size_type start = m_early_input.find(' ');
+        std::string::size_type end = m_early_input.find(' ', start + 1);
+        if (start == std::string::npos || end == std::string::npos ||
+            !m_early_data_handler(m_hdl,
+                m_early_input.substr(start + 1, end - start - 1)))
+        {
+            return;
+        }
+
+        // Limit how long this request may go unconfirmed by the handshake
+        m_early_timer = lib::make_shared<lib::asio::steady_timer>(
+            _WEBSOCKETPP_REF(*m_io_service),
+            lib::asio::milliseconds(m_early_data_timeout));
+        if (m_strand) {
+            m_early_timer->async_wait(m_strand->wrap(lib::bind(
+                &type::handle_early_timeout, get_shared(),
+                lib::placeholders::_1
+            )));
+        } else {
+            m_early_timer->async_wait(lib::bind(
+                &type::handle_early_timeout, get_shared(),
+                lib::placeholders::_1
+            ));
+        }
+
+        complete_early_init(lib::error_code());
+    }
+
+    void handle_early_timeout(lib::asio::error_code const & ec) {
+        if (ec || m_early_state != early_server) {
+            return;
+        }
+        cancel_socket();
+    }
+
+    /// Hand the connection back to the ssl stream
+    void finish_early_accept() {
+        restore_wire_bio();
+        m_early_state = early_none;
+        std::vector<char>().swap(m_wire_input);
+        std::string().swap(m_wire_output);
+
+        if (m_early_timer) {
+            m_early_timer->cancel();
+            m_early_timer.reset();
+        }
+
+        if (m_early_callback) {
+            complete_early_init(lib::error_code());
+        }
+        resume_parked_read();
+    }
+
+    void fail_early_accept(lib::asio::error_code const & ec) {
+        restore_wire_bio();
+        m_early_state = early_none;
+        m_early_failed = true;
+        m_early_input.clear();
+
+        if (m_early_timer) {
+            m_early_timer->cancel();
+            m_early_timer.reset();
+        }
+
+        m_ec = socket::make_error_code(socket::error::tls_handshake_failed);
+        if (m_early_callback) {
+            complete_early_init(m_ec);
+        }
+        if (m_parked_handler) {
+            socket::io_handler handler = m_parked_handler;
+            m_parked_handler = socket::io_handler();
+            post_io(handler, ec, 0);
+        }
+        if (m_write_handler) {
+            socket::io_handler handler = m_write_handler;
+            m_write_handler = socket::io_handler();
+            post_io(handler, ec, 0);
+        }
+    }
+
+    void complete_early_init(lib::error_code const & ec) {
+        init_handler callback = m_early_callback;
+        m_early_callback = init_handler();
+        m_ec = ec;
+        callback(ec);
+    }
+
+    void resume_parked_read() {
+        if (!m_parked_handler) {
+            return;
+        }
+        socket::io_handler handler = m_parked_handler;
+        m_parked_handler = socket::io_handler();
+        async_read_early(m_parked_num_bytes, m_parked_buf, m_parked_len,
+            handler);
+    }
+
+    /// Give the stream's own BIO back to the SSL object
+    void restore_wire_bio() {
+        if (!m_wire_bio) {
+            return;
+        }
+        SSL * ssl = m_socket->native_handle();
+        SSL_set0_rbio(ssl, m_wire_bio);
+        SSL_set0_wbio(ssl, m_wire_bio);
+        m_wire_bio = NULL;
+        m_output_bio = NULL;
+    }
+#endif
+
     socket_type::handshake_type get_handshake_type() {
         if (m_is_server) {
             return lib::asio::ssl::stream_base::server;
@@ -388,12 +1244,46 @@ private:
     socket_ptr          m_socket;
     uri_ptr             m_uri;
     bool                m_is_server;
+    bool                m_release_buffers;
 
     lib::error_code     m_ec;
 
     connection_hdl      m_hdl;
     socket_init_handler m_socket_init_handler;
     tls_init_handler    m_tls_init_handler;
+
+    session_cache_ptr   m_session_cache;
+    bool                m_early_data;
+    early_data_handler  m_early_data_handler;
+    long                m_early_data_timeout;
+#ifdef _WEBSOCKETPP_TLS_EARLY_DATA_
+    early_state         m_early_state;
+    BIO *               m_wire_bio;
+    BIO *               m_output_bio;
+    bool                m_early_reading;
+    bool                m_early_decided;
+    bool                m_handshake_done;
+    bool                m_early_failed;
+    bool                m_reading_wire;
+    bool                m_writing_wire;
+    init_handler        m_early_callback;
+    lib::shared_ptr<lib::asio::steady_timer> m_early_timer;
+
+    /// Plaintext read during the handshake and not yet consumed
+    std::string         m_early_input;
+    /// Plaintext of the write in progress
+    std::string         m_early_output;
+    std::vector<char>   m_wire_input;
+    std::string         m_wire_output;
+
+    socket::io_handler  m_write_handler;
+    size_t              m_write_size;
+
+    size_t              m_parked_num_bytes;
+    char *              m_parked_buf;
+    size_t              m_parked_len;
+    socket::io_handler  m_parked_handler;
+#endif
 };
 
 /// TLS enabled Asio endpoint socket component
@@ -412,7 +1302,10 @@ public:
     /// component.
     typedef socket_con_type::ptr socket_con_ptr;
 
-    explicit endpoint() {}
+    explicit endpoint()
+      : m_release_buffers(true)
+      , m_early_data(false)
+      , m_early_data_timeout(5000) {}
 
     /// Checks whether the endpoint creates secure connections
     /**
@@ -446,6 +1339,105 @@ public:
     void set_tls_init_handler(tls_init_handler h) {
         m_tls_init_handler = h;
     }
+
+    /// Set whether OpenSSL may release idle read and write buffers
+    /**
+     * When enabled (the default) new connections set SSL_MODE_RELEASE_BUFFERS
+     * on their SSL object, where the OpenSSL version supports it. OpenSSL then
+     * frees a connection's record buffers whenever they are empty instead of
+     * keeping them for the lifetime of the connection. This substantially
+     * reduces the memory held by idle connections at the cost of an
+     * allocation per record on busy ones.
+     *
+     * The mode is applied before the socket init handler is called, so it can
+     * also be changed for individual connections from that handler.
+     *
+     * @since 0.8.2
+     *
+     * @param value Whether or not to enable SSL_MODE_RELEASE_BUFFERS
+     */
+    void set_release_buffers(bool value) {
+        m_release_buffers = value;
+    }
+
+    /// Set whether client connections resume previous TLS sessions
+    /**
+     * When enabled, client connections remember the last resumable session
+     * for each host and port and offer it on the next connection to the same
+     * server. A resumed handshake skips certificate exchange and verification.
+     *
+     * Has no effect on servers or with OpenSSL versions older than 1.1.1.
+     *
+     * @since 0.8.2
+     *
+     * @param value Whether or not to resume sessions
+     */
+    void set_session_resumption(bool value) {
+        if (!value) {
+            m_session_cache.reset();
+        } else if (!m_session_cache) {
+            m_session_cache = lib::make_shared<session_cache>();
+        }
+    }
+
+    /// Set whether clients send the opening handshake as TLS 1.3 early data
+    /**
+     * When enabled and a resumed session allows it, the opening handshake
+     * request is sent as 0-RTT early data along with the TLS ClientHello
+     * rather than after the TLS handshake has completed. This saves a round
+     * trip on reconnects. If the server rejects the early data the request is
+     * sent again after the handshake.
+     *
+     * Enabling early data also enables session resumption. Early data is not
+     * protected against replay; the server decides whether it acts on it.
+     *
+     * @since 0.8.2
+     *
+     * @param value Whether or not to send early data
+     */
+    void set_early_data(bool value) {
+        m_early_data = value;
+        if (value) {
+            set_session_resumption(true);
+        }
+    }
+
+    /// Set the handler that decides whether servers act on early data
+    /**
+     * Setting an early data handler makes server connections accept TLS 1.3
+     * early data. When an opening handshake request arrives as early data the
+     * handler is called with its request target. If it returns true the
+     * request is processed immediately and the response is sent before the
+     * TLS handshake completes, otherwise the request waits for the handshake.
+     *
+     * Early data can be replayed by an attacker. Only return true for
+     * resources where opening a connection more than once has no side effects
+     * and do not trust anything sent on the connection before the handshake
+     * completes.
+     *
+     * Requires OpenSSL 1.1.1 or later.
+     *
+     * @since 0.8.2
+     *
+     * @param h The new early_data_handler
+     */
+    void set_early_data_handler(early_data_handler h) {
+        m_early_data_handler = h;
+    }
+
+    /// Set how long an early request may wait for the handshake to finish
+    /**
+     * Connections whose early request was processed but whose TLS handshake
+     * does not complete within this many milliseconds are closed. Default is
+     * 5000.
+     *
+     * @since 0.8.2
+     *
+     * @param duration The timeout in milliseconds
+     */
+    void set_early_data_timeout(long duration) {
+        m_early_data_timeout = duration;
+    }
 protected:
     /// Initialize a connection
     /**
@@ -459,12 +1451,22 @@ protected:
     lib::error_code init(socket_con_ptr scon) {
         scon->set_socket_init_handler(m_socket_init_handler);
         scon->set_tls_init_handler(m_tls_init_handler);
+        scon->set_release_buffers(m_release_buffers);
+        scon->set_session_cache(m_session_cache);
+        scon->set_early_data(m_early_data);
+        scon->set_early_data_handler(m_early_data_handler);
+        scon->set_early_data_timeout(m_early_data_timeout);
         return lib::error_code();
     }
 
 private:
     socket_init_handler m_socket_init_handler;
     tls_init_handler m_tls_init_handler;
+    bool m_release_buffers;
+    session_cache_ptr m_session_cache;
+    bool m_early_data;
+    early_data_handler m_early_data_handler;
+    long m_early_data_timeout;
 };
 
 } // namespace tls_socket
@@ -110,6 +110,14 @@ namespace websocketpp {
  * **async_shutdown**\n
  * `void async_shutdown(shutdown_handler handler)`\n
  * Perform any cleanup necessary (if any). Call `handler` when complete.
+ *
+ * **async_abort**\n
+ * `void async_abort(shutdown_handler handler)`\n
+ * Like async_shutdown, but close the connection immediately without any
+ * graceful shutdown exchange with the remote endpoint. Call `handler` when
+ * complete. Transports without such an exchange may treat this the same as
+ * async_shutdown. This method is optional, connections of transports that
+ * lack it are closed with async_shutdown. (since 0.8.2)
  */
 namespace transport {
 
@@ -134,6 +142,36 @@ typedef lib::function<void()> interrupt_handler;
 /// The type and signature of the callback passed to the dispatch method
 typedef lib::function<void()> dispatch_handler;
 
+/// Whether a transport connection has an `async_abort` method
+/**
+ * Only the name is looked up, so protected methods are found too. It works
+ * by making the name ambiguous in a class derived from both `con` and a
+ * class that has it.
+ *
+ * @since 0.8.2
+ */
+template <typename con>
+struct has_async_abort {
+private:
+    typedef char yes[1];
+    typedef char no[2];
+
+    struct fallback {
+        void async_abort();
+    };
+    struct derived : public con, public fallback {};
+
+    template <typename T, T>
+    struct check;
+
+    template <typename T>
+    static no & probe(check<void (fallback::*)(), &T::async_abort> *);
+    template <typename T>
+    static yes & probe(...);
+public:
+    static bool const value = sizeof(probe<derived>(0)) == sizeof(yes);
+};
+
 /// A simple utility buffer class
 struct buffer {
     buffer(char const * b, size_t l) : buf(b),len(l) {}
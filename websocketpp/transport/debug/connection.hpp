@@ -335,6 +335,14 @@ protected:
     void async_shutdown(shutdown_handler handler) {
         handler(lib::error_code());
     }
+
+    /// Perform cleanup on abortive close
+    /**
+     * @param h The `shutdown_handler` to call back when complete
+     */
+    void async_abort(shutdown_handler handler) {
+        handler(lib::error_code());
+    }
     
     size_t read_some_impl(char const * buf, size_t len) {
         m_alog->write(log::alevel::devel,"debug_con read_some");
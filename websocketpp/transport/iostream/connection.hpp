@@ -439,9 +439,11 @@ protected:
     void async_read_at_least(size_t num_bytes, char *buf, size_t len,
         read_handler handler)
     {
-        std::stringstream s;
-        s << "iostream_con async_read_at_least: " << num_bytes;
-        m_alog->write(log::alevel::devel,s.str());
+        if (m_alog->dynamic_test(log::alevel::devel)) {
+            std::stringstream s;
+            s << "iostream_con async_read_at_least: " << num_bytes;
+            m_alog->write(log::alevel::devel,s.str());
+        }
 
         if (num_bytes > len) {
             handler(make_error_code(error::invalid_num_bytes),size_t(0));
@@ -461,7 +463,9 @@ protected:
         m_buf = buf;
         m_len = len;
         m_bytes_needed = num_bytes;
-        m_read_handler = handler;
+        // swap rather than copy, the bound handler may not fit in the
+        // function object's small buffer
+        m_read_handler.swap(handler);
         m_cursor = 0;
         m_reading = true;
     }
@@ -599,6 +603,19 @@ protected:
 
         handler(ec);
     }
+
+    /// Perform cleanup on abortive close
+    /**
+     * The iostream transport has no graceful shutdown exchange of its own so
+     * this is the same as async_shutdown.
+     *
+     * @since 0.8.2
+     *
+     * @param handler The `shutdown_handler` to call back when complete
+     */
+    void async_abort(transport::shutdown_handler handler) {
+        async_shutdown(handler);
+    }
 private:
     void read(std::istream &in) {
         m_alog->write(log::alevel::devel,"iostream_con read");
@@ -671,8 +688,8 @@ private:
     void complete_read(lib::error_code const & ec) {
         m_reading = false;
 
-        read_handler handler = m_read_handler;
-        m_read_handler = read_handler();
+        read_handler handler;
+        handler.swap(m_read_handler);
 
         handler(ec,m_cursor);
     }
@@ -272,6 +272,14 @@ protected:
     void async_shutdown(shutdown_handler handler) {
         handler(lib::error_code());
     }
+
+    /// Perform cleanup on abortive close
+    /**
+     * @param h The `shutdown_handler` to call back when complete
+     */
+    void async_abort(shutdown_handler handler) {
+        handler(lib::error_code());
+    }
 private:
     // member variables!
     lib::shared_ptr<alog_type> m_alog;
@@ -243,17 +243,17 @@ public:
 
     std::string get_host_port() const {
         if (m_port == (m_secure ? uri_default_secure_port : uri_default_port)) {
-            return m_host;
+            return get_host_literal();
         } else {
             std::stringstream p;
-            p << m_host << ":" << m_port;
+            p << get_host_literal() << ":" << m_port;
             return p.str();
         }
     }
 
     std::string get_authority() const {
         std::stringstream p;
-        p << m_host << ":" << m_port;
+        p << get_host_literal() << ":" << m_port;
         return p.str();
     }
 
@@ -274,7 +274,7 @@ public:
     std::string str() const {
         std::stringstream s;
 
-        s << m_scheme << "://" << m_host;
+        s << m_scheme << "://" << get_host_literal();
 
         if (m_port != (m_secure ? uri_default_secure_port : uri_default_port)) {
             s << ":" << m_port;
@@ -318,6 +318,18 @@ public:
     void set_port(const std::string& port);
     void set_resource(const std::string& resource);*/
 private:
+    /// Return the host as written in a URI
+    /**
+     * IPv6 literals are stored without the brackets that delimit them in a
+     * URI and in the Host header, put them back.
+     */
+    std::string get_host_literal() const {
+        if (m_host.find(':') == std::string::npos) {
+            return m_host;
+        }
+        return "[" + m_host + "]";
+    }
+
     uint16_t get_port_from_string(std::string const & port, lib::error_code &
         ec) const
     {